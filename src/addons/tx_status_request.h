@@ -38,6 +38,87 @@ static struct
     unsigned int confirmedTxCurrentEpochBeginTick;   // first tick of current epoch stored
 } txStatusData;
 
+// Hash index of confirmedTx (current epoch and ticks kept from previous epoch), mapping the transaction digest to the
+// position in confirmedTx. It uses open addressing with linear probing, each slot storing position + 1 (0 means empty).
+// Entries are added by saveConfirmedTx() and the index is rebuilt when a new epoch begins or a snapshot is loaded,
+// so it doesn't need to be saved.
+static constexpr unsigned int getConfirmedTxIndexSizeBits()
+{
+    // power of 2 with load factor of 2/3 at most
+    unsigned int bits = 1;
+    while ((1ULL << bits) < confirmedTxLength + confirmedTxLength / 2)
+        ++bits;
+    return bits;
+}
+constexpr unsigned int confirmedTxIndexSizeBits = getConfirmedTxIndexSizeBits();
+constexpr unsigned long long confirmedTxIndexSize = 1ULL << confirmedTxIndexSizeBits;
+static_assert(confirmedTxLength < 0xFFFFFFFF, "Positions in confirmedTx must fit into confirmedTxIndex");
+static unsigned int* confirmedTxIndex = NULL;
+
+// Random odd multipliers set in initTxStatusRequestAddOn(), so that digests of transactions can't be chosen to end up
+// in the same slots of the index
+static unsigned long long confirmedTxIndexSalt[2] = { 1, 1 };
+
+// Get slot of digest in the index by multiply-shift hashing of the first two 64-bit words with the salt
+static unsigned long long getConfirmedTxIndexSlot(const m256i& digest)
+{
+    return (digest.m256i_u64[0] * confirmedTxIndexSalt[0] + digest.m256i_u64[1] * confirmedTxIndexSalt[1]) >> (64 - confirmedTxIndexSizeBits);
+}
+
+// Add confirmedTx[position] to the index (call with confirmedTxLock acquired)
+static void addToConfirmedTxIndex(unsigned long long position)
+{
+    unsigned long long slot = getConfirmedTxIndexSlot(confirmedTx[position].digest);
+    while (confirmedTxIndex[slot])
+        slot = (slot + 1) & (confirmedTxIndexSize - 1);
+    confirmedTxIndex[slot] = (unsigned int)(position + 1);
+}
+
+// Find transaction by digest, return position in confirmedTx or -1 if not found (call with confirmedTxLock acquired)
+static long long findConfirmedTx(const m256i& digest)
+{
+    unsigned long long slot = getConfirmedTxIndexSlot(digest);
+    while (confirmedTxIndex[slot])
+    {
+        const unsigned int position = confirmedTxIndex[slot] - 1;
+        const m256i confirmedTxDigest = confirmedTx[position].digest;
+        if (confirmedTxDigest == digest)
+            return position;
+        slot = (slot + 1) & (confirmedTxIndexSize - 1);
+    }
+    return -1;
+}
+
+// Rebuild index from the confirmedTx of the current epoch and of the ticks kept from previous epoch, skipping
+// entries of ticks that aren't stored (call with confirmedTxLock acquired)
+static void rebuildConfirmedTxIndex()
+{
+    setMem(confirmedTxIndex, confirmedTxIndexSize * sizeof(confirmedTxIndex[0]), 0);
+
+    const unsigned int tickBegin = txStatusData.confirmedTxCurrentEpochBeginTick;
+    unsigned long long txCount = 0;
+    for (unsigned int tickIndex = 0; tickIndex < MAX_NUMBER_OF_TICKS_PER_EPOCH; ++tickIndex)
+        txCount += txStatusData.tickTxCounter[tickIndex];
+    for (unsigned long long position = 0; position < txCount && position < confirmedTxCurrentEpochLength; ++position)
+    {
+        if (confirmedTx[position].tick >= tickBegin && confirmedTx[position].tick < tickBegin + MAX_NUMBER_OF_TICKS_PER_EPOCH)
+            addToConfirmedTxIndex(position);
+    }
+
+    const unsigned int oldTickBegin = txStatusData.confirmedTxPreviousEpochBeginTick;
+    if (oldTickBegin)
+    {
+        txCount = 0;
+        for (unsigned int tickOffset = 0; tickOffset < TICKS_TO_KEEP_FROM_PRIOR_EPOCH && oldTickBegin + tickOffset < tickBegin; ++tickOffset)
+            txCount += txStatusData.tickTxCounter[MAX_NUMBER_OF_TICKS_PER_EPOCH + tickOffset];
+        for (unsigned long long position = confirmedTxCurrentEpochLength; position < confirmedTxCurrentEpochLength + txCount && position < confirmedTxLength; ++position)
+        {
+            if (confirmedTx[position].tick >= oldTickBegin && confirmedTx[position].tick < tickBegin)
+                addToConfirmedTxIndex(position);
+        }
+    }
+}
+
 
 #define REQUEST_TX_STATUS 201
 
@@ -70,6 +151,38 @@ struct RespondTxStatus
 #pragma pack(pop)
 static RespondTxStatus* tickTxStatusStorage = NULL;
 
+#define REQUEST_TX_STATUS_BY_DIGESTS 203
+
+// Status of single transaction or batch of transactions by digest. The payload consists of 1 to maxNumberOfDigests
+// digests (only the digests sent are part of the message).
+struct RequestTxStatusByDigests
+{
+    static constexpr unsigned int maxNumberOfDigests = 1024;
+
+    m256i digests[maxNumberOfDigests];
+};
+
+#define RESPOND_TX_STATUS_BY_DIGESTS 204
+
+struct RespondTxStatusByDigests
+{
+    unsigned int currentTickOfNode;
+    unsigned int txCount;
+
+    // status of the requested transactions in order of the request, tick is 0 if the digest isn't found (not confirmed
+    // yet, not stored, or tick not available anymore); only the first txCount are sent
+    ConfirmedTx txStatus[RequestTxStatusByDigests::maxNumberOfDigests];
+
+    // return size of this struct to be sent
+    unsigned int size() const
+    {
+        return offsetof(RespondTxStatusByDigests, txStatus) + txCount * sizeof(ConfirmedTx);
+    }
+};
+
+static_assert(sizeof(ConfirmedTx) == 40, "unexpected size");
+static RespondTxStatusByDigests* txStatusByDigestsStorage = NULL;
+
 // Allocate buffers
 static bool initTxStatusRequestAddOn()
 {
@@ -79,6 +192,16 @@ static bool initTxStatusRequestAddOn()
     // allocate tickTxStatus responses storage
     if (!allocatePool(MAX_NUMBER_OF_PROCESSORS * sizeof(RespondTxStatus), (void**)&tickTxStatusStorage))
         return false;
+    // allocate digest index and storage of its responses
+    if (!allocatePool(confirmedTxIndexSize * sizeof(confirmedTxIndex[0]), (void**)&confirmedTxIndex))
+        return false;
+    if (!allocatePool(MAX_NUMBER_OF_PROCESSORS * sizeof(RespondTxStatusByDigests), (void**)&txStatusByDigestsStorage))
+        return false;
+    setMem(confirmedTxIndex, confirmedTxIndexSize * sizeof(confirmedTxIndex[0]), 0);
+    _rdrand64_step(&confirmedTxIndexSalt[0]);
+    _rdrand64_step(&confirmedTxIndexSalt[1]);
+    confirmedTxIndexSalt[0] |= 1;
+    confirmedTxIndexSalt[1] |= 1;
     txStatusData.confirmedTxPreviousEpochBeginTick = 0;
     txStatusData.confirmedTxCurrentEpochBeginTick = 0;
     return true;
@@ -90,6 +213,12 @@ static void deinitTxStatusRequestAddOn()
 {
     if (confirmedTx)
         freePool(confirmedTx);
+    if (tickTxStatusStorage)
+        freePool(tickTxStatusStorage);
+    if (confirmedTxIndex)
+        freePool(confirmedTxIndex);
+    if (txStatusByDigestsStorage)
+        freePool(txStatusByDigestsStorage);
 }
 
 
@@ -156,6 +285,10 @@ static void beginEpochTxStatusRequestAddOn(unsigned int newInitialTick)
     }
 
     tickBegin = newInitialTick;
+
+    ACQUIRE(confirmedTxLock);
+    rebuildConfirmedTxIndex();
+    RELEASE(confirmedTxLock);
 }
 
 
@@ -186,6 +319,9 @@ static bool saveConfirmedTx(unsigned int txNumberMinusOne, bool moneyFlew, unsig
     // keep track of tx number in tick to find it later easier
     txStatusData.tickTxCounter[tickIndex]++;
 
+    // make tx findable by digest
+    addToConfirmedTxIndex(txNumberMinusOne);
+
     RELEASE(confirmedTxLock);
 
     return true;
@@ -248,7 +384,44 @@ static void processRequestConfirmedTx(long long processorNumber, Peer *peer, Req
     enqueueResponse(peer, tickTxStatus.size(), RESPOND_TX_STATUS, header->dejavu(), &tickTxStatus);
 }
 
+
+static void processRequestTxStatusByDigests(long long processorNumber, Peer* peer, RequestResponseHeader* header)
+{
+    if (!header->checkPayloadSizeMinMax(sizeof(m256i), sizeof(RequestTxStatusByDigests)) || header->getPayloadSize() % sizeof(m256i))
+        return;
+    const RequestTxStatusByDigests* request = header->getPayload<RequestTxStatusByDigests>();
+
+    // init response message data, get it from the storage to avoid increasing stack mem
+    RespondTxStatusByDigests& txStatusByDigests = txStatusByDigestsStorage[processorNumber];
+    txStatusByDigests.currentTickOfNode = system.tick;
+    txStatusByDigests.txCount = header->getPayloadSize() / sizeof(m256i);
+
+    for (unsigned int i = 0; i < txStatusByDigests.txCount; i++)
+    {
+        const m256i digest = request->digests[i];
+        ConfirmedTx& txStatus = txStatusByDigests.txStatus[i];
+
+        ACQUIRE(confirmedTxLock);
+        const long long position = findConfirmedTx(digest);
+        if (position >= 0)
+        {
+            copyMem(&txStatus, &confirmedTx[position], sizeof(ConfirmedTx));
+        }
+        else
+        {
+            setMem(&txStatus, sizeof(ConfirmedTx), 0);
+            txStatus.digest = digest;
+        }
+        RELEASE(confirmedTxLock);
+    }
+
+    ASSERT(txStatusByDigests.size() <= sizeof(txStatusByDigests));
+    enqueueResponse(peer, txStatusByDigests.size(), RESPOND_TX_STATUS_BY_DIGESTS, header->dejavu(), &txStatusByDigests);
+}
+
 #if TICK_STORAGE_AUTOSAVE_MODE
+#include "../platform/staged_file_writer.h"
+
 // can only be called from main thread
 static bool saveStateTxStatus(const unsigned int numberOfTransactions, CHAR16* directory)
 {
@@ -270,6 +443,27 @@ static bool saveStateTxStatus(const unsigned int numberOfTransactions, CHAR16* d
     return true;
 }
 
+// Same files as saveStateTxStatus(), but added to writer for writing in the background. txStatusData is staged,
+// confirmedTx is written directly, because the first numberOfTransactions entries don't change until the next epoch.
+static bool addStateTxStatusToStagedFileWriter(StagedFileWriter& writer, const unsigned int numberOfTransactions)
+{
+    static unsigned short TX_STATUS_SNAPSHOT_FILE_NAME[] = L"snapshotTxStatusData";
+    const void* stagedTxStatusData = writer.stage(&txStatusData, sizeof(txStatusData));
+    if (!stagedTxStatusData || !writer.addFile(TX_STATUS_SNAPSHOT_FILE_NAME, stagedTxStatusData, sizeof(txStatusData)))
+    {
+        logToConsole(L"Failed to stage txStatusData");
+        return false;
+    }
+
+    static unsigned short CONFIRMED_TX_SNAPSHOT_FILE_NAME[] = L"snapshotConfirmedTx";
+    if (!writer.addLargeFile(CONFIRMED_TX_SNAPSHOT_FILE_NAME, confirmedTx, numberOfTransactions * sizeof(ConfirmedTx)))
+    {
+        logToConsole(L"Failed to stage ConfirmedTx");
+        return false;
+    }
+    return true;
+}
+
 // can only be called from main thread
 // numberOfTransactions must be known before calling this
 static bool loadStateTxStatus(const unsigned int numberOfTransactions, CHAR16* directory)
@@ -292,6 +486,10 @@ static bool loadStateTxStatus(const unsigned int numberOfTransactions, CHAR16* d
             return false;
         }
     }
+
+    ACQUIRE(confirmedTxLock);
+    rebuildConfirmedTxIndex();
+    RELEASE(confirmedTxLock);
     return true;
 }
 #endif // TICK_STORAGE_AUTOSAVE_MODE
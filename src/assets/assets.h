@@ -14,6 +14,8 @@
 #include "public_settings.h"
 #include "logging/logging.h"
 #include "kangaroo_twelve.h"
+#include "merkle_tree.h"
+#include "delta_snapshot.h"
 #include "four_q.h"
 #include "common_buffers.h"
 
@@ -32,6 +34,9 @@ GLOBAL_VAR_DECL Asset* assets GLOBAL_VAR_INIT(nullptr);
 GLOBAL_VAR_DECL m256i* assetDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long assetDigestsSizeInBytes = (ASSETS_CAPACITY * 2 - 1) * 32ULL;
 GLOBAL_VAR_DECL unsigned long long* assetChangeFlags GLOBAL_VAR_INIT(nullptr);
+// Base + delta files of the universe in the node state snapshot. Assets are marked as changed together with their
+// leaf flags in assetChangeFlags. Only initialized if node states are saved (TICK_STORAGE_AUTOSAVE_MODE).
+GLOBAL_VAR_DECL DeltaSnapshot<Asset, ASSETS_CAPACITY> universeSnapshot;
 static constexpr char CONTRACT_ASSET_UNIT_OF_MEASUREMENT[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
 static constexpr unsigned int NO_ASSET_INDEX = 0xffffffff;
@@ -54,6 +59,7 @@ public: // TODO: make protected
     // - all issuances,
     // - all ownerships belonging to each issuance
     // - all possessions belonging to each ownership
+    // - all ownerships and possessions of each entity (entities with the same hash map start index share a list)
     struct IndexLists
     {
         unsigned int issuancesFirstIdx;
@@ -61,6 +67,28 @@ public: // TODO: make protected
 
         unsigned int nextIdx[ASSETS_CAPACITY];
 
+        unsigned int entityOwnershipsPossessionsFirstIdx[ASSETS_CAPACITY];
+        unsigned int entityNextIdx[ASSETS_CAPACITY];
+
+        // Incremented by rebuild(), which invalidates all list indices (used to detect invalidation if iterating
+        // while releasing universeLock in between)
+        unsigned int rebuildCounter;
+
+        // Return index of first ownership/possession in list of entity, use entityNextIdx for iterating
+        unsigned int getEntityOwnershipsPossessionsFirstIdx(const m256i& publicKey) const
+        {
+            return entityOwnershipsPossessionsFirstIdx[publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1)];
+        }
+
+        // Add ownership or possession as first element in linked list of the entity
+        void addToEntityList(unsigned int newIdx)
+        {
+            ASSERT(newIdx < ASSETS_CAPACITY);
+            const unsigned int entityListIdx = assets[newIdx].varStruct.ownership.publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+            entityNextIdx[newIdx] = entityOwnershipsPossessionsFirstIdx[entityListIdx];
+            entityOwnershipsPossessionsFirstIdx[entityListIdx] = newIdx;
+        }
+
         void addIssuance(unsigned int newIssuanceIdx)
         {
             // add as first element in linked list of all issuances
@@ -81,6 +109,7 @@ public: // TODO: make protected
             ASSERT(ownnershipsPossessionsFirstIdx[issuanceIdx] == NO_ASSET_INDEX || assets[ownnershipsPossessionsFirstIdx[issuanceIdx]].varStruct.issuance.type == OWNERSHIP);
             nextIdx[newOwnershipIdx] = ownnershipsPossessionsFirstIdx[issuanceIdx];
             ownnershipsPossessionsFirstIdx[issuanceIdx] = newOwnershipIdx;
+            addToEntityList(newOwnershipIdx);
         }
 
         // Add newPossessionIdx as first element in linked list of all possessions of ownershipIdx
@@ -93,6 +122,7 @@ public: // TODO: make protected
             ASSERT(ownnershipsPossessionsFirstIdx[ownershipIdx] == NO_ASSET_INDEX || assets[ownnershipsPossessionsFirstIdx[ownershipIdx]].varStruct.possession.type == POSSESSION);
             nextIdx[newPossessionIdx] = ownnershipsPossessionsFirstIdx[ownershipIdx];
             ownnershipsPossessionsFirstIdx[ownershipIdx] = newPossessionIdx;
+            addToEntityList(newPossessionIdx);
         }
 
         // Reset lists to empty
@@ -102,12 +132,15 @@ public: // TODO: make protected
             static_assert(NO_ASSET_INDEX == 0xffffffff, "Following setMem() expects NO_ASSET_INDEX == 0xffffffff");
             setMem(ownnershipsPossessionsFirstIdx, sizeof(ownnershipsPossessionsFirstIdx), 0xff);
             setMem(nextIdx, sizeof(nextIdx), 0xff);
+            setMem(entityOwnershipsPossessionsFirstIdx, sizeof(entityOwnershipsPossessionsFirstIdx), 0xff);
+            setMem(entityNextIdx, sizeof(entityNextIdx), 0xff);
         }
 
         // Rebuild lists from assets array (includes reset)
         void rebuild()
         {
             reset();
+            ++rebuildCounter;
             for (int index = 0; index < ASSETS_CAPACITY; index++)
             {
                 switch (assets[index].varStruct.issuance.type)
@@ -506,8 +539,10 @@ static void getUniverseDigest(m256i& digest)
         if (assetChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
         {
             KangarooTwelve(&assets[digestIndex], sizeof(Asset), &assetDigests[digestIndex], 32);
+            universeSnapshot.markChanged(digestIndex);
         }
     }
+    KangarooTwelve64To32Batch batch;
     unsigned int previousLevelBeginning = 0;
     unsigned int numberOfLeafs = ASSETS_CAPACITY;
     while (numberOfLeafs > 1)
@@ -516,12 +551,13 @@ static void getUniverseDigest(m256i& digest)
         {
             if (assetChangeFlags[i >> 6] & (3ULL << (i & 63)))
             {
-                KangarooTwelve64To32(&assetDigests[previousLevelBeginning + i], &assetDigests[digestIndex]);
+                batch.add(&assetDigests[previousLevelBeginning + i], &assetDigests[digestIndex]);
                 assetChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
                 assetChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
             }
             digestIndex++;
         }
+        batch.flush();
         previousLevelBeginning += numberOfLeafs;
         numberOfLeafs >>= 1;
     }
@@ -563,6 +599,7 @@ static bool loadUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, CHAR16* di
         return false;
     }
     as.indexLists.rebuild();
+    universeSnapshot.requireBase();
     return true;
 }
 
@@ -653,7 +690,10 @@ static void assetsEndEpoch()
     }
     copyMem(assets, reorgAssets, ASSETS_CAPACITY * sizeof(Asset));
 
-    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    // All assets may have moved, so rebuild the whole digest tree (on idle processors) instead of flagging all nodes
+    computeMerkleTree(assets, sizeof(Asset), assetDigests, ASSETS_CAPACITY);
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0);
+    universeSnapshot.requireBase();
 
     as.indexLists.rebuild();
 
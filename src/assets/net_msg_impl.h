@@ -41,79 +41,109 @@ iteration:
     RELEASE(universeLock);
 }
 
+// Maximum number of responses that are prepared while holding universeLock, before releasing the lock for enqueuing
+static constexpr unsigned int assetResponsesPerLock = 4;
+
 static void processRequestOwnedAssets(Peer* peer, RequestResponseHeader* header)
 {
-    RespondOwnedAssets response;
+    RespondOwnedAssets responses[assetResponsesPerLock];
 
     RequestOwnedAssets* request = header->getPayload<RequestOwnedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
+    // Walk the list of ownerships/possessions of the entity (shared with entities of the same hash map start index)
+    // and prepare a few responses at a time under universeLock. The lock is released while enqueuing, so the tick
+    // processor isn't blocked by slow peers. Lists only grow at the front until the next rebuild, so the position
+    // stays valid between chunks unless rebuildCounter changes.
     ACQUIRE(universeLock);
 
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
+    const unsigned int rebuildCounter = as.indexLists.rebuildCounter;
+    unsigned int universeIndex = as.indexLists.getEntityOwnershipsPossessionsFirstIdx(request->publicKey);
+    while (universeIndex != NO_ASSET_INDEX)
     {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
-    {
-        if (assets[universeIndex].varStruct.issuance.type == OWNERSHIP
-            && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+        unsigned int numberOfResponses = 0;
+        while (universeIndex != NO_ASSET_INDEX && numberOfResponses < assetResponsesPerLock)
         {
-            bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
-            bs->CopyMem(&response.issuanceAsset, &assets[assets[universeIndex].varStruct.ownership.issuanceIndex], sizeof(Asset));
-            response.tick = system.tick;
-            response.universeIndex = universeIndex;
-            getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
+            if (assets[universeIndex].varStruct.issuance.type == OWNERSHIP
+                && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+            {
+                RespondOwnedAssets& response = responses[numberOfResponses++];
+                bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
+                bs->CopyMem(&response.issuanceAsset, &assets[assets[universeIndex].varStruct.ownership.issuanceIndex], sizeof(Asset));
+                response.tick = system.tick;
+                response.universeIndex = universeIndex;
+                getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
+            }
+
+            universeIndex = as.indexLists.entityNextIdx[universeIndex];
+        }
+
+        RELEASE(universeLock);
 
-            enqueueResponse(peer, sizeof(response), RespondOwnedAssets::type, header->dejavu(), &response);
+        for (unsigned int i = 0; i < numberOfResponses; i++)
+        {
+            enqueueResponse(peer, sizeof(responses[i]), RespondOwnedAssets::type, header->dejavu(), &responses[i]);
         }
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
+        ACQUIRE(universeLock);
 
-        goto iteration;
+        if (as.indexLists.rebuildCounter != rebuildCounter)
+        {
+            break;
+        }
     }
 
     RELEASE(universeLock);
+
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
 static void processRequestPossessedAssets(Peer* peer, RequestResponseHeader* header)
 {
-    RespondPossessedAssets response;
+    RespondPossessedAssets responses[assetResponsesPerLock];
 
     RequestPossessedAssets* request = header->getPayload<RequestPossessedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
+    // See processRequestOwnedAssets() for how the entity list is iterated
     ACQUIRE(universeLock);
 
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
+    const unsigned int rebuildCounter = as.indexLists.rebuildCounter;
+    unsigned int universeIndex = as.indexLists.getEntityOwnershipsPossessionsFirstIdx(request->publicKey);
+    while (universeIndex != NO_ASSET_INDEX)
     {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
-    {
-        if (assets[universeIndex].varStruct.issuance.type == POSSESSION
-            && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+        unsigned int numberOfResponses = 0;
+        while (universeIndex != NO_ASSET_INDEX && numberOfResponses < assetResponsesPerLock)
         {
-            bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
-            bs->CopyMem(&response.ownershipAsset, &assets[assets[universeIndex].varStruct.possession.ownershipIndex], sizeof(Asset));
-            bs->CopyMem(&response.issuanceAsset, &assets[assets[assets[universeIndex].varStruct.possession.ownershipIndex].varStruct.ownership.issuanceIndex], sizeof(Asset));
-            response.tick = system.tick;
-            response.universeIndex = universeIndex;
-            getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
+            if (assets[universeIndex].varStruct.issuance.type == POSSESSION
+                && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
+            {
+                RespondPossessedAssets& response = responses[numberOfResponses++];
+                bs->CopyMem(&response.asset, &assets[universeIndex], sizeof(Asset));
+                bs->CopyMem(&response.ownershipAsset, &assets[assets[universeIndex].varStruct.possession.ownershipIndex], sizeof(Asset));
+                bs->CopyMem(&response.issuanceAsset, &assets[assets[assets[universeIndex].varStruct.possession.ownershipIndex].varStruct.ownership.issuanceIndex], sizeof(Asset));
+                response.tick = system.tick;
+                response.universeIndex = universeIndex;
+                getSiblings<ASSETS_DEPTH>(response.universeIndex, assetDigests, response.siblings);
+            }
+
+            universeIndex = as.indexLists.entityNextIdx[universeIndex];
+        }
+
+        RELEASE(universeLock);
 
-            enqueueResponse(peer, sizeof(response), RespondPossessedAssets::type, header->dejavu(), &response);
+        for (unsigned int i = 0; i < numberOfResponses; i++)
+        {
+            enqueueResponse(peer, sizeof(responses[i]), RespondPossessedAssets::type, header->dejavu(), &responses[i]);
         }
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
+        ACQUIRE(universeLock);
 
-        goto iteration;
+        if (as.indexLists.rebuildCounter != rebuildCounter)
+        {
+            break;
+        }
     }
 
     RELEASE(universeLock);
+
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+#include "platform/parallel_job.h"
+
+#include "kangaroo_twelve.h"
+#include "merkle_tree.h"
+
+// Page-granular digest of a contract state (used instead of hashing the whole state if CONTRACT_STATE_PAGE_DIGESTS
+// is enabled). The state is split into pages of pageSize bytes (the last one may be shorter). The digest is the root
+// of a Merkle tree whose leafs are the K12 digests of the pages, padded with zero digests to 2^N leafs.
+//
+// Contracts write into their state directly, so there is no hook for tracking writes. Instead, changed pages are
+// found by comparing the state with a shadow copy of the state at the last update. Comparing is an order of
+// magnitude faster than hashing, so only the pages that actually changed are rehashed. This costs memory of the
+// size of the state.
+class ContractStatePageDigest
+{
+public:
+    static constexpr unsigned int pageSize = 65536;
+
+private:
+    // Pages compared / hashed per chunk of parallel job, each chunk owns one word of changedPageFlags
+    static constexpr unsigned int pagesPerChunk = 64;
+
+    unsigned long long stateSize = 0;
+    unsigned int numberOfPages = 0;
+    unsigned int numberOfLeafs = 0;
+
+    // Copy of the state at the last update
+    unsigned char* shadowState = nullptr;
+
+    // All (numberOfLeafs * 2 - 1) digests of the Merkle tree (leafs first)
+    m256i* digests = nullptr;
+
+    // One bit per leaf, used for propagating changes up the tree
+    unsigned long long* changedPageFlags = nullptr;
+
+    // False until the first update, which hashes all pages
+    bool shadowStateValid = false;
+
+    // State passed to update(), used by the chunks of the parallel job
+    const unsigned char* currentState = nullptr;
+
+    unsigned long long rehashedPages = 0;
+
+    static bool pageEquals(const unsigned char* a, const unsigned char* b, unsigned int size)
+    {
+        unsigned int i = 0;
+        for (; i + 128 <= size; i += 128)
+        {
+            __m256i diff = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32))));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 64)), _mm256_loadu_si256((const __m256i*)(b + i + 64))));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 96)), _mm256_loadu_si256((const __m256i*)(b + i + 96))));
+            if (!_mm256_testz_si256(diff, diff))
+            {
+                return false;
+            }
+        }
+        for (; i < size; i++)
+        {
+            if (a[i] != b[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void updatePagesChunk(void* context, unsigned int chunkIndex)
+    {
+        ContractStatePageDigest* pd = (ContractStatePageDigest*)context;
+        const unsigned int beginPage = chunkIndex * pagesPerChunk;
+        const unsigned int endPage = (pd->numberOfPages - beginPage > pagesPerChunk) ? beginPage + pagesPerChunk : pd->numberOfPages;
+        unsigned long long changedFlags = 0;
+        for (unsigned int page = beginPage; page < endPage; page++)
+        {
+            const unsigned long long offset = page * (unsigned long long)pageSize;
+            const unsigned int size = (pd->stateSize - offset > pageSize) ? pageSize : (unsigned int)(pd->stateSize - offset);
+            if (!pd->shadowStateValid || !pageEquals(pd->currentState + offset, pd->shadowState + offset, size))
+            {
+                copyMem(pd->shadowState + offset, pd->currentState + offset, size);
+                KangarooTwelve(pd->shadowState + offset, size, &pd->digests[page], 32);
+                changedFlags |= (1ULL << (page - beginPage));
+            }
+        }
+        pd->changedPageFlags[chunkIndex] = changedFlags;
+    }
+
+public:
+    bool init(unsigned long long size)
+    {
+        stateSize = size;
+        numberOfPages = (unsigned int)((size + pageSize - 1) / pageSize);
+        numberOfLeafs = 1;
+        while (numberOfLeafs < numberOfPages)
+        {
+            numberOfLeafs <<= 1;
+        }
+        const unsigned long long flagsSize = ((numberOfLeafs + 63) / 64) * 8ULL;
+        if (!allocatePool(size ? size : 1, (void**)&shadowState)
+            || !allocatePool((numberOfLeafs * 2ULL - 1) * sizeof(m256i), (void**)&digests)
+            || !allocatePool(flagsSize, (void**)&changedPageFlags))
+        {
+            deinit();
+            return false;
+        }
+        setMem(digests, (numberOfLeafs * 2ULL - 1) * sizeof(m256i), 0);
+        setMem(changedPageFlags, flagsSize, 0);
+        shadowStateValid = false;
+        rehashedPages = 0;
+        return true;
+    }
+
+    void deinit()
+    {
+        if (shadowState)
+        {
+            freePool(shadowState);
+            shadowState = nullptr;
+        }
+        if (digests)
+        {
+            freePool(digests);
+            digests = nullptr;
+        }
+        if (changedPageFlags)
+        {
+            freePool(changedPageFlags);
+            changedPageFlags = nullptr;
+        }
+        shadowStateValid = false;
+    }
+
+    // Update digests of pages that differ from the last update and return the digest of the whole state.
+    // The state must not be changed while this is running. Pages are compared and hashed in parallel by idle
+    // processors (see runParallelJob()).
+    m256i update(const unsigned char* state)
+    {
+        ASSERT(digests && shadowState);
+        if (!numberOfPages)
+        {
+            return m256i::zero();
+        }
+
+        currentState = state;
+        const unsigned int numberOfChunks = (numberOfPages + pagesPerChunk - 1) / pagesPerChunk;
+        if (numberOfChunks > 1)
+        {
+            runParallelJob(updatePagesChunk, this, numberOfChunks);
+        }
+        else
+        {
+            updatePagesChunk(this, 0);
+        }
+        currentState = nullptr;
+
+        if (!shadowStateValid)
+        {
+            computeMerkleTreeInnerNodes(digests, numberOfLeafs);
+            setMem(changedPageFlags, ((numberOfLeafs + 63) / 64) * 8ULL, 0);
+            rehashedPages += numberOfPages;
+            shadowStateValid = true;
+        }
+        else
+        {
+            for (unsigned int chunk = 0; chunk < numberOfChunks; chunk++)
+            {
+                rehashedPages += __popcnt64(changedPageFlags[chunk]);
+            }
+
+            // Rehash inner nodes with changed children (similar to getComputerDigest())
+            KangarooTwelve64To32Batch batch;
+            unsigned int digestIndex = numberOfLeafs;
+            unsigned int previousLevelBeginning = 0;
+            unsigned int levelSize = numberOfLeafs;
+            while (levelSize > 1)
+            {
+                for (unsigned int i = 0; i < levelSize; i += 2)
+                {
+                    if (changedPageFlags[i >> 6] & (3ULL << (i & 63)))
+                    {
+                        batch.add(&digests[previousLevelBeginning + i], &digests[digestIndex]);
+                        changedPageFlags[i >> 6] &= ~(3ULL << (i & 63));
+                        changedPageFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+                    }
+                    digestIndex++;
+                }
+                batch.flush();
+                previousLevelBeginning += levelSize;
+                levelSize >>= 1;
+            }
+            changedPageFlags[0] = 0;
+        }
+
+        return digests[numberOfLeafs * 2 - 2];
+    }
+
+    // Number of pages hashed by update() since init()
+    unsigned long long getNumberOfRehashedPages() const
+    {
+        return rehashedPages;
+    }
+};
+
+#if CONTRACT_STATE_PAGE_DIGESTS
+GLOBAL_VAR_DECL ContractStatePageDigest contractStatePageDigests[contractCount];
+#endif
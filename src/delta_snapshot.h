@@ -0,0 +1,366 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/file_io.h"
+#include "platform/staged_file_writer.h"
+
+#include "kangaroo_twelve.h"
+
+// Snapshot of a large array of fixed-size records (such as the spectrum or the universe), consisting of a base file
+// with all records and a sequence of delta files. Each delta file contains the records changed since the previous
+// save, followed by their indices. Changes are reported with markChanged() from the places that set the change flags
+// of the digest leafs. Bulk changes that bypass the digest flags (loading, reorganizing) need requireBase().
+//
+// Loading applies the deltas in order after the base. If the deltas grow too many or too large, they are compacted
+// into a single delta with all records changed since the base. If even that is too large, a new base is saved.
+template <typename RecordT, unsigned long long capacity>
+class DeltaSnapshot
+{
+public:
+    static constexpr unsigned int maxNumberOfDeltas = 32;
+    static constexpr unsigned long long maxRecordsPerDelta = capacity / 16;
+    static constexpr unsigned long long baseSize = capacity * sizeof(RecordT);
+
+private:
+    static constexpr unsigned long long flagsSize = capacity / 8;
+    static constexpr unsigned long long deltaBufferSize = maxRecordsPerDelta * (sizeof(RecordT) + sizeof(unsigned int));
+
+    struct DeltaIndex
+    {
+        m256i checksum; // K12 of the rest of the index
+        unsigned int epoch;
+        unsigned int numberOfDeltas;
+        unsigned int numberOfRecords[maxNumberOfDeltas];
+        m256i digests[maxNumberOfDeltas]; // K12 of the delta files
+    } deltaIndex;
+
+    // Records changed since the last save / since the last base, one bit per record
+    unsigned long long* changedFlags = nullptr;
+    unsigned long long* changedSinceBaseFlags = nullptr;
+
+    // Records of one delta followed by their indices
+    unsigned char* deltaBuffer = nullptr;
+
+    CHAR16 deltaFileName[48];
+    CHAR16 indexFileName[64];
+    bool baseRequired = true;
+
+    // Statistics of the last save
+    unsigned long long lastSavedRecords = 0;
+    bool lastSaveWasBase = false;
+    bool lastSaveWasCompaction = false;
+
+    void updateIndexChecksum()
+    {
+        KangarooTwelve((unsigned char*)&deltaIndex + sizeof(deltaIndex.checksum), sizeof(deltaIndex) - sizeof(deltaIndex.checksum), &deltaIndex.checksum, sizeof(deltaIndex.checksum));
+    }
+
+    // Copy the records flagged in flags into deltaBuffer, followed by their indices. Returns false if there are more
+    // than maxRecordsPerDelta records.
+    bool collectDelta(const RecordT* records, const unsigned long long* flags, unsigned int& numberOfRecords, unsigned long long& deltaSize)
+    {
+        unsigned long long count = 0;
+        for (unsigned long long i = 0; i < capacity / 64; i++)
+        {
+            count += __popcnt64(flags[i]);
+        }
+        if (count > maxRecordsPerDelta)
+        {
+            return false;
+        }
+
+        RecordT* deltaRecords = (RecordT*)deltaBuffer;
+        unsigned int* deltaIndices = (unsigned int*)(deltaBuffer + count * sizeof(RecordT));
+        unsigned int k = 0;
+        for (unsigned long long i = 0; i < capacity / 64; i++)
+        {
+            unsigned long long bits = flags[i];
+            while (bits)
+            {
+                const unsigned int index = (unsigned int)(i * 64 + _tzcnt_u64(bits));
+                copyMem(&deltaRecords[k], &records[index], sizeof(RecordT));
+                deltaIndices[k] = index;
+                k++;
+                bits &= bits - 1;
+            }
+        }
+        numberOfRecords = k;
+        deltaSize = count * (sizeof(RecordT) + sizeof(unsigned int));
+        return true;
+    }
+
+    // Prepare deltaBuffer and deltaIndex for saving the changes since the last save. Returns false if a base has to
+    // be saved instead. If nothing has changed, deltaNumber is set to maxNumberOfDeltas and no delta file is needed.
+    bool prepareDelta(const RecordT* records, unsigned int epoch, unsigned int& deltaNumber, unsigned long long& deltaSize)
+    {
+        if (baseRequired || deltaIndex.epoch != epoch)
+        {
+            return false;
+        }
+
+        bool anyChange = false;
+        for (unsigned long long i = 0; i < capacity / 64; i++)
+        {
+            anyChange |= (changedFlags[i] != 0);
+            changedSinceBaseFlags[i] |= changedFlags[i];
+        }
+        lastSavedRecords = 0;
+        lastSaveWasBase = false;
+        lastSaveWasCompaction = false;
+        if (!anyChange)
+        {
+            deltaNumber = maxNumberOfDeltas;
+            deltaSize = 0;
+            return true;
+        }
+
+        unsigned long long recordsInDeltas = 0;
+        for (unsigned int i = 0; i < deltaIndex.numberOfDeltas; i++)
+        {
+            recordsInDeltas += deltaIndex.numberOfRecords[i];
+        }
+
+        unsigned int numberOfRecords = 0;
+        deltaNumber = deltaIndex.numberOfDeltas;
+        if (deltaNumber >= maxNumberOfDeltas || recordsInDeltas >= maxRecordsPerDelta
+            || !collectDelta(records, changedFlags, numberOfRecords, deltaSize))
+        {
+            // Compaction: replace all deltas by one with the records changed since the base
+            deltaNumber = 0;
+            if (!collectDelta(records, changedSinceBaseFlags, numberOfRecords, deltaSize))
+            {
+                return false;
+            }
+            lastSaveWasCompaction = true;
+        }
+
+        deltaIndex.numberOfRecords[deltaNumber] = numberOfRecords;
+        KangarooTwelve(deltaBuffer, (unsigned int)deltaSize, &deltaIndex.digests[deltaNumber], sizeof(m256i));
+        deltaIndex.numberOfDeltas = deltaNumber + 1;
+        updateIndexChecksum();
+        setMem(changedFlags, flagsSize, 0);
+
+        lastSavedRecords = numberOfRecords;
+        return true;
+    }
+
+    // Prepare deltaIndex for saving a new base
+    void prepareBase(unsigned int epoch)
+    {
+        deltaIndex.epoch = epoch;
+        deltaIndex.numberOfDeltas = 0;
+        updateIndexChecksum();
+        setMem(changedFlags, flagsSize, 0);
+        setMem(changedSinceBaseFlags, flagsSize, 0);
+        baseRequired = false;
+
+        lastSavedRecords = capacity;
+        lastSaveWasBase = true;
+        lastSaveWasCompaction = false;
+    }
+
+public:
+    // Allocate buffers, delta files are named fileName.XXX and the index is fileNameIndex
+    bool init(const CHAR16* fileName)
+    {
+        if (!allocatePool(flagsSize, (void**)&changedFlags)
+            || !allocatePool(flagsSize, (void**)&changedSinceBaseFlags)
+            || !allocatePool(deltaBufferSize, (void**)&deltaBuffer))
+        {
+            deinit();
+            return false;
+        }
+        setMem(changedFlags, flagsSize, 0);
+        setMem(changedSinceBaseFlags, flagsSize, 0);
+        setMem(&deltaIndex, sizeof(deltaIndex), 0);
+        setText(deltaFileName, fileName);
+        setText(indexFileName, fileName);
+        appendText(indexFileName, L"Index");
+        baseRequired = true;
+        return true;
+    }
+
+    void deinit()
+    {
+        if (changedFlags)
+        {
+            freePool(changedFlags);
+            changedFlags = nullptr;
+        }
+        if (changedSinceBaseFlags)
+        {
+            freePool(changedSinceBaseFlags);
+            changedSinceBaseFlags = nullptr;
+        }
+        if (deltaBuffer)
+        {
+            freePool(deltaBuffer);
+            deltaBuffer = nullptr;
+        }
+    }
+
+    // Record that the record at index has changed since the last save. Does nothing if not initialized.
+    inline void markChanged(unsigned int index)
+    {
+        if (changedFlags)
+        {
+            changedFlags[index >> 6] |= (1ULL << (index & 63));
+        }
+    }
+
+    // Make the next save write a new base, for example after all records have changed or a save has failed
+    void requireBase()
+    {
+        baseRequired = true;
+    }
+
+    // Save a delta (or a new base if needed) and the index into directory. The records must not change while this
+    // is running.
+    bool saveToFiles(const RecordT* records, const CHAR16* baseFileName, const CHAR16* directory, unsigned int epoch)
+    {
+        unsigned int deltaNumber;
+        unsigned long long deltaSize;
+        bool ok;
+        if (prepareDelta(records, epoch, deltaNumber, deltaSize))
+        {
+            ok = true;
+            if (deltaNumber < maxNumberOfDeltas)
+            {
+                CHAR16 deltaFileNameWithNumber[64];
+                getLargeFileChunkName(deltaFileName, deltaNumber, deltaFileNameWithNumber);
+                ok = ::save(deltaFileNameWithNumber, deltaSize, deltaBuffer, directory) == (long long)deltaSize;
+            }
+        }
+        else
+        {
+            prepareBase(epoch);
+            ok = ::save(baseFileName, baseSize, (const unsigned char*)records, directory) == (long long)baseSize;
+        }
+        ok = ok && ::save(indexFileName, sizeof(deltaIndex), (const unsigned char*)&deltaIndex, directory) == sizeof(deltaIndex);
+        if (!ok)
+        {
+            requireBase();
+        }
+        return ok;
+    }
+
+    // Same as saveToFiles(), but the files are added to writer. Delta files are written from the own buffer, which
+    // doesn't change until the next save. A base is copied into the staging buffer of writer. If writing fails later,
+    // requireBase() has to be called.
+    bool addToStagedFileWriter(StagedFileWriter& writer, const RecordT* records, const CHAR16* baseFileName, unsigned int epoch)
+    {
+        unsigned int deltaNumber;
+        unsigned long long deltaSize;
+        bool ok;
+        if (prepareDelta(records, epoch, deltaNumber, deltaSize))
+        {
+            ok = true;
+            if (deltaNumber < maxNumberOfDeltas)
+            {
+                CHAR16 deltaFileNameWithNumber[64];
+                getLargeFileChunkName(deltaFileName, deltaNumber, deltaFileNameWithNumber);
+                ok = writer.addFile(deltaFileNameWithNumber, deltaBuffer, deltaSize);
+            }
+        }
+        else
+        {
+            prepareBase(epoch);
+            const void* stagedRecords = writer.stage(records, baseSize);
+            ok = stagedRecords && writer.addFile(baseFileName, stagedRecords, baseSize);
+        }
+        ok = ok && writer.addFile(indexFileName, &deltaIndex, sizeof(deltaIndex));
+        if (!ok)
+        {
+            requireBase();
+        }
+        return ok;
+    }
+
+    // Load base and apply all deltas listed in the index. Following saves continue the sequence of deltas. A base
+    // without index (saved before delta snapshots were introduced) is loaded as is.
+    bool loadFromFiles(RecordT* records, const CHAR16* baseFileName, const CHAR16* directory, unsigned int epoch)
+    {
+        requireBase();
+        if (::load(baseFileName, baseSize, (unsigned char*)records, directory) != (long long)baseSize)
+        {
+            return false;
+        }
+        if (getFileSize(indexFileName, (CHAR16*)directory) < 0)
+        {
+            return true;
+        }
+
+        m256i checksum;
+        if (::load(indexFileName, sizeof(deltaIndex), (unsigned char*)&deltaIndex, directory) != sizeof(deltaIndex))
+        {
+            return false;
+        }
+        KangarooTwelve((unsigned char*)&deltaIndex + sizeof(deltaIndex.checksum), sizeof(deltaIndex) - sizeof(deltaIndex.checksum), &checksum, sizeof(checksum));
+        if (checksum != deltaIndex.checksum || deltaIndex.epoch != epoch || deltaIndex.numberOfDeltas > maxNumberOfDeltas)
+        {
+            return false;
+        }
+
+        setMem(changedFlags, flagsSize, 0);
+        setMem(changedSinceBaseFlags, flagsSize, 0);
+        for (unsigned int deltaNumber = 0; deltaNumber < deltaIndex.numberOfDeltas; deltaNumber++)
+        {
+            const unsigned int numberOfRecords = deltaIndex.numberOfRecords[deltaNumber];
+            if (numberOfRecords > maxRecordsPerDelta)
+            {
+                return false;
+            }
+            const unsigned long long deltaSize = numberOfRecords * (sizeof(RecordT) + sizeof(unsigned int));
+            CHAR16 deltaFileNameWithNumber[64];
+            getLargeFileChunkName(deltaFileName, deltaNumber, deltaFileNameWithNumber);
+            if (::load(deltaFileNameWithNumber, deltaSize, deltaBuffer, directory) != (long long)deltaSize)
+            {
+                return false;
+            }
+            KangarooTwelve(deltaBuffer, (unsigned int)deltaSize, &checksum, sizeof(checksum));
+            if (checksum != deltaIndex.digests[deltaNumber])
+            {
+                return false;
+            }
+
+            const RecordT* deltaRecords = (const RecordT*)deltaBuffer;
+            const unsigned int* deltaIndices = (const unsigned int*)(deltaBuffer + numberOfRecords * sizeof(RecordT));
+            for (unsigned int k = 0; k < numberOfRecords; k++)
+            {
+                const unsigned int index = deltaIndices[k];
+                if (index >= capacity)
+                {
+                    return false;
+                }
+                copyMem(&records[index], &deltaRecords[k], sizeof(RecordT));
+                changedSinceBaseFlags[index >> 6] |= (1ULL << (index & 63));
+            }
+        }
+        baseRequired = false;
+        return true;
+    }
+
+    unsigned int getNumberOfDeltas() const
+    {
+        return deltaIndex.numberOfDeltas;
+    }
+
+    // Number of records written by the last save (capacity if it was a base)
+    unsigned long long getLastSavedRecords() const
+    {
+        return lastSavedRecords;
+    }
+
+    bool lastSavedBase() const
+    {
+        return lastSaveWasBase;
+    }
+
+    bool lastSavedCompaction() const
+    {
+        return lastSaveWasCompaction;
+    }
+};
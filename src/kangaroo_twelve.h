@@ -2494,6 +2494,453 @@ static void KangarooTwelve64To32(const void* input, void* output)
     KangarooTwelve64To32((const unsigned char*)input, (unsigned char*)output);
 }
 
+////////// Multi-lane KangarooTwelve64To32 \\\\\\\\\\
+
+// Hashing of several independent 64-byte inputs in parallel, one input per 64-bit lane of an AVX2 / AVX-512 register.
+// The result is identical to calling KangarooTwelve64To32() for each input. It is used for building Merkle trees,
+// where each level consists of many independent 64-byte nodes.
+
+static constexpr unsigned long long K12MultiLaneRoundConstants[12] = {
+    KeccakF1600RoundConstant0, KeccakF1600RoundConstant1, KeccakF1600RoundConstant2, KeccakF1600RoundConstant3,
+    KeccakF1600RoundConstant4, KeccakF1600RoundConstant5, KeccakF1600RoundConstant6, KeccakF1600RoundConstant7,
+    KeccakF1600RoundConstant8, KeccakF1600RoundConstant9, KeccakF1600RoundConstant10, 0x8000000080008008ULL
+};
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+
+#define K12_ROL256(a, offset) _mm256_or_si256(_mm256_slli_epi64(a, offset), _mm256_srli_epi64(a, 64 - (offset)))
+
+// Transpose 4x4 matrix of 64-bit values
+static inline void K12Transpose4x4(__m256i& r0, __m256i& r1, __m256i& r2, __m256i& r3)
+{
+    const __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    const __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    const __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    const __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+    r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+    r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+    r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+// Apply the 12-round Keccak-p[1600] permutation to 4 states, one state per 64-bit lane of A
+static inline void KeccakP1600x4_Permute_12rounds(__m256i A[25])
+{
+    __m256i B[25], C[5], D[5];
+
+    for (int round = 0; round < 12; round++)
+    {
+        C[0] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[0], A[5]), _mm256_xor_si256(A[10], A[15])), A[20]);
+        C[1] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[1], A[6]), _mm256_xor_si256(A[11], A[16])), A[21]);
+        C[2] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[2], A[7]), _mm256_xor_si256(A[12], A[17])), A[22]);
+        C[3] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[3], A[8]), _mm256_xor_si256(A[13], A[18])), A[23]);
+        C[4] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[4], A[9]), _mm256_xor_si256(A[14], A[19])), A[24]);
+        D[0] = _mm256_xor_si256(C[4], K12_ROL256(C[1], 1));
+        D[1] = _mm256_xor_si256(C[0], K12_ROL256(C[2], 1));
+        D[2] = _mm256_xor_si256(C[1], K12_ROL256(C[3], 1));
+        D[3] = _mm256_xor_si256(C[2], K12_ROL256(C[4], 1));
+        D[4] = _mm256_xor_si256(C[3], K12_ROL256(C[0], 1));
+        B[0] = _mm256_xor_si256(A[0], D[0]);
+        B[10] = K12_ROL256(_mm256_xor_si256(A[1], D[1]), 1);
+        B[20] = K12_ROL256(_mm256_xor_si256(A[2], D[2]), 62);
+        B[5] = K12_ROL256(_mm256_xor_si256(A[3], D[3]), 28);
+        B[15] = K12_ROL256(_mm256_xor_si256(A[4], D[4]), 27);
+        B[16] = K12_ROL256(_mm256_xor_si256(A[5], D[0]), 36);
+        B[1] = K12_ROL256(_mm256_xor_si256(A[6], D[1]), 44);
+        B[11] = K12_ROL256(_mm256_xor_si256(A[7], D[2]), 6);
+        B[21] = K12_ROL256(_mm256_xor_si256(A[8], D[3]), 55);
+        B[6] = K12_ROL256(_mm256_xor_si256(A[9], D[4]), 20);
+        B[7] = K12_ROL256(_mm256_xor_si256(A[10], D[0]), 3);
+        B[17] = K12_ROL256(_mm256_xor_si256(A[11], D[1]), 10);
+        B[2] = K12_ROL256(_mm256_xor_si256(A[12], D[2]), 43);
+        B[12] = K12_ROL256(_mm256_xor_si256(A[13], D[3]), 25);
+        B[22] = K12_ROL256(_mm256_xor_si256(A[14], D[4]), 39);
+        B[23] = K12_ROL256(_mm256_xor_si256(A[15], D[0]), 41);
+        B[8] = K12_ROL256(_mm256_xor_si256(A[16], D[1]), 45);
+        B[18] = K12_ROL256(_mm256_xor_si256(A[17], D[2]), 15);
+        B[3] = K12_ROL256(_mm256_xor_si256(A[18], D[3]), 21);
+        B[13] = K12_ROL256(_mm256_xor_si256(A[19], D[4]), 8);
+        B[14] = K12_ROL256(_mm256_xor_si256(A[20], D[0]), 18);
+        B[24] = K12_ROL256(_mm256_xor_si256(A[21], D[1]), 2);
+        B[9] = K12_ROL256(_mm256_xor_si256(A[22], D[2]), 61);
+        B[19] = K12_ROL256(_mm256_xor_si256(A[23], D[3]), 56);
+        B[4] = K12_ROL256(_mm256_xor_si256(A[24], D[4]), 14);
+        A[0] = _mm256_xor_si256(B[0], _mm256_andnot_si256(B[1], B[2]));
+        A[1] = _mm256_xor_si256(B[1], _mm256_andnot_si256(B[2], B[3]));
+        A[2] = _mm256_xor_si256(B[2], _mm256_andnot_si256(B[3], B[4]));
+        A[3] = _mm256_xor_si256(B[3], _mm256_andnot_si256(B[4], B[0]));
+        A[4] = _mm256_xor_si256(B[4], _mm256_andnot_si256(B[0], B[1]));
+        A[5] = _mm256_xor_si256(B[5], _mm256_andnot_si256(B[6], B[7]));
+        A[6] = _mm256_xor_si256(B[6], _mm256_andnot_si256(B[7], B[8]));
+        A[7] = _mm256_xor_si256(B[7], _mm256_andnot_si256(B[8], B[9]));
+        A[8] = _mm256_xor_si256(B[8], _mm256_andnot_si256(B[9], B[5]));
+        A[9] = _mm256_xor_si256(B[9], _mm256_andnot_si256(B[5], B[6]));
+        A[10] = _mm256_xor_si256(B[10], _mm256_andnot_si256(B[11], B[12]));
+        A[11] = _mm256_xor_si256(B[11], _mm256_andnot_si256(B[12], B[13]));
+        A[12] = _mm256_xor_si256(B[12], _mm256_andnot_si256(B[13], B[14]));
+        A[13] = _mm256_xor_si256(B[13], _mm256_andnot_si256(B[14], B[10]));
+        A[14] = _mm256_xor_si256(B[14], _mm256_andnot_si256(B[10], B[11]));
+        A[15] = _mm256_xor_si256(B[15], _mm256_andnot_si256(B[16], B[17]));
+        A[16] = _mm256_xor_si256(B[16], _mm256_andnot_si256(B[17], B[18]));
+        A[17] = _mm256_xor_si256(B[17], _mm256_andnot_si256(B[18], B[19]));
+        A[18] = _mm256_xor_si256(B[18], _mm256_andnot_si256(B[19], B[15]));
+        A[19] = _mm256_xor_si256(B[19], _mm256_andnot_si256(B[15], B[16]));
+        A[20] = _mm256_xor_si256(B[20], _mm256_andnot_si256(B[21], B[22]));
+        A[21] = _mm256_xor_si256(B[21], _mm256_andnot_si256(B[22], B[23]));
+        A[22] = _mm256_xor_si256(B[22], _mm256_andnot_si256(B[23], B[24]));
+        A[23] = _mm256_xor_si256(B[23], _mm256_andnot_si256(B[24], B[20]));
+        A[24] = _mm256_xor_si256(B[24], _mm256_andnot_si256(B[20], B[21]));
+        A[0] = _mm256_xor_si256(A[0], _mm256_set1_epi64x(K12MultiLaneRoundConstants[round]));
+    }
+}
+
+// Compute KangarooTwelve64To32() of 4 inputs with AVX2
+static void KangarooTwelve64To32x4(const unsigned char* const input[4], unsigned char* const output[4])
+{
+    __m256i A[25];
+
+    // Absorb 64-byte inputs (state lanes 0..7 of each input), the K12 suffix, and the padding
+    for (int i = 0; i < 8; i += 4)
+    {
+        A[i] = _mm256_loadu_si256((const __m256i*)(input[0] + i * 8));
+        A[i + 1] = _mm256_loadu_si256((const __m256i*)(input[1] + i * 8));
+        A[i + 2] = _mm256_loadu_si256((const __m256i*)(input[2] + i * 8));
+        A[i + 3] = _mm256_loadu_si256((const __m256i*)(input[3] + i * 8));
+        K12Transpose4x4(A[i], A[i + 1], A[i + 2], A[i + 3]);
+    }
+    A[8] = _mm256_set1_epi64x(0x0700);
+    for (int i = 9; i < 25; i++)
+    {
+        A[i] = _mm256_setzero_si256();
+    }
+    A[20] = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+
+    KeccakP1600x4_Permute_12rounds(A);
+
+    // Squeeze first 32 bytes of each state
+    K12Transpose4x4(A[0], A[1], A[2], A[3]);
+    _mm256_storeu_si256((__m256i*)output[0], A[0]);
+    _mm256_storeu_si256((__m256i*)output[1], A[1]);
+    _mm256_storeu_si256((__m256i*)output[2], A[2]);
+    _mm256_storeu_si256((__m256i*)output[3], A[3]);
+}
+
+#undef K12_ROL256
+
+#endif
+
+#if defined(__AVX512F__)
+
+// Compute KangarooTwelve64To32() of 8 inputs with AVX-512
+static void KangarooTwelve64To32x8(const unsigned char* const input[8], unsigned char* const output[8])
+{
+    __m512i A[25], B[25], C[5], D[5];
+
+    // Absorb 64-byte inputs (state lanes 0..7 of each input), the K12 suffix, and the padding
+    const __m512i inputAddresses = _mm512_loadu_si512(input);
+    for (int i = 0; i < 8; i++)
+    {
+        A[i] = _mm512_i64gather_epi64(_mm512_add_epi64(inputAddresses, _mm512_set1_epi64(i * 8)), nullptr, 1);
+    }
+    A[8] = _mm512_set1_epi64(0x0700);
+    for (int i = 9; i < 25; i++)
+    {
+        A[i] = _mm512_setzero_si512();
+    }
+    A[20] = _mm512_set1_epi64((long long)0x8000000000000000ULL);
+
+    for (int round = 0; round < 12; round++)
+    {
+        C[0] = _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(A[0], A[5], A[10], 0x96), A[15], A[20], 0x96);
+        C[1] = _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(A[1], A[6], A[11], 0x96), A[16], A[21], 0x96);
+        C[2] = _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(A[2], A[7], A[12], 0x96), A[17], A[22], 0x96);
+        C[3] = _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(A[3], A[8], A[13], 0x96), A[18], A[23], 0x96);
+        C[4] = _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(A[4], A[9], A[14], 0x96), A[19], A[24], 0x96);
+        D[0] = _mm512_xor_si512(C[4], _mm512_rol_epi64(C[1], 1));
+        D[1] = _mm512_xor_si512(C[0], _mm512_rol_epi64(C[2], 1));
+        D[2] = _mm512_xor_si512(C[1], _mm512_rol_epi64(C[3], 1));
+        D[3] = _mm512_xor_si512(C[2], _mm512_rol_epi64(C[4], 1));
+        D[4] = _mm512_xor_si512(C[3], _mm512_rol_epi64(C[0], 1));
+        B[0] = _mm512_xor_si512(A[0], D[0]);
+        B[10] = _mm512_rol_epi64(_mm512_xor_si512(A[1], D[1]), 1);
+        B[20] = _mm512_rol_epi64(_mm512_xor_si512(A[2], D[2]), 62);
+        B[5] = _mm512_rol_epi64(_mm512_xor_si512(A[3], D[3]), 28);
+        B[15] = _mm512_rol_epi64(_mm512_xor_si512(A[4], D[4]), 27);
+        B[16] = _mm512_rol_epi64(_mm512_xor_si512(A[5], D[0]), 36);
+        B[1] = _mm512_rol_epi64(_mm512_xor_si512(A[6], D[1]), 44);
+        B[11] = _mm512_rol_epi64(_mm512_xor_si512(A[7], D[2]), 6);
+        B[21] = _mm512_rol_epi64(_mm512_xor_si512(A[8], D[3]), 55);
+        B[6] = _mm512_rol_epi64(_mm512_xor_si512(A[9], D[4]), 20);
+        B[7] = _mm512_rol_epi64(_mm512_xor_si512(A[10], D[0]), 3);
+        B[17] = _mm512_rol_epi64(_mm512_xor_si512(A[11], D[1]), 10);
+        B[2] = _mm512_rol_epi64(_mm512_xor_si512(A[12], D[2]), 43);
+        B[12] = _mm512_rol_epi64(_mm512_xor_si512(A[13], D[3]), 25);
+        B[22] = _mm512_rol_epi64(_mm512_xor_si512(A[14], D[4]), 39);
+        B[23] = _mm512_rol_epi64(_mm512_xor_si512(A[15], D[0]), 41);
+        B[8] = _mm512_rol_epi64(_mm512_xor_si512(A[16], D[1]), 45);
+        B[18] = _mm512_rol_epi64(_mm512_xor_si512(A[17], D[2]), 15);
+        B[3] = _mm512_rol_epi64(_mm512_xor_si512(A[18], D[3]), 21);
+        B[13] = _mm512_rol_epi64(_mm512_xor_si512(A[19], D[4]), 8);
+        B[14] = _mm512_rol_epi64(_mm512_xor_si512(A[20], D[0]), 18);
+        B[24] = _mm512_rol_epi64(_mm512_xor_si512(A[21], D[1]), 2);
+        B[9] = _mm512_rol_epi64(_mm512_xor_si512(A[22], D[2]), 61);
+        B[19] = _mm512_rol_epi64(_mm512_xor_si512(A[23], D[3]), 56);
+        B[4] = _mm512_rol_epi64(_mm512_xor_si512(A[24], D[4]), 14);
+        A[0] = _mm512_ternarylogic_epi64(B[0], B[1], B[2], 0xD2);
+        A[1] = _mm512_ternarylogic_epi64(B[1], B[2], B[3], 0xD2);
+        A[2] = _mm512_ternarylogic_epi64(B[2], B[3], B[4], 0xD2);
+        A[3] = _mm512_ternarylogic_epi64(B[3], B[4], B[0], 0xD2);
+        A[4] = _mm512_ternarylogic_epi64(B[4], B[0], B[1], 0xD2);
+        A[5] = _mm512_ternarylogic_epi64(B[5], B[6], B[7], 0xD2);
+        A[6] = _mm512_ternarylogic_epi64(B[6], B[7], B[8], 0xD2);
+        A[7] = _mm512_ternarylogic_epi64(B[7], B[8], B[9], 0xD2);
+        A[8] = _mm512_ternarylogic_epi64(B[8], B[9], B[5], 0xD2);
+        A[9] = _mm512_ternarylogic_epi64(B[9], B[5], B[6], 0xD2);
+        A[10] = _mm512_ternarylogic_epi64(B[10], B[11], B[12], 0xD2);
+        A[11] = _mm512_ternarylogic_epi64(B[11], B[12], B[13], 0xD2);
+        A[12] = _mm512_ternarylogic_epi64(B[12], B[13], B[14], 0xD2);
+        A[13] = _mm512_ternarylogic_epi64(B[13], B[14], B[10], 0xD2);
+        A[14] = _mm512_ternarylogic_epi64(B[14], B[10], B[11], 0xD2);
+        A[15] = _mm512_ternarylogic_epi64(B[15], B[16], B[17], 0xD2);
+        A[16] = _mm512_ternarylogic_epi64(B[16], B[17], B[18], 0xD2);
+        A[17] = _mm512_ternarylogic_epi64(B[17], B[18], B[19], 0xD2);
+        A[18] = _mm512_ternarylogic_epi64(B[18], B[19], B[15], 0xD2);
+        A[19] = _mm512_ternarylogic_epi64(B[19], B[15], B[16], 0xD2);
+        A[20] = _mm512_ternarylogic_epi64(B[20], B[21], B[22], 0xD2);
+        A[21] = _mm512_ternarylogic_epi64(B[21], B[22], B[23], 0xD2);
+        A[22] = _mm512_ternarylogic_epi64(B[22], B[23], B[24], 0xD2);
+        A[23] = _mm512_ternarylogic_epi64(B[23], B[24], B[20], 0xD2);
+        A[24] = _mm512_ternarylogic_epi64(B[24], B[20], B[21], 0xD2);
+        A[0] = _mm512_xor_si512(A[0], _mm512_set1_epi64(K12MultiLaneRoundConstants[round]));
+    }
+
+    // Squeeze first 32 bytes of each state
+    const __m512i outputAddresses = _mm512_loadu_si512(output);
+    for (int i = 0; i < 4; i++)
+    {
+        _mm512_i64scatter_epi64(nullptr, _mm512_add_epi64(outputAddresses, _mm512_set1_epi64(i * 8)), A[i], 1);
+    }
+}
+
+#endif
+
+// Collects independent KangarooTwelve64To32() calls and computes them with the multi-lane implementation as soon as
+// all lanes are filled. Outputs are only valid after flush(). Inputs of a batch must not overlap with its outputs.
+class KangarooTwelve64To32Batch
+{
+public:
+#if defined(__AVX512F__)
+    static constexpr unsigned int numberOfLanes = 8;
+#elif defined(__AVX2__)
+    static constexpr unsigned int numberOfLanes = 4;
+#else
+    static constexpr unsigned int numberOfLanes = 1;
+#endif
+
+    void add(const void* input, void* output)
+    {
+        inputs[numberOfJobs] = (const unsigned char*)input;
+        outputs[numberOfJobs] = (unsigned char*)output;
+        if (++numberOfJobs == numberOfLanes)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        unsigned int i = 0;
+#if defined(__AVX512F__)
+        if (numberOfJobs == 8)
+        {
+            KangarooTwelve64To32x8(inputs, outputs);
+            i = 8;
+        }
+#endif
+#if defined(__AVX2__) || defined(__AVX512F__)
+        if (numberOfJobs - i >= 4)
+        {
+            KangarooTwelve64To32x4(inputs + i, outputs + i);
+            i += 4;
+        }
+#endif
+        for (; i < numberOfJobs; i++)
+        {
+            KangarooTwelve64To32(inputs[i], outputs[i]);
+        }
+        numberOfJobs = 0;
+    }
+
+private:
+    const unsigned char* inputs[numberOfLanes];
+    unsigned char* outputs[numberOfLanes];
+    unsigned int numberOfJobs = 0;
+};
+
+// Compute KangarooTwelve64To32() of count consecutive 64-byte inputs, writing count consecutive 32-byte outputs.
+// Input and output must not overlap.
+static void KangarooTwelve64To32Multiple(const void* input, void* output, unsigned long long count)
+{
+    const unsigned char* in = (const unsigned char*)input;
+    unsigned char* out = (unsigned char*)output;
+#if defined(__AVX512F__)
+    while (count >= 8)
+    {
+        const unsigned char* inputs[8] = { in, in + 64, in + 128, in + 192, in + 256, in + 320, in + 384, in + 448 };
+        unsigned char* outputs[8] = { out, out + 32, out + 64, out + 96, out + 128, out + 160, out + 192, out + 224 };
+        KangarooTwelve64To32x8(inputs, outputs);
+        in += 512;
+        out += 256;
+        count -= 8;
+    }
+#endif
+#if defined(__AVX2__) || defined(__AVX512F__)
+    while (count >= 4)
+    {
+        const unsigned char* inputs[4] = { in, in + 64, in + 128, in + 192 };
+        unsigned char* outputs[4] = { out, out + 32, out + 64, out + 96 };
+        KangarooTwelve64To32x4(inputs, outputs);
+        in += 256;
+        out += 128;
+        count -= 4;
+    }
+#endif
+    while (count)
+    {
+        KangarooTwelve64To32(in, out);
+        in += 64;
+        out += 32;
+        count--;
+    }
+}
+
+////////// Multi-lane KangarooTwelve of short inputs \\\\\\\\\\
+
+// Hashing of several independent inputs shorter than K12_chunkSize bytes in parallel. Such an input is a single chunk,
+// so KangarooTwelve() absorbs input || 0x00 (empty customization string) with the domain separation byte 0x07 into one
+// state. Inputs are processed together if they need the same number of permutations. The result is identical to
+// calling KangarooTwelve() for each input. It is used for computing the digests of logs, which are mostly short.
+
+// Number of permutations (absorbed blocks) of KangarooTwelve() for input shorter than K12_chunkSize bytes
+static inline unsigned int KangarooTwelveShortInputNumberOfBlocks(unsigned int inputByteLen)
+{
+    return (inputByteLen + 1) / K12_rateInBytes + 1;
+}
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+
+// Compute KangarooTwelve() of 4 inputs shorter than K12_chunkSize bytes with AVX2. All inputs must need the same
+// number of blocks (see KangarooTwelveShortInputNumberOfBlocks()) and outputByteLen must not exceed K12_rateInBytes.
+static void KangarooTwelveShortInputx4(const unsigned char* const input[4], const unsigned int inputByteLen[4], unsigned char* const output[4], unsigned int outputByteLen)
+{
+    constexpr unsigned int laneCount = K12_rateInBytes / 8;
+    __m256i A[25];
+    for (int i = 0; i < 25; i++)
+    {
+        A[i] = _mm256_setzero_si256();
+    }
+
+    const unsigned int numberOfBlocks = KangarooTwelveShortInputNumberOfBlocks(inputByteLen[0]);
+    unsigned long long lastBlocks[4][laneCount];
+    for (unsigned int block = 0; block < numberOfBlocks; block++)
+    {
+        const unsigned int offset = block * K12_rateInBytes;
+        const unsigned long long* blocks[4];
+        for (int j = 0; j < 4; j++)
+        {
+            if (offset + K12_rateInBytes <= inputByteLen[j])
+            {
+                blocks[j] = (const unsigned long long*)(input[j] + offset);
+            }
+            else
+            {
+                // Copy end of input, followed by the K12 suffix 0x00 and (in last block) the padding
+                unsigned char* lastBlock = (unsigned char*)lastBlocks[j];
+                setMem(lastBlock, K12_rateInBytes, 0);
+                if (offset < inputByteLen[j])
+                {
+                    copyMem(lastBlock, input[j] + offset, inputByteLen[j] - offset);
+                }
+                if (block == numberOfBlocks - 1)
+                {
+                    lastBlock[inputByteLen[j] + 1 - offset] ^= 0x07;
+                    lastBlock[K12_rateInBytes - 1] ^= 0x80;
+                }
+                blocks[j] = lastBlocks[j];
+            }
+        }
+        for (unsigned int i = 0; i < laneCount; i++)
+        {
+            A[i] = _mm256_xor_si256(A[i], _mm256_set_epi64x(blocks[3][i], blocks[2][i], blocks[1][i], blocks[0][i]));
+        }
+        KeccakP1600x4_Permute_12rounds(A);
+    }
+
+    // Squeeze first outputByteLen bytes of each state
+    unsigned long long state[laneCount][4];
+    const unsigned int outputLaneCount = (outputByteLen + 7) / 8;
+    for (unsigned int i = 0; i < outputLaneCount; i++)
+    {
+        _mm256_storeu_si256((__m256i*)state[i], A[i]);
+    }
+    for (int j = 0; j < 4; j++)
+    {
+        for (unsigned int i = 0; i < outputLaneCount; i++)
+        {
+            copyMem(output[j] + i * 8, &state[i][j], (outputByteLen - i * 8 < 8) ? outputByteLen - i * 8 : 8);
+        }
+    }
+}
+
+#endif
+
+// Compute KangarooTwelve() of count independent inputs, writing outputByteLen bytes to each output. Inputs shorter
+// than K12_chunkSize bytes are grouped by number of blocks for the multi-lane implementation, longer inputs are hashed
+// one by one. outputByteLen must not exceed K12_rateInBytes. Inputs must not overlap with outputs.
+static void KangarooTwelveMultiple(const unsigned char* const* input, const unsigned int* inputByteLen, unsigned char* const* output, unsigned int count, unsigned int outputByteLen)
+{
+#if defined(__AVX2__) || defined(__AVX512F__)
+    // Inputs waiting for 3 others with the same number of blocks
+    constexpr unsigned int maxNumberOfBlocks = K12_chunkSize / K12_rateInBytes + 1;
+    unsigned int pending[maxNumberOfBlocks][4];
+    unsigned int numberOfPending[maxNumberOfBlocks];
+    setMem(numberOfPending, sizeof(numberOfPending), 0);
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (inputByteLen[i] >= K12_chunkSize)
+        {
+            KangarooTwelve(input[i], inputByteLen[i], output[i], outputByteLen);
+            continue;
+        }
+        const unsigned int group = KangarooTwelveShortInputNumberOfBlocks(inputByteLen[i]) - 1;
+        pending[group][numberOfPending[group]++] = i;
+        if (numberOfPending[group] == 4)
+        {
+            const unsigned int* p = pending[group];
+            const unsigned char* inputs[4] = { input[p[0]], input[p[1]], input[p[2]], input[p[3]] };
+            const unsigned int inputByteLens[4] = { inputByteLen[p[0]], inputByteLen[p[1]], inputByteLen[p[2]], inputByteLen[p[3]] };
+            unsigned char* outputs[4] = { output[p[0]], output[p[1]], output[p[2]], output[p[3]] };
+            KangarooTwelveShortInputx4(inputs, inputByteLens, outputs, outputByteLen);
+            numberOfPending[group] = 0;
+        }
+    }
+    for (unsigned int group = 0; group < maxNumberOfBlocks; group++)
+    {
+        for (unsigned int k = 0; k < numberOfPending[group]; k++)
+        {
+            const unsigned int i = pending[group][k];
+            KangarooTwelve(input[i], inputByteLen[i], output[i], outputByteLen);
+        }
+    }
+#else
+    for (unsigned int i = 0; i < count; i++)
+    {
+        KangarooTwelve(input[i], inputByteLen[i], output[i], outputByteLen);
+    }
+#endif
+}
+
 static void random(const unsigned char* publicKey, const unsigned char* nonce, unsigned char* output, unsigned long long outputSize)
 {
     unsigned char state[200];
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/file_io.h"
+
+#include "kangaroo_twelve.h"
+
+#ifndef LOG_SEGMENT_SIZE
+#define LOG_SEGMENT_SIZE 268435456ULL // 256 MiB, a segment is closed when the next append would exceed this size
+#endif
+#ifndef LOG_MAX_NUMBER_OF_SEGMENTS
+#define LOG_MAX_NUMBER_OF_SEGMENTS 512 // segments kept on disk, the oldest is overwritten when starting another one
+#endif
+
+static_assert(LOG_MAX_NUMBER_OF_SEGMENTS <= 1000, "Segment file names only have 3 digits");
+static_assert(LOG_SEGMENT_SIZE < (1ULL << 31), "Offsets of logs in segment are stored as 32-bit numbers");
+
+static unsigned short LOG_SEGMENTS_DIRECTORY[] = L"logs";
+static unsigned short LOG_SEGMENT_FILE_NAME[] = L"logSegment";
+static unsigned short LOG_SEGMENT_OFFSETS_FILE_NAME[] = L"logSegmentOffsets";
+static unsigned short LOG_SEGMENT_INDEX_FILE_NAME[] = L"logSegments.idx";
+
+// Rolling on-disk segments of logs evicted from (or about to be evicted from) the circular log buffer of qLogger.
+// A segment holds logs of consecutive IDs from one epoch, appended to a data file, and an offsets file with the offset
+// of each log in the data file (the compact index log ID -> offset). The segment index lists the segments in ring
+// order, the oldest segment (and its files) being reused when all LOG_MAX_NUMBER_OF_SEGMENTS are taken. It is
+// rewritten after each append and only counts data that has been written, so it is consistent after a restart. The
+// last segment isn't appended to after reopening, because its files may have unlisted data at the end.
+//
+// All functions must be called from the main processor (file access), which is why processRequestLog() queues reads
+// of evicted logs instead of reading them directly.
+class LogSegmentStore
+{
+public:
+    struct Segment
+    {
+        unsigned long long firstLogId;
+        unsigned long long numberOfLogs;
+        unsigned long long size;
+        unsigned int epoch;
+        unsigned int _padding;
+    };
+
+    // Maximum number of logs returned by one read (number of offsets read from the offsets file)
+    static constexpr unsigned int maxNumberOfLogsPerRead = 16384;
+
+    // Returned by read() if log fromID is found, but is larger than maxSize
+    static constexpr long long logTooLarge = -2;
+
+private:
+    struct Index
+    {
+        m256i checksum; // K12 of the rest of the index
+        unsigned int firstSegment; // ring position of oldest segment
+        unsigned int numberOfSegments;
+        Segment segments[LOG_MAX_NUMBER_OF_SEGMENTS];
+    } index;
+
+    const CHAR16* directory = NULL;
+    bool opened = false;
+
+    // Files of the last segment, only open if it is appended to
+    FileHandle dataFile = NULL;
+    FileHandle offsetsFile = NULL;
+
+    unsigned int offsetsBuffer[maxNumberOfLogsPerRead + 1];
+
+    static void getFileName(const CHAR16* fileName, unsigned int ringPosition, CHAR16* fileNameWithNumber)
+    {
+        getLargeFileChunkName(fileName, ringPosition, fileNameWithNumber);
+    }
+
+    unsigned int getRingPosition(unsigned int segment) const
+    {
+        return (index.firstSegment + segment) % LOG_MAX_NUMBER_OF_SEGMENTS;
+    }
+
+    void updateChecksum()
+    {
+        KangarooTwelve((unsigned char*)&index + sizeof(index.checksum), sizeof(index) - sizeof(index.checksum), &index.checksum, sizeof(index.checksum));
+    }
+
+    bool saveIndex()
+    {
+        updateChecksum();
+        return save(LOG_SEGMENT_INDEX_FILE_NAME, sizeof(index), (unsigned char*)&index, directory) == sizeof(index);
+    }
+
+    void closeSegmentFiles()
+    {
+        if (dataFile)
+        {
+            closeFile(dataFile);
+            dataFile = NULL;
+        }
+        if (offsetsFile)
+        {
+            closeFile(offsetsFile);
+            offsetsFile = NULL;
+        }
+    }
+
+    // Start new segment, dropping the oldest if the index is full
+    bool startSegment(unsigned int epoch, unsigned long long firstLogId)
+    {
+        closeSegmentFiles();
+        if (index.numberOfSegments == LOG_MAX_NUMBER_OF_SEGMENTS)
+        {
+            index.firstSegment = (index.firstSegment + 1) % LOG_MAX_NUMBER_OF_SEGMENTS;
+            index.numberOfSegments--;
+        }
+        const unsigned int ringPosition = getRingPosition(index.numberOfSegments);
+        Segment& segment = index.segments[ringPosition];
+        segment.firstLogId = firstLogId;
+        segment.numberOfLogs = 0;
+        segment.size = 0;
+        segment.epoch = epoch;
+        segment._padding = 0;
+        index.numberOfSegments++;
+
+        // The index is saved before overwriting the files of the dropped segment
+        CHAR16 fileName[64];
+        if (!saveIndex())
+        {
+            return false;
+        }
+        getFileName(LOG_SEGMENT_FILE_NAME, ringPosition, fileName);
+        dataFile = openFileForWriting(fileName, directory);
+        getFileName(LOG_SEGMENT_OFFSETS_FILE_NAME, ringPosition, fileName);
+        offsetsFile = openFileForWriting(fileName, directory);
+        if (!dataFile || !offsetsFile)
+        {
+            closeSegmentFiles();
+            return false;
+        }
+        return true;
+    }
+
+public:
+    // Open store in directory (NULL means root directory), loading the segment index if there is a valid one.
+    // Returns number of segments found.
+    unsigned int open(const CHAR16* storeDirectory)
+    {
+        closeSegmentFiles();
+        directory = storeDirectory;
+        opened = true;
+
+        m256i checksum;
+        if (getFileSize(LOG_SEGMENT_INDEX_FILE_NAME, (CHAR16*)directory) == sizeof(index)
+            && load(LOG_SEGMENT_INDEX_FILE_NAME, sizeof(index), (unsigned char*)&index, directory) == sizeof(index))
+        {
+            KangarooTwelve((unsigned char*)&index + sizeof(index.checksum), sizeof(index) - sizeof(index.checksum), &checksum, sizeof(checksum));
+            if (checksum == index.checksum
+                && index.firstSegment < LOG_MAX_NUMBER_OF_SEGMENTS
+                && index.numberOfSegments <= LOG_MAX_NUMBER_OF_SEGMENTS)
+            {
+                return index.numberOfSegments;
+            }
+        }
+        setMem(&index, sizeof(index), 0);
+        return 0;
+    }
+
+    void close()
+    {
+        closeSegmentFiles();
+        opened = false;
+    }
+
+    bool isOpen() const
+    {
+        return opened;
+    }
+
+    unsigned int getNumberOfSegments() const
+    {
+        return index.numberOfSegments;
+    }
+
+    // Get segment by number, 0 being the oldest
+    const Segment& getSegment(unsigned int segment) const
+    {
+        ASSERT(segment < index.numberOfSegments);
+        return index.segments[getRingPosition(segment)];
+    }
+
+    // Append complete logs with consecutive IDs starting with firstLogId, stored in logs (size bytes). logOffsets
+    // holds the offset of each of the numberOfLogs logs relative to logs. A new segment is started if the logs don't
+    // continue the last segment or wouldn't fit into it. Returns false on error.
+    bool append(unsigned int epoch, unsigned long long firstLogId, const char* logs, unsigned long long size, const unsigned int* logOffsets, unsigned int numberOfLogs)
+    {
+        if (!opened || !numberOfLogs)
+        {
+            return false;
+        }
+        Segment* segment = (index.numberOfSegments) ? &index.segments[getRingPosition(index.numberOfSegments - 1)] : NULL;
+        if (!dataFile || !segment || segment->epoch != epoch
+            || segment->firstLogId + segment->numberOfLogs != firstLogId
+            || (segment->size && segment->size + size > LOG_SEGMENT_SIZE))
+        {
+            if (!startSegment(epoch, firstLogId))
+            {
+                return false;
+            }
+            segment = &index.segments[getRingPosition(index.numberOfSegments - 1)];
+        }
+
+        // offsets in segment are written in chunks of offsetsBuffer
+        for (unsigned int i = 0; i < numberOfLogs; i += maxNumberOfLogsPerRead)
+        {
+            const unsigned int n = (numberOfLogs - i < maxNumberOfLogsPerRead) ? numberOfLogs - i : maxNumberOfLogsPerRead;
+            for (unsigned int j = 0; j < n; j++)
+            {
+                offsetsBuffer[j] = (unsigned int)(segment->size + logOffsets[i + j]);
+            }
+            if (!writeToFile(offsetsFile, (unsigned char*)offsetsBuffer, n * sizeof(unsigned int)))
+            {
+                closeSegmentFiles();
+                return false;
+            }
+        }
+        if (!writeToFile(dataFile, (const unsigned char*)logs, size)
+            || !flushFile(dataFile) || !flushFile(offsetsFile))
+        {
+            // Data written beyond the size in the index is ignored, the next append starts a new segment
+            closeSegmentFiles();
+            return false;
+        }
+
+        segment->numberOfLogs += numberOfLogs;
+        segment->size += size;
+        return saveIndex();
+    }
+
+    // Find newest segment of epoch containing log logId, returns -1 if there is none
+    int findSegment(unsigned int epoch, unsigned long long logId) const
+    {
+        for (int segment = index.numberOfSegments - 1; segment >= 0; segment--)
+        {
+            const Segment& s = index.segments[getRingPosition(segment)];
+            if (s.epoch == epoch && logId >= s.firstLogId && logId < s.firstLogId + s.numberOfLogs)
+            {
+                return segment;
+            }
+        }
+        return -1;
+    }
+
+    // Read logs fromID to toID (inclusive) of epoch into buffer, but not more than maxSize bytes, not more than
+    // maxNumberOfLogsPerRead logs, and not beyond the end of the segment containing fromID. At least the log fromID is
+    // read if it is found and fits into maxSize. Returns number of bytes read (nextID is set to the first log ID not
+    // read), logTooLarge if log fromID doesn't fit into maxSize, or -1 if log fromID isn't found or can't be read.
+    long long read(unsigned int epoch, unsigned long long fromID, unsigned long long toID, unsigned long long maxSize, char* buffer, unsigned long long& nextID)
+    {
+        const int segmentNumber = (fromID <= toID) ? findSegment(epoch, fromID) : -1;
+        if (segmentNumber < 0)
+        {
+            return -1;
+        }
+        const unsigned int ringPosition = getRingPosition(segmentNumber);
+        const Segment& segment = index.segments[ringPosition];
+        const unsigned long long segmentEndID = segment.firstLogId + segment.numberOfLogs;
+
+        // Read offsets of logs fromID to lastID and of the log behind lastID, if it is in the segment
+        unsigned long long lastID = (toID < segmentEndID - 1) ? toID : segmentEndID - 1;
+        if (lastID - fromID >= maxNumberOfLogsPerRead)
+        {
+            lastID = fromID + maxNumberOfLogsPerRead - 1;
+        }
+        const unsigned int numberOfOffsets = (unsigned int)(lastID - fromID + 1 + (lastID + 1 < segmentEndID));
+        CHAR16 fileName[64];
+        getFileName(LOG_SEGMENT_OFFSETS_FILE_NAME, ringPosition, fileName);
+        if (loadPart(fileName, (fromID - segment.firstLogId) * sizeof(unsigned int), numberOfOffsets * sizeof(unsigned int), (unsigned char*)offsetsBuffer, directory) != numberOfOffsets * sizeof(unsigned int))
+        {
+            return -1;
+        }
+        if (lastID + 1 == segmentEndID)
+        {
+            offsetsBuffer[numberOfOffsets] = (unsigned int)segment.size;
+        }
+
+        // Reduce to logs fitting into maxSize
+        unsigned int numberOfLogs = (unsigned int)(lastID - fromID + 1);
+        while (numberOfLogs && offsetsBuffer[numberOfLogs] - offsetsBuffer[0] > maxSize)
+        {
+            numberOfLogs--;
+        }
+        if (!numberOfLogs)
+        {
+            return logTooLarge;
+        }
+
+        const unsigned long long size = offsetsBuffer[numberOfLogs] - offsetsBuffer[0];
+        getFileName(LOG_SEGMENT_FILE_NAME, ringPosition, fileName);
+        if (loadPart(fileName, offsetsBuffer[0], size, (unsigned char*)buffer, directory) != (long long)size)
+        {
+            return -1;
+        }
+        nextID = fromID + numberOfLogs;
+        return size;
+    }
+};
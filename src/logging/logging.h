@@ -7,12 +7,15 @@
 #include "platform/debugging.h"
 
 #include "network_messages/header.h"
+#include "network_messages/common_def.h"
 
 #include "private_settings.h"
 #include "public_settings.h"
 #include "system.h"
 #include "kangaroo_twelve.h"
 
+#include "logging/log_segments.h"
+
 struct Peer;
 
 #define LOG_UNIVERSE (LOG_ASSET_ISSUANCES | LOG_ASSET_OWNERSHIP_CHANGES | LOG_ASSET_POSSESSION_CHANGES)
@@ -34,8 +37,24 @@ struct Peer;
 #define LOG_TX_PER_TICK (NUMBER_OF_TRANSACTIONS_PER_TICK + LOG_TX_NUMBER_OF_SPECIAL_EVENT)// +5 special events
 #define LOG_TX_INFO_STORAGE (MAX_NUMBER_OF_TICKS_PER_EPOCH * LOG_TX_PER_TICK) 
 #define LOG_HEADER_SIZE 26 // 2 bytes epoch + 4 bytes tick + 4 bytes log size/types + 8 bytes log id + 8 bytes log digest
+#ifndef LOG_INDEX_POSTINGS
+#define LOG_INDEX_POSTINGS 33554432ULL // Number of (key, log ID) entries in secondary log index, must be power of 2
+#endif
+#ifndef LOG_INDEX_KEYS
+#define LOG_INDEX_KEYS 4194304ULL // Number of keys (message types, entities, contracts) in secondary log index, must be power of 2
+#endif
+#define LOG_FILE_BUFFER_SIZE (32ULL << 20) // Buffer for persisting logs to disk and reading them, holds a log of maximum size
+#define LOG_FLUSH_STEP_SIZE (8ULL << 20) // Maximum size of logs persisted per main loop iteration
+#define LOG_DISK_READ_SIZE (1ULL << 20) // Maximum size of logs read from disk per main loop iteration
+#define LOG_DISK_READ_QUEUE_LENGTH 64
+#define LOG_DIGEST_BATCH_SIZE 1024 // Maximum number of logs whose digests are computed together by updateDigests()
+#define LOG_INDEX_KEY_PROBES 4
+#define LOG_INDEX_MAX_KEYS_PER_LOG 4 // message type + up to 3 public keys
+#ifndef LOG_INDEX_MAX_POSTINGS_PER_QUERY
+#define LOG_INDEX_MAX_POSTINGS_PER_QUERY 65536 // Maximum number of index entries visited per RequestIndexedLogs
+#endif
 
-// Fetches log
+// Fetches log (the logs of a tick are available after the tick has been processed)
 struct RequestLog
 {
     unsigned long long passcode[4];
@@ -58,6 +77,60 @@ struct RespondLog
 };
 
 
+// Fetches log like RequestLog, but the range may be larger and cross the wrap-around of the circular log buffer.
+// The response is a sequence of RespondLog packets, each with complete logs in order of log ID, followed by
+// EndResponse. About maxResponseSize bytes of logs are sent per request at most. If the ID of the last log received
+// is less than toID, the client continues with fromID = last log ID + 1 (cursor). If log fromID isn't available,
+// only EndResponse is sent.
+struct RequestLogStream
+{
+    unsigned long long passcode[4];
+    unsigned long long fromID;
+    unsigned long long toID; // inclusive
+
+    static constexpr unsigned long long maxPacketSize = 4ULL << 20;
+    static constexpr unsigned long long maxResponseSize = 16ULL << 20;
+
+    enum {
+        type = 54,
+    };
+};
+
+
+// Fetches the latest logs (at most maxNumberOfLogs) with ID in [fromID, toID] matching a filter, using the secondary
+// log index: all logs of a message type, all logs involving an entity (as source, destination, or issuer in QU
+// transfers, asset and burning logs), or all messages of a contract. The response is a sequence of RespondLog packets,
+// each with one log, in order of log ID, followed by EndResponse. If maxNumberOfLogs logs are received, the client may
+// continue with toID = first log ID - 1 to get older logs. The index and the number of index entries visited per request
+// are bounded, so old logs may not be found even if they are still in the log buffer. Without LOG_INDEX, the response
+// is just EndResponse.
+struct RequestIndexedLogs
+{
+    unsigned long long passcode[4];
+    unsigned long long fromID;
+    unsigned long long toID; // inclusive
+    m256i publicKey; // used if filterType == byEntity
+    unsigned int contractIndex; // used if filterType == byContract
+    unsigned char messageType; // used if filterType == byMessageType
+    unsigned char filterType;
+    unsigned char _padding[2];
+
+    enum {
+        byMessageType = 0,
+        byEntity = 1,
+        byContract = 2,
+    };
+
+    static constexpr unsigned int maxNumberOfLogs = 1024;
+
+    enum {
+        type = 55,
+    };
+};
+
+static_assert(sizeof(RequestIndexedLogs) == 4 * 8 + 2 * 8 + 32 + 8, "Unexpected size");
+
+
 // Request logid ranges from tx hash
 struct RequestLogIdRangeFromTx
 {
@@ -277,10 +350,35 @@ public:
     inline static BlobInfo* mapLogIdToBufferIndex = NULL;
     inline static unsigned long long logBufferTail;
     inline static unsigned long long logId;
+    // ID of the first log whose digest hasn't been computed yet. Written by the tick processor in updateDigests() after
+    // the digests have been stored, read by the request processors and the main processor.
+    inline static volatile unsigned long long digestedLogId;
     inline static unsigned int tickBegin;
     inline static unsigned int currentTxId;
     inline static unsigned int currentTick;
     inline static BlobInfo currentTxInfo;
+    inline static unsigned int resetCounter = 0;
+
+    // Persisting logs to disk and reading logs evicted from logBuffer, both done by the main processor
+    inline static LogSegmentStore logSegments;
+    inline static char* logFileBuffer = NULL;
+    inline static unsigned int* logFileOffsets = NULL;
+    inline static unsigned long long persistedLogId; // ID of the next log to append to the segments
+
+    // Queue of requests for logs that have been evicted from logBuffer, served by processDiskReads()
+    struct DiskRead
+    {
+        Peer* peer;
+        IPv4Address peerAddress;
+        unsigned int dejavu;
+        unsigned int epoch;
+        unsigned long long fromID;
+        unsigned long long toID; // inclusive
+    };
+    inline static DiskRead diskReads[LOG_DISK_READ_QUEUE_LENGTH];
+    inline static unsigned int diskReadsHead = 0;
+    inline static unsigned int diskReadsTail = 0;
+    inline static volatile char diskReadsLock = 0;
     // 5 special txs for 5 special events in qubic
     inline static unsigned int SC_INITIALIZE_TX = NUMBER_OF_TRANSACTIONS_PER_TICK + 0;
     inline static unsigned int SC_BEGIN_EPOCH_TX = NUMBER_OF_TRANSACTIONS_PER_TICK + 1;
@@ -312,6 +410,7 @@ public:
     }
 
     // since we use round buffer, verifying digest for each log is needed to avoid sending out wrong log
+    // (this also rejects logs whose digest hasn't been computed by updateDigests() yet)
     static bool verifyLog(const char* ptr, unsigned long long logId)
     {
 #if ENABLED_LOGGING
@@ -376,6 +475,278 @@ public:
         }
     } logBuf;
 
+    // Secondary index mapping keys (message type, entity, contract) to the IDs of the logs they occur in. Postings
+    // are stored in a circular array in order of log ID, each linking to the previous posting of the same key, so
+    // that the postings of a key are found newest first by following the links from the key's slot. The oldest
+    // postings are overwritten when the array is full and the oldest key slot of a probing sequence is replaced if all
+    // are occupied, so the index has constant size. Queries check the logs found in the log buffer, so entries of
+    // logs that have been overwritten and keys colliding in the hash are filtered out.
+    struct LogIndexKeySlot
+    {
+        unsigned long long key; // 0 means empty
+        unsigned long long lastPosting; // posting number + 1, 0 means none
+    };
+
+    struct LogIndexPosting
+    {
+        unsigned long long logId;
+        unsigned long long previousPosting; // posting number + 1, 0 means none
+    };
+
+    inline static LogIndexKeySlot* logIndexKeys = NULL;
+    inline static LogIndexPosting* logIndexPostings = NULL;
+    inline static unsigned long long logIndexNumberOfPostings;
+
+    static struct logIndexAccess
+    {
+        static void init()
+        {
+            setMem(logIndexKeys, LOG_INDEX_KEYS * sizeof(LogIndexKeySlot), 0);
+            logIndexNumberOfPostings = 0;
+        }
+
+        // Number of public keys at the beginning of a message of messageType (source, destination, issuer)
+        static unsigned int getNumberOfPublicKeys(unsigned char messageType)
+        {
+            switch (messageType)
+            {
+            case QU_TRANSFER: return 2;
+            case ASSET_ISSUANCE: return 1;
+            case ASSET_OWNERSHIP_CHANGE: return 3;
+            case ASSET_POSSESSION_CHANGE: return 3;
+            case BURNING: return 1;
+            default: return 0;
+            }
+        }
+
+        static bool isContractMessage(unsigned char messageType)
+        {
+            return messageType >= CONTRACT_ERROR_MESSAGE && messageType <= CONTRACT_DEBUG_MESSAGE;
+        }
+
+        static unsigned long long getKey(unsigned char filterType, unsigned long long value)
+        {
+            // cheap mixing is enough, because the lower bits of public keys are random already
+            unsigned long long key = (value ^ ((filterType + 1ULL) * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+            key ^= key >> 31;
+            return key ? key : 1;
+        }
+
+        // Get keys of a message (without duplicates), returns number of keys
+        static unsigned int getKeys(unsigned char messageType, const char* message, unsigned int messageSize, unsigned long long* keys)
+        {
+            unsigned int numberOfKeys = 0;
+            keys[numberOfKeys++] = getKey(RequestIndexedLogs::byMessageType, messageType);
+            const unsigned int numberOfPublicKeys = getNumberOfPublicKeys(messageType);
+            if (messageSize >= numberOfPublicKeys * sizeof(m256i))
+            {
+                for (unsigned int i = 0; i < numberOfPublicKeys; i++)
+                {
+                    const unsigned long long key = getKey(RequestIndexedLogs::byEntity, *((const unsigned long long*)(message + i * sizeof(m256i))));
+                    unsigned int j = 1;
+                    while (j < numberOfKeys && keys[j] != key)
+                    {
+                        j++;
+                    }
+                    if (j == numberOfKeys)
+                    {
+                        keys[numberOfKeys++] = key;
+                    }
+                }
+            }
+            if (isContractMessage(messageType) && messageSize >= sizeof(unsigned int))
+            {
+                keys[numberOfKeys++] = getKey(RequestIndexedLogs::byContract, *((const unsigned int*)message));
+            }
+            ASSERT(numberOfKeys <= LOG_INDEX_MAX_KEYS_PER_LOG);
+            return numberOfKeys;
+        }
+
+        // Find slot of key, or NULL if key isn't in index
+        static LogIndexKeySlot* findSlot(unsigned long long key)
+        {
+            for (unsigned int i = 0; i < LOG_INDEX_KEY_PROBES; i++)
+            {
+                LogIndexKeySlot& slot = logIndexKeys[(key + i) & (LOG_INDEX_KEYS - 1)];
+                if (slot.key == key)
+                {
+                    return &slot;
+                }
+            }
+            return NULL;
+        }
+
+        // Add log with ID logId to the index, called by logMessage()
+        static void add(unsigned long long logId, unsigned char messageType, const char* message, unsigned int messageSize)
+        {
+            unsigned long long keys[LOG_INDEX_MAX_KEYS_PER_LOG];
+            const unsigned int numberOfKeys = getKeys(messageType, message, messageSize, keys);
+            for (unsigned int k = 0; k < numberOfKeys; k++)
+            {
+                LogIndexKeySlot* slot = findSlot(keys[k]);
+                if (!slot)
+                {
+                    // use empty slot or replace the one with the oldest postings
+                    slot = &logIndexKeys[keys[k] & (LOG_INDEX_KEYS - 1)];
+                    for (unsigned int i = 0; i < LOG_INDEX_KEY_PROBES && slot->key; i++)
+                    {
+                        LogIndexKeySlot& candidate = logIndexKeys[(keys[k] + i) & (LOG_INDEX_KEYS - 1)];
+                        if (!candidate.key || candidate.lastPosting < slot->lastPosting)
+                        {
+                            slot = &candidate;
+                        }
+                    }
+                    slot->key = keys[k];
+                    slot->lastPosting = 0;
+                }
+
+                LogIndexPosting& posting = logIndexPostings[logIndexNumberOfPostings & (LOG_INDEX_POSTINGS - 1)];
+                posting.logId = logId;
+                posting.previousPosting = slot->lastPosting;
+                slot->lastPosting = ++logIndexNumberOfPostings;
+            }
+        }
+
+        // Check that log logId is in the log buffer and matches the filter of the request
+        static bool matches(unsigned long long logId, const RequestIndexedLogs& request)
+        {
+            const BlobInfo info = logBuf.getBlobInfo(logId);
+            if (info.startIndex < 0)
+            {
+                return false;
+            }
+            const char* log = logBuffer + info.startIndex;
+            const unsigned char messageType = (unsigned char)(*((unsigned int*)(log + 6)) >> 24);
+            const unsigned int messageSize = getLogSize(log);
+            const char* message = log + LOG_HEADER_SIZE;
+            switch (request.filterType)
+            {
+            case RequestIndexedLogs::byMessageType:
+                return messageType == request.messageType;
+            case RequestIndexedLogs::byEntity:
+            {
+                const unsigned int numberOfPublicKeys = getNumberOfPublicKeys(messageType);
+                if (messageSize >= numberOfPublicKeys * sizeof(m256i))
+                {
+                    for (unsigned int i = 0; i < numberOfPublicKeys; i++)
+                    {
+                        // messages in log buffer aren't aligned
+                        m256i publicKey;
+                        copyMem(&publicKey, message + i * sizeof(m256i), sizeof(m256i));
+                        if (publicKey == request.publicKey)
+                        {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+            case RequestIndexedLogs::byContract:
+                return isContractMessage(messageType) && messageSize >= sizeof(unsigned int) && *((const unsigned int*)message) == request.contractIndex;
+            }
+            return false;
+        }
+
+        // Find the latest logs (at most maxNumberOfLogs) with ID in [request.fromID, request.toID] matching the filter
+        // of the request. The IDs are written to logIds in ascending order, returns number of logs found. At most
+        // LOG_INDEX_MAX_POSTINGS_PER_QUERY entries are visited, so older logs of frequent keys may be missing.
+        static unsigned int find(const RequestIndexedLogs& request, unsigned long long* logIds, unsigned int maxNumberOfLogs)
+        {
+            unsigned long long value;
+            switch (request.filterType)
+            {
+            case RequestIndexedLogs::byMessageType: value = request.messageType; break;
+            case RequestIndexedLogs::byEntity: value = request.publicKey.m256i_u64[0]; break;
+            case RequestIndexedLogs::byContract: value = request.contractIndex; break;
+            default: return 0;
+            }
+            const LogIndexKeySlot* slot = findSlot(getKey(request.filterType, value));
+            if (!slot)
+            {
+                return 0;
+            }
+
+            unsigned int numberOfLogs = 0;
+            unsigned int numberOfVisitedPostings = 0;
+            unsigned long long posting = slot->lastPosting;
+            while (posting && numberOfLogs < maxNumberOfLogs && numberOfVisitedPostings++ < LOG_INDEX_MAX_POSTINGS_PER_QUERY)
+            {
+                // stop at postings that have been overwritten
+                if (posting + LOG_INDEX_POSTINGS <= logIndexNumberOfPostings)
+                {
+                    break;
+                }
+                const LogIndexPosting& entry = logIndexPostings[(posting - 1) & (LOG_INDEX_POSTINGS - 1)];
+                if (entry.logId < request.fromID)
+                {
+                    break;
+                }
+                if (entry.logId <= request.toID && matches(entry.logId, request))
+                {
+                    logIds[numberOfLogs++] = entry.logId;
+                }
+                if (entry.previousPosting >= posting)
+                {
+                    break;
+                }
+                posting = entry.previousPosting;
+            }
+
+            for (unsigned int i = 0; i < numberOfLogs / 2; i++)
+            {
+                const unsigned long long tmp = logIds[i];
+                logIds[i] = logIds[numberOfLogs - 1 - i];
+                logIds[numberOfLogs - 1 - i] = tmp;
+            }
+            return numberOfLogs;
+        }
+    } logIndex;
+
+    // Get next packet of a log stream: range in logBuffer holding the logs from fromID (inclusive) to toID (inclusive)
+    // or less, so that the range doesn't cross the wrap-around of the buffer and doesn't exceed maxSize bytes (unless
+    // the log fromID alone is larger). Returns false if log fromID isn't available. Otherwise, nextID is set to the
+    // ID of the first log not included.
+    static bool getLogStreamPacket(unsigned long long fromID, unsigned long long toID, unsigned long long maxSize, BlobInfo& packet, unsigned long long& nextID)
+    {
+        // Digests of logs before endID are stored, read them after reading endID
+        const unsigned long long endID = digestedLogId;
+        _mm_lfence();
+
+        packet = logBuf.getBlobInfo(fromID);
+        if (packet.startIndex < 0 || packet.length < 0 || fromID > toID)
+        {
+            return false;
+        }
+
+        // Append following logs as long as they are stored directly behind each other, which is checked with the
+        // cheap log ID comparison instead of computing the digest of each log
+        unsigned long long lastID = fromID;
+        long long lastStartIndex = packet.startIndex;
+        while (lastID < toID && lastID + 1 < endID)
+        {
+            const BlobInfo& next = mapLogIdToBufferIndex[(lastID + 1) % LOG_MAX_STORAGE_ENTRIES];
+            if (next.startIndex != packet.startIndex + packet.length
+                || packet.length + next.length > (long long)maxSize
+                || getLogId(logBuffer + next.startIndex) != lastID + 1)
+            {
+                break;
+            }
+            lastStartIndex = next.startIndex;
+            packet.length += next.length;
+            ++lastID;
+        }
+
+        // The buffer is overwritten sequentially, so the logs between the first and the last log are intact if both
+        // are. The first has been verified by getBlobInfo(). If the last isn't intact, only send the first.
+        if (lastID != fromID && !verifyLog(logBuffer + lastStartIndex, lastID))
+        {
+            packet.length = logBuf.getBlobInfo(fromID).length;
+            lastID = fromID;
+        }
+        nextID = lastID + 1;
+        return true;
+    }
+
 
     // Struct to map log id ranges from tx hash
     static struct mapTxToLogIdAccess
@@ -431,6 +802,130 @@ public:
     } tx;
 #endif
 
+    // Open the on-disk log segments in directory, after which the main loop persists logs with flushToDisk()
+    // and serves requests for evicted logs with processDiskReads()
+    static bool openLogSegments(const CHAR16* directory)
+    {
+#if ENABLED_LOGGING
+        static_assert(LOG_FILE_BUFFER_SIZE >= RequestResponseHeader::max_size + LOG_HEADER_SIZE, "Log file buffer must hold log of maximum size");
+        static_assert(LOG_FILE_BUFFER_SIZE >= LOG_DISK_READ_SIZE, "Log file buffer too small");
+        if (logFileBuffer == NULL)
+        {
+            if (!allocatePool(LOG_FILE_BUFFER_SIZE, (void**)&logFileBuffer))
+            {
+                logToConsole(L"Failed to allocate logging buffer!");
+
+                return false;
+            }
+        }
+        if (logFileOffsets == NULL)
+        {
+            if (!allocatePool((LOG_FILE_BUFFER_SIZE / LOG_HEADER_SIZE + 1) * sizeof(unsigned int), (void**)&logFileOffsets))
+            {
+                logToConsole(L"Failed to allocate logging buffer!");
+
+                return false;
+            }
+        }
+
+        // The node opens the segments before its epoch is known, so the log to continue persisting with is determined
+        // by reset()
+        logSegments.open(directory);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Get ID of the first log to persist after reset: behind the logs of the epoch persisted before a restart of the
+    // node, 0 if there are none. Logs that haven't been persisted before the restart are lost, flushToDisk() skips them.
+    static unsigned long long getFirstLogIdToPersist(unsigned int epoch)
+    {
+#if ENABLED_LOGGING
+        const unsigned int numberOfSegments = logSegments.getNumberOfSegments();
+        if (logSegments.isOpen() && numberOfSegments)
+        {
+            const LogSegmentStore::Segment& lastSegment = logSegments.getSegment(numberOfSegments - 1);
+            if (lastSegment.epoch == epoch)
+            {
+                return lastSegment.firstLogId + lastSegment.numberOfLogs;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    // Append the next complete logs that haven't been persisted yet (up to maxSize bytes) to the on-disk segments
+    static void flushToDisk(unsigned long long maxSize)
+    {
+#if ENABLED_LOGGING
+        if (!logSegments.isOpen())
+        {
+            return;
+        }
+        const unsigned int counter = resetCounter;
+        const unsigned long long fromID = persistedLogId;
+        // Logs are complete once their digest has been computed
+        const unsigned long long endID = digestedLogId;
+        _mm_lfence();
+        if (fromID >= endID)
+        {
+            return;
+        }
+        if (maxSize > LOG_FILE_BUFFER_SIZE)
+        {
+            maxSize = LOG_FILE_BUFFER_SIZE;
+        }
+        const unsigned long long toID = endID - 1;
+
+        BlobInfo packet;
+        unsigned long long nextID;
+        if (!getLogStreamPacket(fromID, toID, maxSize, packet, nextID))
+        {
+            // Log fromID has been overwritten before persisting it, continue with the oldest log available (the
+            // available logs are the newest ones, so binary search can be used)
+            unsigned long long low = fromID + 1, high = toID;
+            while (low < high)
+            {
+                const unsigned long long middle = (low + high) / 2;
+                if (logBuf.getBlobInfo(middle).startIndex >= 0)
+                {
+                    high = middle;
+                }
+                else
+                {
+                    low = middle + 1;
+                }
+            }
+            if (counter == resetCounter)
+            {
+                persistedLogId = low;
+            }
+            return;
+        }
+
+        // The buffer is overwritten sequentially, so the copy is intact if the first log still is after copying
+        copyMem(logFileBuffer, logBuffer + packet.startIndex, packet.length);
+        if (!verifyLog(logBuffer + packet.startIndex, fromID))
+        {
+            return;
+        }
+        unsigned int numberOfLogs = 0;
+        for (long long offset = 0; offset < packet.length; offset += LOG_HEADER_SIZE + getLogSize(logFileBuffer + offset))
+        {
+            logFileOffsets[numberOfLogs++] = (unsigned int)offset;
+        }
+        ASSERT(numberOfLogs == nextID - fromID);
+
+        // If writing fails, the logs are skipped like logs overwritten before persisting
+        logSegments.append(*((unsigned short*)logFileBuffer), fromID, logFileBuffer, packet.length, logFileOffsets, numberOfLogs);
+        if (counter == resetCounter)
+        {
+            persistedLogId = nextID;
+        }
+#endif
+    }
+
     static void registerNewTx(const unsigned int tick, const unsigned int txId)
     {
 #if ENABLED_LOGGING
@@ -471,6 +966,28 @@ public:
                 return false;
             }
         }
+
+#if LOG_INDEX
+        if (logIndexKeys == NULL)
+        {
+            if (!allocatePool(LOG_INDEX_KEYS * sizeof(LogIndexKeySlot), (void**)&logIndexKeys))
+            {
+                logToConsole(L"Failed to allocate log index buffer!");
+
+                return false;
+            }
+        }
+
+        if (logIndexPostings == NULL)
+        {
+            if (!allocatePool(LOG_INDEX_POSTINGS * sizeof(LogIndexPosting), (void**)&logIndexPostings))
+            {
+                logToConsole(L"Failed to allocate log index buffer!");
+
+                return false;
+            }
+        }
+#endif
         reset(0);
 #endif
         return true;
@@ -494,6 +1011,27 @@ public:
             freePool(mapLogIdToBufferIndex);
             mapLogIdToBufferIndex = nullptr;
         }
+        if (logIndexKeys)
+        {
+            freePool(logIndexKeys);
+            logIndexKeys = nullptr;
+        }
+        if (logIndexPostings)
+        {
+            freePool(logIndexPostings);
+            logIndexPostings = nullptr;
+        }
+        logSegments.close();
+        if (logFileBuffer)
+        {
+            freePool(logFileBuffer);
+            logFileBuffer = nullptr;
+        }
+        if (logFileOffsets)
+        {
+            freePool(logFileOffsets);
+            logFileOffsets = nullptr;
+        }
 #endif
     }
 
@@ -502,8 +1040,14 @@ public:
 #if ENABLED_LOGGING
         logBuf.init();
         tx.init();
+#if LOG_INDEX
+        logIndex.init();
+#endif
         logBufferTail = 0;
         logId = 0;
+        digestedLogId = 0;
+        persistedLogId = getFirstLogIdToPersist(system.epoch);
+        resetCounter++;
         tickBegin = _tickBegin;
 #endif
     }
@@ -517,18 +1061,60 @@ public:
             logBufferTail = 0; // reset back to beginning
         }
         logBuf.set(logId, logBufferTail, LOG_HEADER_SIZE + messageSize);
+#if LOG_INDEX
+        logIndex.add(logId, messageType, (const char*)message, messageSize);
+#endif
         *((unsigned short*)(logBuffer + (logBufferTail))) = system.epoch;
         *((unsigned int*)(logBuffer + (logBufferTail + 2))) = system.tick;
         *((unsigned int*)(logBuffer + (logBufferTail + 6))) = messageSize | (messageType << 24);
         *((unsigned long long*)(logBuffer + (logBufferTail + 10))) = logId++;
-        unsigned long long logDigest = 0;
-        KangarooTwelve(message, messageSize, &logDigest, 8);
-        *((unsigned long long*)(logBuffer + (logBufferTail + 18))) = logDigest;
+        *((unsigned long long*)(logBuffer + (logBufferTail + 18))) = 0; // digest is set by updateDigests()
         copyMem(logBuffer + (logBufferTail + LOG_HEADER_SIZE), message, messageSize);
         logBufferTail += LOG_HEADER_SIZE + messageSize;
 #endif
     }
 
+    // Compute the digests of the logs written since the last call, making them available to readers. Called by the
+    // tick processor at the end of each tick, so that logMessage() only needs to copy the message and the digests are
+    // computed in batches with the multi-lane KangarooTwelve. Digests are set in order of log ID, so a log is complete
+    // if its digest and the digest of a later log are valid (see getLogStreamPacket()).
+    static void updateDigests()
+    {
+#if ENABLED_LOGGING
+        char* logs[LOG_DIGEST_BATCH_SIZE];
+        const unsigned char* messages[LOG_DIGEST_BATCH_SIZE];
+        unsigned int messageSizes[LOG_DIGEST_BATCH_SIZE];
+        unsigned long long digests[LOG_DIGEST_BATCH_SIZE];
+        unsigned char* digestPointers[LOG_DIGEST_BATCH_SIZE];
+        while (digestedLogId < logId)
+        {
+            const unsigned long long endID = (logId - digestedLogId > LOG_DIGEST_BATCH_SIZE) ? digestedLogId + LOG_DIGEST_BATCH_SIZE : logId;
+            unsigned int numberOfLogs = 0;
+            for (unsigned long long id = digestedLogId; id < endID; id++)
+            {
+                // Logs that have already been overwritten are skipped
+                const BlobInfo& info = mapLogIdToBufferIndex[id % LOG_MAX_STORAGE_ENTRIES];
+                if (info.startIndex < 0 || getLogId(logBuffer + info.startIndex) != id)
+                {
+                    continue;
+                }
+                logs[numberOfLogs] = logBuffer + info.startIndex;
+                messages[numberOfLogs] = (const unsigned char*)(logs[numberOfLogs] + LOG_HEADER_SIZE);
+                messageSizes[numberOfLogs] = getLogSize(logs[numberOfLogs]);
+                digestPointers[numberOfLogs] = (unsigned char*)&digests[numberOfLogs];
+                numberOfLogs++;
+            }
+            KangarooTwelveMultiple(messages, messageSizes, digestPointers, numberOfLogs, 8);
+            for (unsigned int i = 0; i < numberOfLogs; i++)
+            {
+                *((unsigned long long*)(logs[i] + 18)) = digests[i];
+            }
+            _mm_sfence(); // publish digests before digestedLogId
+            digestedLogId = endID;
+        }
+#endif
+    }
+
     template <typename T>
     void logQuTransfer(T message)
     {
@@ -656,6 +1242,18 @@ public:
     // get logging content from log ID
     static void processRequestLog(Peer* peer, RequestResponseHeader* header);
 
+    // queue request for logs evicted from the log buffer, returns false if they can't be read from disk
+    static bool enqueueDiskRead(Peer* peer, unsigned int dejavu, unsigned long long fromID, unsigned long long toID);
+
+    // serve next queued request for evicted logs from disk, called by the main loop
+    static void processDiskReads();
+
+    // get logging content of a range of log IDs in several packets
+    static void processRequestLogStream(Peer* peer, RequestResponseHeader* header);
+
+    // get logs matching a filter (message type, entity, contract) using the secondary log index
+    static void processRequestIndexedLogs(Peer* peer, RequestResponseHeader* header);
+
     // convert from tx id to log ID
     static void processRequestTxLogInfo(Peer* peer, RequestResponseHeader* header);
 
@@ -4,7 +4,8 @@
 #include "network_core/peers.h"
 
 
-// Request: ranges of log ID
+// Request: ranges of log ID. Logs evicted from the log buffer are read from the on-disk segments by the main loop,
+// see processDiskReads().
 void qLogger::processRequestLog(Peer* peer, RequestResponseHeader* header)
 {
 #if ENABLED_LOGGING
@@ -53,7 +54,8 @@ void qLogger::processRequestLog(Peer* peer, RequestResponseHeader* header)
             }
             enqueueResponse(peer, (unsigned int)(length), RespondLog::type, header->dejavu(), logBuffer + startFrom);
         }
-        else
+        else if (startIdBufferRange.startIndex != -1 || request->fromID >= digestedLogId
+            || !enqueueDiskRead(peer, header->dejavu(), request->fromID, request->toID))
         {
             enqueueResponse(peer, 0, RespondLog::type, header->dejavu(), NULL);
         }
@@ -63,6 +65,132 @@ void qLogger::processRequestLog(Peer* peer, RequestResponseHeader* header)
     enqueueResponse(peer, 0, RespondLog::type, header->dejavu(), NULL);
 }
 
+bool qLogger::enqueueDiskRead(Peer* peer, unsigned int dejavu, unsigned long long fromID, unsigned long long toID)
+{
+#if ENABLED_LOGGING
+    if (!logSegments.isOpen() || fromID > toID)
+    {
+        return false;
+    }
+    bool queued = false;
+    ACQUIRE(diskReadsLock);
+    if ((diskReadsHead + 1) % LOG_DISK_READ_QUEUE_LENGTH != diskReadsTail)
+    {
+        DiskRead& diskRead = diskReads[diskReadsHead];
+        diskRead.peer = peer;
+        diskRead.peerAddress = peer->address;
+        diskRead.dejavu = dejavu;
+        diskRead.epoch = system.epoch;
+        diskRead.fromID = fromID;
+        diskRead.toID = toID;
+        diskReadsHead = (diskReadsHead + 1) % LOG_DISK_READ_QUEUE_LENGTH;
+        queued = true;
+    }
+    RELEASE(diskReadsLock);
+    return queued;
+#else
+    return false;
+#endif
+}
+
+// Reads at most LOG_DISK_READ_SIZE bytes per call, so the main loop isn't stalled. Like with RequestLog, the client
+// requests the rest of the range if the response doesn't contain all logs. A single log larger than LOG_DISK_READ_SIZE
+// is read alone, up to the maximum size of a response.
+void qLogger::processDiskReads()
+{
+#if ENABLED_LOGGING
+    ACQUIRE(diskReadsLock);
+    if (diskReadsTail == diskReadsHead)
+    {
+        RELEASE(diskReadsLock);
+        return;
+    }
+    const DiskRead diskRead = diskReads[diskReadsTail];
+    diskReadsTail = (diskReadsTail + 1) % LOG_DISK_READ_QUEUE_LENGTH;
+    RELEASE(diskReadsLock);
+
+    // Skip if the connection has been closed (and the peer slot may have been reused) since queuing
+    if (!diskRead.peer->isConnectedAccepted || diskRead.peer->isClosing || diskRead.peer->address.u32 != diskRead.peerAddress.u32)
+    {
+        return;
+    }
+    unsigned long long nextID;
+    long long size = logSegments.read(diskRead.epoch, diskRead.fromID, diskRead.toID, LOG_DISK_READ_SIZE, logFileBuffer, nextID);
+    if (size == LogSegmentStore::logTooLarge)
+    {
+        size = logSegments.read(diskRead.epoch, diskRead.fromID, diskRead.fromID, RequestResponseHeader::max_size - sizeof(RequestResponseHeader), logFileBuffer, nextID);
+    }
+    if (size > 0 && verifyLog(logFileBuffer, diskRead.fromID))
+    {
+        enqueueResponse(diskRead.peer, (unsigned int)size, RespondLog::type, diskRead.dejavu, logFileBuffer);
+    }
+    else
+    {
+        enqueueResponse(diskRead.peer, 0, RespondLog::type, diskRead.dejavu, NULL);
+    }
+#endif
+}
+
+// Request: range of log IDs, streamed in several packets
+void qLogger::processRequestLogStream(Peer* peer, RequestResponseHeader* header)
+{
+#if ENABLED_LOGGING
+    RequestLogStream* request = header->getPayload<RequestLogStream>();
+    if (request->passcode[0] == logReaderPasscodes[0]
+        && request->passcode[1] == logReaderPasscodes[1]
+        && request->passcode[2] == logReaderPasscodes[2]
+        && request->passcode[3] == logReaderPasscodes[3])
+    {
+        unsigned long long fromID = request->fromID;
+        unsigned long long sentSize = 0;
+        BlobInfo packet;
+        unsigned long long nextID;
+        while (fromID <= request->toID && sentSize < RequestLogStream::maxResponseSize)
+        {
+            unsigned long long maxSize = RequestLogStream::maxResponseSize - sentSize;
+            if (maxSize > RequestLogStream::maxPacketSize)
+            {
+                maxSize = RequestLogStream::maxPacketSize;
+            }
+            if (!getLogStreamPacket(fromID, request->toID, maxSize, packet, nextID))
+            {
+                break;
+            }
+            enqueueResponse(peer, (unsigned int)(packet.length), RespondLog::type, header->dejavu(), logBuffer + packet.startIndex);
+            sentSize += packet.length;
+            fromID = nextID;
+        }
+    }
+#endif
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
+}
+
+// Request: logs matching a filter, found with the secondary log index
+void qLogger::processRequestIndexedLogs(Peer* peer, RequestResponseHeader* header)
+{
+#if ENABLED_LOGGING && LOG_INDEX
+    RequestIndexedLogs* request = header->getPayload<RequestIndexedLogs>();
+    if (request->passcode[0] == logReaderPasscodes[0]
+        && request->passcode[1] == logReaderPasscodes[1]
+        && request->passcode[2] == logReaderPasscodes[2]
+        && request->passcode[3] == logReaderPasscodes[3]
+        && request->fromID <= request->toID)
+    {
+        unsigned long long logIds[RequestIndexedLogs::maxNumberOfLogs];
+        const unsigned int numberOfLogs = logIndex.find(*request, logIds, RequestIndexedLogs::maxNumberOfLogs);
+        for (unsigned int i = 0; i < numberOfLogs; i++)
+        {
+            BlobInfo info = logBuf.getBlobInfo(logIds[i]);
+            if (info.startIndex >= 0)
+            {
+                enqueueResponse(peer, (unsigned int)(info.length), RespondLog::type, header->dejavu(), logBuffer + info.startIndex);
+            }
+        }
+    }
+#endif
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
+}
+
 void qLogger::processRequestTxLogInfo(Peer* peer, RequestResponseHeader* header)
 {
 #if ENABLED_LOGGING
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/parallel_job.h"
+
+#include "kangaroo_twelve.h"
+
+// Helpers for computing complete Merkle trees (such as spectrumDigests and assetDigests) from scratch.
+// The digests of the leafs are stored at the beginning of the digest array, followed by the levels of inner nodes.
+// Large levels are split into chunks that are hashed in parallel by idle processors (see runParallelJob()).
+
+static constexpr unsigned int merkleTreeNodesPerChunk = 65536;
+
+struct MerkleTreeHashingContext
+{
+    const unsigned char* input;
+    unsigned int inputSize;
+    m256i* output;
+    unsigned int numberOfNodes;
+};
+
+static void hashMerkleTreeNodesChunk(void* context, unsigned int chunkIndex)
+{
+    const MerkleTreeHashingContext* ctx = (const MerkleTreeHashingContext*)context;
+    const unsigned int beginIndex = chunkIndex * merkleTreeNodesPerChunk;
+    const unsigned int endIndex = (ctx->numberOfNodes - beginIndex > merkleTreeNodesPerChunk) ? beginIndex + merkleTreeNodesPerChunk : ctx->numberOfNodes;
+    if (ctx->inputSize == 64)
+    {
+        KangarooTwelve64To32Multiple(ctx->input + beginIndex * 64ULL, &ctx->output[beginIndex], endIndex - beginIndex);
+    }
+    else
+    {
+        for (unsigned int i = beginIndex; i < endIndex; i++)
+        {
+            KangarooTwelve(ctx->input + i * (unsigned long long)ctx->inputSize, ctx->inputSize, &ctx->output[i], 32);
+        }
+    }
+}
+
+// Hash numberOfNodes consecutive inputs of inputSize bytes each to consecutive digests in output
+static void hashMerkleTreeNodes(const void* input, unsigned int inputSize, m256i* output, unsigned int numberOfNodes)
+{
+    MerkleTreeHashingContext context;
+    context.input = (const unsigned char*)input;
+    context.inputSize = inputSize;
+    context.output = output;
+    context.numberOfNodes = numberOfNodes;
+
+    const unsigned int numberOfChunks = (numberOfNodes + merkleTreeNodesPerChunk - 1) / merkleTreeNodesPerChunk;
+    if (numberOfChunks > 1)
+    {
+        runParallelJob(hashMerkleTreeNodesChunk, &context, numberOfChunks);
+    }
+    else if (numberOfChunks)
+    {
+        hashMerkleTreeNodesChunk(&context, 0);
+    }
+}
+
+// Compute the inner nodes of the Merkle tree, whose numberOfLeafs leaf digests are at the beginning of digests.
+// numberOfLeafs must be 2^N.
+static void computeMerkleTreeInnerNodes(m256i* digests, unsigned int numberOfLeafs)
+{
+    unsigned int digestIndex = numberOfLeafs;
+    unsigned int previousLevelBeginning = 0;
+    while (numberOfLeafs > 1)
+    {
+        hashMerkleTreeNodes(&digests[previousLevelBeginning], 64, &digests[digestIndex], numberOfLeafs >> 1);
+
+        previousLevelBeginning += numberOfLeafs;
+        digestIndex += numberOfLeafs >> 1;
+        numberOfLeafs >>= 1;
+    }
+}
+
+// Compute all (numberOfLeafs * 2 - 1) digests of the Merkle tree of numberOfLeafs leafs of leafSize bytes each.
+// numberOfLeafs must be 2^N.
+static void computeMerkleTree(const void* leafs, unsigned int leafSize, m256i* digests, unsigned int numberOfLeafs)
+{
+    hashMerkleTreeNodes(leafs, leafSize, digests, numberOfLeafs);
+    computeMerkleTreeInnerNodes(digests, numberOfLeafs);
+}
@@ -10,6 +10,12 @@
 #include "network_messages/common_def.h"
 #include "network_messages/header.h"
 #include "network_messages/common_response.h"
+#include "network_messages/broadcast_message.h"
+#include "network_messages/computors.h"
+#include "network_messages/public_peers.h"
+#include "network_messages/special_command.h"
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
 
 #include "tcp4.h"
 #include "kangaroo_twelve.h"
@@ -40,6 +46,8 @@ struct Peer
     EFI_TCP4_LISTEN_TOKEN connectAcceptToken;
     IPv4Address address;
     void* receiveBuffer;
+    // Offset of first unprocessed byte in receiveBuffer (FragmentBuffer points behind last received byte)
+    unsigned int receiveBufferReadOffset;
     EFI_TCP4_RECEIVE_DATA receiveData;
     EFI_TCP4_IO_TOKEN receiveToken;
     EFI_TCP4_TRANSMIT_DATA transmitData;
@@ -64,6 +72,9 @@ typedef struct
 static Peer peers[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
 static volatile long long numberOfReceivedBytes = 0, prevNumberOfReceivedBytes = 0;
 static volatile long long numberOfTransmittedBytes = 0, prevNumberOfTransmittedBytes = 0;
+// Bytes copied when moving received messages to the request queue / when moving partial messages in receive buffers
+static volatile long long numberOfRequestQueueCopiedBytes = 0, prevNumberOfRequestQueueCopiedBytes = 0;
+static volatile long long numberOfReceiveBufferCopiedBytes = 0, prevNumberOfReceiveBufferCopiedBytes = 0;
 static int numberOfAcceptedIncommingConnection = 0;
 
 static volatile char publicPeersLock = 0;
@@ -82,11 +93,54 @@ static volatile long long numberOfDisseminatedRequests = 0, prevNumberOfDissemin
 static unsigned char* requestQueueBuffer = NULL;
 static unsigned char* responseQueueBuffer = NULL;
 
-static struct Request
+// Received requests are queued in separate lanes, so that consensus-critical messages don't wait behind floods of
+// transactions or client queries. Each lane has its own part of requestQueueBuffer (byte budget), its own ring of
+// elements with lock, and its own drop policy. Request processors dequeue with weighted round robin
+// (see requestQueueLaneSchedule).
+#define REQUEST_QUEUE_LANE_CONSENSUS 0 // ticks, tick data, computors, peers, special commands
+#define REQUEST_QUEUE_LANE_TRANSACTIONS 1 // transactions and broadcasted messages
+#define REQUEST_QUEUE_LANE_QUERIES 2 // all other requests, mostly from clients (entities, assets, contract functions, logs, ...)
+#define NUMBER_OF_REQUEST_QUEUE_LANES 3
+
+static constexpr unsigned int requestQueueLaneBufferSizes[NUMBER_OF_REQUEST_QUEUE_LANES] = { 268435456, 268435456, 536870912 };
+static_assert(requestQueueLaneBufferSizes[0] + requestQueueLaneBufferSizes[1] + requestQueueLaneBufferSizes[2] == REQUEST_QUEUE_BUFFER_SIZE, "Lane buffers must add up to REQUEST_QUEUE_BUFFER_SIZE");
+
+// Lane to try first per dequeue, 4:2:1 weighting (other lanes are tried in order of priority if it is empty)
+static constexpr unsigned char requestQueueLaneSchedule[] = {
+    REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_TRANSACTIONS, REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_QUERIES,
+    REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_TRANSACTIONS, REQUEST_QUEUE_LANE_CONSENSUS
+};
+
+struct Request
 {
     Peer* peer;
     unsigned int offset;
-} requestQueueElements[REQUEST_QUEUE_LENGTH];
+    unsigned long long enqueueTick;
+};
+
+static struct RequestQueueLane
+{
+    unsigned char* buffer;
+    unsigned int bufferSize;
+    volatile unsigned int bufferHead, bufferTail;
+    volatile unsigned short elementHead, elementTail;
+    volatile char tailLock;
+
+    volatile long long numberOfDiscardedRequests;
+    volatile unsigned long long waitingTicksNumerator, waitingTicksDenominator;
+
+    Request elements[REQUEST_QUEUE_LENGTH];
+
+    unsigned int filledBufferSize() const
+    {
+        return (bufferHead >= bufferTail) ? (bufferHead - bufferTail) : (bufferSize - (bufferTail - bufferHead));
+    }
+
+    unsigned int filledLength() const
+    {
+        return (unsigned short)(elementHead - elementTail);
+    }
+} requestQueueLanes[NUMBER_OF_REQUEST_QUEUE_LANES];
 
 static struct Response
 {
@@ -94,11 +148,8 @@ static struct Response
     unsigned int offset;
 } responseQueueElements[RESPONSE_QUEUE_LENGTH];
 
-static volatile unsigned int requestQueueBufferHead = 0, requestQueueBufferTail = 0;
 static volatile unsigned int responseQueueBufferHead = 0, responseQueueBufferTail = 0;
-static volatile unsigned short requestQueueElementHead = 0, requestQueueElementTail = 0;
 static volatile unsigned short responseQueueElementHead = 0, responseQueueElementTail = 0;
-static volatile char requestQueueTailLock = 0;
 static volatile char responseQueueHeadLock = 0;
 static volatile unsigned long long queueProcessingNumerator = 0, queueProcessingDenominator = 0;
 static volatile unsigned long long tickerLoopNumerator = 0, tickerLoopDenominator = 0;
@@ -159,6 +210,140 @@ static void closePeer(Peer* peer)
     }
 }
 
+// Assign parts of requestQueueBuffer to the lanes, must be called after allocating requestQueueBuffer.
+static void initRequestQueueLanes()
+{
+    unsigned int offset = 0;
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        RequestQueueLane& lane = requestQueueLanes[laneIndex];
+        lane.buffer = requestQueueBuffer + offset;
+        lane.bufferSize = requestQueueLaneBufferSizes[laneIndex];
+        lane.bufferHead = lane.bufferTail = 0;
+        lane.elementHead = lane.elementTail = 0;
+        lane.tailLock = 0;
+        lane.numberOfDiscardedRequests = 0;
+        lane.waitingTicksNumerator = lane.waitingTicksDenominator = 0;
+        offset += requestQueueLaneBufferSizes[laneIndex];
+    }
+}
+
+static unsigned int getRequestQueueLane(unsigned char type)
+{
+    switch (type)
+    {
+    case BroadcastTick::type:
+    case BroadcastFutureTickData::type:
+    case BroadcastComputors::type:
+    case RequestComputors::type:
+    case RequestQuorumTick::type:
+    case RequestTickData::type:
+    case REQUEST_TICK_TRANSACTIONS:
+    case ExchangePublicPeers::type:
+    case SpecialCommand::type:
+        return REQUEST_QUEUE_LANE_CONSENSUS;
+
+    case BROADCAST_TRANSACTION:
+    case BroadcastMessage::type:
+        return REQUEST_QUEUE_LANE_TRANSACTIONS;
+
+    default:
+        return REQUEST_QUEUE_LANE_QUERIES;
+    }
+}
+
+// Check if TryAgain is sent when a request is dropped because its lane is full. Only gossip between peers is dropped
+// silently, because it is received from other peers again. Clients wait for a response to all other requests.
+static bool isTryAgainSentIfDropped(unsigned char type)
+{
+    switch (type)
+    {
+    case BroadcastTick::type:
+    case BroadcastFutureTickData::type:
+    case BroadcastComputors::type:
+    case ExchangePublicPeers::type:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+// Copy next request to header and return its peer, or return false if all lanes are empty. The lane is chosen
+// according to requestQueueLaneSchedule, scheduleIndex is the position of the calling processor in the schedule.
+static bool dequeueRequest(RequestResponseHeader* header, Peer*& peer, unsigned int& scheduleIndex)
+{
+    const unsigned int preferredLane = requestQueueLaneSchedule[scheduleIndex];
+    if (++scheduleIndex == sizeof(requestQueueLaneSchedule))
+    {
+        scheduleIndex = 0;
+    }
+
+    for (unsigned int i = 0; i < NUMBER_OF_REQUEST_QUEUE_LANES; i++)
+    {
+        // preferred lane first, followed by the other lanes in order of priority
+        const unsigned int laneIndex = (i == 0) ? preferredLane : ((i - 1 < preferredLane) ? i - 1 : i);
+        RequestQueueLane& lane = requestQueueLanes[laneIndex];
+        if (lane.elementTail == lane.elementHead)
+        {
+            continue;
+        }
+
+        ACQUIRE(lane.tailLock);
+
+        if (lane.elementTail == lane.elementHead)
+        {
+            RELEASE(lane.tailLock);
+            continue;
+        }
+
+        const Request& request = lane.elements[lane.elementTail];
+        RequestResponseHeader* requestHeader = (RequestResponseHeader*)&lane.buffer[request.offset];
+        bs->CopyMem(header, requestHeader, requestHeader->size());
+        lane.bufferTail += requestHeader->size();
+        peer = request.peer;
+        lane.waitingTicksNumerator += __rdtsc() - request.enqueueTick;
+        lane.waitingTicksDenominator++;
+
+        if (lane.bufferTail > lane.bufferSize - BUFFER_SIZE)
+        {
+            lane.bufferTail = 0;
+        }
+        lane.elementTail++;
+
+        RELEASE(lane.tailLock);
+
+        return true;
+    }
+
+    return false;
+}
+
+// Called after processing all complete messages in the receive buffer of the peer. Frees the buffer if it is
+// empty. Otherwise, it moves the remaining partial message to the beginning of the buffer, but only if it starts in
+// the second half of the buffer. Messages are smaller than half of the buffer, so the rest of the message always fits,
+// and the number of copied bytes is at most the number of processed bytes (usually much lower).
+static void compactReceiveBuffer(Peer* peer)
+{
+    const unsigned int writeOffset = (unsigned int)(((unsigned long long)peer->receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peer->receiveBuffer));
+    const unsigned int readOffset = peer->receiveBufferReadOffset;
+    static_assert(0xFFFFFF <= BUFFER_SIZE / 2, "Receive buffer must be able to hold two messages of maximum size");
+    ASSERT(readOffset <= writeOffset);
+    if (readOffset == writeOffset)
+    {
+        peer->receiveData.FragmentTable[0].FragmentBuffer = peer->receiveBuffer;
+        peer->receiveBufferReadOffset = 0;
+    }
+    else if (readOffset >= BUFFER_SIZE / 2)
+    {
+        const unsigned int remainingSize = writeOffset - readOffset;
+        bs->CopyMem(peer->receiveBuffer, ((char*)peer->receiveBuffer) + readOffset, remainingSize);
+        numberOfReceiveBufferCopiedBytes += remainingSize;
+        peer->receiveData.FragmentTable[0].FragmentBuffer = ((char*)peer->receiveBuffer) + remainingSize;
+        peer->receiveBufferReadOffset = 0;
+    }
+}
+
 // Add message to sending buffer of specific peer, can only called from main thread (not thread-safe).
 static void push(Peer* peer, RequestResponseHeader* requestResponseHeader)
 {
@@ -546,12 +731,13 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                     numberOfReceivedBytes += peers[i].receiveData.DataLength;
                     *((unsigned long long*) & peers[i].receiveData.FragmentTable[0].FragmentBuffer) += peers[i].receiveData.DataLength;
 
+                    // Process all complete messages in place, compacting the receive buffer only once afterwards
                 iteration:
-                    unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
+                    unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer)) - peers[i].receiveBufferReadOffset;
 
                     if (receivedDataSize >= sizeof(RequestResponseHeader))
                     {
-                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)peers[i].receiveBuffer;
+                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)(((char*)peers[i].receiveBuffer) + peers[i].receiveBufferReadOffset);
                         if (requestResponseHeader->size() < sizeof(RequestResponseHeader))
                         {
                             // protocol violation -> forget peer
@@ -576,25 +762,29 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                                 // (or drop it without processing if Dejavu filter tells to ignore it)
                                 if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
                                 {
-                                    if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
-                                        && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
+                                    const unsigned int laneIndex = getRequestQueueLane(requestResponseHeader->type());
+                                    RequestQueueLane& lane = requestQueueLanes[laneIndex];
+                                    if ((lane.bufferHead >= lane.bufferTail || lane.bufferHead + requestResponseHeader->size() < lane.bufferTail)
+                                        && (unsigned short)(lane.elementHead + 1) != lane.elementTail)
                                     {
                                         dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
 
-                                        ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
-                                        ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
-                                        ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
-
-                                        requestQueueElements[requestQueueElementHead].offset = requestQueueBufferHead;
-                                        bs->CopyMem(&requestQueueBuffer[requestQueueBufferHead], peers[i].receiveBuffer, requestResponseHeader->size());
-                                        requestQueueBufferHead += requestResponseHeader->size();
-                                        requestQueueElements[requestQueueElementHead].peer = &peers[i];
-                                        if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
+                                        ASSERT(lane.bufferHead < lane.bufferSize);
+                                        ASSERT(lane.bufferHead + requestResponseHeader->size() < lane.bufferSize);
+
+                                        Request& request = lane.elements[lane.elementHead];
+                                        request.offset = lane.bufferHead;
+                                        bs->CopyMem(&lane.buffer[lane.bufferHead], requestResponseHeader, requestResponseHeader->size());
+                                        numberOfRequestQueueCopiedBytes += requestResponseHeader->size();
+                                        lane.bufferHead += requestResponseHeader->size();
+                                        request.peer = &peers[i];
+                                        request.enqueueTick = __rdtsc();
+                                        if (lane.bufferHead > lane.bufferSize - BUFFER_SIZE)
                                         {
-                                            requestQueueBufferHead = 0;
+                                            lane.bufferHead = 0;
                                         }
                                         // TODO: Place a fence
-                                        requestQueueElementHead++;
+                                        lane.elementHead++;
 
                                         if (!(--dejavuSwapCounter))
                                         {
@@ -607,8 +797,12 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                                     else
                                     {
                                         _InterlockedIncrement64(&numberOfDiscardedRequests);
+                                        _InterlockedIncrement64(&lane.numberOfDiscardedRequests);
 
-                                        enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
+                                        if (isTryAgainSentIfDropped(requestResponseHeader->type()))
+                                        {
+                                            enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
+                                        }
                                     }
                                 }
                                 else
@@ -616,13 +810,14 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                                     _InterlockedIncrement64(&numberOfDuplicateRequests);
                                 }
 
-                                bs->CopyMem(peers[i].receiveBuffer, ((char*)peers[i].receiveBuffer) + requestResponseHeader->size(), receivedDataSize -= requestResponseHeader->size());
-                                peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + receivedDataSize;
+                                peers[i].receiveBufferReadOffset += requestResponseHeader->size();
 
                                 goto iteration;
                             }
                         }
                     }
+
+                    compactReceiveBuffer(&peers[i]);
                 }
             }
         }
@@ -742,6 +937,7 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
                 if (peers[i].connectAcceptToken.NewChildHandle = getTcp4Protocol(peers[i].address.u8, port, &peers[i].tcp4Protocol))
                 {
                     peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
+                    peers[i].receiveBufferReadOffset = 0;
                     peers[i].dataToTransmitSize = 0;
                     peers[i].isReceiving = FALSE;
                     peers[i].isTransmitting = FALSE;
@@ -775,6 +971,7 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
             {
                 peers[i].isIncommingConnection = TRUE;
                 peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
+                peers[i].receiveBufferReadOffset = 0;
                 peers[i].dataToTransmitSize = 0;
                 peers[i].isReceiving = FALSE;
                 peers[i].isTransmitting = FALSE;
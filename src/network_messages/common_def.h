@@ -78,3 +78,76 @@ static void getSiblings(int digestIndex, const m256i* digests, m256i siblings[de
         siblingIndex >>= 1;
     }
 }
+
+// Sort the leaf indices of a multi-proof and remove duplicates, returns the number of indices left. Insertion sort is
+// fast enough for the small number of leaves of a request.
+static unsigned int sortMultiProofIndices(int* digestIndices, unsigned int numberOfIndices)
+{
+    for (unsigned int i = 1; i < numberOfIndices; i++)
+    {
+        const int digestIndex = digestIndices[i];
+        unsigned int j = i;
+        for (; j > 0 && digestIndices[j - 1] > digestIndex; j--)
+        {
+            digestIndices[j] = digestIndices[j - 1];
+        }
+        digestIndices[j] = digestIndex;
+    }
+    unsigned int numberOfNodes = 0;
+    for (unsigned int i = 0; i < numberOfIndices; i++)
+    {
+        if (!numberOfNodes || digestIndices[numberOfNodes - 1] != digestIndices[i])
+        {
+            digestIndices[numberOfNodes++] = digestIndices[i];
+        }
+    }
+    return numberOfNodes;
+}
+
+// Same as getMultiProofSiblings(), but digestIndices must already be sorted without duplicates (see
+// sortMultiProofIndices()). Besides the index computations, only the sibling digests are copied, so sorting can be
+// done before acquiring the lock of the digests. digestIndices is used as work buffer.
+template <unsigned int depth>
+static unsigned int getMultiProofSiblingsOfSortedIndices(int* digestIndices, unsigned int numberOfIndices, const m256i* digests, m256i* siblings)
+{
+    unsigned int numberOfNodes = numberOfIndices;
+
+    // go up level by level, keeping the sorted indices of the nodes that can be computed from the leaves
+    const unsigned int capacity = (1ULL << depth);
+    unsigned int digestOffset = 0;
+    unsigned int numberOfSiblings = 0;
+    for (unsigned int j = 0; j < depth; j++)
+    {
+        unsigned int numberOfParents = 0;
+        for (unsigned int i = 0; i < numberOfNodes; i++)
+        {
+            const int nodeIndex = digestIndices[i];
+            if (!(nodeIndex & 1) && i + 1 < numberOfNodes && digestIndices[i + 1] == nodeIndex + 1)
+            {
+                // both children are known
+                i++;
+            }
+            else
+            {
+                siblings[numberOfSiblings++] = digests[digestOffset + (nodeIndex ^ 1)];
+            }
+            digestIndices[numberOfParents++] = nodeIndex >> 1;
+        }
+        numberOfNodes = numberOfParents;
+        digestOffset += (capacity >> j);
+    }
+
+    return numberOfSiblings;
+}
+
+// Compute the siblings needed for verifying several leaves of the tree together (multi-proof). Siblings that can be
+// computed from the leaves are left out, so the shared upper levels of the individual proofs of getSiblings() are only
+// included once. The siblings are ordered by level (leaf level first) and by index within the level. digestIndices
+// (any order, may contain duplicates) is used as work buffer. Returns the number of siblings, which is at most
+// numberOfIndices * depth. This function is not thread safe, make sure resource protection is handled outside.
+template <unsigned int depth>
+static unsigned int getMultiProofSiblings(int* digestIndices, unsigned int numberOfIndices, const m256i* digests, m256i* siblings)
+{
+    const unsigned int numberOfNodes = sortMultiProofIndices(digestIndices, numberOfIndices);
+    return getMultiProofSiblingsOfSortedIndices<depth>(digestIndices, numberOfNodes, digests, siblings);
+}
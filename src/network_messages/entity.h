@@ -37,3 +37,45 @@ struct RespondedEntity
 };
 
 static_assert(sizeof(RespondedEntity) == sizeof(::Entity) + 4 + 4 + 32 * SPECTRUM_DEPTH, "Something is wrong with the struct size.");
+
+
+// Request entities of up to maxNumberOfPublicKeys public keys with one message. The payload is an array of public
+// keys (m256i), the number of public keys is derived from the payload size.
+struct RequestEntities
+{
+    static constexpr unsigned int maxNumberOfPublicKeys = 1024;
+
+    enum {
+        type = 52,
+    };
+};
+
+
+struct RespondedEntitiesEntry
+{
+    ::Entity entity;
+    int spectrumIndex; // -1 if entity isn't found
+    unsigned int reserved;
+};
+
+static_assert(sizeof(RespondedEntitiesEntry) == sizeof(::Entity) + 4 + 4, "Something is wrong with the struct size.");
+
+
+// Response to RequestEntities, followed by RespondedEntitiesEntry entries[numberOfEntities] (in order of the requested
+// public keys) and m256i siblings[numberOfSiblings]. The siblings are the deduplicated multi-proof of all entities
+// found, see getMultiProofSiblings(). All entries and siblings refer to the same state of the spectrum.
+struct RespondEntities
+{
+    unsigned int tick;
+    unsigned int numberOfEntities;
+    unsigned int numberOfSiblings;
+    unsigned int reserved;
+
+    static constexpr unsigned long long maxSize = 16 + RequestEntities::maxNumberOfPublicKeys * (sizeof(RespondedEntitiesEntry) + 32ULL * SPECTRUM_DEPTH);
+
+    enum {
+        type = 53,
+    };
+};
+
+static_assert(sizeof(RespondEntities) == 16, "Something is wrong with the struct size.");
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/common_def.h"
+
+// Secondary index of a pending transactions pool (such as entityPendingTransactions), which lists the pool slots
+// per scheduled tick. It allows to get the pending transactions of a tick in O(number of transactions of the tick)
+// instead of scanning all slots of the pool.
+//
+// Slots are kept in doubly-linked lists, one list per bucket (tick % numberOfBuckets). Because of the modulo,
+// a bucket may contain slots of other ticks, so users need to check the tick of the transaction in the slot.
+// The index is not thread-safe. The lock of the pending transactions pool has to be acquired by the caller.
+template <unsigned int numberOfSlots, unsigned int numberOfBuckets>
+class PendingTransactionTickIndex
+{
+public:
+    static constexpr unsigned int noSlot = 0xffffffff;
+
+private:
+    static_assert(numberOfSlots < 0x80000000 && numberOfBuckets < 0x80000000, "Too many slots or buckets");
+
+    // Value of slotPrev of first slot in bucket list
+    static constexpr unsigned int headFlag = 0x80000000;
+
+    // Value of slotPrev of slots that are not in any list
+    static constexpr unsigned int notLinked = 0xffffffff;
+
+    // First slot of each bucket list, noSlot if empty
+    unsigned int* bucketHeads = nullptr;
+
+    // Next slot in the bucket list, noSlot at the end of the list
+    unsigned int* slotNext = nullptr;
+
+    // Previous slot in the bucket list, headFlag | bucket for first slot in list, notLinked if not in any list
+    unsigned int* slotPrev = nullptr;
+
+public:
+    bool init()
+    {
+        if (!allocatePool(numberOfBuckets * sizeof(unsigned int), (void**)&bucketHeads)
+            || !allocatePool(numberOfSlots * sizeof(unsigned int), (void**)&slotNext)
+            || !allocatePool(numberOfSlots * sizeof(unsigned int), (void**)&slotPrev))
+        {
+            return false;
+        }
+        reset();
+        return true;
+    }
+
+    void deinit()
+    {
+        if (bucketHeads)
+        {
+            freePool(bucketHeads);
+            bucketHeads = nullptr;
+        }
+        if (slotNext)
+        {
+            freePool(slotNext);
+            slotNext = nullptr;
+        }
+        if (slotPrev)
+        {
+            freePool(slotPrev);
+            slotPrev = nullptr;
+        }
+    }
+
+    // Remove all slots from the index (all bytes 0xff means noSlot / notLinked)
+    void reset()
+    {
+        setMem(bucketHeads, numberOfBuckets * sizeof(unsigned int), 0xff);
+        setMem(slotNext, numberOfSlots * sizeof(unsigned int), 0xff);
+        setMem(slotPrev, numberOfSlots * sizeof(unsigned int), 0xff);
+    }
+
+    // Add slot to list of tick. Slot must not be in the index yet (call remove() before).
+    void add(unsigned int slot, unsigned int tick)
+    {
+        ASSERT(slot < numberOfSlots);
+        ASSERT(slotPrev[slot] == notLinked);
+        const unsigned int bucket = tick % numberOfBuckets;
+        const unsigned int oldHead = bucketHeads[bucket];
+        slotNext[slot] = oldHead;
+        slotPrev[slot] = headFlag | bucket;
+        if (oldHead != noSlot)
+        {
+            slotPrev[oldHead] = slot;
+        }
+        bucketHeads[bucket] = slot;
+    }
+
+    // Remove slot from its list if it is in the index.
+    void remove(unsigned int slot)
+    {
+        ASSERT(slot < numberOfSlots);
+        const unsigned int prev = slotPrev[slot];
+        if (prev == notLinked)
+        {
+            return;
+        }
+
+        const unsigned int next = slotNext[slot];
+        if (prev & headFlag)
+        {
+            bucketHeads[prev & ~headFlag] = next;
+        }
+        else
+        {
+            slotNext[prev] = next;
+        }
+        if (next != noSlot)
+        {
+            slotPrev[next] = prev;
+        }
+        slotNext[slot] = noSlot;
+        slotPrev[slot] = notLinked;
+    }
+
+    // Return first slot in list of tick's bucket or noSlot if the list is empty.
+    unsigned int firstSlot(unsigned int tick) const
+    {
+        return bucketHeads[tick % numberOfBuckets];
+    }
+
+    // Return slot following the passed slot in the bucket list or noSlot at the end of the list.
+    unsigned int nextSlot(unsigned int slot) const
+    {
+        ASSERT(slot < numberOfSlots);
+        return slotNext[slot];
+    }
+};
+
+
+// Small hash map from the transaction digests of one tick to their index in TickData::transactionDigests,
+// used to match pending transactions with the digests of a tick without comparing each pair.
+class TickTransactionDigestMap
+{
+private:
+    static constexpr unsigned int capacity = NUMBER_OF_TRANSACTIONS_PER_TICK * 2;
+    static constexpr unsigned short emptyEntry = 0xffff;
+    static constexpr unsigned short removedEntry = 0xfffe;
+    static_assert((capacity & (capacity - 1)) == 0, "Capacity must be 2^N");
+    static_assert(NUMBER_OF_TRANSACTIONS_PER_TICK < removedEntry, "Transaction index does not fit into entry");
+
+    unsigned short entries[capacity];
+
+public:
+    void reset()
+    {
+        setMem(entries, sizeof(entries), 0xff);
+    }
+
+    // Add transactionIndex with digest. Entries with the same digest are found in the order they were added.
+    void add(const m256i& digest, unsigned short transactionIndex)
+    {
+        unsigned int index = digest.m256i_u32[0] & (capacity - 1);
+        while (entries[index] != emptyEntry)
+        {
+            index = (index + 1) & (capacity - 1);
+        }
+        entries[index] = transactionIndex;
+    }
+
+    // Return transaction index of digest and remove it from the map, or return -1 if not found.
+    // Digests must be the array that the transaction indices refer to.
+    int findAndRemove(const m256i& digest, const m256i* digests)
+    {
+        unsigned int index = digest.m256i_u32[0] & (capacity - 1);
+        while (entries[index] != emptyEntry)
+        {
+            const unsigned short transactionIndex = entries[index];
+            if (transactionIndex != removedEntry && digests[transactionIndex] == digest)
+            {
+                entries[index] = removedEntry;
+                return transactionIndex;
+            }
+            index = (index + 1) & (capacity - 1);
+        }
+        return -1;
+    }
+};
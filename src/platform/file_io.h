@@ -19,11 +19,34 @@
 
 static EFI_FILE_PROTOCOL* root = NULL;
 
+#ifdef NO_UEFI
+// Path of fileName in directory (directory may be NULL), path needs 256 characters
+static const CHAR16* getNoUefiFilePath(const CHAR16* fileName, const CHAR16* directory, CHAR16* path)
+{
+    if (!directory)
+    {
+        return fileName;
+    }
+    setText(path, directory);
+    appendText(path, L"/");
+    appendText(path, fileName);
+    return path;
+}
+#endif
+
 static long long getFileSize(CHAR16* fileName, CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of getFileSize() is missing! No valid file size returned!");
-    return -1;
+    CHAR16 path[256];
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, getNoUefiFilePath(fileName, directory, path), L"rb") != 0 || !file)
+    {
+        return -1;
+    }
+    _fseeki64(file, 0, SEEK_END);
+    const long long fileSize = _ftelli64(file);
+    fclose(file);
+    return fileSize;
 #else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file;
@@ -120,13 +143,9 @@ static bool createDir(const CHAR16* dirName)
 static long long load(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
-    if (directory)
-    {
-        logToConsole(L"Argument directory not implemented for NO_UEFI load()! Pass full path as fileName!");
-        return -1;
-    }
+    CHAR16 path[256];
     FILE* file = nullptr;
-    if (_wfopen_s(&file, fileName, L"rb") != 0 || !file)
+    if (_wfopen_s(&file, getNoUefiFilePath(fileName, directory, path), L"rb") != 0 || !file)
     {
         wprintf(L"Error opening file %s!\n", fileName);
         return -1;
@@ -134,6 +153,7 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
     if (fread(buffer, 1, totalSize, file) != totalSize)
     {
         wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
+        fclose(file);
         return -1;
     }
     fclose(file);
@@ -201,11 +221,25 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
 #endif
 }
 
-static long long save(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+#ifdef NO_UEFI
+typedef FILE* FileHandle;
+#else
+typedef EFI_FILE_PROTOCOL* FileHandle;
+#endif
+
+// Open (create or overwrite) a file for writing it with writeToFile() in one or more steps. Returns NULL on error.
+// The file must be closed with closeFile().
+static FileHandle openFileForWriting(const CHAR16* fileName, const CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of save() is missing! No file saved!");
-    return 0;
+    CHAR16 path[256];
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, getNoUefiFilePath(fileName, directory, path), L"wb") != 0 || !file)
+    {
+        wprintf(L"Error opening file %s!\n", fileName);
+        return NULL;
+    }
+    return file;
 #else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file = NULL;
@@ -221,13 +255,13 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
         if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
         {
             logStatusToConsole(L"FileIOSave:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
-            return -1;
+            return NULL;
         }
 
         if (NULL == directoryProtocol)
         {
             logStatusToConsole(L"FileIOSave:OpenDir directory protocols is NULL", status, __LINE__);
-            return -1;
+            return NULL;
         }
 
         // Open the file from the directory.
@@ -235,7 +269,7 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
         {
             logStatusToConsole(L"FileIOSave:OpenDir::OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
             directoryProtocol->Close(directoryProtocol);
-            return -1;
+            return NULL;
         }
         directoryProtocol->Close(directoryProtocol);
     }
@@ -244,37 +278,153 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
         if (status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0))
         {
             logStatusToConsole(L"FileIOSave:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
-            return -1;
+            return NULL;
         }
     }
-    
-    if (EFI_SUCCESS == status)
+
+    return file;
+#endif
+}
+
+// Append totalSize bytes to a file opened with openFileForWriting(). Returns false on error.
+static bool writeToFile(FileHandle file, const unsigned char* buffer, unsigned long long totalSize)
+{
+#ifdef NO_UEFI
+    return fwrite(buffer, 1, totalSize, file) == totalSize;
+#else
+    EFI_STATUS status;
+    unsigned long long writtenSize = 0;
+    while (writtenSize < totalSize)
     {
-        unsigned long long writtenSize = 0;
-        while (writtenSize < totalSize)
+        unsigned long long size = (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize));
+        status = file->Write(file, &size, (void*)&buffer[writtenSize]);
+        if (status
+            || size != (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize)))
         {
-            unsigned long long size = (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize));
-            status = file->Write(file, &size, (void*)&buffer[writtenSize]);
-            if (status
-                || size != (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize)))
-            {
-                // If this error occurs, see the definition of WRITING_CHUNK_SIZE above.
-                logStatusToConsole(L"EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
+            // If this error occurs, see the definition of WRITING_CHUNK_SIZE above.
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
 
-                file->Close(file);
+            return false;
+        }
+        writtenSize += size;
+    }
+    return true;
+#endif
+}
 
-                return -1;
-            }
-            writtenSize += size;
+// Write buffered data of a file opened with openFileForWriting() to disk, so it can be read while the file stays open.
+// Returns false on error.
+static bool flushFile(FileHandle file)
+{
+#ifdef NO_UEFI
+    return fflush(file) == 0;
+#else
+    EFI_STATUS status = file->Flush(file);
+    if (status)
+    {
+        logStatusToConsole(L"EFI_FILE_PROTOCOL.Flush() fails", status, __LINE__);
+        return false;
+    }
+    return true;
+#endif
+}
+
+static void closeFile(FileHandle file)
+{
+#ifdef NO_UEFI
+    fclose(file);
+#else
+    file->Close(file);
+#endif
+}
+
+// Read totalSize bytes starting at offset of a file into buffer (random access). Returns number of bytes read or -1 on
+// error.
+static long long loadPart(const CHAR16* fileName, unsigned long long offset, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    CHAR16 path[256];
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, getNoUefiFilePath(fileName, directory, path), L"rb") != 0 || !file)
+    {
+        return -1;
+    }
+    if (_fseeki64(file, offset, SEEK_SET) != 0 || fread(buffer, 1, totalSize, file) != totalSize)
+    {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return totalSize;
+#else
+    EFI_STATUS status;
+    EFI_FILE_PROTOCOL* file;
+    EFI_FILE_PROTOCOL* directoryProtocol;
+    if (NULL != directory)
+    {
+        if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
+        {
+            return -1;
         }
-        file->Close(file);
+        status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ, 0);
+        directoryProtocol->Close(directoryProtocol);
+        if (status)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ, 0))
+        {
+            return -1;
+        }
+    }
 
-        return writtenSize;
+    if (status = file->SetPosition(file, offset))
+    {
+        logStatusToConsole(L"EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+        file->Close(file);
+        return -1;
     }
-    return -1;
+    unsigned long long readSize = 0;
+    while (readSize < totalSize)
+    {
+        unsigned long long size = (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize));
+        status = file->Read(file, &size, &buffer[readSize]);
+        if (status
+            || size != (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize)))
+        {
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
+            file->Close(file);
+            return -1;
+        }
+        readSize += size;
+    }
+    file->Close(file);
+    return readSize;
 #endif
 }
 
+static long long save(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+{
+    FileHandle file = openFileForWriting(fileName, directory);
+    if (!file)
+    {
+        return -1;
+    }
+
+    if (!writeToFile(file, buffer, totalSize))
+    {
+        closeFile(file);
+
+        return -1;
+    }
+    closeFile(file);
+
+    return totalSize;
+}
+
 
 static bool initFilesystem()
 {
@@ -403,6 +553,14 @@ static unsigned int getTextSize(CHAR16* text, int maximumSize)
     return result;
 }
 
+// Name of chunk file chunkId of a large file (fileName followed by ".XXX" with chunkId), output needs 64 characters
+static void getLargeFileChunkName(const CHAR16* fileName, int chunkId, CHAR16* fileNameWithChunkId)
+{
+    setText(fileNameWithChunkId, fileName);
+    appendText(fileNameWithChunkId, L".XXX");
+    addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+}
+
 // Break the large file to many chunks to write if the size is greater or equal FILE_CHUNK_SIZE
 // - skipWriteEqualChunkSize: skip write the chunk file if the size of existed file match with buffer data. Set false if need the write always happens
 static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory = NULL, bool skipWriteEqualChunkSize = true)
@@ -415,9 +573,7 @@ static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     unsigned long long totalWriteSize = 0;
     while (totalSize) {
         CHAR16 fileNameWithChunkId[64];
-        setText(fileNameWithChunkId, fileName);
-        appendText(fileNameWithChunkId, L".XXX");
-        addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+        getLargeFileChunkName(fileName, chunkId, fileNameWithChunkId);
         const unsigned long long writeSize = maxWriteSizePerChunk < totalSize ? maxWriteSizePerChunk : totalSize;
         long long existFileSize = getFileSize(fileNameWithChunkId, directory);
         if (!skipWriteEqualChunkSize || (existFileSize != writeSize)) {
@@ -444,9 +600,7 @@ static long long loadLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     unsigned long long totalReadSize = 0;
     while (totalSize) {
         CHAR16 fileNameWithChunkId[64];
-        setText(fileNameWithChunkId, fileName);
-        appendText(fileNameWithChunkId, L".XXX");
-        addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+        getLargeFileChunkName(fileName, chunkId, fileNameWithChunkId);
         const unsigned long long readSize = maxReadSizePerChunk < totalSize ? maxReadSizePerChunk : totalSize;
         unsigned long long res = load(fileNameWithChunkId, readSize, buffer, directory);
         if (res != readSize) {
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "global_var.h"
+#include "concurrency.h"
+
+// Simple fork-join facility: a processor (usually the tick processor) splits work into independent chunks with
+// runParallelJob() and executes them together with idle processors, which call helpWithParallelJob() from their
+// waiting loops (such as the request processors). Only one job runs at a time. If no processor helps, the caller
+// executes all chunks itself, so it is safe to use in any context.
+
+typedef void (*ParallelJobFunction)(void* context, unsigned int chunkIndex);
+
+GLOBAL_VAR_DECL struct ParallelJob
+{
+    ParallelJobFunction volatile function = nullptr; // nullptr if no job is running
+    void* volatile context = nullptr;
+    volatile long numberOfChunks = 0;
+    volatile long nextChunk = 0;
+    volatile long finishedChunks = 0;
+    volatile long numberOfHelpers = 0;
+    volatile char lock = 0;
+
+    // Statistics for estimating the speedup: execution time of all chunks (summed over all processors) compared to
+    // the wall-clock time of the jobs, both measured in CPU ticks
+    volatile long long totalChunkTicks = 0;
+    unsigned long long totalJobTicks = 0;
+    unsigned long long numberOfJobs = 0;
+    volatile long long numberOfHelperChunks = 0;
+} parallelJob;
+
+// Execute chunks of the current job until none is left. Returns the number of chunks executed.
+static unsigned int runParallelJobChunks()
+{
+    unsigned int executedChunks = 0;
+    while (true)
+    {
+        const long chunkIndex = _InterlockedIncrement(&parallelJob.nextChunk) - 1;
+        if (chunkIndex >= parallelJob.numberOfChunks)
+        {
+            break;
+        }
+
+        const unsigned long long beginningTick = __rdtsc();
+        parallelJob.function(parallelJob.context, chunkIndex);
+        _InterlockedExchangeAdd64(&parallelJob.totalChunkTicks, __rdtsc() - beginningTick);
+        _InterlockedIncrement(&parallelJob.finishedChunks);
+        executedChunks++;
+    }
+    return executedChunks;
+}
+
+// Run function(context, chunkIndex) for all chunkIndex < numberOfChunks and return when all chunks are done.
+// Chunks may run in parallel on other processors, so they must not depend on each other.
+static void runParallelJob(ParallelJobFunction function, void* context, unsigned int numberOfChunks)
+{
+    ACQUIRE(parallelJob.lock);
+
+    const unsigned long long beginningTick = __rdtsc();
+    parallelJob.context = context;
+    parallelJob.numberOfChunks = numberOfChunks;
+    parallelJob.nextChunk = 0;
+    parallelJob.finishedChunks = 0;
+    _mm_mfence();
+    parallelJob.function = function; // publish job, helpers may join from now on
+
+    runParallelJobChunks();
+    while (parallelJob.finishedChunks < (long)numberOfChunks)
+    {
+        _mm_pause();
+    }
+
+    // Stop new helpers from joining and wait until all helpers have left, so the context isn't used anymore
+    parallelJob.function = nullptr;
+    _mm_mfence();
+    while (parallelJob.numberOfHelpers)
+    {
+        _mm_pause();
+    }
+
+    parallelJob.totalJobTicks += __rdtsc() - beginningTick;
+    parallelJob.numberOfJobs++;
+
+    RELEASE(parallelJob.lock);
+}
+
+// Called by idle processors in their waiting loops. Executes chunks of the current job if there is one.
+// Returns true if at least one chunk was executed.
+static bool helpWithParallelJob()
+{
+    if (!parallelJob.function)
+    {
+        return false;
+    }
+
+    _InterlockedIncrement(&parallelJob.numberOfHelpers);
+    unsigned int executedChunks = 0;
+    if (parallelJob.function)
+    {
+        executedChunks = runParallelJobChunks();
+        _InterlockedExchangeAdd64(&parallelJob.numberOfHelperChunks, executedChunks);
+    }
+    _InterlockedDecrement(&parallelJob.numberOfHelpers);
+
+    return executedChunks > 0;
+}
+
+// Average number of processors working on parallel jobs, multiplied by 10
+static unsigned long long getParallelJobSpeedupTimes10()
+{
+    return (parallelJob.totalJobTicks) ? parallelJob.totalChunkTicks * 10 / parallelJob.totalJobTicks : 0;
+}
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "file_io.h"
+#include "memory.h"
+#include "parallel_job.h"
+#include "debugging.h"
+#include "time_stamp_counter.h"
+
+// Writes a set of files from memory in small steps, so the main loop can save large amounts of data (such as the node
+// states) while continuing its other work (such as networking). Data that may change before it is written has to be
+// copied into the staging buffer with stage() before adding its file. Data that doesn't change anymore can be written
+// from its original location. Files are written in the order of adding them.
+//
+// Only the main processor may use this, because UEFI file functions must not be called from other processors.
+class StagedFileWriter
+{
+public:
+    static constexpr unsigned int maxNumberOfFiles = 1024;
+
+private:
+    // Chunks of copying into the staging buffer, which are run in parallel by idle processors
+    static constexpr unsigned long long stagingChunkSize = 16 * 1024 * 1024;
+
+    // A file consists of up to two segments, for example data of older ticks followed by a staged copy of the current
+    // tick's data
+    struct File
+    {
+        CHAR16 name[64];
+        const unsigned char* data[2];
+        unsigned long long size[2];
+        bool skipIfSizeEquals;
+    };
+
+    struct StagingContext
+    {
+        unsigned char* destination;
+        const unsigned char* source;
+        unsigned long long size;
+    };
+
+    File* files = nullptr;
+    unsigned int numberOfFiles = 0;
+    CHAR16 directory[16];
+
+    unsigned char* stagingBuffer = nullptr;
+    unsigned long long stagingBufferSize = 0;
+    unsigned long long stagingBufferUsed = 0;
+
+    // State of writing
+    unsigned int currentFile = 0;
+    unsigned int currentSegment = 0;
+    unsigned long long currentOffset = 0;
+    FileHandle currentFileHandle = NULL;
+    bool writing = false;
+    bool failed = false;
+
+    // Statistics of the last (or current) set of files
+    unsigned long long totalSize = 0;
+    unsigned long long writtenSize = 0;
+    unsigned long long writingBeginningTick = 0;
+    unsigned long long writingTicks = 0;
+
+    static void stageChunk(void* context, unsigned int chunkIndex)
+    {
+        const StagingContext* ctx = (const StagingContext*)context;
+        const unsigned long long offset = chunkIndex * stagingChunkSize;
+        const unsigned long long size = (ctx->size - offset > stagingChunkSize) ? stagingChunkSize : ctx->size - offset;
+        copyMem(ctx->destination + offset, ctx->source + offset, size);
+    }
+
+    bool addFileEntry(const CHAR16* fileName, const void* data0, unsigned long long size0, const void* data1, unsigned long long size1, bool skipIfSizeEquals)
+    {
+        if (numberOfFiles >= maxNumberOfFiles)
+        {
+            return false;
+        }
+        File& file = files[numberOfFiles++];
+        setText(file.name, fileName);
+        file.data[0] = (const unsigned char*)data0;
+        file.size[0] = size0;
+        file.data[1] = (const unsigned char*)data1;
+        file.size[1] = size1;
+        file.skipIfSizeEquals = skipIfSizeEquals;
+        totalSize += size0 + size1;
+        return true;
+    }
+
+    void finishFile()
+    {
+        if (currentFileHandle)
+        {
+            closeFile(currentFileHandle);
+            currentFileHandle = NULL;
+        }
+        currentFile++;
+        currentSegment = 0;
+        currentOffset = 0;
+    }
+
+    void stop(bool success)
+    {
+        if (currentFileHandle)
+        {
+            closeFile(currentFileHandle);
+            currentFileHandle = NULL;
+        }
+        writingTicks = __rdtsc() - writingBeginningTick;
+        writing = false;
+        failed = !success;
+    }
+
+public:
+    bool init(unsigned long long maxStagingBufferSize)
+    {
+        if (!allocatePool(maxNumberOfFiles * sizeof(File), (void**)&files)
+            || !allocatePool(maxStagingBufferSize, (void**)&stagingBuffer))
+        {
+            deinit();
+            return false;
+        }
+        stagingBufferSize = maxStagingBufferSize;
+        stagingBufferUsed = 0;
+        numberOfFiles = 0;
+        writing = false;
+        failed = false;
+        return true;
+    }
+
+    void deinit()
+    {
+        if (files)
+        {
+            freePool(files);
+            files = nullptr;
+        }
+        if (stagingBuffer)
+        {
+            freePool(stagingBuffer);
+            stagingBuffer = nullptr;
+        }
+    }
+
+    // Start collecting a new set of files, which are written into directory (may be NULL)
+    void begin(const CHAR16* directoryName)
+    {
+        ASSERT(!writing);
+        if (directoryName)
+        {
+            setText(directory, directoryName);
+        }
+        else
+        {
+            directory[0] = 0;
+        }
+        numberOfFiles = 0;
+        stagingBufferUsed = 0;
+        totalSize = 0;
+        writtenSize = 0;
+        writingTicks = 0;
+        failed = false;
+    }
+
+    // Copy size bytes of data into the staging buffer and return the copy, or nullptr if the staging buffer is full.
+    // Large copies are split into chunks that idle processors help with (see runParallelJob()).
+    const void* stage(const void* data, unsigned long long size)
+    {
+        const unsigned long long alignedSize = (size + 63) & ~63ULL;
+        if (alignedSize > stagingBufferSize - stagingBufferUsed)
+        {
+            return nullptr;
+        }
+        unsigned char* copy = stagingBuffer + stagingBufferUsed;
+        stagingBufferUsed += alignedSize;
+
+        StagingContext context;
+        context.destination = copy;
+        context.source = (const unsigned char*)data;
+        context.size = size;
+        const unsigned int numberOfChunks = (unsigned int)((size + stagingChunkSize - 1) / stagingChunkSize);
+        if (numberOfChunks > 1)
+        {
+            runParallelJob(stageChunk, &context, numberOfChunks);
+        }
+        else if (numberOfChunks)
+        {
+            stageChunk(&context, 0);
+        }
+        return copy;
+    }
+
+    // Add file consisting of size0 bytes of data0 followed by size1 bytes of data1. The data must not change until the
+    // file is written. Returns false if too many files have been added.
+    bool addFile(const CHAR16* fileName, const void* data0, unsigned long long size0, const void* data1 = nullptr, unsigned long long size1 = 0)
+    {
+        return addFileEntry(fileName, data0, size0, data1, size1, false);
+    }
+
+    // Same as addFile(), but split into chunk files of FILE_CHUNK_SIZE bytes like saveLargeFile() does, so the file
+    // can be loaded with loadLargeFile(). If skipWriteEqualChunkSize is set, chunk files that already exist with the
+    // expected size are not written again.
+    bool addLargeFile(const CHAR16* fileName, const void* data0, unsigned long long size0, const void* data1 = nullptr, unsigned long long size1 = 0, bool skipWriteEqualChunkSize = true)
+    {
+        const unsigned long long fileSize = size0 + size1;
+        if (fileSize < FILE_CHUNK_SIZE)
+        {
+            return addFileEntry(fileName, data0, size0, data1, size1, false);
+        }
+
+        int chunkId = 0;
+        for (unsigned long long offset = 0; offset < fileSize; offset += FILE_CHUNK_SIZE, chunkId++)
+        {
+            const unsigned long long chunkEnd = (fileSize - offset > FILE_CHUNK_SIZE) ? offset + FILE_CHUNK_SIZE : fileSize;
+            const void* chunkData[2] = { nullptr, nullptr };
+            unsigned long long chunkSize[2] = { 0, 0 };
+            unsigned int segment = 0;
+            if (offset < size0)
+            {
+                chunkData[segment] = (const unsigned char*)data0 + offset;
+                chunkSize[segment] = ((chunkEnd < size0) ? chunkEnd : size0) - offset;
+                segment++;
+            }
+            if (chunkEnd > size0)
+            {
+                const unsigned long long begin = (offset > size0) ? offset - size0 : 0;
+                chunkData[segment] = (const unsigned char*)data1 + begin;
+                chunkSize[segment] = chunkEnd - size0 - begin;
+            }
+
+            CHAR16 fileNameWithChunkId[64];
+            getLargeFileChunkName(fileName, chunkId, fileNameWithChunkId);
+            if (!addFileEntry(fileNameWithChunkId, chunkData[0], chunkSize[0], chunkData[1], chunkSize[1], skipWriteEqualChunkSize))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Start writing the files added since begin()
+    void startWriting()
+    {
+        ASSERT(!writing);
+        currentFile = 0;
+        currentSegment = 0;
+        currentOffset = 0;
+        currentFileHandle = NULL;
+        writtenSize = 0;
+        writingBeginningTick = __rdtsc();
+        writing = numberOfFiles > 0;
+        failed = false;
+    }
+
+    // Write up to maxSize bytes of the files. Returns false if writing failed, which stops writing the remaining files.
+    bool writeStep(unsigned long long maxSize)
+    {
+        if (!writing)
+        {
+            return !failed;
+        }
+
+        while (currentFile < numberOfFiles)
+        {
+            File& file = files[currentFile];
+            if (!currentFileHandle)
+            {
+                const CHAR16* dir = directory[0] ? directory : NULL;
+                if (file.skipIfSizeEquals && getFileSize(file.name, (CHAR16*)dir) == (long long)(file.size[0] + file.size[1]))
+                {
+                    writtenSize += file.size[0] + file.size[1];
+                    finishFile();
+                    continue;
+                }
+                currentFileHandle = openFileForWriting(file.name, dir);
+                if (!currentFileHandle)
+                {
+                    stop(false);
+                    return false;
+                }
+            }
+
+            while (currentSegment < 2)
+            {
+                const unsigned long long segmentSize = file.size[currentSegment];
+                if (currentOffset < segmentSize)
+                {
+                    if (!maxSize)
+                    {
+                        return true;
+                    }
+                    const unsigned long long size = (segmentSize - currentOffset > maxSize) ? maxSize : segmentSize - currentOffset;
+                    if (!writeToFile(currentFileHandle, file.data[currentSegment] + currentOffset, size))
+                    {
+                        stop(false);
+                        return false;
+                    }
+                    currentOffset += size;
+                    writtenSize += size;
+                    maxSize -= size;
+                }
+                if (currentOffset >= segmentSize)
+                {
+                    currentSegment++;
+                    currentOffset = 0;
+                }
+            }
+            finishFile();
+        }
+
+        stop(true);
+        return true;
+    }
+
+    bool isWriting() const
+    {
+        return writing;
+    }
+
+    // True if the last set of files could not be written completely
+    bool hasFailed() const
+    {
+        return failed;
+    }
+
+    unsigned int getNumberOfFiles() const
+    {
+        return numberOfFiles;
+    }
+
+    unsigned long long getTotalSize() const
+    {
+        return totalSize;
+    }
+
+    unsigned long long getWrittenSize() const
+    {
+        return writtenSize;
+    }
+
+    unsigned long long getStagedSize() const
+    {
+        return stagingBufferUsed;
+    }
+
+    // Bytes per second of the last completed set of files (chunk files that were skipped count as written)
+    unsigned long long getWritingThroughput() const
+    {
+        const unsigned long long milliseconds = getWritingMilliseconds();
+        return (milliseconds) ? writtenSize * 1000 / milliseconds : 0;
+    }
+
+    // Duration of writing the last completed set of files in milliseconds
+    unsigned long long getWritingMilliseconds() const
+    {
+        return writingTicks * 1000 / frequency;
+    }
+};
@@ -37,6 +37,10 @@ static const unsigned char whiteListPeers[][4] = {
 static unsigned long long logReaderPasscodes[4] = {
     0, 0, 0, 0 // REMOVE THIS ENTRY AND REPLACE IT WITH YOUR OWN RANDOM NUMBERS IN [0..18446744073709551615] RANGE IF LOGGING IS ENABLED
 };
+// Persist logs to rolling segment files in directory "logs", so logs overwritten in the log buffer can still be requested
+#define LOG_PERSIST_TO_DISK 0 // "0" disables it, "1" enables it
+// Secondary index of logs by message type, entity, and contract for RequestIndexedLogs (needs about 576 MiB of RAM)
+#define LOG_INDEX 0 // "0" disables it, "1" enables it
 
 // Mode for auto save ticks:
 // 0: disable
@@ -47,4 +51,9 @@ static unsigned long long logReaderPasscodes[4] = {
 // Perform state persisting when your node is misaligned will also make your node misaligned after resuming.
 // Thus, picking various TICK_STORAGE_AUTOSAVE_TICK_PERIOD numbers across AUX nodes is recommended.
 // some suggested prime numbers you can try: 971 977 983 991 997
-#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1000
\ No newline at end of file
+#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1000
+// How node states are saved if TICK_STORAGE_AUTOSAVE_MODE is enabled:
+// 0: the tick processor waits and peers are disconnected until all files are written
+// 1: the states are copied into a staging buffer (needs several GB of additional RAM), the tick processor continues
+//    right after copying and the main loop writes the files step by step while the node keeps running
+#define TICK_STORAGE_AUTOSAVE_STAGING 0
\ No newline at end of file
@@ -75,6 +75,11 @@ static unsigned short CONTRACT_FILE_NAME[] = L"contract????.???";
 
 #define SOLUTION_SECURITY_DEPOSIT 1000000
 
+// Compute contract state digests as Merkle root over pages of the state, rehashing only changed pages. This changes
+// the computer digest, so all computors have to switch at the same epoch. Needs additional RAM of the size of all
+// contract states.
+#define CONTRACT_STATE_PAGE_DIGESTS 0
+
 // include commonly needed definitions
 #include "network_messages/common_def.h"
 
@@ -26,6 +26,7 @@
 #include "platform/time_stamp_counter.h"
 
 #include "platform/custom_stack.h"
+#include "platform/parallel_job.h"
 
 #include "text_output.h"
 
@@ -45,12 +46,16 @@
 
 #include "spectrum.h"
 #include "contract_core/qpi_spectrum_impl.h"
+#include "contract_core/contract_state_digest.h"
 
 #include "logging/logging.h"
 #include "logging/net_msg_impl.h"
 
 #include "tick_storage.h"
 #include "vote_counter.h"
+#include "revenue.h"
+#include "tick_vote_matcher.h"
+#include "pending_transaction_index.h"
 
 #include "addons/tx_status_request.h"
 
@@ -90,8 +95,6 @@ struct Processor : public CustomStack
 
 
 
-static const unsigned short revenuePoints[1 + 1024] = { 0, 710, 1125, 1420, 1648, 1835, 1993, 2129, 2250, 2358, 2455, 2545, 2627, 2702, 2773, 2839, 2901, 2960, 3015, 3068, 3118, 3165, 3211, 3254, 3296, 3336, 3375, 3412, 3448, 3483, 3516, 3549, 3580, 3611, 3641, 3670, 3698, 3725, 3751, 3777, 3803, 3827, 3851, 3875, 3898, 3921, 3943, 3964, 3985, 4006, 4026, 4046, 4066, 4085, 4104, 4122, 4140, 4158, 4175, 4193, 4210, 4226, 4243, 4259, 4275, 4290, 4306, 4321, 4336, 4350, 4365, 4379, 4393, 4407, 4421, 4435, 4448, 4461, 4474, 4487, 4500, 4512, 4525, 4537, 4549, 4561, 4573, 4585, 4596, 4608, 4619, 4630, 4641, 4652, 4663, 4674, 4685, 4695, 4705, 4716, 4726, 4736, 4746, 4756, 4766, 4775, 4785, 4795, 4804, 4813, 4823, 4832, 4841, 4850, 4859, 4868, 4876, 4885, 4894, 4902, 4911, 4919, 4928, 4936, 4944, 4952, 4960, 4968, 4976, 4984, 4992, 5000, 5008, 5015, 5023, 5031, 5038, 5046, 5053, 5060, 5068, 5075, 5082, 5089, 5096, 5103, 5110, 5117, 5124, 5131, 5138, 5144, 5151, 5158, 5164, 5171, 5178, 5184, 5191, 5197, 5203, 5210, 5216, 5222, 5228, 5235, 5241, 5247, 5253, 5259, 5265, 5271, 5277, 5283, 5289, 5295, 5300, 5306, 5312, 5318, 5323, 5329, 5335, 5340, 5346, 5351, 5357, 5362, 5368, 5373, 5378, 5384, 5389, 5394, 5400, 5405, 5410, 5415, 5420, 5425, 5431, 5436, 5441, 5446, 5451, 5456, 5461, 5466, 5471, 5475, 5480, 5485, 5490, 5495, 5500, 5504, 5509, 5514, 5518, 5523, 5528, 5532, 5537, 5542, 5546, 5551, 5555, 5560, 5564, 5569, 5573, 5577, 5582, 5586, 5591, 5595, 5599, 5604, 5608, 5612, 5616, 5621, 5625, 5629, 5633, 5637, 5642, 5646, 5650, 5654, 5658, 5662, 5666, 5670, 5674, 5678, 5682, 5686, 5690, 5694, 5698, 5702, 5706, 5710, 5714, 5718, 5721, 5725, 5729, 5733, 5737, 5740, 5744, 5748, 5752, 5755, 5759, 5763, 5766, 5770, 5774, 5777, 5781, 5785, 5788, 5792, 5795, 5799, 5802, 5806, 5809, 5813, 5816, 5820, 5823, 5827, 5830, 5834, 5837, 5841, 5844, 5847, 5851, 5854, 5858, 5861, 5864, 5868, 5871, 5874, 5878, 5881, 5884, 5887, 5891, 5894, 5897, 5900, 5904, 5907, 5910, 5913, 5916, 5919, 5923, 5926, 5929, 5932, 5935, 5938, 5941, 5944, 5948, 5951, 5954, 5957, 5960, 5963, 5966, 5969, 5972, 5975, 5978, 5981, 5984, 5987, 5990, 5993, 5996, 5999, 6001, 6004, 6007, 6010, 6013, 6016, 6019, 6022, 6025, 6027, 6030, 6033, 6036, 6039, 6041, 6044, 6047, 6050, 6053, 6055, 6058, 6061, 6064, 6066, 6069, 6072, 6075, 6077, 6080, 6083, 6085, 6088, 6091, 6093, 6096, 6099, 6101, 6104, 6107, 6109, 6112, 6115, 6117, 6120, 6122, 6125, 6128, 6130, 6133, 6135, 6138, 6140, 6143, 6145, 6148, 6151, 6153, 6156, 6158, 6161, 6163, 6166, 6168, 6170, 6173, 6175, 6178, 6180, 6183, 6185, 6188, 6190, 6193, 6195, 6197, 6200, 6202, 6205, 6207, 6209, 6212, 6214, 6216, 6219, 6221, 6224, 6226, 6228, 6231, 6233, 6235, 6238, 6240, 6242, 6244, 6247, 6249, 6251, 6254, 6256, 6258, 6260, 6263, 6265, 6267, 6269, 6272, 6274, 6276, 6278, 6281, 6283, 6285, 6287, 6289, 6292, 6294, 6296, 6298, 6300, 6303, 6305, 6307, 6309, 6311, 6313, 6316, 6318, 6320, 6322, 6324, 6326, 6328, 6330, 6333, 6335, 6337, 6339, 6341, 6343, 6345, 6347, 6349, 6351, 6353, 6356, 6358, 6360, 6362, 6364, 6366, 6368, 6370, 6372, 6374, 6376, 6378, 6380, 6382, 6384, 6386, 6388, 6390, 6392, 6394, 6396, 6398, 6400, 6402, 6404, 6406, 6408, 6410, 6412, 6414, 6416, 6418, 6420, 6421, 6423, 6425, 6427, 6429, 6431, 6433, 6435, 6437, 6439, 6441, 6443, 6444, 6446, 6448, 6450, 6452, 6454, 6456, 6458, 6459, 6461, 6463, 6465, 6467, 6469, 6471, 6472, 6474, 6476, 6478, 6480, 6482, 6483, 6485, 6487, 6489, 6491, 6493, 6494, 6496, 6498, 6500, 6502, 6503, 6505, 6507, 6509, 6510, 6512, 6514, 6516, 6518, 6519, 6521, 6523, 6525, 6526, 6528, 6530, 6532, 6533, 6535, 6537, 6538, 6540, 6542, 6544, 6545, 6547, 6549, 6550, 6552, 6554, 6556, 6557, 6559, 6561, 6562, 6564, 6566, 6567, 6569, 6571, 6572, 6574, 6576, 6577, 6579, 6581, 6582, 6584, 6586, 6587, 6589, 6591, 6592, 6594, 6596, 6597, 6599, 6600, 6602, 6604, 6605, 6607, 6609, 6610, 6612, 6613, 6615, 6617, 6618, 6620, 6621, 6623, 6625, 6626, 6628, 6629, 6631, 6632, 6634, 6636, 6637, 6639, 6640, 6642, 6643, 6645, 6647, 6648, 6650, 6651, 6653, 6654, 6656, 6657, 6659, 6660, 6662, 6663, 6665, 6667, 6668, 6670, 6671, 6673, 6674, 6676, 6677, 6679, 6680, 6682, 6683, 6685, 6686, 6688, 6689, 6691, 6692, 6694, 6695, 6697, 6698, 6699, 6701, 6702, 6704, 6705, 6707, 6708, 6710, 6711, 6713, 6714, 6716, 6717, 6718, 6720, 6721, 6723, 6724, 6726, 6727, 6729, 6730, 6731, 6733, 6734, 6736, 6737, 6739, 6740, 6741, 6743, 6744, 6746, 6747, 6748, 6750, 6751, 6753, 6754, 6755, 6757, 6758, 6760, 6761, 6762, 6764, 6765, 6767, 6768, 6769, 6771, 6772, 6773, 6775, 6776, 6778, 6779, 6780, 6782, 6783, 6784, 6786, 6787, 6788, 6790, 6791, 6793, 6794, 6795, 6797, 6798, 6799, 6801, 6802, 6803, 6805, 6806, 6807, 6809, 6810, 6811, 6813, 6814, 6815, 6816, 6818, 6819, 6820, 6822, 6823, 6824, 6826, 6827, 6828, 6830, 6831, 6832, 6833, 6835, 6836, 6837, 6839, 6840, 6841, 6842, 6844, 6845, 6846, 6848, 6849, 6850, 6851, 6853, 6854, 6855, 6856, 6858, 6859, 6860, 6862, 6863, 6864, 6865, 6867, 6868, 6869, 6870, 6872, 6873, 6874, 6875, 6877, 6878, 6879, 6880, 6882, 6883, 6884, 6885, 6886, 6888, 6889, 6890, 6891, 6893, 6894, 6895, 6896, 6897, 6899, 6900, 6901, 6902, 6904, 6905, 6906, 6907, 6908, 6910, 6911, 6912, 6913, 6914, 6916, 6917, 6918, 6919, 6920, 6921, 6923, 6924, 6925, 6926, 6927, 6929, 6930, 6931, 6932, 6933, 6934, 6936, 6937, 6938, 6939, 6940, 6941, 6943, 6944, 6945, 6946, 6947, 6948, 6950, 6951, 6952, 6953, 6954, 6955, 6957, 6958, 6959, 6960, 6961, 6962, 6963, 6965, 6966, 6967, 6968, 6969, 6970, 6971, 6972, 6974, 6975, 6976, 6977, 6978, 6979, 6980, 6981, 6983, 6984, 6985, 6986, 6987, 6988, 6989, 6990, 6991, 6993, 6994, 6995, 6996, 6997, 6998, 6999, 7000, 7001, 7003, 7004, 7005, 7006, 7007, 7008, 7009, 7010, 7011, 7012, 7013, 7015, 7016, 7017, 7018, 7019, 7020, 7021, 7022, 7023, 7024, 7025, 7026, 7027, 7029, 7030, 7031, 7032, 7033, 7034, 7035, 7036, 7037, 7038, 7039, 7040, 7041, 7042, 7043, 7044, 7046, 7047, 7048, 7049, 7050, 7051, 7052, 7053, 7054, 7055, 7056, 7057, 7058, 7059, 7060, 7061, 7062, 7063, 7064, 7065, 7066, 7067, 7068, 7069, 7070, 7071, 7073, 7074, 7075, 7076, 7077, 7078, 7079, 7080, 7081, 7082, 7083, 7084, 7085, 7086, 7087, 7088, 7089, 7090, 7091, 7092, 7093, 7094, 7095, 7096, 7097, 7098, 7099 };
-
 static volatile int shutDownNode = 0;
 static volatile unsigned char mainAuxStatus = 0;
 static volatile bool forceRefreshPeerList = false;
@@ -127,6 +130,8 @@ static unsigned short ownComputorIndicesMapping[sizeof(computorSeeds) / sizeof(c
 
 static TickStorage ts;
 static VoteCounter voteCounter;
+static RevenueScore revenueScoreCounter;
+static TickVoteMatcher tickVoteMatcher;
 static Tick etalonTick;
 static TickData nextTickData;
 
@@ -143,7 +148,9 @@ static unsigned int entityPendingTransactionIndices[SPECTRUM_CAPACITY]; // [SPEC
 static volatile char computorPendingTransactionsLock = 0;
 static unsigned char* computorPendingTransactions = NULL;
 static unsigned char* computorPendingTransactionDigests = NULL;
-static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+static PendingTransactionTickIndex<SPECTRUM_CAPACITY, MAX_NUMBER_OF_TICKS_PER_EPOCH> entityPendingTransactionTickIndex; // guarded by entityPendingTransactionsLock
+static PendingTransactionTickIndex<NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR, MAX_NUMBER_OF_TICKS_PER_EPOCH> computorPendingTransactionTickIndex; // guarded by computorPendingTransactionsLock
+static TickTransactionDigestMap nextTickTransactionDigestMap;
 
 static unsigned long long mainLoopNumerator = 0, mainLoopDenominator = 0;
 static unsigned char contractProcessorState = 0;
@@ -202,6 +209,13 @@ static bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
 static unsigned int minimumComputorScore = 0, minimumCandidateScore = 0;
 static int solutionThreshold[MAX_NUMBER_EPOCH] = { -1 };
 static unsigned long long solutionTotalExecutionTicks = 0;
+// Solutions verified by each processor (tick processor, solution processors, and request processors taking tasks while
+// idle), cumulative and at the last logInfo()
+static struct
+{
+    unsigned long long numberOfSolutions;
+    unsigned long long executionTicks;
+} solutionProcessorStats[MAX_NUMBER_OF_PROCESSORS], prevSolutionProcessorStats[MAX_NUMBER_OF_PROCESSORS];
 static unsigned long long K12MeasurementsCount = 0;
 static unsigned long long K12MeasurementsSum = 0;
 static volatile char minerScoreArrayLock = 0;
@@ -216,6 +230,9 @@ static bool loadMiningSeedFromFile = false;
 static bool loadAllNodeStateFromFile = false;
 #if TICK_STORAGE_AUTOSAVE_MODE
 static unsigned int nextPersistingNodeStateTick = 0;
+// Delta files of spectrum and universe in the snapshot directory (base files are SPECTRUM_FILE_NAME / UNIVERSE_FILE_NAME)
+static CHAR16 SPECTRUM_DELTA_FILE_NAME[] = L"snapshotSpectrumDelta";
+static CHAR16 UNIVERSE_DELTA_FILE_NAME[] = L"snapshotUniverseDelta";
 struct
 {
     Tick etalonTick;
@@ -233,7 +250,19 @@ struct
     unsigned int numberOfMiners;
     unsigned int numberOfTransactions;
     unsigned long long lastLogId;
+    // Appended last, so the node state files saved before (which end before this field) can still be loaded
+    unsigned char revenueScoreData[RevenueScore::RevenueScoreDataSize];
 } nodeStateBuffer;
+#if TICK_STORAGE_AUTOSAVE_STAGING
+// Bytes written per iteration of the main loop while saving node states in the background
+#define NODE_STATE_WRITING_STEP_SIZE (4 * 1024 * 1024)
+static StagedFileWriter nodeStateWriter;
+static CHAR16 nodeStateDirectory[16];
+static unsigned int nodeStateEpoch = 0;
+static unsigned long long nodeStateStagingTicks = 0;
+// Set until the main loop has finished writing the staged node states (including the score cache)
+static volatile bool nodeStatesWriting = false;
+#endif
 #endif
 static bool saveComputer(CHAR16* directory = NULL);
 static bool saveSystem(CHAR16* directory = NULL);
@@ -389,7 +418,11 @@ static void getComputerDigest(m256i& digest)
                 contractStateLock[digestIndex].acquireRead();
 
                 const unsigned long long startTick = __rdtsc();
+#if CONTRACT_STATE_PAGE_DIGESTS
+                contractStateDigests[digestIndex] = contractStatePageDigests[digestIndex].update(contractStates[digestIndex]);
+#else
                 KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
+#endif
                 const unsigned long long executionTicks = __rdtsc() - startTick;
 
                 contractStateLock[digestIndex].releaseRead();
@@ -406,6 +439,7 @@ static void getComputerDigest(m256i& digest)
             }
         }
     }
+    KangarooTwelve64To32Batch batch;
     unsigned int previousLevelBeginning = 0;
     unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
     while (numberOfLeafs > 1)
@@ -414,12 +448,13 @@ static void getComputerDigest(m256i& digest)
         {
             if (contractStateChangeFlags[i >> 6] & (3ULL << (i & 63)))
             {
-                KangarooTwelve64To32(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
+                batch.add(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
                 contractStateChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
                 contractStateChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
             }
             digestIndex++;
         }
+        batch.flush();
         previousLevelBeginning += numberOfLeafs;
         numberOfLeafs >>= 1;
     }
@@ -815,8 +850,10 @@ static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* heade
                 if (((Transaction*)&computorPendingTransactions[computorIndex * offset * MAX_TRANSACTION_SIZE])->tick < request->tick
                     && request->tick < system.initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
                 {
+                    computorPendingTransactionTickIndex.remove(computorIndex * offset);
                     bs->CopyMem(&computorPendingTransactions[computorIndex * offset * MAX_TRANSACTION_SIZE], request, transactionSize);
                     KangarooTwelve(request, transactionSize, &computorPendingTransactionDigests[computorIndex * offset * 32ULL], 32);
+                    computorPendingTransactionTickIndex.add(computorIndex * offset, request->tick);
                 }
 
                 RELEASE(computorPendingTransactionsLock);
@@ -835,8 +872,10 @@ static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* heade
                     if (((Transaction*)&entityPendingTransactions[spectrumIndex * MAX_TRANSACTION_SIZE])->tick < request->tick
                         && request->tick < system.initialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH)
                     {
+                        entityPendingTransactionTickIndex.remove(spectrumIndex);
                         bs->CopyMem(&entityPendingTransactions[spectrumIndex * MAX_TRANSACTION_SIZE], request, transactionSize);
                         KangarooTwelve(request, transactionSize, &entityPendingTransactionDigests[spectrumIndex * 32ULL], 32);
+                        entityPendingTransactionTickIndex.add(spectrumIndex, request->tick);
                     }
 
                     RELEASE(entityPendingTransactionsLock);
@@ -1053,31 +1092,129 @@ static void processRequestEntity(Peer* peer, RequestResponseHeader* header)
     RespondedEntity respondedEntity;
 
     RequestedEntity* request = header->getPayload<RequestedEntity>();
-    respondedEntity.entity.publicKey = request->publicKey;
-    // Inside spectrumIndex already have acquire/release lock
-    respondedEntity.spectrumIndex = spectrumIndex(respondedEntity.entity.publicKey);
     respondedEntity.tick = system.tick;
-    if (respondedEntity.spectrumIndex < 0)
+
+    // Lock-free read of entity and siblings, retried if the spectrum has been changed concurrently
+    long long sequenceNumber;
+    do
     {
-        respondedEntity.entity.incomingAmount = 0;
-        respondedEntity.entity.outgoingAmount = 0;
-        respondedEntity.entity.numberOfIncomingTransfers = 0;
-        respondedEntity.entity.numberOfOutgoingTransfers = 0;
-        respondedEntity.entity.latestIncomingTransferTick = 0;
-        respondedEntity.entity.latestOutgoingTransferTick = 0;
+        sequenceNumber = beginSpectrumRead();
+        respondedEntity.entity.publicKey = request->publicKey;
+        respondedEntity.spectrumIndex = isZero(request->publicKey) ? -1 : spectrumIndexNoLock(request->publicKey);
+        if (respondedEntity.spectrumIndex < 0)
+        {
+            respondedEntity.entity.incomingAmount = 0;
+            respondedEntity.entity.outgoingAmount = 0;
+            respondedEntity.entity.numberOfIncomingTransfers = 0;
+            respondedEntity.entity.numberOfOutgoingTransfers = 0;
+            respondedEntity.entity.latestIncomingTransferTick = 0;
+            respondedEntity.entity.latestOutgoingTransferTick = 0;
+
+            bs->SetMem(respondedEntity.siblings, sizeof(respondedEntity.siblings), 0);
+        }
+        else
+        {
+            bs->CopyMem(&respondedEntity.entity, &spectrum[respondedEntity.spectrumIndex], sizeof(::Entity));
+            getSiblings<SPECTRUM_DEPTH>(respondedEntity.spectrumIndex, spectrumDigests, respondedEntity.siblings);
+        }
+    } while (!endSpectrumRead(sequenceNumber));
+
 
-        bs->SetMem(respondedEntity.siblings, sizeof(respondedEntity.siblings), 0);
+    enqueueResponse(peer, sizeof(respondedEntity), RESPOND_ENTITY, header->dejavu(), &respondedEntity);
+}
+
+// Get the spectrum indices of the entities found, sorted and without duplicates, for
+// getMultiProofSiblingsOfSortedIndices(). Returns the number of indices.
+static unsigned int getSortedSpectrumIndices(const RespondedEntitiesEntry* entries, unsigned int numberOfEntities, int* digestIndices)
+{
+    unsigned int numberOfFoundEntities = 0;
+    for (unsigned int i = 0; i < numberOfEntities; i++)
+    {
+        if (entries[i].spectrumIndex >= 0)
+        {
+            digestIndices[numberOfFoundEntities++] = entries[i].spectrumIndex;
+        }
     }
-    else
+    return sortMultiProofIndices(digestIndices, numberOfFoundEntities);
+}
+
+// Respond entities of several public keys with a shared multi-proof, built in one consistent read of the spectrum.
+// The response is built in responseBuffer, which must hold RespondEntities::maxSize bytes.
+static void processRequestEntities(Peer* peer, RequestResponseHeader* header, unsigned char* responseBuffer)
+{
+    const unsigned int payloadSize = header->getPayloadSize();
+    if (!payloadSize || payloadSize % sizeof(m256i) || payloadSize > RequestEntities::maxNumberOfPublicKeys * sizeof(m256i))
     {
-        bs->CopyMem(&respondedEntity.entity, &spectrum[respondedEntity.spectrumIndex], sizeof(::Entity));
-        ACQUIRE(spectrumLock);
-        getSiblings<SPECTRUM_DEPTH>(respondedEntity.spectrumIndex, spectrumDigests, respondedEntity.siblings);
-        RELEASE(spectrumLock);
+        enqueueResponse(peer, 0, RespondEntities::type, header->dejavu(), NULL);
+        return;
     }
 
+    const m256i* publicKeys = header->getPayload<m256i>();
+    RespondEntities* response = (RespondEntities*)responseBuffer;
+    RespondedEntitiesEntry* entries = (RespondedEntitiesEntry*)(responseBuffer + sizeof(RespondEntities));
+    response->numberOfEntities = payloadSize / sizeof(m256i);
+    response->reserved = 0;
+    m256i* siblings = (m256i*)(entries + response->numberOfEntities);
+    int digestIndices[RequestEntities::maxNumberOfPublicKeys];
+    unsigned int numberOfDigestIndices = 0;
+    static_assert(spectrumReadMaxLockFreeAttempts > 1, "Last attempt needs the spectrum indices of a previous attempt");
+
+    // Lock-free read of entities and siblings, retried if the spectrum has been changed concurrently. The last attempt
+    // holds spectrumLock, because the read of many entities and siblings takes long enough to collide with writers.
+    // To keep the locked section short, the spectrum indices of the previous attempt are sorted before acquiring the
+    // lock. They are only sorted again if an index found while holding the lock is different.
+    long long sequenceNumber = 0;
+    for (unsigned int attempt = 1; ; attempt++)
+    {
+        const bool lastAttempt = (attempt == spectrumReadMaxLockFreeAttempts);
+        if (lastAttempt)
+        {
+            numberOfDigestIndices = getSortedSpectrumIndices(entries, response->numberOfEntities, digestIndices);
+            ACQUIRE(spectrumLock);
+        }
+        else
+        {
+            sequenceNumber = beginSpectrumRead();
+        }
 
-    enqueueResponse(peer, sizeof(respondedEntity), RESPOND_ENTITY, header->dejavu(), &respondedEntity);
+        response->tick = system.tick;
+        bool spectrumIndicesChanged = false;
+        for (unsigned int i = 0; i < response->numberOfEntities; i++)
+        {
+            RespondedEntitiesEntry& entry = entries[i];
+            const int spectrumIndex = isZero(publicKeys[i]) ? -1 : spectrumIndexNoLock(publicKeys[i]);
+            spectrumIndicesChanged |= (spectrumIndex != entry.spectrumIndex);
+            entry.spectrumIndex = spectrumIndex;
+            entry.reserved = 0;
+            if (entry.spectrumIndex < 0)
+            {
+                setMem(&entry.entity, sizeof(entry.entity), 0);
+                entry.entity.publicKey = publicKeys[i];
+            }
+            else
+            {
+                copyMem(&entry.entity, &spectrum[entry.spectrumIndex], sizeof(::Entity));
+            }
+        }
+        if (!lastAttempt || spectrumIndicesChanged)
+        {
+            numberOfDigestIndices = getSortedSpectrumIndices(entries, response->numberOfEntities, digestIndices);
+        }
+        response->numberOfSiblings = getMultiProofSiblingsOfSortedIndices<SPECTRUM_DEPTH>(digestIndices, numberOfDigestIndices, spectrumDigests, siblings);
+
+        if (lastAttempt)
+        {
+            RELEASE(spectrumLock);
+            break;
+        }
+        if (endSpectrumRead(sequenceNumber))
+        {
+            break;
+        }
+    }
+
+    enqueueResponse(peer, sizeof(RespondEntities) + response->numberOfEntities * sizeof(RespondedEntitiesEntry) + response->numberOfSiblings * sizeof(m256i),
+        RespondEntities::type, header->dejavu(), response);
 }
 
 static void processRequestContractIPO(Peer* peer, RequestResponseHeader* header)
@@ -1316,6 +1453,42 @@ static void checkAndSwitchMiningPhase()
     }
 }
 
+// Verify the next queued solution of the current tick if a score compute buffer is free
+static bool processQueuedSolution(unsigned long long processorNumber)
+{
+    const unsigned long long startTick = __rdtsc();
+    if (!score->tryProcessSolution(processorNumber))
+    {
+        return false;
+    }
+    solutionProcessorStats[processorNumber].numberOfSolutions++;
+    solutionProcessorStats[processorNumber].executionTicks += __rdtsc() - startTick;
+    return true;
+}
+
+// Request processors that aren't solution processors take queued solutions while idle, but at most one per request
+// queue lane at the same time. A verification takes hundreds of milliseconds, in which the processor doesn't handle
+// requests, so most request processors have to stay available for incoming requests.
+#define MAX_NUMBER_OF_IDLE_SOLUTION_PROCESSORS NUMBER_OF_REQUEST_QUEUE_LANES
+static volatile long numberOfIdleSolutionProcessors = 0;
+
+static bool processQueuedSolutionWhileIdle(unsigned long long processorNumber)
+{
+    if (solutionProcessorFlags[processorNumber])
+    {
+        return processQueuedSolution(processorNumber);
+    }
+
+    if (_InterlockedIncrement(&numberOfIdleSolutionProcessors) > MAX_NUMBER_OF_IDLE_SOLUTION_PROCESSORS)
+    {
+        _InterlockedDecrement(&numberOfIdleSolutionProcessors);
+        return false;
+    }
+    const bool processed = processQueuedSolution(processorNumber);
+    _InterlockedDecrement(&numberOfIdleSolutionProcessors);
+    return processed;
+}
+
 // Disabling the optimizer for requestProcessor() is a workaround introduced to solve an issue
 // that has been observed in testnets/2024-11-23-release-227-qvault.
 // In this test, the processors calling requestProcessor() were stuck before entering the function.
@@ -1331,6 +1504,7 @@ static void requestProcessor(void* ProcedureArgument)
 
     Processor* processor = (Processor*)ProcedureArgument;
     RequestResponseHeader* header = (RequestResponseHeader*)processor->buffer;
+    unsigned int requestQueueLaneScheduleIndex = 0;
     while (!shutDownNode)
     {
         checkinTime(processorNumber);
@@ -1340,7 +1514,11 @@ static void requestProcessor(void* ProcedureArgument)
             _InterlockedIncrement(&epochTransitionWaitingRequestProcessors);
             while (epochTransitionState)
             {
-                _mm_pause();
+                // help the tick processor with parallelized parts of the epoch transition
+                if (!helpWithParallelJob())
+                {
+                    _mm_pause();
+                }
             }
             _InterlockedDecrement(&epochTransitionWaitingRequestProcessors);
         }
@@ -1348,196 +1526,204 @@ static void requestProcessor(void* ProcedureArgument)
         // try to compute a solution if any is queued and this thread is assigned to compute solution
         if (solutionProcessorFlags[processorNumber])
         {
-            score->tryProcessSolution(processorNumber);
+            processQueuedSolution(processorNumber);
         }
         
-        if (requestQueueElementTail == requestQueueElementHead)
+        Peer* peer;
+        if (!dequeueRequest(header, peer, requestQueueLaneScheduleIndex))
         {
-            _mm_pause();
+            // while idle, help with parallel jobs or take queued solutions (if a score compute buffer is free and
+            // not too many request processors are verifying solutions already)
+            if (!helpWithParallelJob() && !processQueuedSolutionWhileIdle(processorNumber))
+            {
+                _mm_pause();
+            }
         }
         else
         {
-            ACQUIRE(requestQueueTailLock);
+            const unsigned long long beginningTick = __rdtsc();
 
-            if (requestQueueElementTail == requestQueueElementHead)
+            switch (header->type())
             {
-                RELEASE(requestQueueTailLock);
-            }
-            else
+            case ExchangePublicPeers::type:
             {
-                const unsigned long long beginningTick = __rdtsc();
-
-                {
-                    RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                    bs->CopyMem(header, requestHeader, requestHeader->size());
-                    requestQueueBufferTail += requestHeader->size();
-                }
+                processExchangePublicPeers(peer, header);
+            }
+            break;
 
-                Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+            case BroadcastMessage::type:
+            {
+                processBroadcastMessage(processorNumber, header);
+            }
+            break;
 
-                if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                {
-                    requestQueueBufferTail = 0;
-                }
-                requestQueueElementTail++;
+            case BroadcastComputors::type:
+            {
+                processBroadcastComputors(peer, header);
+            }
+            break;
 
-                RELEASE(requestQueueTailLock);
-                switch (header->type())
-                {
-                case ExchangePublicPeers::type:
-                {
-                    processExchangePublicPeers(peer, header);
-                }
-                break;
+            case BroadcastTick::type:
+            {
+                processBroadcastTick(peer, header);
+            }
+            break;
 
-                case BroadcastMessage::type:
-                {
-                    processBroadcastMessage(processorNumber, header);
-                }
-                break;
+            case BroadcastFutureTickData::type:
+            {
+                processBroadcastFutureTickData(peer, header);
+            }
+            break;
 
-                case BroadcastComputors::type:
-                {
-                    processBroadcastComputors(peer, header);
-                }
-                break;
+            case BROADCAST_TRANSACTION:
+            {
+                processBroadcastTransaction(peer, header);
+            }
+            break;
 
-                case BroadcastTick::type:
-                {
-                    processBroadcastTick(peer, header);
-                }
-                break;
+            case RequestComputors::type:
+            {
+                processRequestComputors(peer, header);
+            }
+            break;
 
-                case BroadcastFutureTickData::type:
-                {
-                    processBroadcastFutureTickData(peer, header);
-                }
-                break;
+            case RequestQuorumTick::type:
+            {
+                processRequestQuorumTick(peer, header);
+            }
+            break;
 
-                case BROADCAST_TRANSACTION:
-                {
-                    processBroadcastTransaction(peer, header);
-                }
-                break;
+            case RequestTickData::type:
+            {
+                processRequestTickData(peer, header);
+            }
+            break;
 
-                case RequestComputors::type:
-                {
-                    processRequestComputors(peer, header);
-                }
-                break;
+            case REQUEST_TICK_TRANSACTIONS:
+            {
+                processRequestTickTransactions(peer, header);
+            }
+            break;
 
-                case RequestQuorumTick::type:
-                {
-                    processRequestQuorumTick(peer, header);
-                }
-                break;
+            case REQUEST_TRANSACTION_INFO:
+            {
+                processRequestTransactionInfo(peer, header);
+            }
+            break;
 
-                case RequestTickData::type:
-                {
-                    processRequestTickData(peer, header);
-                }
-                break;
+            case REQUEST_CURRENT_TICK_INFO:
+            {
+                processRequestCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_TICK_TRANSACTIONS:
-                {
-                    processRequestTickTransactions(peer, header);
-                }
-                break;
+            case REQUEST_ENTITY:
+            {
+                processRequestEntity(peer, header);
+            }
+            break;
 
-                case REQUEST_TRANSACTION_INFO:
-                {
-                    processRequestTransactionInfo(peer, header);
-                }
-                break;
+            case RequestEntities::type:
+            {
+                // requests are at most RequestResponseHeader::max_size, so the response is built in the second half of the buffer
+                static_assert(RequestResponseHeader::max_size <= BUFFER_SIZE / 2 && RespondEntities::maxSize <= BUFFER_SIZE / 2, "Request processor buffer is too small");
+                processRequestEntities(peer, header, (unsigned char*)processor->buffer + BUFFER_SIZE / 2);
+            }
+            break;
 
-                case REQUEST_CURRENT_TICK_INFO:
-                {
-                    processRequestCurrentTickInfo(peer, header);
-                }
-                break;
+            case RequestContractIPO::type:
+            {
+                processRequestContractIPO(peer, header);
+            }
+            break;
 
-                case REQUEST_ENTITY:
-                {
-                    processRequestEntity(peer, header);
-                }
-                break;
+            case RequestIssuedAssets::type:
+            {
+                processRequestIssuedAssets(peer, header);
+            }
+            break;
 
-                case RequestContractIPO::type:
-                {
-                    processRequestContractIPO(peer, header);
-                }
-                break;
+            case RequestOwnedAssets::type:
+            {
+                processRequestOwnedAssets(peer, header);
+            }
+            break;
 
-                case RequestIssuedAssets::type:
-                {
-                    processRequestIssuedAssets(peer, header);
-                }
-                break;
+            case RequestPossessedAssets::type:
+            {
+                processRequestPossessedAssets(peer, header);
+            }
+            break;
 
-                case RequestOwnedAssets::type:
-                {
-                    processRequestOwnedAssets(peer, header);
-                }
-                break;
+            case RequestContractFunction::type:
+            {
+                processRequestContractFunction(peer, processorNumber, header);
+            }
+            break;
 
-                case RequestPossessedAssets::type:
-                {
-                    processRequestPossessedAssets(peer, header);
-                }
-                break;
+            case RequestLog::type:
+            {
+                logger.processRequestLog(peer, header);
+            }
+            break;
 
-                case RequestContractFunction::type:
-                {
-                    processRequestContractFunction(peer, processorNumber, header);
-                }
-                break;
+            case RequestLogStream::type:
+            {
+                logger.processRequestLogStream(peer, header);
+            }
+            break;
 
-                case RequestLog::type:
-                {
-                    logger.processRequestLog(peer, header);
-                }
-                break;
+            case RequestIndexedLogs::type:
+            {
+                logger.processRequestIndexedLogs(peer, header);
+            }
+            break;
 
-                case RequestLogIdRangeFromTx::type:
-                {
-                    logger.processRequestTxLogInfo(peer, header);
-                }
-                break;
+            case RequestLogIdRangeFromTx::type:
+            {
+                logger.processRequestTxLogInfo(peer, header);
+            }
+            break;
 
-                case RequestAllLogIdRangesFromTick::type:
-                {
-                    logger.processRequestTickTxLogInfo(peer, header);
-                }
-                break;
+            case RequestAllLogIdRangesFromTick::type:
+            {
+                logger.processRequestTickTxLogInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_SYSTEM_INFO:
-                {
-                    processRequestSystemInfo(peer, header);
-                }
-                break;
+            case REQUEST_SYSTEM_INFO:
+            {
+                processRequestSystemInfo(peer, header);
+            }
+            break;
 
-                case SpecialCommand::type:
-                {
-                    processSpecialCommand(peer, header);
-                }
-                break;
+            case SpecialCommand::type:
+            {
+                processSpecialCommand(peer, header);
+            }
+            break;
 
 #if ADDON_TX_STATUS_REQUEST
-                /* qli: process RequestTxStatus message */
-                case REQUEST_TX_STATUS:
-                {
-                    processRequestConfirmedTx(processorNumber, peer, header);
-                }
-                break;
+            /* qli: process RequestTxStatus message */
+            case REQUEST_TX_STATUS:
+            {
+                processRequestConfirmedTx(processorNumber, peer, header);
+            }
+            break;
+
+            case REQUEST_TX_STATUS_BY_DIGESTS:
+            {
+                processRequestTxStatusByDigests(processorNumber, peer, header);
+            }
+            break;
 #endif
 
-                }
+            }
 
-                queueProcessingNumerator += __rdtsc() - beginningTick;
-                queueProcessingDenominator++;
+            queueProcessingNumerator += __rdtsc() - beginningTick;
+            queueProcessingDenominator++;
 
-                _InterlockedIncrement64(&numberOfProcessedRequests);
-            }
+            _InterlockedIncrement64(&numberOfProcessedRequests);
         }
     }
 }
@@ -1855,15 +2041,14 @@ static void processTickTransactionSolution(const MiningSolutionTransaction* tran
             && transaction->inputSize == 64
             && transaction->inputType == MiningSolutionTransaction::transactionType());
 
-    m256i data[3] = { transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce };
-    static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
-    unsigned int flagIndex;
-    KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
+    // lower 32 bits of solution hash are the flag index, the full hash is reused by the score cache
+    const unsigned long long solutionHash = computeSolutionHash(transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
+    const unsigned int flagIndex = (unsigned int)solutionHash;
     if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
     {
         minerSolutionFlags[flagIndex >> 6] |= (1ULL << (flagIndex & 63));
 
-        unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
+        unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce, solutionHash);
         if (score->isValidScore(solutionScore))
         {
             resourceTestingDigest ^= (unsigned long long)(solutionScore);
@@ -2303,6 +2488,8 @@ static void processTick(unsigned long long processorNumber)
     ts.tickData.acquireLock();
     bs->CopyMem(&nextTickData, &ts.tickData[tickIndex], sizeof(TickData));
     ts.tickData.releaseLock();
+    // Tick data of a tick being processed doesn't change anymore
+    revenueScoreCounter.addTick(system.tick, nextTickData, system.epoch);
     unsigned long long solutionProcessStartTick = __rdtsc(); // for tracking the time processing solutions
     if (nextTickData.epoch == system.epoch)
     {
@@ -2334,13 +2521,11 @@ static void processTick(unsigned long long processorNumber)
                             {
                                 const m256i& solution_miningSeed = *(m256i*)transaction->inputPtr();
                                 const m256i& solution_nonce = *(m256i*)(transaction->inputPtr() + 32);
-                                m256i data[3] = { transaction->sourcePublicKey, solution_miningSeed, solution_nonce };
-                                static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
-                                unsigned int flagIndex;
-                                KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
+                                const unsigned long long solutionHash = computeSolutionHash(transaction->sourcePublicKey, solution_miningSeed, solution_nonce);
+                                const unsigned int flagIndex = (unsigned int)solutionHash;
                                 if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
                                 {
-                                    score->addTask(transaction->sourcePublicKey, solution_miningSeed, solution_nonce);
+                                    score->addTask(transaction->sourcePublicKey, solution_miningSeed, solution_nonce, solutionHash);
                                 }
                             }
                         }
@@ -2355,7 +2540,7 @@ static void processTick(unsigned long long processorNumber)
             score->startProcessTaskQueue();
             while (!score->isTaskQueueProcessed())
             {
-                score->tryProcessSolution(processorNumber);
+                processQueuedSolution(processorNumber);
             }
             score->stopProcessTaskQueue();
         }
@@ -2391,34 +2576,8 @@ static void processTick(unsigned long long processorNumber)
         _mm_pause();
     }
 
-    unsigned int digestIndex;
     ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    updateSpectrumDigestsOfCurrentTick();
 
     etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
     RELEASE(spectrumLock);
@@ -2455,11 +2614,14 @@ static void processTick(unsigned long long processorNumber)
 
                     unsigned int j = 0;
 
-                    unsigned int numberOfEntityPendingTransactionIndices;
-                    for (numberOfEntityPendingTransactionIndices = 0; numberOfEntityPendingTransactionIndices < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; numberOfEntityPendingTransactionIndices++)
+                    // Collect the pool slots of the published tick from the tick index instead of scanning the whole pools
+                    unsigned int numberOfEntityPendingTransactionIndices = 0;
+                    ACQUIRE(computorPendingTransactionsLock);
+                    for (unsigned int slot = computorPendingTransactionTickIndex.firstSlot(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET); slot != computorPendingTransactionTickIndex.noSlot; slot = computorPendingTransactionTickIndex.nextSlot(slot))
                     {
-                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices] = numberOfEntityPendingTransactionIndices;
+                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices++] = slot;
                     }
+                    RELEASE(computorPendingTransactionsLock);
                     while (j < NUMBER_OF_TRANSACTIONS_PER_TICK && numberOfEntityPendingTransactionIndices)
                     {
                         const unsigned int index = random(numberOfEntityPendingTransactionIndices);
@@ -2487,10 +2649,13 @@ static void processTick(unsigned long long processorNumber)
                         entityPendingTransactionIndices[index] = entityPendingTransactionIndices[--numberOfEntityPendingTransactionIndices];
                     }
 
-                    for (numberOfEntityPendingTransactionIndices = 0; numberOfEntityPendingTransactionIndices < SPECTRUM_CAPACITY; numberOfEntityPendingTransactionIndices++)
+                    numberOfEntityPendingTransactionIndices = 0;
+                    ACQUIRE(entityPendingTransactionsLock);
+                    for (unsigned int slot = entityPendingTransactionTickIndex.firstSlot(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET); slot != entityPendingTransactionTickIndex.noSlot; slot = entityPendingTransactionTickIndex.nextSlot(slot))
                     {
-                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices] = numberOfEntityPendingTransactionIndices;
+                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices++] = slot;
                     }
+                    RELEASE(entityPendingTransactionsLock);
                     while (j < NUMBER_OF_TRANSACTIONS_PER_TICK && numberOfEntityPendingTransactionIndices)
                     {
                         const unsigned int index = random(numberOfEntityPendingTransactionIndices);
@@ -2686,6 +2851,7 @@ static void beginEpoch()
 #endif
     ts.beginEpoch(system.initialTick);
     voteCounter.init();
+    revenueScoreCounter.init();
 #ifndef NDEBUG
     ts.checkStateConsistencyWithAssert();
 #endif
@@ -2701,6 +2867,8 @@ static void beginEpoch()
     {
         ((Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick = 0;
     }
+    computorPendingTransactionTickIndex.reset();
+    entityPendingTransactionTickIndex.reset();
 
     bs->SetMem(solutionPublicationTicks, sizeof(solutionPublicationTicks), 0);
     bs->SetMem(faultyComputorFlags, sizeof(faultyComputorFlags), 0);
@@ -2839,26 +3007,11 @@ static void endEpoch()
     // Only issue qus if the max supply is not yet reached
     if (spectrumInfo.totalAmount + ISSUANCE_RATE <= MAX_SUPPLY)
     {
-        // Compute revenue scores of computors
+        // Revenue scores of computors have been accumulated in processTick() for all ticks of the epoch
         unsigned long long revenueScore[NUMBER_OF_COMPUTORS];
-        bs->SetMem(revenueScore, sizeof(revenueScore), 0);
-        for (unsigned int tick = system.initialTick; tick < system.tick; tick++)
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
         {
-            ts.tickData.acquireLock();
-            TickData& td = ts.tickData.getByTickInCurrentEpoch(tick);
-            if (td.epoch == system.epoch)
-            {
-                unsigned int numberOfTransactions = 0;
-                for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
-                {
-                    if (!isZero(td.transactionDigests[transactionIndex]))
-                    {
-                        numberOfTransactions++;
-                    }
-                }
-                revenueScore[tick % NUMBER_OF_COMPUTORS] += revenuePoints[numberOfTransactions];
-            }
-            ts.tickData.releaseLock();
+            revenueScore[i] = revenueScoreCounter.getScore(i);
         }
 
         // Merge votecount to final rev score
@@ -2982,9 +3135,11 @@ static void endEpoch()
     // Reorganize spectrum hash map (also updates spectrumInfo)
     {
         ACQUIRE(spectrumLock);
+        beginSpectrumWrite();
 
         reorganizeSpectrum();
 
+        endSpectrumWrite();
         RELEASE(spectrumLock);
     }
 
@@ -3109,6 +3264,47 @@ static bool invalidateNodeStates(CHAR16* directory)
     return ts.saveInvalidateData(system.epoch, directory);
 }
 
+// Log what the last save of a delta snapshot wrote
+template <typename DeltaSnapshotT>
+static void logDeltaSnapshotSave(const CHAR16* name, const DeltaSnapshotT& snapshot)
+{
+    setText(message, name);
+    if (snapshot.lastSavedBase())
+    {
+        appendText(message, L" saved as new base");
+    }
+    else
+    {
+        appendText(message, (snapshot.lastSavedCompaction()) ? L" saved as compacted delta (" : L" saved as delta (");
+        appendNumber(message, snapshot.getLastSavedRecords(), TRUE);
+        appendText(message, L" changed records, ");
+        appendNumber(message, snapshot.getNumberOfDeltas(), TRUE);
+        appendText(message, L" deltas since base)");
+    }
+    logToConsole(message);
+}
+
+// Copy the mining states and other variables into nodeStateBuffer
+static void fillNodeStateBuffer()
+{
+    copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
+    copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
+    copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
+    copyMem(nodeStateBuffer.competitorPublicKeys, (void*)competitorPublicKeys, sizeof(competitorPublicKeys));
+    copyMem(nodeStateBuffer.competitorScores, (void*)competitorScores, sizeof(competitorScores));
+    copyMem(nodeStateBuffer.competitorComputorStatuses, (void*)competitorComputorStatuses, sizeof(competitorComputorStatuses));
+    copyMem(nodeStateBuffer.solutionPublicationTicks, (void*)solutionPublicationTicks, sizeof(solutionPublicationTicks));
+    copyMem(nodeStateBuffer.faultyComputorFlags, (void*)faultyComputorFlags, sizeof(faultyComputorFlags));
+    copyMem(&nodeStateBuffer.broadcastedComputors, (void*)&broadcastedComputors, sizeof(broadcastedComputors));
+    copyMem(&nodeStateBuffer.resourceTestingDigest, &resourceTestingDigest, sizeof(resourceTestingDigest));
+    nodeStateBuffer.currentRandomSeed = score->currentRandomSeed;
+    nodeStateBuffer.numberOfMiners = numberOfMiners;
+    nodeStateBuffer.numberOfTransactions = numberOfTransactions;
+    nodeStateBuffer.lastLogId = logger.logId;
+    voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
+    revenueScoreCounter.saveAllDataToArray(nodeStateBuffer.revenueScoreData);
+}
+
 // can only called from main thread
 static bool saveAllNodeStates()
 {
@@ -3134,11 +3330,15 @@ static bool saveAllNodeStates()
     appendText(message, directory); appendText(message, L"/");
     appendText(message, SPECTRUM_FILE_NAME);
     logToConsole(message);
-    if (!saveSpectrum(SPECTRUM_FILE_NAME, directory))
+    ACQUIRE(spectrumLock);
+    bool ok = spectrumSnapshot.saveToFiles(spectrum, SPECTRUM_FILE_NAME, directory, system.epoch);
+    RELEASE(spectrumLock);
+    if (!ok)
     {
         logToConsole(L"Failed to save spectrum");
         return false;
     }
+    logDeltaSnapshotSave(L"spectrum", spectrumSnapshot);
 
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
@@ -3147,11 +3347,15 @@ static bool saveAllNodeStates()
     appendText(message, directory); appendText(message, L"/");
     appendText(message, UNIVERSE_FILE_NAME);
     logToConsole(message);
-    if (!saveUniverse(UNIVERSE_FILE_NAME, directory))
+    ACQUIRE(universeLock);
+    ok = universeSnapshot.saveToFiles(assets, UNIVERSE_FILE_NAME, directory, system.epoch);
+    RELEASE(universeLock);
+    if (!ok)
     {
         logToConsole(L"Failed to save universe");
         return false;
     }
+    logDeltaSnapshotSave(L"universe", universeSnapshot);
 
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
@@ -3176,21 +3380,7 @@ static bool saveAllNodeStates()
     
     score->saveScoreCache(system.epoch, directory);
     
-    copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
-    copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
-    copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
-    copyMem(nodeStateBuffer.competitorPublicKeys, (void*)competitorPublicKeys, sizeof(competitorPublicKeys));
-    copyMem(nodeStateBuffer.competitorScores, (void*)competitorScores, sizeof(competitorScores));
-    copyMem(nodeStateBuffer.competitorComputorStatuses, (void*)competitorComputorStatuses, sizeof(competitorComputorStatuses));
-    copyMem(nodeStateBuffer.solutionPublicationTicks, (void*)solutionPublicationTicks, sizeof(solutionPublicationTicks));
-    copyMem(nodeStateBuffer.faultyComputorFlags, (void*)faultyComputorFlags, sizeof(faultyComputorFlags));
-    copyMem(&nodeStateBuffer.broadcastedComputors, (void*)&broadcastedComputors, sizeof(broadcastedComputors));
-    copyMem(&nodeStateBuffer.resourceTestingDigest, &resourceTestingDigest, sizeof(resourceTestingDigest));
-    nodeStateBuffer.currentRandomSeed = score->currentRandomSeed;
-    nodeStateBuffer.numberOfMiners = numberOfMiners;
-    nodeStateBuffer.numberOfTransactions = numberOfTransactions;
-    nodeStateBuffer.lastLogId = logger.logId;
-    voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
+    fillNodeStateBuffer();
 
     CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
     savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
@@ -3256,6 +3446,177 @@ static bool saveAllNodeStates()
     return true;
 }
 
+#if TICK_STORAGE_AUTOSAVE_STAGING
+
+// Size of the staging buffer of nodeStateWriter, which holds copies of all node states that may change while the
+// files are written
+static unsigned long long getNodeStateStagingBufferSize()
+{
+    unsigned long long size = spectrumSizeInBytes + ASSETS_CAPACITY * sizeof(Asset) + sizeof(system)
+        + spectrumDigestsSizeInByte + assetDigestsSizeInBytes + contractStateDigestsSizeInBytes + NUMBER_OF_MINER_SOLUTION_FLAGS / 8;
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        size += contractDescriptions[contractIndex].stateSize;
+    }
+
+    // Data of the last saved tick and metadata of tick storage
+    size += sizeof(TickData) + sizeof(Tick) * NUMBER_OF_COMPUTORS + sizeof(unsigned long long) * NUMBER_OF_TRANSACTIONS_PER_TICK + 4096;
+#if ADDON_TX_STATUS_REQUEST
+    size += sizeof(txStatusData);
+#endif
+
+    // Staged copies are aligned to 64 bytes
+    return size + (contractCount + 16) * 64ULL;
+}
+
+// Stage size bytes of data and add it to nodeStateWriter as file fileName
+static bool stageNodeStateFile(const CHAR16* fileName, const void* data, unsigned long long size)
+{
+    const void* stagedData = nodeStateWriter.stage(data, size);
+    return stagedData && nodeStateWriter.addFile(fileName, stagedData, size);
+}
+
+// Same as saveAllNodeStates(), but the states are only copied into the staging buffer of nodeStateWriter, which
+// takes a fraction of the time of writing them. The files are written by the main loop afterwards.
+// can only called from main thread while the tick processor is waiting
+static bool stageAllNodeStates()
+{
+    nodeStateEpoch = system.epoch;
+    setText(nodeStateDirectory, L"ep");
+    appendNumber(nodeStateDirectory, system.epoch, false);
+
+    logToConsole(L"Start staging node states from main thread");
+
+    // Mark current snapshot metadata as invalid at the beginning (see saveAllNodeStates())
+    if (!invalidateNodeStates(nodeStateDirectory))
+    {
+        logToConsole(L"Failed to init snapshot metadata");
+        return false;
+    }
+
+    nodeStateWriter.begin(nodeStateDirectory);
+
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
+    ACQUIRE(spectrumLock);
+    bool ok = spectrumSnapshot.addToStagedFileWriter(nodeStateWriter, spectrum, SPECTRUM_FILE_NAME, system.epoch);
+    RELEASE(spectrumLock);
+    if (!ok)
+    {
+        logToConsole(L"Failed to stage spectrum");
+        return false;
+    }
+
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
+    ACQUIRE(universeLock);
+    ok = universeSnapshot.addToStagedFileWriter(nodeStateWriter, assets, UNIVERSE_FILE_NAME, system.epoch);
+    RELEASE(universeLock);
+    if (!ok)
+    {
+        logToConsole(L"Failed to stage universe");
+        return false;
+    }
+
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        contractStateLock[contractIndex].acquireRead();
+        ok = stageNodeStateFile(CONTRACT_FILE_NAME, contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
+        contractStateLock[contractIndex].releaseRead();
+        if (!ok)
+        {
+            logToConsole(L"Failed to stage computer");
+            return false;
+        }
+    }
+
+    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
+    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
+    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
+    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
+    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
+    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
+
+    // nodeStateBuffer isn't changed until the next save, so it is written without staging
+    fillNodeStateBuffer();
+    if (!stageNodeStateFile(SYSTEM_SNAPSHOT_FILE_NAME, &system, sizeof(system))
+        || !nodeStateWriter.addFile(NODE_STATE_FILE_NAME, &nodeStateBuffer, sizeof(nodeStateBuffer))
+        || !stageNodeStateFile(SPECTRUM_DIGEST_FILE_NAME, spectrumDigests, spectrumDigestsSizeInByte)
+        || !stageNodeStateFile(UNIVERSE_DIGEST_FILE_NAME, assetDigests, assetDigestsSizeInBytes)
+        || !stageNodeStateFile(COMPUTER_DIGEST_FILE_NAME, contractStateDigests, contractStateDigestsSizeInBytes)
+        || !stageNodeStateFile(MINER_SOL_FLAG_FILE_NAME, minerSolutionFlags, NUMBER_OF_MINER_SOLUTION_FLAGS / 8))
+    {
+        logToConsole(L"Failed to stage system, mining states and digests");
+        return false;
+    }
+
+#if ADDON_TX_STATUS_REQUEST
+    if (!addStateTxStatusToStagedFileWriter(nodeStateWriter, numberOfTransactions))
+    {
+        logToConsole(L"Failed to stage tx status");
+        return false;
+    }
+#endif
+
+    // Tick storage comes last, because its metadata file marks the snapshot as valid
+    if (!ts.addToStagedFileWriter(nodeStateWriter, system.epoch, system.tick))
+    {
+        logToConsole(L"Failed to stage tick storage");
+        return false;
+    }
+
+    return true;
+}
+
+// Segment and delta files of the last save may be missing or incomplete, so the next save has to write all ticks and
+// new bases
+static void requireFullNodeStateSave()
+{
+    ts.resetSnapshotSegments();
+    spectrumSnapshot.requireBase();
+    universeSnapshot.requireBase();
+}
+
+// Called by the main loop after nodeStateWriter has finished
+static void finishWritingNodeStates()
+{
+    if (nodeStateWriter.hasFailed())
+    {
+        requireFullNodeStateSave();
+        logToConsole(L"Failed to write node states");
+    }
+    else
+    {
+        logDeltaSnapshotSave(L"spectrum", spectrumSnapshot);
+        logDeltaSnapshotSave(L"universe", universeSnapshot);
+
+        // The score cache is only a cache, so it is saved directly instead of staging it
+        score->saveScoreCache(nodeStateEpoch, nodeStateDirectory);
+
+        setNumber(message, nodeStateWriter.getWrittenSize(), TRUE);
+        appendText(message, L" bytes of node states written in ");
+        appendNumber(message, nodeStateWriter.getWritingMilliseconds(), TRUE);
+        appendText(message, L" ms (");
+        appendNumber(message, nodeStateWriter.getWritingThroughput() / (1024 * 1024), TRUE);
+        appendText(message, L" MiB/s), tick processor paused for ");
+        appendNumber(message, nodeStateStagingTicks * 1000 / frequency, TRUE);
+        appendText(message, L" ms.");
+        logToConsole(message);
+    }
+    nodeStatesWriting = false;
+}
+
+#endif
+
 static bool loadAllNodeStates()
 {
     CHAR16 directory[16];
@@ -3281,20 +3642,23 @@ static bool loadAllNodeStates()
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
-    if (!loadSpectrum(SPECTRUM_FILE_NAME, directory))
+    if (!spectrumSnapshot.loadFromFiles(spectrum, SPECTRUM_FILE_NAME, directory, system.epoch))
     {
         logToConsole(L"Failed to load spectrum");
         return false;
     }
+    updateSpectrumInfo();
+    invalidateSpectrumTickJournal();
 
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
-    if (!loadUniverse(UNIVERSE_FILE_NAME, directory))
+    if (!universeSnapshot.loadFromFiles(assets, UNIVERSE_FILE_NAME, directory, system.epoch))
     {
         logToConsole(L"Failed to load universe");
         return false;
     }
+    as.indexLists.rebuild();
 
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
@@ -3307,8 +3671,12 @@ static bool loadAllNodeStates()
     }
 
     CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
-    long long loadedSize = load(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
-    if (loadedSize != sizeof(nodeStateBuffer))
+    // Node state files saved by older versions don't contain the revenue scores, they are rebuilt from the tick data
+    constexpr unsigned long long nodeStateSizeWithoutRevenueScore = sizeof(nodeStateBuffer) - sizeof(nodeStateBuffer.revenueScoreData);
+    const bool rebuildRevenueScore = (getFileSize(NODE_STATE_FILE_NAME, directory) == nodeStateSizeWithoutRevenueScore);
+    const unsigned long long nodeStateSize = rebuildRevenueScore ? nodeStateSizeWithoutRevenueScore : sizeof(nodeStateBuffer);
+    long long loadedSize = load(NODE_STATE_FILE_NAME, nodeStateSize, (unsigned char*)&nodeStateBuffer, directory);
+    if (loadedSize != nodeStateSize)
     {
         logToConsole(L"Failed to load mining state");
         return false;
@@ -3327,8 +3695,14 @@ static bool loadAllNodeStates()
     initialRandomSeedFromPersistingState = nodeStateBuffer.currentRandomSeed;
     numberOfTransactions = nodeStateBuffer.numberOfTransactions;
     logger.logId = nodeStateBuffer.lastLogId;
+    logger.digestedLogId = logger.logId;
     loadMiningSeedFromFile = true;
     voteCounter.loadAllDataFromArray(nodeStateBuffer.voteCounterData);
+    tickVoteMatcher.invalidate();
+    if (!rebuildRevenueScore)
+    {
+        revenueScoreCounter.loadAllDataFromArray(nodeStateBuffer.revenueScoreData);
+    }
 
     // update own computor indices
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
@@ -3353,6 +3727,17 @@ static bool loadAllNodeStates()
         return false;
     }
 
+    if (rebuildRevenueScore)
+    {
+        // The node state was saved before processing system.tick, so all ticks before it have been added
+        logToConsole(L"Rebuilding revenue scores from tick data");
+        revenueScoreCounter.init();
+        for (unsigned int tick = system.initialTick; tick < system.tick; tick++)
+        {
+            revenueScoreCounter.addTick(tick, ts.tickData.getByTickInCurrentEpoch(tick), system.epoch);
+        }
+    }
+
     setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
     setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
     CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
@@ -3623,84 +4008,77 @@ static void prepareNextTickTransactions()
         
     if (numberOfKnownNextTickTransactions != numberOfNextTickTransactions)
     {
-        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; i++)
+        // Map digests of unknown transactions to their index in the tick, so each pending transaction is matched with one lookup
+        nextTickTransactionDigestMap.reset();
+        for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
+        {
+            if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
+            {
+                nextTickTransactionDigestMap.add(nextTickData.transactionDigests[j], j);
+            }
+        }
+
+        // Only visit the pending transactions scheduled for the next tick, using the tick indices of the pools
+        auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(nextTick);
+        ACQUIRE(computorPendingTransactionsLock);
+        for (unsigned int i = computorPendingTransactionTickIndex.firstSlot(nextTick); i != computorPendingTransactionTickIndex.noSlot && numberOfKnownNextTickTransactions != numberOfNextTickTransactions; i = computorPendingTransactionTickIndex.nextSlot(i))
         {
             Transaction* pendingTransaction = (Transaction*)&computorPendingTransactions[i * MAX_TRANSACTION_SIZE];
             if (pendingTransaction->tick == nextTick)
             {
-                ACQUIRE(computorPendingTransactionsLock);
-
                 ASSERT(pendingTransaction->checkValidity());
-                auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
-                for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
+                const int j = nextTickTransactionDigestMap.findAndRemove(*((m256i*)&computorPendingTransactionDigests[i * 32ULL]), nextTickData.transactionDigests);
+                if (j >= 0)
                 {
-                    if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
+                    ts.tickTransactions.acquireLock();
+                    if (!tsPendingTransactionOffsets[j])
                     {
-                        if (&computorPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
+                        const unsigned int transactionSize = pendingTransaction->totalSize();
+                        if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                         {
-                            ts.tickTransactions.acquireLock();
-                            if (!tsPendingTransactionOffsets[j])
-                            {
-                                const unsigned int transactionSize = pendingTransaction->totalSize();
-                                if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                                {
-                                    tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
-                                    bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
-                                    ts.nextTickTransactionOffset += transactionSize;
-                                }
-                            }
-                            ts.tickTransactions.releaseLock();
-
-                            numberOfKnownNextTickTransactions++;
-                            unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
-
-                            break;
+                            tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
+                            bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
+                            ts.nextTickTransactionOffset += transactionSize;
                         }
                     }
-                }
+                    ts.tickTransactions.releaseLock();
 
-                RELEASE(computorPendingTransactionsLock);
+                    numberOfKnownNextTickTransactions++;
+                    unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
+                }
             }
         }
-        for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+        RELEASE(computorPendingTransactionsLock);
+
+        ACQUIRE(entityPendingTransactionsLock);
+        for (unsigned int i = entityPendingTransactionTickIndex.firstSlot(nextTick); i != entityPendingTransactionTickIndex.noSlot && numberOfKnownNextTickTransactions != numberOfNextTickTransactions; i = entityPendingTransactionTickIndex.nextSlot(i))
         {
             Transaction* pendingTransaction = (Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE];
             if (pendingTransaction->tick == nextTick)
             {
-                ACQUIRE(entityPendingTransactionsLock);
-
                 ASSERT(pendingTransaction->checkValidity());
-                auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
-                for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
+                const int j = nextTickTransactionDigestMap.findAndRemove(*((m256i*)&entityPendingTransactionDigests[i * 32ULL]), nextTickData.transactionDigests);
+                if (j >= 0)
                 {
-                    if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
+                    ts.tickTransactions.acquireLock();
+                    if (!tsPendingTransactionOffsets[j])
                     {
-                        if (&entityPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
+                        const unsigned int transactionSize = pendingTransaction->totalSize();
+                        if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                         {
-                            ts.tickTransactions.acquireLock();
-                            if (!tsPendingTransactionOffsets[j])
-                            {
-                                const unsigned int transactionSize = pendingTransaction->totalSize();
-                                if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                                {
-                                    tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
-                                    bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
-                                    ts.nextTickTransactionOffset += transactionSize;
-                                }
-                            }
-                            ts.tickTransactions.releaseLock();
-
-                            numberOfKnownNextTickTransactions++;
-                            unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
-
-                            break;
+                            tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
+                            bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
+                            ts.nextTickTransactionOffset += transactionSize;
                         }
                     }
-                }
+                    ts.tickTransactions.releaseLock();
 
-                RELEASE(entityPendingTransactionsLock);
+                    numberOfKnownNextTickTransactions++;
+                    unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
+                }
             }
         }
+        RELEASE(entityPendingTransactionsLock);
 
         // Update requestedTickTransactions the list of txs that not exist in memory so the MAIN loop can try to fetch them from peers
         for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
@@ -3755,6 +4133,7 @@ static void updateVotesCount(unsigned int& tickNumberOfComputors, unsigned int&
 {
     const unsigned int currentTickIndex = ts.tickToIndexCurrentEpoch(system.tick);
     const Tick* tsCompTicks = ts.ticks.getByTickIndex(currentTickIndex);
+    tickVoteMatcher.prepare(system.tick, system.epoch, etalonTick, resourceTestingDigest, broadcastedComputors.computors.publicKeys);
     for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
     {
         ts.ticks.acquireLock(i);
@@ -3764,38 +4143,15 @@ static void updateVotesCount(unsigned int& tickNumberOfComputors, unsigned int&
         {
             tickTotalNumberOfComputors++;
 
-            if (*((unsigned long long*) & tick->millisecond) == *((unsigned long long*) & etalonTick.millisecond)
-                && tick->prevSpectrumDigest == etalonTick.prevSpectrumDigest
-                && tick->prevUniverseDigest == etalonTick.prevUniverseDigest
-                && tick->prevComputerDigest == etalonTick.prevComputerDigest
-                && tick->transactionDigest == etalonTick.transactionDigest)
-            {
-                m256i saltedData[2];
-                m256i saltedDigest;
-                saltedData[0] = broadcastedComputors.computors.publicKeys[tick->computorIndex];
-                saltedData[1].m256i_u64[0] = resourceTestingDigest;
-                KangarooTwelve(saltedData, 32 + sizeof(resourceTestingDigest), &saltedDigest, sizeof(resourceTestingDigest));
-                if (tick->saltedResourceTestingDigest == saltedDigest.m256i_u64[0])
+            bool isNewMatch;
+            if (tickVoteMatcher.matches(i, *tick, isNewMatch))
+            {
+                tickNumberOfComputors++;
+                if (isNewMatch)
                 {
-                    saltedData[1] = etalonTick.saltedSpectrumDigest;
-                    KangarooTwelve64To32(saltedData, &saltedDigest);
-                    if (tick->saltedSpectrumDigest == saltedDigest)
-                    {
-                        saltedData[1] = etalonTick.saltedUniverseDigest;
-                        KangarooTwelve64To32(saltedData, &saltedDigest);
-                        if (tick->saltedUniverseDigest == saltedDigest)
-                        {
-                            saltedData[1] = etalonTick.saltedComputerDigest;
-                            KangarooTwelve64To32(saltedData, &saltedDigest);
-                            if (tick->saltedComputerDigest == saltedDigest)
-                            {
-                                tickNumberOfComputors++;
-                                // to avoid submitting invalid votes (eg: all zeroes with valid signature)
-                                // only count votes that matched etalonTick
-                                voteCounter.registerNewVote(tick->tick, tick->computorIndex);
-                            }
-                        }
-                    }
+                    // to avoid submitting invalid votes (eg: all zeroes with valid signature)
+                    // only count votes that matched etalonTick
+                    voteCounter.registerNewVote(tick->tick, tick->computorIndex);
                 }
             }
         }
@@ -3892,6 +4248,7 @@ static void tickProcessor(void*)
                     persistingNodeStateTickProcWaiting = 0;
                 }
                 processTick(processorNumber);
+                logger.updateDigests();
                 latestProcessedTick = system.tick;
             }
 
@@ -4209,8 +4566,18 @@ static void tickProcessor(void*)
                                         _mm_pause();
                                     }
 
+#if TICK_STORAGE_AUTOSAVE_MODE && TICK_STORAGE_AUTOSAVE_STAGING
+                                    // tick storage and confirmed transactions of the node state are written by the main
+                                    // loop without staging, so wait until it is done before beginEpoch() resets them
+                                    while (nodeStatesWriting)
+                                    {
+                                        _mm_pause();
+                                    }
+#endif
+
                                     // end current epoch
                                     endEpoch();
+                                    logger.updateDigests();
 
                                     // instruct main loop to save system and wait until it is done
                                     systemMustBeSaved = true;
@@ -4491,6 +4858,11 @@ static bool initialize()
 
             return false;
         }
+        if (!computorPendingTransactionTickIndex.init() || !entityPendingTransactionTickIndex.init())
+        {
+            logToConsole(L"Failed to allocate pending transaction tick index!");
+            return false;
+        }
         bs->SetMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
 
         if (!initSpectrum())
@@ -4512,6 +4884,14 @@ static bool initialize()
 
                 return false;
             }
+#if CONTRACT_STATE_PAGE_DIGESTS
+            if (!contractStatePageDigests[contractIndex].init(size))
+            {
+                logToConsole(L"Failed to allocate contract state page digests!");
+
+                return false;
+            }
+#endif
         }
 
         if (status = bs->AllocatePool(EfiRuntimeServicesData, sizeof(*score), (void**)&score))
@@ -4529,10 +4909,32 @@ static bool initialize()
             return false;
         }
 
+#if TICK_STORAGE_AUTOSAVE_MODE
+        if (!spectrumSnapshot.init(SPECTRUM_DELTA_FILE_NAME) || !universeSnapshot.init(UNIVERSE_DELTA_FILE_NAME))
+        {
+            logToConsole(L"Failed to allocate spectrum / universe snapshot buffers!");
+            return false;
+        }
+#endif
+#if TICK_STORAGE_AUTOSAVE_MODE && TICK_STORAGE_AUTOSAVE_STAGING
+        if (!nodeStateWriter.init(getNodeStateStagingBufferSize()))
+        {
+            logToConsole(L"Failed to allocate node state staging buffer!");
+            return false;
+        }
+#endif
+
         if (!logger.initLogging())
         {
             return false;
         }
+#if LOG_PERSIST_TO_DISK
+        createDir(LOG_SEGMENTS_DIRECTORY);
+        if (!logger.openLogSegments(LOG_SEGMENTS_DIRECTORY))
+        {
+            return false;
+        }
+#endif
             
 
 #if ADDON_TX_STATUS_REQUEST
@@ -4582,23 +4984,7 @@ static bool initialize()
             {
                 const unsigned long long beginningTick = __rdtsc();
 
-                unsigned int digestIndex;
-                for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                {
-                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                }
-                unsigned int previousLevelBeginning = 0;
-                unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                while (numberOfLeafs > 1)
-                {
-                    for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                    {
-                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-                    }
-
-                    previousLevelBeginning += numberOfLeafs;
-                    numberOfLeafs >>= 1;
-                }
+                computeSpectrumDigests();
 
                 setNumber(message, SPECTRUM_CAPACITY * sizeof(::Entity), TRUE);
                 appendText(message, L" bytes of the spectrum data are hashed (");
@@ -4691,6 +5077,7 @@ static bool initialize()
 
         return false;
     }
+    initRequestQueueLanes();
 
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
@@ -4794,6 +5181,9 @@ static void deinitialize()
         {
             bs->FreePool(contractStates[contractIndex]);
         }
+#if CONTRACT_STATE_PAGE_DIGESTS
+        contractStatePageDigests[contractIndex].deinit();
+#endif
     }
 
     if (computorPendingTransactionDigests)
@@ -4812,7 +5202,16 @@ static void deinitialize()
     {
         bs->FreePool(entityPendingTransactions);
     }
+    entityPendingTransactionTickIndex.deinit();
+    computorPendingTransactionTickIndex.deinit();
     ts.deinit();
+#if TICK_STORAGE_AUTOSAVE_MODE
+    spectrumSnapshot.deinit();
+    universeSnapshot.deinit();
+#endif
+#if TICK_STORAGE_AUTOSAVE_MODE && TICK_STORAGE_AUTOSAVE_STAGING
+    nodeStateWriter.deinit();
+#endif
 
     if (score)
     {
@@ -4932,6 +5331,15 @@ static void logInfo()
     appendNumber(message, numberOfTransmittedBytes - prevNumberOfTransmittedBytes, TRUE);
     appendText(message, L" ..."); appendNumber(message, numberOfWaitingBytes, TRUE);
     appendText(message, L").");
+    if (numberOfReceivedBytes - prevNumberOfReceivedBytes)
+    {
+        // bytes copied per received byte (in percent)
+        appendText(message, L" Copied ");
+        appendNumber(message, (numberOfRequestQueueCopiedBytes - prevNumberOfRequestQueueCopiedBytes) * 100 / (numberOfReceivedBytes - prevNumberOfReceivedBytes), FALSE);
+        appendText(message, L"% to queue + ");
+        appendNumber(message, (numberOfReceiveBufferCopiedBytes - prevNumberOfReceiveBufferCopiedBytes) * 100 / (numberOfReceivedBytes - prevNumberOfReceivedBytes), FALSE);
+        appendText(message, L"% in receive buffers.");
+    }
 #if USE_SCORE_CACHE
     appendText(message, L" Score cache: Hit ");
     appendNumber(message, score->scoreCache.hitCount(), TRUE);
@@ -4947,6 +5355,8 @@ static void logInfo()
     prevNumberOfDisseminatedRequests = numberOfDisseminatedRequests;
     prevNumberOfReceivedBytes = numberOfReceivedBytes;
     prevNumberOfTransmittedBytes = numberOfTransmittedBytes;
+    prevNumberOfRequestQueueCopiedBytes = numberOfRequestQueueCopiedBytes;
+    prevNumberOfReceiveBufferCopiedBytes = numberOfReceiveBufferCopiedBytes;
 
     setNumber(message, numberOfProcessors - 2, TRUE);
 
@@ -5043,9 +5453,14 @@ static void logInfo()
     appendText(message, L" pending transactions.");
     logToConsole(message);
 
-    unsigned int filledRequestQueueBufferSize = (requestQueueBufferHead >= requestQueueBufferTail) ? (requestQueueBufferHead - requestQueueBufferTail) : (REQUEST_QUEUE_BUFFER_SIZE - (requestQueueBufferTail - requestQueueBufferHead));
+    unsigned int filledRequestQueueBufferSize = 0;
+    unsigned int filledRequestQueueLength = 0;
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        filledRequestQueueBufferSize += requestQueueLanes[laneIndex].filledBufferSize();
+        filledRequestQueueLength += requestQueueLanes[laneIndex].filledLength();
+    }
     unsigned int filledResponseQueueBufferSize = (responseQueueBufferHead >= responseQueueBufferTail) ? (responseQueueBufferHead - responseQueueBufferTail) : (RESPONSE_QUEUE_BUFFER_SIZE - (responseQueueBufferTail - responseQueueBufferHead));
-    unsigned int filledRequestQueueLength = (requestQueueElementHead >= requestQueueElementTail) ? (requestQueueElementHead - requestQueueElementTail) : (REQUEST_QUEUE_LENGTH - (requestQueueElementTail - requestQueueElementHead));
     unsigned int filledResponseQueueLength = (responseQueueElementHead >= responseQueueElementTail) ? (responseQueueElementHead - responseQueueElementTail) : (RESPONSE_QUEUE_LENGTH - (responseQueueElementTail - responseQueueElementHead));
     setNumber(message, filledRequestQueueBufferSize, TRUE);
     appendText(message, L" (");
@@ -5069,7 +5484,78 @@ static void logInfo()
     appendNumber(message, solutionTotalExecutionTicks * 1000 / frequency, TRUE);
     appendText(message, L" ms | Spectrum reorg time = ");
     appendNumber(message, spectrumReorgTotalExecutionTicks * 1000 / frequency, TRUE);
-    appendText(message, L" ms.");
+    appendText(message, L" ms | Spectrum digest updates (journal/full scan) = ");
+    appendNumber(message, spectrumDigestUpdateJournalCount, TRUE);
+    appendText(message, L"/");
+    appendNumber(message, spectrumDigestUpdateFullScanCount, TRUE);
+    appendText(message, L" | Parallel jobs = ");
+    appendNumber(message, parallelJob.numberOfJobs, TRUE);
+    appendText(message, L" (speedup ");
+    const unsigned long long parallelJobSpeedupTimes10 = getParallelJobSpeedupTimes10();
+    appendNumber(message, parallelJobSpeedupTimes10 / 10, FALSE);
+    appendText(message, L".");
+    appendNumber(message, parallelJobSpeedupTimes10 % 10, FALSE);
+    appendText(message, L"x, ");
+    appendNumber(message, parallelJob.numberOfHelperChunks, TRUE);
+    appendText(message, L" chunks done by helpers).");
+    logToConsole(message);
+
+    setText(message, L"Request lanes (consensus | transactions | queries): ");
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        const RequestQueueLane& lane = requestQueueLanes[laneIndex];
+        if (laneIndex)
+        {
+            appendText(message, L" | ");
+        }
+        appendNumber(message, lane.filledBufferSize(), TRUE);
+        appendText(message, L" (");
+        appendNumber(message, lane.filledLength(), TRUE);
+        appendText(message, L"), wait ");
+        if (lane.waitingTicksDenominator)
+        {
+            appendNumber(message, (lane.waitingTicksNumerator / lane.waitingTicksDenominator) * 1000000 / frequency, TRUE);
+        }
+        else
+        {
+            appendText(message, L"?");
+        }
+        appendText(message, L" mcs, ");
+        appendNumber(message, lane.numberOfDiscardedRequests, TRUE);
+        appendText(message, L" dropped");
+    }
+    appendText(message, L".");
+    logToConsole(message);
+
+    setText(message, L"Solutions verified since last log (processor: count, time):");
+    unsigned long long numberOfSolutions = 0, numberOfStolenSolutions = 0;
+    for (unsigned int i = 0; i < MAX_NUMBER_OF_PROCESSORS; i++)
+    {
+        const unsigned long long processorSolutions = solutionProcessorStats[i].numberOfSolutions - prevSolutionProcessorStats[i].numberOfSolutions;
+        const unsigned long long processorTicks = solutionProcessorStats[i].executionTicks - prevSolutionProcessorStats[i].executionTicks;
+        prevSolutionProcessorStats[i].numberOfSolutions += processorSolutions;
+        prevSolutionProcessorStats[i].executionTicks += processorTicks;
+        if (processorSolutions)
+        {
+            appendText(message, L" #");
+            appendNumber(message, i, FALSE);
+            appendText(message, L": ");
+            appendNumber(message, processorSolutions, TRUE);
+            appendText(message, L", ");
+            appendNumber(message, processorTicks * 1000 / frequency, TRUE);
+            appendText(message, L" ms |");
+            numberOfSolutions += processorSolutions;
+            if (!solutionProcessorFlags[i] && i != tickProcessorIDs[0])
+            {
+                numberOfStolenSolutions += processorSolutions;
+            }
+        }
+    }
+    appendText(message, L" total ");
+    appendNumber(message, numberOfSolutions, TRUE);
+    appendText(message, L" (");
+    appendNumber(message, numberOfStolenSolutions, TRUE);
+    appendText(message, L" taken by idle request processors).");
     logToConsole(message);
 }
 
@@ -5979,6 +6465,11 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
 
                 processKeyPresses();
 
+#if LOG_PERSIST_TO_DISK
+                logger.flushToDisk(LOG_FLUSH_STEP_SIZE);
+                logger.processDiskReads();
+#endif
+
 #if TICK_STORAGE_AUTOSAVE_MODE
                 bool nextAutoSaveTickUpdated = false;
                 if (mainAuxStatus & 1)
@@ -5993,7 +6484,11 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                 else
                 {
                     // AUX mode
+#if TICK_STORAGE_AUTOSAVE_STAGING
+                    if (system.tick > ts.getPreloadTick() && !nodeStatesWriting) // check the last saved tick
+#else
                     if (system.tick > ts.getPreloadTick()) // check the last saved tick
+#endif
                     {
                         // Start auto save if nextAutoSaveTick == system.tick (or if the main loop has missed nextAutoSaveTick)
                         if (system.tick >= nextPersistingNodeStateTick)
@@ -6009,6 +6504,45 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                 }
                 if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1)
                 {
+#if TICK_STORAGE_AUTOSAVE_STAGING
+                    if (nodeStatesWriting)
+                    {
+                        // Previous save still running (F8 pressed while writing) -> finish it while the tick processor waits
+                        while (nodeStateWriter.isWriting())
+                        {
+                            nodeStateWriter.writeStep(NODE_STATE_WRITING_STEP_SIZE);
+                        }
+                        finishWritingNodeStates();
+                    }
+
+                    // Copying node states is fast enough to keep the peer connections, the files are written below
+                    // while the tick processor continues
+                    logToConsole(L"Staging node state...");
+                    const unsigned long long stagingBeginningTick = __rdtsc();
+                    const bool staged = stageAllNodeStates();
+                    requestPersistingNodeState = 0;
+                    nodeStateStagingTicks = __rdtsc() - stagingBeginningTick;
+                    if (staged)
+                    {
+                        nodeStatesWriting = true;
+                        nodeStateWriter.startWriting();
+
+                        setNumber(message, nodeStateWriter.getStagedSize(), TRUE);
+                        appendText(message, L" bytes of node states staged in ");
+                        appendNumber(message, nodeStateStagingTicks * 1000 / frequency, TRUE);
+                        appendText(message, L" ms, writing ");
+                        appendNumber(message, nodeStateWriter.getTotalSize(), TRUE);
+                        appendText(message, L" bytes in ");
+                        appendNumber(message, nodeStateWriter.getNumberOfFiles(), TRUE);
+                        appendText(message, L" files in the background.");
+                        logToConsole(message);
+                    }
+                    else
+                    {
+                        // Staging the snapshots may have prepared deltas and segments that are never written
+                        requireFullNodeStateSave();
+                    }
+#else
                     // Saving node state takes a lot of time -> Close peer connections before to signal that
                     // the peers should connect to another node.
                     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
@@ -6020,7 +6554,18 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     saveAllNodeStates();
                     requestPersistingNodeState = 0;
                     logToConsole(L"Complete saving all node states");
+#endif
+                }
+#if TICK_STORAGE_AUTOSAVE_STAGING
+                if (nodeStatesWriting)
+                {
+                    nodeStateWriter.writeStep(NODE_STATE_WRITING_STEP_SIZE);
+                    if (!nodeStateWriter.isWriting())
+                    {
+                        finishWritingNodeStates();
+                    }
                 }
+#endif
                 if (nextAutoSaveTickUpdated)
                 {
                     setText(message, L"Auto-save in AUX mode scheduled for tick ");
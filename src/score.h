@@ -18,6 +18,23 @@ unsigned long long top_of_stack;
 static_assert(false, "Either AVX2 or AVX512 is required.");
 #endif
 
+// Synapse used in a tick of the score function: index of the neuron to update, and index of the supplier neuron with
+// the synapse sign in the lowest bit. With up to 2^15 neurons, indices are stored in 16 bits, which halves the memory
+// traffic of streaming the per-tick synapses (maxDuration of them) in each pass.
+template <bool compactIndices>
+struct ScorePoolSynapseData
+{
+    unsigned int neuronIndex;
+    unsigned int supplierIndexWithSign;
+};
+
+template <>
+struct ScorePoolSynapseData<true>
+{
+    unsigned short neuronIndex;
+    unsigned short supplierIndexWithSign;
+};
+
 template<
     unsigned long long dataLength,
     unsigned long long numberOfHiddenNeurons,
@@ -41,6 +58,15 @@ struct ScoreFunction
     static_assert(numberOfNeighborNeurons < 0x7FFFFFFF, "Current implementation only support MAX_UINT32 number of neighbors");
     static_assert((allNeuronsCount* numberOfNeighborNeurons) % 64 == 0, "numberOfNeighborNeurons * allNeuronsCount must dividable by 64");
 
+    // Neuron states are saved every checkpointInterval ticks of the current best run, so an optimization step that
+    // skips a tick only recomputes from the last checkpoint before that tick instead of from tick 0.
+    static constexpr unsigned long long maxNumberOfCheckpoints = 256;
+    static constexpr unsigned long long checkpointInterval = (maxDuration + maxNumberOfCheckpoints - 1) / maxNumberOfCheckpoints;
+    static constexpr unsigned long long numberOfCheckpoints = (maxDuration + checkpointInterval - 1) / checkpointInterval;
+
+    // Distance (in ticks) of prefetching the per-tick synapses ahead of the neuron loop
+    static constexpr unsigned long long synapsePrefetchDistance = 256;
+
     long long miningData[dataLength];
 
     struct K12EngineX1 {
@@ -139,11 +165,7 @@ struct ScoreFunction
         }
     };
 
-    struct PoolSynapseData
-    {
-        unsigned int neuronIndex;
-        unsigned int supplierIndexWithSign;
-    };
+    typedef ScorePoolSynapseData<(allNeuronsCount < 0x8000)> PoolSynapseData;
 
     struct computeBuffer {
         struct Neuron
@@ -174,6 +196,10 @@ struct ScoreFunction
         unsigned char* _prvCachedNeurons;
         unsigned char* _curCachedNeurons;
 
+        // Neuron states at the checkpoints of the current best run, and of the run of the current optimization step
+        char* _checkpoints;
+        char* _trialCheckpoints;
+
     } *_computeBuffer = nullptr;
     m256i currentRandomSeed;
     unsigned int randomXNeuronStart;
@@ -267,6 +293,18 @@ struct ScoreFunction
                     freePool(_computeBuffer[i]._curCachedNeurons);
                     _computeBuffer[i]._curCachedNeurons = nullptr;
                 }
+
+                if (_computeBuffer[i]._checkpoints)
+                {
+                    freePool(_computeBuffer[i]._checkpoints);
+                    _computeBuffer[i]._checkpoints = nullptr;
+                }
+
+                if (_computeBuffer[i]._trialCheckpoints)
+                {
+                    freePool(_computeBuffer[i]._trialCheckpoints);
+                    _computeBuffer[i]._trialCheckpoints = nullptr;
+                }
             }
 
             freePool(_computeBuffer);
@@ -347,6 +385,13 @@ struct ScoreFunction
                     logToConsole(L"Failed to allocate memory for cur cached neurons!");
                     return false;
                 }
+
+                if (!allocatePool(numberOfCheckpoints * allNeuronsCount, (void**)&(cb._checkpoints))
+                    || !allocatePool(numberOfCheckpoints * allNeuronsCount, (void**)&(cb._trialCheckpoints)))
+                {
+                    logToConsole(L"Failed to allocate memory for neuron checkpoints!");
+                    return false;
+                }
             }
         }
 
@@ -360,6 +405,8 @@ struct ScoreFunction
             setMem(_computeBuffer[i]._skipTicksMap, sizeof(_computeBuffer[i]._skipTicksMap[0]) * maxDuration, 0);
             setMem(_computeBuffer[i]._prvCachedNeurons, sizeof(_computeBuffer[i]._prvCachedNeurons[0]) * maxDuration, 0);
             setMem(_computeBuffer[i]._curCachedNeurons, sizeof(_computeBuffer[i]._curCachedNeurons[0]) * maxDuration, 0);
+            setMem(_computeBuffer[i]._checkpoints, numberOfCheckpoints * allNeuronsCount, 0);
+            setMem(_computeBuffer[i]._trialCheckpoints, numberOfCheckpoints * allNeuronsCount, 0);
             solutionEngineLock[i] = 0;
         }
 
@@ -463,8 +510,8 @@ struct ScoreFunction
 
             unsigned int isPositive = !(pSynapseSigns[offset >> 6] & (1ULL << (offset & 63ULL))) ? 1 : 0;
 
-            pPoolSynapseData[i].neuronIndex = (unsigned int)neuronIndex;
-            pPoolSynapseData[i].supplierIndexWithSign = ((unsigned int)supplierNeuronIndex << 1) | isPositive;
+            pPoolSynapseData[i].neuronIndex = (decltype(pPoolSynapseData[i].neuronIndex))neuronIndex;
+            pPoolSynapseData[i].supplierIndexWithSign = (decltype(pPoolSynapseData[i].supplierIndexWithSign))((supplierNeuronIndex << 1) | isPositive);
         }
 
         unsigned int random2XVal = randomXNeuronStart;
@@ -476,34 +523,48 @@ struct ScoreFunction
         }
     }
 
+    // Update the neuron of one tick and return whether its value was unchanged
+    bool computeTickNeuron(const PoolSynapseData& data, char* neuronInput, char& oldNeuronValue)
+    {
+        const unsigned int neuronIndex = data.neuronIndex;
+        const unsigned int supplierNeuronIndex = (data.supplierIndexWithSign >> 1);
+        const unsigned int sign = (data.supplierIndexWithSign & 1U);
+
+        char nnV = neuronInput[supplierNeuronIndex];
+        nnV = sign ? nnV : -nnV;
+
+        oldNeuronValue = neuronInput[neuronIndex];
+        char newNeuronValue = oldNeuronValue + nnV;
+        clampNeuron(newNeuronValue);
+        neuronInput[neuronIndex] = newNeuronValue;
+        return oldNeuronValue == newNeuronValue;
+    }
+
     unsigned int computeFullNeurons(
         const PoolSynapseData* pPoolSynapseTick,
         const unsigned char* skipTicksMap,
         unsigned char* curCachedNeurons,
-        computeBuffer::Neuron& neurons)
+        computeBuffer::Neuron& neurons,
+        char* checkpoints)
     {
         setMem(neurons.input, sizeof(neurons.input[0]) * allNeuronsCount, 0);
         for (int i = 0; i < dataLength; i++)
         {
             neurons.input[i] = (char)miningData[i];
         }
-        for (long long tick = 0; tick < maxDuration; tick++)
+        for (unsigned long long checkpoint = 0; checkpoint < numberOfCheckpoints; checkpoint++)
         {
-            PoolSynapseData data = pPoolSynapseTick[tick];
-            unsigned int neuronIndex = data.neuronIndex;
-            unsigned int supplierNeuronIndex = (data.supplierIndexWithSign >> 1);
-            unsigned int sign = (data.supplierIndexWithSign & 1U);
-
-            char nnV = neurons.input[supplierNeuronIndex];
-            nnV = sign ? nnV : -nnV;
-
-            char oldNeuronValue = neurons.input[neuronIndex];
-            neurons.input[neuronIndex] += nnV;
-            clampNeuron(neurons.input[neuronIndex]);
-
-            if (skipTicksMap[tick] & candidateSkipTickMaskBits)
+            copyMem(checkpoints + checkpoint * allNeuronsCount, neurons.input, allNeuronsCount);
+            const long long endTick = (checkpoint + 1 < numberOfCheckpoints) ? (checkpoint + 1) * checkpointInterval : maxDuration;
+            for (long long tick = checkpoint * checkpointInterval; tick < endTick; tick++)
             {
-                curCachedNeurons[tick] = (oldNeuronValue == neurons.input[neuronIndex]);
+                _mm_prefetch((const char*)(pPoolSynapseTick + tick + synapsePrefetchDistance), _MM_HINT_T0);
+                char oldNeuronValue;
+                const bool unchanged = computeTickNeuron(pPoolSynapseTick[tick], neurons.input, oldNeuronValue);
+                if (skipTicksMap[tick] & candidateSkipTickMaskBits)
+                {
+                    curCachedNeurons[tick] = unchanged;
+                }
             }
         }
 
@@ -547,37 +608,37 @@ struct ScoreFunction
         }
     }
 
-    unsigned int computeSkipTicksNeurons(const PoolSynapseData* pPoolSynapseTick, const unsigned char* skipTicksMap, unsigned char* curCachedNeurons, computeBuffer::Neuron& neurons)
+    // Compute neurons with the ticks of skipTicksMap skipped, starting from checkpoint startCheckpoint of the current
+    // best run (the ticks skipped before it must be the same). Neuron states of the later checkpoints are saved to
+    // trialCheckpoints.
+    unsigned int computeSkipTicksNeurons(const PoolSynapseData* pPoolSynapseTick, const unsigned char* skipTicksMap, unsigned char* curCachedNeurons, computeBuffer::Neuron& neurons,
+        const char* checkpoints, char* trialCheckpoints, unsigned long long startCheckpoint)
     {
-        // Reset neuron values
-        setMem(neurons.input, sizeof(neurons.input[0]) * allNeuronsCount, 0);
-        for (int i = 0; i < dataLength; i++)
-        {
-            neurons.input[i] = (char)miningData[i];
-        }
+        // Restore neuron values of checkpoint
+        copyMem(neurons.input, checkpoints + startCheckpoint * allNeuronsCount, allNeuronsCount);
 
         // Compute
-        for (long long tick = 0; tick < maxDuration; tick++)
+        for (unsigned long long checkpoint = startCheckpoint; checkpoint < numberOfCheckpoints; checkpoint++)
         {
-            // Tick not on the list, accumulate as normal
-            PoolSynapseData data = pPoolSynapseTick[tick];
-            unsigned int neuronIndex = data.neuronIndex;
-            unsigned int supplierNeuronIndex = (data.supplierIndexWithSign >> 1);
-            unsigned int sign = (data.supplierIndexWithSign & 1U);
-
-            char nnV = neurons.input[supplierNeuronIndex];
-            nnV = sign ? nnV : -nnV;
-
-            char oldNeuronValue = neurons.input[neuronIndex];
-            neurons.input[neuronIndex] += nnV;
-            clampNeuron(neurons.input[neuronIndex]);
-
-            if (skipTicksMap[tick] & candidateSkipTickMaskBits)
+            if (checkpoint > startCheckpoint)
             {
-                curCachedNeurons[tick] = (oldNeuronValue == neurons.input[neuronIndex]);
-                if (skipTicksMap[tick] & skippedTickMaskBits)
+                copyMem(trialCheckpoints + checkpoint * allNeuronsCount, neurons.input, allNeuronsCount);
+            }
+            const long long endTick = (checkpoint + 1 < numberOfCheckpoints) ? (checkpoint + 1) * checkpointInterval : maxDuration;
+            for (long long tick = checkpoint * checkpointInterval; tick < endTick; tick++)
+            {
+                _mm_prefetch((const char*)(pPoolSynapseTick + tick + synapsePrefetchDistance), _MM_HINT_T0);
+                const PoolSynapseData data = pPoolSynapseTick[tick];
+                char oldNeuronValue;
+                const bool unchanged = computeTickNeuron(data, neurons.input, oldNeuronValue);
+
+                if (skipTicksMap[tick] & candidateSkipTickMaskBits)
                 {
-                    neurons.input[neuronIndex] = oldNeuronValue;
+                    curCachedNeurons[tick] = unchanged;
+                    if (skipTicksMap[tick] & skippedTickMaskBits)
+                    {
+                        neurons.input[data.neuronIndex] = oldNeuronValue;
+                    }
                 }
             }
         }
@@ -594,11 +655,9 @@ struct ScoreFunction
         return currentScore;
     }
 
-    // Compute score
-    unsigned int computeScore(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    // Compute score with compute buffer solutionBufIdx, which must be locked by the caller
+    unsigned int computeScore(const int solutionBufIdx, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
     {
-        const int solutionBufIdx = (int)(processor_Number % solutionBufferCount);
-
         computeBuffer& cb = _computeBuffer[solutionBufIdx];
         PoolSynapseData* pPoolSynapseTick = cb._poolSynapseTickData;
         auto& neurons = cb._neurons;
@@ -620,7 +679,7 @@ struct ScoreFunction
         computeSkipTicks(cb._poolRandom2Buffer, cb._skipTicks, cb._skipTicksMap, cb._ticksNumbers);
 
         // First run to get the score of fulll 
-        unsigned int score = computeFullNeurons(pPoolSynapseTick, cb._skipTicksMap, prvCachedNeurons, neurons);
+        unsigned int score = computeFullNeurons(pPoolSynapseTick, cb._skipTicksMap, prvCachedNeurons, neurons, cb._checkpoints);
 
         // Run the optimization steps
         for (long long l = 0; l < numberOfOptimizationSteps - 1; l++)
@@ -633,13 +692,18 @@ struct ScoreFunction
                 continue;
             }
 
-            // reset map
+            // Ticks before the checkpoint preceding skipTick are computed like in the current best run, so start there
+            const unsigned long long startCheckpoint = skipTick / checkpointInterval;
+            const long long startTick = startCheckpoint * checkpointInterval;
+
+            // reset map (keeping the results of the ticks that aren't recomputed)
             for (long long k = 0; k < numberOfOptimizationSteps - 1; k++)
             {
-                curCachedNeurons[cb._skipTicks[k]] = 0;
+                const long long candidateTick = cb._skipTicks[k];
+                curCachedNeurons[candidateTick] = (candidateTick < startTick) ? prvCachedNeurons[candidateTick] : 0;
             }
 
-            unsigned int currentScore = computeSkipTicksNeurons(pPoolSynapseTick, cb._skipTicksMap, curCachedNeurons, neurons);
+            unsigned int currentScore = computeSkipTicksNeurons(pPoolSynapseTick, cb._skipTicksMap, curCachedNeurons, neurons, cb._checkpoints, cb._trialCheckpoints, startCheckpoint);
 
             // Check if this tick is good to skip
             if (currentScore >= score)
@@ -650,6 +714,12 @@ struct ScoreFunction
                 unsigned char* tmp = prvCachedNeurons;
                 prvCachedNeurons = curCachedNeurons;
                 curCachedNeurons = tmp;
+
+                // Later checkpoints now refer to this run
+                if (startCheckpoint + 1 < numberOfCheckpoints)
+                {
+                    copyMem(cb._checkpoints + (startCheckpoint + 1) * allNeuronsCount, cb._trialCheckpoints + (startCheckpoint + 1) * allNeuronsCount, (numberOfCheckpoints - startCheckpoint - 1) * allNeuronsCount);
+                }
             }
             else // Make score worse, reset it
             {
@@ -659,8 +729,35 @@ struct ScoreFunction
         return score;
     }
 
-    // main score function
-    unsigned int operator()(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    // Try to lock a free compute buffer, starting with the one preferred by processor_Number. Returns the index of the
+    // locked buffer or -1 if all are in use.
+    int tryAcquireComputeBuffer(const unsigned long long processor_Number)
+    {
+        for (unsigned long long i = 0; i < solutionBufferCount; i++)
+        {
+            const int solutionBufIdx = (int)((processor_Number + i) % solutionBufferCount);
+            if (!solutionEngineLock[solutionBufIdx] && TRY_ACQUIRE(solutionEngineLock[solutionBufIdx]))
+            {
+                return solutionBufIdx;
+            }
+        }
+        return -1;
+    }
+
+    // Lock any free compute buffer, waiting until one is available
+    int acquireComputeBuffer(const unsigned long long processor_Number)
+    {
+        int solutionBufIdx;
+        while ((solutionBufIdx = tryAcquireComputeBuffer(processor_Number)) < 0)
+        {
+            _mm_pause();
+        }
+        return solutionBufIdx;
+    }
+
+    // Score function using the locked compute buffer solutionBufIdx in case of a score cache miss, solutionHash is the
+    // result of computeSolutionHash()
+    unsigned int scoreWithComputeBuffer(const int solutionBufIdx, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned long long solutionHash)
     {
         if (isZero(miningSeed) || miningSeed != currentRandomSeed)
         {
@@ -669,8 +766,7 @@ struct ScoreFunction
 
         int score = 0;
 #if USE_SCORE_CACHE
-        unsigned int scoreCacheIndex = scoreCache.getCacheIndex(publicKey, miningSeed, nonce);
-        score = scoreCache.tryFetching(publicKey, miningSeed, nonce, scoreCacheIndex);
+        score = scoreCache.tryFetching(publicKey, miningSeed, nonce, solutionHash);
         if (score >= scoreCache.MIN_VALID_SCORE)
         {
             return score;
@@ -678,14 +774,10 @@ struct ScoreFunction
         score = 0;
 #endif
 
-        const int solutionBufIdx = (int)(processor_Number % solutionBufferCount);
-        ACQUIRE(solutionEngineLock[solutionBufIdx]);
-
-        score = computeScore(processor_Number, publicKey, miningSeed, nonce);
+        score = computeScore(solutionBufIdx, publicKey, miningSeed, nonce);
 
-        RELEASE(solutionEngineLock[solutionBufIdx]);
 #if USE_SCORE_CACHE
-        scoreCache.addEntry(publicKey, miningSeed, nonce, scoreCacheIndex, score);
+        scoreCache.addEntry(publicKey, miningSeed, nonce, solutionHash, score);
 #endif
 #ifdef NO_UEFI
         int y = 2 + score;
@@ -694,6 +786,25 @@ struct ScoreFunction
         return score;
     }
 
+    // main score function, solutionHash is the result of computeSolutionHash()
+    unsigned int operator()(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned long long solutionHash)
+    {
+        if (isZero(miningSeed) || miningSeed != currentRandomSeed)
+        {
+            return DATA_LENGTH + 1; // return invalid score
+        }
+
+        const int solutionBufIdx = acquireComputeBuffer(processor_Number);
+        const unsigned int score = scoreWithComputeBuffer(solutionBufIdx, publicKey, miningSeed, nonce, solutionHash);
+        RELEASE(solutionEngineLock[solutionBufIdx]);
+        return score;
+    }
+
+    unsigned int operator()(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    {
+        return (*this)(processor_Number, publicKey, miningSeed, nonce, computeSolutionHash(publicKey, miningSeed, nonce));
+    }
+
 #ifdef NO_UEFI
     unsigned long long stackSize = 0;
 #endif
@@ -701,17 +812,20 @@ struct ScoreFunction
     // Multithreaded solutions verification:
     // This module mainly serve tick processor in qubic core node, thus the queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK 
     // for future use for somewhere else, you can only increase the size.
+    // Tasks aren't bound to processors or compute buffers: any processor that finds a free compute buffer takes the next
+    // task, so idle processors keep taking work until the queue is drained instead of waiting for a busy buffer.
 
     volatile char taskQueueLock = 0;
     struct {
         m256i publicKey[NUMBER_OF_TRANSACTIONS_PER_TICK];
         m256i miningSeed[NUMBER_OF_TRANSACTIONS_PER_TICK];
         m256i nonce[NUMBER_OF_TRANSACTIONS_PER_TICK];
+        unsigned long long solutionHash[NUMBER_OF_TRANSACTIONS_PER_TICK];
     } taskQueue;
-    unsigned int _nTask;
-    unsigned int _nProcessing;
-    unsigned int _nFinished;
-    bool _nIsTaskQueueReady;
+    volatile unsigned int _nTask;
+    volatile unsigned int _nProcessing;
+    volatile unsigned int _nFinished;
+    volatile bool _nIsTaskQueueReady;
 
     void resetTaskQueue()
     {
@@ -723,9 +837,9 @@ struct ScoreFunction
         RELEASE(taskQueueLock);
     }
 
-    // add task to the queue
+    // add task to the queue, solutionHash is the result of computeSolutionHash()
     // queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK 
-    void addTask(m256i publicKey, m256i miningSeed, m256i nonce)
+    void addTask(m256i publicKey, m256i miningSeed, m256i nonce, unsigned long long solutionHash)
     {
         ACQUIRE(taskQueueLock);
         if (_nTask < NUMBER_OF_TRANSACTIONS_PER_TICK)
@@ -734,6 +848,7 @@ struct ScoreFunction
             taskQueue.publicKey[index] = publicKey;
             taskQueue.miningSeed[index] = miningSeed;
             taskQueue.nonce[index] = nonce;
+            taskQueue.solutionHash[index] = solutionHash;
         }
         RELEASE(taskQueueLock);
     }
@@ -753,7 +868,7 @@ struct ScoreFunction
     }
 
     // get a task, can call on any thread
-    bool getTask(m256i* publicKey, m256i* miningSeed, m256i* nonce)
+    bool getTask(m256i* publicKey, m256i* miningSeed, m256i* nonce, unsigned long long* solutionHash)
     {
         if (!_nIsTaskQueueReady)
         {
@@ -767,6 +882,7 @@ struct ScoreFunction
             *publicKey = taskQueue.publicKey[index];
             *miningSeed = taskQueue.miningSeed[index];
             *nonce = taskQueue.nonce[index];
+            *solutionHash = taskQueue.solutionHash[index];
             result = true;
         }
         else
@@ -788,16 +904,31 @@ struct ScoreFunction
         return _nFinished == _nTask;
     }
 
-    void tryProcessSolution(unsigned long long processorNumber)
+    // Process the next queued solution if there is one and a compute buffer is free. Returns true if a solution has been
+    // processed.
+    bool tryProcessSolution(unsigned long long processorNumber)
     {
+        if (!_nIsTaskQueueReady || _nProcessing >= _nTask)
+        {
+            return false;
+        }
+        const int solutionBufIdx = tryAcquireComputeBuffer(processorNumber);
+        if (solutionBufIdx < 0)
+        {
+            return false;
+        }
+
         m256i publicKey;
         m256i miningSeed;
         m256i nonce;
-        bool res = this->getTask(&publicKey, &miningSeed, &nonce);
+        unsigned long long solutionHash;
+        bool res = this->getTask(&publicKey, &miningSeed, &nonce, &solutionHash);
         if (res)
         {
-            (*this)(processorNumber, publicKey, miningSeed, nonce);
+            scoreWithComputeBuffer(solutionBufIdx, publicKey, miningSeed, nonce, solutionHash);
             this->finishTask();
         }
+        RELEASE(solutionEngineLock[solutionBufIdx]);
+        return res;
     }
 };
@@ -9,12 +9,33 @@
 
 #include "kangaroo_twelve.h"
 
-/// Cache storing scores for pairs of publicKey and nonce (hash map)
-template <unsigned int size, unsigned int collisionRetries = 20>
+/// Compute 64-bit hash of solution (publicKey, miningSeed, nonce) used as index and tag in the score cache. K12 is an
+/// extendable-output function, so the lower 32 bits equal the 4-byte digest used as index of minerSolutionFlags and the
+/// hash only has to be computed once per solution.
+static unsigned long long computeSolutionHash(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+{
+    m256i buffer[3] = { publicKey, miningSeed, nonce };
+    unsigned long long hash;
+    KangarooTwelve(buffer, sizeof(buffer), &hash, sizeof(hash));
+    return hash;
+}
+
+/// Cache storing scores for triples of publicKey, miningSeed, and nonce (hash map)
+///
+/// The cache is striped across numberOfShards shards with one lock per shard, so solution processors looking up or
+/// adding different solutions rarely wait for each other. The solution hash selects the shard and the bucket within the
+/// shard, collisions are resolved by linear probing within the shard. Instead of the mining seed, which is the same for
+/// all solutions of a phase, an entry stores the generation of the seed (see getSeedGeneration()). Only the latest
+/// maxNumberOfSeedGenerations seeds are kept, entries of older seeds are outdated and their buckets are reused.
+template <unsigned int size, unsigned int collisionRetries = 20, unsigned int numberOfShards = 64>
 class ScoreCache
 {
-    static_assert(collisionRetries < size, "Number of fetch retries in case of collision is too big!");
 public:
+    static constexpr unsigned int entriesPerShard = (size + numberOfShards - 1) / numberOfShards;
+    static constexpr unsigned int maxNumberOfSeedGenerations = 4;
+
+    static_assert(numberOfShards > 0, "Number of shards must be positive!");
+    static_assert(collisionRetries < entriesPerShard, "Number of fetch retries in case of collision is too big!");
 
     /// Init cache
     ScoreCache()
@@ -25,178 +46,427 @@ public:
     /// Reset all cache entries
     void reset()
     {
-        ACQUIRE(lock);
-        setMem((unsigned char*)cache, sizeof(cache), 0);
-        hits = 0;
-        misses = 0;
-        collisions = 0;
-        RELEASE(lock);
+        for (unsigned int i = 0; i < numberOfShards; ++i)
+        {
+            Shard& shard = shards[i];
+            ACQUIRE(shard.lock);
+            setMem((unsigned char*)shard.entries, sizeof(shard.entries), 0);
+            shard.hits = 0;
+            shard.misses = 0;
+            shard.collisions = 0;
+            RELEASE(shard.lock);
+        }
+        ACQUIRE(seedLock);
+        setMem(seeds, sizeof(seeds), 0);
+        lastSeedGeneration = 0;
+        RELEASE(seedLock);
     }
 
     /// Return maximum number of entries that can be stored in cache
     constexpr unsigned int capacity() const
     {
-        return size;
-    }
-
-    /// Get cache index based on hash function
-    unsigned int getCacheIndex(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
-    {
-        m256i buffer[3] = { publicKey, miningSeed, nonce };
-        unsigned char digest[32];
-        KangarooTwelve(buffer, 96, digest, 32);
-        unsigned int result = *((unsigned long long*)digest) % capacity();
-
-        return result;
+        return entriesPerShard * numberOfShards;
     }
 
     static constexpr int MIN_VALID_SCORE = 0;
     static constexpr int SCORE_CACHE_MISS = -1;
     static constexpr int SCORE_CACHE_COLLISION = -2;
 
-    // Try to fetch data from cacheIndex, also checking a few following entries in case of collisions (may update cacheIndex),
-    // increments counter of hits, misses, or collisions
-    int tryFetching(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned int & cacheIndex)
+    // Try to fetch score of solution with hash computed by computeSolutionHash(), also checking a few following entries
+    // in case of collisions, increments counter of hits, misses, or collisions
+    int tryFetching(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned long long hash)
     {
-        int retVal;
-        unsigned int tryFetchIdx = cacheIndex % capacity();
-        ACQUIRE(lock);
-        for (unsigned int i = 0; i < collisionRetries; ++i)
+        const unsigned int seedGeneration = findSeedGeneration(miningSeed);
+        const unsigned long long tag = getTag(hash);
+        Shard& shard = shards[getShardIndex(hash)];
+        unsigned int bucketIndex = getBucketIndex(hash);
+
+        int retVal = SCORE_CACHE_MISS;
+        ACQUIRE(shard.lock);
+        if (seedGeneration)
         {
-            const m256i& cachedPublicKey = cache[tryFetchIdx].publicKey;
-            if (isZero(cachedPublicKey))
+            for (unsigned int i = 0; i < collisionRetries; ++i)
             {
-                // miss: data not available in cache yet (entry is empty)
-                misses++;
-                retVal = SCORE_CACHE_MISS;
-                break;
-            }
+                const CacheEntry& entry = shard.entries[bucketIndex];
+                if (!entry.tag)
+                {
+                    // miss: data not available in cache yet (entry is empty)
+                    retVal = SCORE_CACHE_MISS;
+                    break;
+                }
 
-            const m256i& cachedMiningSeed = cache[tryFetchIdx].miningSeed;
-            const m256i& cachedNonce = cache[tryFetchIdx].nonce;
-            if (cachedPublicKey == publicKey && cachedMiningSeed == miningSeed && cachedNonce == nonce)
-            {
-                // hit: data available in cache -> return score
-                hits++;
-                retVal = cache[tryFetchIdx].score;
-                break;
-            }
+                if (entry.tag == tag && entry.seedGeneration == seedGeneration && entry.matches(publicKey, nonce))
+                {
+                    // hit: data available in cache -> return score
+                    retVal = entry.score;
+                    break;
+                }
 
-            // collision: other data is mapped to same index -> retry at following index
-            retVal = SCORE_CACHE_COLLISION;
-            tryFetchIdx = (tryFetchIdx + 1) % capacity();
+                // collision: other (or outdated) data is mapped to same index -> retry at following index
+                retVal = SCORE_CACHE_COLLISION;
+                bucketIndex = (bucketIndex + 1) % entriesPerShard;
+            }
         }
-        RELEASE(lock);
-
-        if (retVal == SCORE_CACHE_COLLISION)
+        if (retVal == SCORE_CACHE_MISS)
+        {
+            shard.misses++;
+        }
+        else if (retVal == SCORE_CACHE_COLLISION)
         {
-            collisions++;
+            shard.collisions++;
         }
         else
         {
-            cacheIndex = tryFetchIdx;
+            shard.hits++;
         }
+        RELEASE(shard.lock);
+
         return retVal;
     }
 
-    /// Add entry to cache (may overwrite existing entry)
-    void addEntry(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned int cacheIndex, int score)
+    /// Add entry of solution with hash computed by computeSolutionHash() to cache. The entry is stored in the first bucket
+    /// that is empty, outdated, or holds the same solution. If there is none within collisionRetries buckets, the entry
+    /// overwrites the first bucket.
+    void addEntry(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned long long hash, int score)
     {
-        cacheIndex %= capacity();
-        ACQUIRE(lock);
-        cache[cacheIndex].publicKey = publicKey;
-        cache[cacheIndex].miningSeed = miningSeed;
-        cache[cacheIndex].nonce = nonce;
-        cache[cacheIndex].score = score;
-        RELEASE(lock);
+        const unsigned int seedGeneration = getSeedGeneration(miningSeed);
+        const unsigned int oldestValidGeneration = getOldestValidSeedGeneration();
+        const unsigned long long tag = getTag(hash);
+        Shard& shard = shards[getShardIndex(hash)];
+        const unsigned int firstBucketIndex = getBucketIndex(hash);
+        unsigned int bucketIndex = firstBucketIndex;
+
+        bool found = false;
+        ACQUIRE(shard.lock);
+        for (unsigned int i = 0; i < collisionRetries; ++i)
+        {
+            const CacheEntry& entry = shard.entries[bucketIndex];
+            if (!entry.tag || entry.seedGeneration < oldestValidGeneration
+                || (entry.tag == tag && entry.seedGeneration == seedGeneration && entry.matches(publicKey, nonce)))
+            {
+                found = true;
+                break;
+            }
+            bucketIndex = (bucketIndex + 1) % entriesPerShard;
+        }
+        if (!found)
+        {
+            bucketIndex = firstBucketIndex;
+        }
+
+        CacheEntry& entry = shard.entries[bucketIndex];
+        entry.tag = tag;
+        copyMem(entry.publicKey, &publicKey, sizeof(entry.publicKey));
+        copyMem(entry.nonce, &nonce, sizeof(entry.nonce));
+        entry.score = score;
+        entry.seedGeneration = seedGeneration;
+        RELEASE(shard.lock);
     }
 
-    /// Save score cache to file
+    /// Save populated buckets of score cache to file
     void save(CHAR16* filename, CHAR16* directory = NULL)
     {
         logToConsole(L"Saving score cache file...");
 
         const unsigned long long beginningTick = __rdtsc();
-        ACQUIRE(lock);
-        long long savedSize = ::save(filename, sizeof(cache), (unsigned char*)&cache, directory);
-        RELEASE(lock);
-        if (savedSize == sizeof(cache))
+        SavedEntry* buffer = NULL;
+        if (!allocatePool(entriesPerShard * sizeof(SavedEntry), (void**)&buffer))
+        {
+            logToConsole(L"Error while saving score cache: Failed to allocate memory");
+            return;
+        }
+        FileHandle file = openFileForWriting(filename, directory);
+        if (!file)
+        {
+            freePool(buffer);
+            return;
+        }
+
+        FileHeader header;
+        setMem(&header, sizeof(header), 0);
+        header.version = fileVersion;
+        header.shardCapacity = entriesPerShard;
+        header.shardCount = numberOfShards;
+        ACQUIRE(seedLock);
+        copyMem(header.seeds, seeds, sizeof(seeds));
+        header.lastSeedGeneration = lastSeedGeneration;
+        RELEASE(seedLock);
+        const unsigned int oldestValidGeneration = getOldestValidSeedGeneration(header.lastSeedGeneration);
+
+        bool success = writeToFile(file, (unsigned char*)&header, sizeof(header));
+        unsigned long long savedSize = sizeof(header);
+        for (unsigned int shardIndex = 0; shardIndex < numberOfShards && success; ++shardIndex)
+        {
+            Shard& shard = shards[shardIndex];
+            unsigned int numberOfEntries = 0;
+            ACQUIRE(shard.lock);
+            for (unsigned int bucketIndex = 0; bucketIndex < entriesPerShard; ++bucketIndex)
+            {
+                const CacheEntry& entry = shard.entries[bucketIndex];
+                if (entry.tag && entry.seedGeneration >= oldestValidGeneration)
+                {
+                    buffer[numberOfEntries].shardIndex = shardIndex;
+                    buffer[numberOfEntries].bucketIndex = bucketIndex;
+                    buffer[numberOfEntries].entry = entry;
+                    ++numberOfEntries;
+                }
+            }
+            RELEASE(shard.lock);
+            success = writeToFile(file, (unsigned char*)buffer, numberOfEntries * sizeof(SavedEntry));
+            savedSize += numberOfEntries * sizeof(SavedEntry);
+        }
+        closeFile(file);
+        freePool(buffer);
+
+        if (success)
         {
             setNumber(message, savedSize, TRUE);
             appendText(message, L" bytes of the score cache data are saved (");
+            appendNumber(message, (savedSize - sizeof(header)) / sizeof(SavedEntry), TRUE);
+            appendText(message, L" entries, ");
             appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
             appendText(message, L" microseconds).");
             logToConsole(message);
         }
+        else
+        {
+            logToConsole(L"Error while saving score cache: Failed to write file");
+        }
     }
 
     /// Try to load score cache file
     bool load(CHAR16* filename, CHAR16* directory = NULL)
     {
-        bool success = true;
         logToConsole(L"Loading score cache...");
         reset();
-        ACQUIRE(lock);
-        long long loadedSize = ::load(filename, sizeof(cache), (unsigned char*)cache, directory);
-        RELEASE(lock);
-        if (loadedSize != sizeof(cache))
+
+        const long long fileSize = getFileSize(filename, directory);
+        if (fileSize < 0)
+        {
+            logToConsole(L"Error while loading score cache: File does not exists (ignore this error if this is the epoch start)");
+            return false;
+        }
+        if (fileSize < (long long)sizeof(FileHeader) || (fileSize - sizeof(FileHeader)) % sizeof(SavedEntry))
+        {
+            logToConsole(L"Error while loading score cache: Score cache file has invalid size. System may not work properly");
+            return false;
+        }
+
+        unsigned char* buffer = NULL;
+        if (!allocatePool(fileSize, (void**)&buffer))
+        {
+            logToConsole(L"Error while loading score cache: Failed to allocate memory");
+            return false;
+        }
+        bool success = false;
+        const FileHeader* header = (const FileHeader*)buffer;
+        if (::load(filename, fileSize, buffer, directory) != fileSize)
         {
-            if (loadedSize == -1)
+            logToConsole(L"Error while loading score cache: Failed to read file");
+        }
+        else if (header->version != fileVersion || header->shardCapacity != entriesPerShard || header->shardCount != numberOfShards)
+        {
+            logToConsole(L"Error while loading score cache: Score cache file has other format or size than defined. System may not work properly");
+        }
+        else
+        {
+            const SavedEntry* savedEntries = (const SavedEntry*)(buffer + sizeof(FileHeader));
+            const unsigned long long numberOfEntries = (fileSize - sizeof(FileHeader)) / sizeof(SavedEntry);
+            success = true;
+            for (unsigned long long i = 0; i < numberOfEntries; ++i)
             {
-                logToConsole(L"Error while loading score cache: File does not exists (ignore this error if this is the epoch start)");
+                if (savedEntries[i].shardIndex >= numberOfShards || savedEntries[i].bucketIndex >= entriesPerShard)
+                {
+                    success = false;
+                    break;
+                }
             }
-            else if (loadedSize < sizeof(cache))
+            if (success)
             {
-                logToConsole(L"Error while loading score cache: Score cache file is smaller than defined. System may not work properly");
+                ACQUIRE(seedLock);
+                copyMem(seeds, header->seeds, sizeof(seeds));
+                lastSeedGeneration = header->lastSeedGeneration;
+                RELEASE(seedLock);
+                for (unsigned long long i = 0; i < numberOfEntries; ++i)
+                {
+                    Shard& shard = shards[savedEntries[i].shardIndex];
+                    ACQUIRE(shard.lock);
+                    shard.entries[savedEntries[i].bucketIndex] = savedEntries[i].entry;
+                    RELEASE(shard.lock);
+                }
+
+                setNumber(message, numberOfEntries, TRUE);
+                appendText(message, L" score cache entries loaded!");
+                logToConsole(message);
             }
             else
             {
-                logToConsole(L"Error while loading score cache: Score cache file is larger than defined. System may not work properly");
+                logToConsole(L"Error while loading score cache: Score cache file is corrupted. System may not work properly");
             }
-            success = false;
-        }
-        else
-        {
-            logToConsole(L"Loaded score cache data!");
         }
+        freePool(buffer);
+
         return success;
     }
 
     // Return number of hits (data available in cache when fetched)
     unsigned int hitCount() const
     {
-        return hits;
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < numberOfShards; ++i)
+        {
+            count += shards[i].hits;
+        }
+        return count;
     }
 
     // Return number of misses (data not in cache yet)
     unsigned int missCount() const
     {
-        return misses;
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < numberOfShards; ++i)
+        {
+            count += shards[i].misses;
+        }
+        return count;
     }
 
     // Return number of collisions (other data is mapped to same index)
     unsigned int collisionCount() const
     {
-        return collisions;
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < numberOfShards; ++i)
+        {
+            count += shards[i].collisions;
+        }
+        return count;
     }
 
 private:
     struct CacheEntry
     {
-        m256i publicKey;
-        m256i miningSeed;
-        m256i nonce;
+        unsigned long long tag; // solution hash (0 if entry is empty)
+        unsigned long long publicKey[4];
+        unsigned long long nonce[4];
         int score;
+        unsigned int seedGeneration;
+
+        bool matches(const m256i& otherPublicKey, const m256i& otherNonce) const
+        {
+            return publicKey[0] == otherPublicKey.m256i_u64[0] && publicKey[1] == otherPublicKey.m256i_u64[1]
+                && publicKey[2] == otherPublicKey.m256i_u64[2] && publicKey[3] == otherPublicKey.m256i_u64[3]
+                && nonce[0] == otherNonce.m256i_u64[0] && nonce[1] == otherNonce.m256i_u64[1]
+                && nonce[2] == otherNonce.m256i_u64[2] && nonce[3] == otherNonce.m256i_u64[3];
+        }
+    };
+    static_assert(sizeof(CacheEntry) == 80, "Unexpected size of score cache entry");
+
+    struct Shard
+    {
+        // cache entries (set zero or load from a file on init)
+        CacheEntry entries[entriesPerShard];
+
+        // lock to prevent race conditions on parallel access of the shard
+        volatile char lock;
+
+        // statistics of hits, misses, and collisions
+        unsigned int hits;
+        unsigned int misses;
+        unsigned int collisions;
+    };
+
+    struct SeedGeneration
+    {
+        m256i miningSeed;
+        unsigned int generation; // 0 if unused
     };
-    
-    // cache entries (set zero or load from a file on init)
-    CacheEntry cache[size];
 
-    // lock to prevent race conditions on parallel access
-    volatile char lock = 0;
+    static constexpr unsigned int fileVersion = 2;
+
+    struct FileHeader
+    {
+        unsigned int version;
+        unsigned int shardCapacity;
+        unsigned int shardCount;
+        unsigned int lastSeedGeneration;
+        SeedGeneration seeds[maxNumberOfSeedGenerations];
+    };
+
+    // populated bucket as stored in file after FileHeader
+    struct SavedEntry
+    {
+        unsigned int shardIndex;
+        unsigned int bucketIndex;
+        CacheEntry entry;
+    };
+
+    Shard shards[numberOfShards];
+
+    // seeds of the latest generations, seed of generation g is stored at index g % maxNumberOfSeedGenerations
+    SeedGeneration seeds[maxNumberOfSeedGenerations];
+    volatile unsigned int lastSeedGeneration = 0;
+    volatile char seedLock = 0;
 
-    // statistics of hits, misses, and collisions
-    unsigned int hits = 0;
-    unsigned int misses = 0;
-    unsigned int collisions = 0;
+    static unsigned int getShardIndex(unsigned long long hash)
+    {
+        return (unsigned int)(hash % numberOfShards);
+    }
+
+    static unsigned int getBucketIndex(unsigned long long hash)
+    {
+        return (unsigned int)((hash / numberOfShards) % entriesPerShard);
+    }
+
+    static unsigned long long getTag(unsigned long long hash)
+    {
+        return hash ? hash : 1;
+    }
+
+    static unsigned int getOldestValidSeedGeneration(unsigned int lastGeneration)
+    {
+        return (lastGeneration > maxNumberOfSeedGenerations) ? lastGeneration - maxNumberOfSeedGenerations + 1 : 1;
+    }
+
+    unsigned int getOldestValidSeedGeneration() const
+    {
+        return getOldestValidSeedGeneration(lastSeedGeneration);
+    }
+
+    // Return generation of miningSeed or 0 if it isn't one of the latest seeds (seedLock must be acquired)
+    unsigned int findSeedGenerationLocked(const m256i& miningSeed) const
+    {
+        for (unsigned int i = 0; i < maxNumberOfSeedGenerations; ++i)
+        {
+            if (seeds[i].generation && seeds[i].miningSeed == miningSeed)
+            {
+                return seeds[i].generation;
+            }
+        }
+        return 0;
+    }
+
+    // Return generation of miningSeed or 0 if it isn't one of the latest seeds
+    unsigned int findSeedGeneration(const m256i& miningSeed)
+    {
+        ACQUIRE(seedLock);
+        const unsigned int generation = findSeedGenerationLocked(miningSeed);
+        RELEASE(seedLock);
+        return generation;
+    }
+
+    // Return generation of miningSeed, starting a new generation replacing the oldest seed if it is a new seed
+    unsigned int getSeedGeneration(const m256i& miningSeed)
+    {
+        ACQUIRE(seedLock);
+        unsigned int generation = findSeedGenerationLocked(miningSeed);
+        if (!generation)
+        {
+            generation = lastSeedGeneration + 1;
+            seeds[generation % maxNumberOfSeedGenerations].miningSeed = miningSeed;
+            seeds[generation % maxNumberOfSeedGenerations].generation = generation;
+            lastSeedGeneration = generation;
+        }
+        RELEASE(seedLock);
+        return generation;
+    }
 };
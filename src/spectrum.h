@@ -14,6 +14,8 @@
 #include "public_settings.h"
 #include "system.h"
 #include "kangaroo_twelve.h"
+#include "merkle_tree.h"
+#include "delta_snapshot.h"
 #include "common_buffers.h"
 
 GLOBAL_VAR_DECL volatile char spectrumLock GLOBAL_VAR_INIT(0);
@@ -32,6 +34,102 @@ static constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACI
 
 GLOBAL_VAR_DECL unsigned long long spectrumReorgTotalExecutionTicks GLOBAL_VAR_INIT(0);
 
+// Flags of spectrumDigests nodes that need to be recomputed, used while updating the digests at the end of a tick
+GLOBAL_VAR_DECL unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+
+// Base + delta files of the spectrum in the node state snapshot. Entities are marked as changed together with their
+// leaf flags in spectrumChangeFlags. Only initialized if node states are saved (TICK_STORAGE_AUTOSAVE_MODE).
+GLOBAL_VAR_DECL DeltaSnapshot<::Entity, SPECTRUM_CAPACITY> spectrumSnapshot;
+
+// Journal of spectrum indices changed since the last update of spectrumDigests. It avoids scanning the whole
+// spectrum for finding the entities changed in the current tick. If the journal overflows or the spectrum is
+// changed in bulk (loading, reorganizing), it becomes invalid and the next digest update falls back to full scan.
+static constexpr unsigned int spectrumTickJournalCapacity = 65536;
+GLOBAL_VAR_DECL struct SpectrumTickJournal {
+    bool valid = false;
+    unsigned int numberOfIndices = 0;
+    unsigned int indices[spectrumTickJournalCapacity];
+} spectrumTickJournal;
+
+GLOBAL_VAR_DECL unsigned long long spectrumDigestUpdateJournalCount GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL unsigned long long spectrumDigestUpdateFullScanCount GLOBAL_VAR_INIT(0);
+
+// Sequence number of a seqlock that allows to read spectrum and spectrumDigests without acquiring spectrumLock.
+// Writers (holding spectrumLock) make it odd before changing data and even again after finishing. Readers check that
+// it was even and unchanged during the read, and retry otherwise.
+GLOBAL_VAR_DECL volatile long long spectrumSequenceNumber GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL volatile long long spectrumReadRetries GLOBAL_VAR_INIT(0);
+
+
+// Start changing spectrum / spectrumDigests, must be called with spectrumLock acquired and must not be nested
+static inline void beginSpectrumWrite()
+{
+    ASSERT((spectrumSequenceNumber & 1) == 0);
+    _InterlockedIncrement64(&spectrumSequenceNumber);
+}
+
+// Finish changing spectrum / spectrumDigests, must be called before releasing spectrumLock
+static inline void endSpectrumWrite()
+{
+    ASSERT((spectrumSequenceNumber & 1) == 1);
+    _InterlockedIncrement64(&spectrumSequenceNumber);
+}
+
+// Start lock-free read, returns sequence number to pass to endSpectrumRead()
+static inline long long beginSpectrumRead()
+{
+    long long sequenceNumber;
+    while ((sequenceNumber = spectrumSequenceNumber) & 1)
+    {
+        _mm_pause();
+    }
+    _mm_lfence();
+    return sequenceNumber;
+}
+
+// Check that lock-free read was consistent. If false is returned, data read may be inconsistent and read must be retried.
+static inline bool endSpectrumRead(long long sequenceNumber)
+{
+    _mm_lfence();
+    if (spectrumSequenceNumber == sequenceNumber)
+    {
+        return true;
+    }
+    _InterlockedIncrement64(&spectrumReadRetries);
+    return false;
+}
+
+// Number of lock-free attempts of long reads before falling back to reading with spectrumLock acquired, so frequent
+// spectrum changes can't make a reader retry forever
+static constexpr unsigned int spectrumReadMaxLockFreeAttempts = 4;
+
+
+// Mark journal as invalid, so the next digest update scans the whole spectrum, acquire no lock
+static void invalidateSpectrumTickJournal()
+{
+    spectrumTickJournal.valid = false;
+}
+
+// Record that entity at index is changed in the current tick, must be called with spectrumLock acquired before
+// updating latestIncomingTransferTick / latestOutgoingTransferTick.
+static void recordSpectrumTickJournal(unsigned int index)
+{
+    if (spectrum[index].latestIncomingTransferTick == system.tick || spectrum[index].latestOutgoingTransferTick == system.tick)
+    {
+        // Already changed (and recorded) in this tick
+        return;
+    }
+
+    if (spectrumTickJournal.numberOfIndices < spectrumTickJournalCapacity)
+    {
+        spectrumTickJournal.indices[spectrumTickJournal.numberOfIndices++] = index;
+    }
+    else
+    {
+        spectrumTickJournal.valid = false;
+    }
+}
+
 
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
 static void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
@@ -139,6 +237,12 @@ private:
     DustBurning* buf;
 };
 
+// Compute all nodes of spectrumDigests from scratch, hashing each level with the multi-lane K12 on idle processors.
+static void computeSpectrumDigests()
+{
+    computeMerkleTree(spectrum, sizeof(::Entity), spectrumDigests, SPECTRUM_CAPACITY);
+}
+
 // Clean up spectrum hash map, removing all entities with balance 0. Updates spectrumInfo.
 static void reorganizeSpectrum()
 {
@@ -167,62 +271,57 @@ static void reorganizeSpectrum()
     }
     copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity));
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-        }
+    // Indices recorded in journal are outdated after moving entities
+    invalidateSpectrumTickJournal();
+    spectrumSnapshot.requireBase();
 
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
+    computeSpectrumDigests();
 
     updateSpectrumInfo();
 
     spectrumReorgTotalExecutionTicks += __rdtsc() - spectrumReorgStartTick;
 }
 
-static int spectrumIndex(const m256i& publicKey)
+// Probe hash map for publicKey without any synchronization. Caller has to make sure that the spectrum isn't changed
+// concurrently, either by holding spectrumLock or by using beginSpectrumRead() / endSpectrumRead().
+static int spectrumIndexNoLock(const m256i& publicKey)
 {
-    if (isZero(publicKey))
-    {
-        return -1;
-    }
-
     unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
 
-    ACQUIRE(spectrumLock);
-
-iteration:
-    if (spectrum[index].publicKey == publicKey)
-    {
-        RELEASE(spectrumLock);
-
-        return index;
-    }
-    else
+    // Limit number of iterations, because data may be inconsistent if a writer is active during a lock-free read
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
     {
+        if (spectrum[index].publicKey == publicKey)
+        {
+            return index;
+        }
         if (isZero(spectrum[index].publicKey))
         {
-            RELEASE(spectrumLock);
-
             return -1;
         }
-        else
-        {
-            index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+        index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+    }
+    return -1;
+}
 
-            goto iteration;
-        }
+// Return index of entity in spectrum or -1 if not found. Doesn't acquire spectrumLock, so it must not be called
+// by a thread that is changing the spectrum.
+static int spectrumIndex(const m256i& publicKey)
+{
+    if (isZero(publicKey))
+    {
+        return -1;
     }
+
+    int index;
+    long long sequenceNumber;
+    do
+    {
+        sequenceNumber = beginSpectrumRead();
+        index = spectrumIndexNoLock(publicKey);
+    } while (!endSpectrumRead(sequenceNumber));
+
+    return index;
 }
 
 static long long energy(const int index)
@@ -238,6 +337,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
         unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
 
         ACQUIRE(spectrumLock);
+        beginSpectrumWrite();
 
         // Anti-dust feature: prevent that spectrum fills to more than 75% of capacity to keep hash map lookup fast
         if (spectrumInfo.numberOfEntities >= (SPECTRUM_CAPACITY / 2) + (SPECTRUM_CAPACITY / 4))
@@ -305,6 +405,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
     iteration:
         if (spectrum[index].publicKey == publicKey)
         {
+            recordSpectrumTickJournal(index);
             spectrum[index].incomingAmount += amount;
             spectrum[index].numberOfIncomingTransfers++;
             spectrum[index].latestIncomingTransferTick = system.tick;
@@ -315,6 +416,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
         {
             if (isZero(spectrum[index].publicKey))
             {
+                recordSpectrumTickJournal(index);
                 spectrum[index].publicKey = publicKey;
                 spectrum[index].incomingAmount = amount;
                 spectrum[index].numberOfIncomingTransfers = 1;
@@ -341,6 +443,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
             }
         }
 
+        endSpectrumWrite();
         RELEASE(spectrumLock);
     }
 }
@@ -354,11 +457,14 @@ static bool decreaseEnergy(const int index, long long amount)
 
         if (energy(index) >= amount)
         {
+            beginSpectrumWrite();
+            recordSpectrumTickJournal(index);
             spectrum[index].outgoingAmount += amount;
             spectrum[index].numberOfOutgoingTransfers++;
             spectrum[index].latestOutgoingTransferTick = system.tick;
 
             spectrumInfo.totalAmount -= amount;
+            endSpectrumWrite();
 
             RELEASE(spectrumLock);
 
@@ -371,6 +477,105 @@ static bool decreaseEnergy(const int index, long long amount)
     return false;
 }
 
+// Update spectrumDigests after processing a tick: rehash all entities changed in the current tick and propagate
+// changes up to the root. Uses the tick journal if valid and falls back to scanning the whole spectrum otherwise.
+// Both ways recompute exactly the same nodes. Caller must acquire spectrumLock.
+static void updateSpectrumDigestsOfCurrentTick()
+{
+    beginSpectrumWrite();
+
+    KangarooTwelve64To32Batch batch;
+    if (spectrumTickJournal.valid)
+    {
+        // Rehash leafs of changed entities, using change flags to skip duplicates
+        unsigned int* indices = spectrumTickJournal.indices;
+        unsigned int numberOfIndices = 0;
+        for (unsigned int k = 0; k < spectrumTickJournal.numberOfIndices; k++)
+        {
+            const unsigned int digestIndex = indices[k];
+            if ((spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+                && !(spectrumChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63))))
+            {
+                batch.add(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+                spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+                spectrumSnapshot.markChanged(digestIndex);
+                indices[numberOfIndices++] = digestIndex;
+            }
+        }
+        batch.flush();
+
+        // Propagate changes level by level, only visiting the parents of changed nodes
+        unsigned int previousLevelBeginning = 0;
+        unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+        while (numberOfLeafs > 1)
+        {
+            unsigned int numberOfParents = 0;
+            for (unsigned int k = 0; k < numberOfIndices; k++)
+            {
+                const unsigned int i = indices[k] & ~1U;
+                if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+                {
+                    batch.add(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[previousLevelBeginning + numberOfLeafs + (i >> 1)]);
+                    spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                    indices[numberOfParents++] = i >> 1;
+                }
+            }
+            batch.flush();
+            // All flags of this level are cleared now, so setting parent flags cannot collide
+            for (unsigned int k = 0; k < numberOfParents; k++)
+            {
+                spectrumChangeFlags[indices[k] >> 6] |= (1ULL << (indices[k] & 63));
+            }
+            numberOfIndices = numberOfParents;
+
+            previousLevelBeginning += numberOfLeafs;
+            numberOfLeafs >>= 1;
+        }
+
+        spectrumDigestUpdateJournalCount++;
+    }
+    else
+    {
+        unsigned int digestIndex;
+        for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+        {
+            if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+            {
+                batch.add(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+                spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+                spectrumSnapshot.markChanged(digestIndex);
+            }
+        }
+        batch.flush();
+        unsigned int previousLevelBeginning = 0;
+        unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+        while (numberOfLeafs > 1)
+        {
+            for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+            {
+                if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+                {
+                    batch.add(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
+                    spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                    spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+                }
+                digestIndex++;
+            }
+            batch.flush();
+            previousLevelBeginning += numberOfLeafs;
+            numberOfLeafs >>= 1;
+        }
+
+        spectrumDigestUpdateFullScanCount++;
+    }
+    spectrumChangeFlags[0] = 0;
+
+    // Start new journal for the next tick
+    spectrumTickJournal.numberOfIndices = 0;
+    spectrumTickJournal.valid = true;
+
+    endSpectrumWrite();
+}
 
 static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
 {
@@ -383,6 +588,8 @@ static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
         return false;
     }
     updateSpectrumInfo();
+    invalidateSpectrumTickJournal();
+    spectrumSnapshot.requireBase();
     return true;
 }
 
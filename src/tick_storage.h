@@ -11,11 +11,15 @@
 #include "public_settings.h"
 
 #if TICK_STORAGE_AUTOSAVE_MODE
+#include "platform/staged_file_writer.h"
+#include "kangaroo_twelve.h"
+
 static unsigned short SNAPSHOT_METADATA_FILE_NAME[] = L"snapshotMetadata.???";
 static unsigned short SNAPSHOT_TICK_DATA_FILE_NAME[] = L"snapshotTickdata.???";
 static unsigned short SNAPSHOT_TICKS_FILE_NAME[] = L"snapshotTicks.???";
 static unsigned short SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME[] = L"snapshotTickTransactionOffsets.???";
 static unsigned short SNAPSHOT_TRANSACTIONS_FILE_NAME[] = L"snapshotTickTransaction.???";
+static unsigned short SNAPSHOT_SEGMENT_INDEX_FILE_NAME[] = L"snapshotTickSegments.???";
 #endif
 // Encapsulated tick storage of current epoch that can additionally keep the last ticks of the previous epoch.
 // The number of ticks to keep from the previous epoch is TICKS_TO_KEEP_FROM_PRIOR_EPOCH (defined in public_settings.h).
@@ -107,6 +111,28 @@ private:
         unsigned long long outNextTickTransactionOffset;
         // may need to store more meta data here to verify consistency when loading (ie: some nodes have different configs and can't use the saved files)
     } metaData;
+
+    // The snapshot files are append-only segments. A save only writes the ticks since the last save (starting with
+    // the last saved tick again, because its votes may have changed after saving) and the transaction bytes added
+    // since then. The segment index lists the segments, which are loaded in order. The first save of an epoch (or
+    // after a failed save or if the index is full) writes all ticks as segment 0.
+    static constexpr unsigned int maxNumberOfSnapshotSegments = 512;
+    struct SnapshotSegment
+    {
+        unsigned int tickBegin;
+        unsigned int tickEnd; // inclusive
+        unsigned long long transactionsBegin;
+        unsigned long long transactionsEnd;
+    };
+    struct SnapshotSegmentIndex
+    {
+        m256i checksum; // K12 of the rest of the index
+        unsigned int epoch;
+        unsigned int tickBegin;
+        unsigned int numberOfSegments;
+        SnapshotSegment segments[maxNumberOfSnapshotSegments];
+    } segmentIndex;
+
     inline static unsigned long long lastCheckTransactionOffset = 0; // use for save/load transaction state
     void prepareMetaDataFilename(short epoch)
     {
@@ -119,6 +145,7 @@ private:
         addEpochToFileName(SNAPSHOT_TICKS_FILE_NAME, sizeof(SNAPSHOT_TICKS_FILE_NAME) / sizeof(SNAPSHOT_TICKS_FILE_NAME[0]), epoch);
         addEpochToFileName(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, sizeof(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME) / sizeof(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME[0]), epoch);
         addEpochToFileName(SNAPSHOT_TRANSACTIONS_FILE_NAME, sizeof(SNAPSHOT_TRANSACTIONS_FILE_NAME) / sizeof(SNAPSHOT_TRANSACTIONS_FILE_NAME[0]), epoch);
+        addEpochToFileName(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, sizeof(SNAPSHOT_SEGMENT_INDEX_FILE_NAME) / sizeof(SNAPSHOT_SEGMENT_INDEX_FILE_NAME[0]), epoch);
     }
     bool saveMetaData(short epoch, unsigned int tickEnd, long long outTotalTransactionSize, unsigned long long outNextTickTransactionOffset, CHAR16* directory = NULL)
     {
@@ -134,77 +161,122 @@ private:
         }
         return true;
     }
-    bool saveTickData(unsigned long long nTick, CHAR16* directory = NULL)
+    // Get the ticks and transactions of the next segment for saving ticks up to `tick`. Returns the number of the
+    // segment, which is 0 if all ticks have to be saved.
+    unsigned int getNextSnapshotSegment(unsigned int epoch, unsigned int tick, SnapshotSegment& segment)
     {
-        long long totalWriteSize = nTick * sizeof(TickData);
-        auto sz = saveLargeFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalWriteSize, (unsigned char*)tickDataPtr, directory);
+        segment.tickEnd = tick;
+        if (segmentIndex.epoch == epoch && segmentIndex.tickBegin == tickBegin
+            && segmentIndex.numberOfSegments > 0 && segmentIndex.numberOfSegments < maxNumberOfSnapshotSegments
+            && segmentIndex.segments[segmentIndex.numberOfSegments - 1].tickEnd <= tick)
+        {
+            const SnapshotSegment& lastSegment = segmentIndex.segments[segmentIndex.numberOfSegments - 1];
+            segment.tickBegin = lastSegment.tickEnd;
+            segment.transactionsBegin = lastSegment.transactionsEnd;
+            return segmentIndex.numberOfSegments;
+        }
+        segment.tickBegin = tickBegin;
+        segment.transactionsBegin = 0;
+        return 0;
+    }
+    // Set segment segmentNumber as the last one of the index and update the checksum
+    void setLastSnapshotSegment(unsigned int epoch, unsigned int segmentNumber, const SnapshotSegment& segment)
+    {
+        segmentIndex.epoch = epoch;
+        segmentIndex.tickBegin = tickBegin;
+        segmentIndex.segments[segmentNumber] = segment;
+        segmentIndex.numberOfSegments = segmentNumber + 1;
+        KangarooTwelve((unsigned char*)&segmentIndex + sizeof(segmentIndex.checksum), sizeof(segmentIndex) - sizeof(segmentIndex.checksum), &segmentIndex.checksum, sizeof(segmentIndex.checksum));
+    }
+    bool saveSegmentIndex(CHAR16* directory = NULL)
+    {
+        auto sz = save(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, sizeof(segmentIndex), (unsigned char*)&segmentIndex, directory);
+        if (sz != sizeof(segmentIndex))
+        {
+            // files may not match the index anymore -> next save writes everything
+            segmentIndex.numberOfSegments = 0;
+            return false;
+        }
+        return true;
+    }
+    bool saveTickData(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
+    {
+        CHAR16 fileName[64];
+        getLargeFileChunkName(SNAPSHOT_TICK_DATA_FILE_NAME, segmentNumber, fileName);
+        long long totalWriteSize = (segment.tickEnd - segment.tickBegin + 1ULL) * sizeof(TickData);
+        auto sz = saveLargeFile(fileName, totalWriteSize, (unsigned char*)(tickDataPtr + (segment.tickBegin - tickBegin)), directory, false);
         if (sz != totalWriteSize)
         {
             return false;
         }
         return true;
     }
-    bool saveTicks(unsigned long long nTick, CHAR16* directory = NULL)
+    bool saveTicks(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
     {
-        long long totalWriteSize = nTick * sizeof(Tick) * NUMBER_OF_COMPUTORS;
-        auto sz = saveLargeFile(SNAPSHOT_TICKS_FILE_NAME, totalWriteSize, (unsigned char*)ticksPtr, directory);
+        CHAR16 fileName[64];
+        getLargeFileChunkName(SNAPSHOT_TICKS_FILE_NAME, segmentNumber, fileName);
+        long long totalWriteSize = (segment.tickEnd - segment.tickBegin + 1ULL) * sizeof(Tick) * NUMBER_OF_COMPUTORS;
+        auto sz = saveLargeFile(fileName, totalWriteSize, (unsigned char*)(ticksPtr + (segment.tickBegin - tickBegin) * (unsigned long long)NUMBER_OF_COMPUTORS), directory, false);
         if (sz != totalWriteSize)
         {
             return false;
         }
         return true;
     }
-    bool saveTickTransactionOffsets(unsigned long long nTick, CHAR16* directory = NULL)
+    bool saveTickTransactionOffsets(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
     {
-        long long totalWriteSize = nTick * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
-        auto sz = saveLargeFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalWriteSize, (unsigned char*)tickTransactionOffsetsPtr, directory);
+        CHAR16 fileName[64];
+        getLargeFileChunkName(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, segmentNumber, fileName);
+        long long totalWriteSize = (segment.tickEnd - segment.tickBegin + 1ULL) * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
+        auto sz = saveLargeFile(fileName, totalWriteSize, (unsigned char*)(tickTransactionOffsetsPtr + (segment.tickBegin - tickBegin) * (unsigned long long)NUMBER_OF_TRANSACTIONS_PER_TICK), directory, false);
         if (sz != totalWriteSize)
         {
             return false;
         }
         return true;
     }
-    bool saveTransactions(unsigned long long nTick, long long& outTotalTransactionSize, unsigned long long& outNextTickTransactionOffset, CHAR16* directory = NULL)
+    // Find the end of the last transaction of the first nTick ticks (and the following tick), which is the size of
+    // tickTransactions to save. Caller must hold tickTransactions lock.
+    unsigned long long findTransactionsEndOffset(unsigned long long nTick)
     {
         unsigned int toTick = tickBegin + (unsigned int)(nTick);
-        unsigned long long toPtr = 0;
-        outNextTickTransactionOffset = FIRST_TICK_TRANSACTION_OFFSET;
         lastCheckTransactionOffset = tickBegin > lastCheckTransactionOffset ? tickBegin : lastCheckTransactionOffset;
-        // find the offset
+        unsigned long long maxOffset = FIRST_TICK_TRANSACTION_OFFSET;
+        unsigned int tick = 0;
+        for (tick = toTick; tick >= lastCheckTransactionOffset; tick--)
         {
-            unsigned long long maxOffset = FIRST_TICK_TRANSACTION_OFFSET;
-            unsigned int tick = 0;
-            for (tick = toTick; tick >= lastCheckTransactionOffset; tick--)
+            for (int idx = NUMBER_OF_TRANSACTIONS_PER_TICK - 1; idx >= 0; idx--)
             {
-                for (int idx = NUMBER_OF_TRANSACTIONS_PER_TICK - 1; idx >= 0; idx--)
+                if (this->tickTransactionOffsets(tick, idx))
                 {
-                    if (this->tickTransactionOffsets(tick, idx))
-                    {
-                        unsigned long long offset = this->tickTransactionOffsets(tick, idx);
-                        Transaction* tx = (Transaction*)(tickTransactionsPtr + offset);
-                        unsigned long long tmp = offset + tx->totalSize();
-                        if (tmp > maxOffset){
-                            maxOffset = tmp;
-                            lastCheckTransactionOffset = tick;
-                        }
+                    unsigned long long offset = this->tickTransactionOffsets(tick, idx);
+                    Transaction* tx = (Transaction*)(tickTransactionsPtr + offset);
+                    unsigned long long tmp = offset + tx->totalSize();
+                    if (tmp > maxOffset){
+                        maxOffset = tmp;
+                        lastCheckTransactionOffset = tick;
                     }
                 }
             }
-            toPtr = maxOffset;
-            outNextTickTransactionOffset = maxOffset;
-        }
-        
-        // saving from the first tx of from tick to the last tx of (totick)
-        long long totalWriteSize = toPtr;
-        unsigned char* ptr = tickTransactionsPtr;
-        auto sz = saveLargeFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalWriteSize, (unsigned char*)ptr, directory);
+        }
+        return maxOffset;
+    }
+    // Save the transaction bytes of the segment. tickTransactions is append-only, so the bytes before
+    // segment.transactionsBegin have been saved by the previous segments already.
+    bool saveTransactions(unsigned long long nTick, unsigned int segmentNumber, SnapshotSegment& segment, CHAR16* directory = NULL)
+    {
+        // find the offset
+        unsigned long long toPtr = findTransactionsEndOffset(nTick);
+        segment.transactionsEnd = (toPtr > segment.transactionsBegin) ? toPtr : segment.transactionsBegin;
+
+        CHAR16 fileName[64];
+        getLargeFileChunkName(SNAPSHOT_TRANSACTIONS_FILE_NAME, segmentNumber, fileName);
+        long long totalWriteSize = segment.transactionsEnd - segment.transactionsBegin;
+        auto sz = saveLargeFile(fileName, totalWriteSize, tickTransactionsPtr + segment.transactionsBegin, directory, false);
         if (sz != totalWriteSize)
         {
-            outTotalTransactionSize = -1;
             return false;
         }
-        outTotalTransactionSize = totalWriteSize;
-
         return true;
     }
     bool loadMetaData(CHAR16* directory = NULL)
@@ -234,46 +306,128 @@ private:
 #endif
         return true;
     }
-    bool loadTickData(unsigned long long nTick, CHAR16* directory = NULL)
+    bool loadSegmentIndex(CHAR16* directory = NULL)
     {
-        long long totalLoadSize = nTick * sizeof(TickData);
-        auto sz = loadLargeFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalLoadSize, (unsigned char*)tickDataPtr, directory);
+        auto sz = load(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, sizeof(segmentIndex), (unsigned char*)&segmentIndex, directory);
+        if (sz != sizeof(segmentIndex))
+        {
+            return false;
+        }
+        m256i checksum;
+        KangarooTwelve((unsigned char*)&segmentIndex + sizeof(segmentIndex.checksum), sizeof(segmentIndex) - sizeof(segmentIndex.checksum), &checksum, sizeof(checksum));
+        return checksum == segmentIndex.checksum;
+    }
+    // Check that the segments are consecutive and end with the ticks and transactions of the meta data
+    bool checkSegmentIndex()
+    {
+        if (segmentIndex.epoch != metaData.epoch || segmentIndex.tickBegin != tickBegin
+            || segmentIndex.numberOfSegments == 0 || segmentIndex.numberOfSegments > maxNumberOfSnapshotSegments) {
+            return false;
+        }
+        for (unsigned int i = 0; i < segmentIndex.numberOfSegments; i++)
+        {
+            const SnapshotSegment& segment = segmentIndex.segments[i];
+            const unsigned int expectedTickBegin = (i) ? segmentIndex.segments[i - 1].tickEnd : tickBegin;
+            const unsigned long long expectedTransactionsBegin = (i) ? segmentIndex.segments[i - 1].transactionsEnd : 0;
+            if (segment.tickBegin != expectedTickBegin || segment.tickEnd < segment.tickBegin
+                || segment.transactionsBegin != expectedTransactionsBegin || segment.transactionsEnd < segment.transactionsBegin) {
+                return false;
+            }
+        }
+        const SnapshotSegment& lastSegment = segmentIndex.segments[segmentIndex.numberOfSegments - 1];
+        if (lastSegment.tickEnd != metaData.tickEnd
+            || lastSegment.transactionsEnd != (unsigned long long)metaData.outTotalTransactionSize
+            || lastSegment.transactionsEnd > tickTransactionsSizeCurrentEpoch) {
+            return false;
+        }
+        return true;
+    }
+    // Segment number of a snapshot saved before the segment index was introduced. Its files have no segment number
+    // and it is loaded as a single segment with all ticks of the metadata.
+    static constexpr unsigned int legacySnapshotSegment = 0xFFFFFFFF;
+    static void getSnapshotSegmentFileName(const CHAR16* fileName, unsigned int segmentNumber, CHAR16* segmentFileName)
+    {
+        if (segmentNumber == legacySnapshotSegment)
+            setText(segmentFileName, fileName);
+        else
+            getLargeFileChunkName(fileName, segmentNumber, segmentFileName);
+    }
+    bool loadTickData(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
+    {
+        CHAR16 fileName[64];
+        getSnapshotSegmentFileName(SNAPSHOT_TICK_DATA_FILE_NAME, segmentNumber, fileName);
+        long long totalLoadSize = (segment.tickEnd - segment.tickBegin + 1ULL) * sizeof(TickData);
+        auto sz = loadLargeFile(fileName, totalLoadSize, (unsigned char*)(tickDataPtr + (segment.tickBegin - tickBegin)), directory);
         if (sz != totalLoadSize)
         {
             return false;
         }
         return true;
     }
-    bool loadTicks(unsigned long long nTick, CHAR16* directory = NULL)
+    bool loadTicks(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
     {
-        long long totalLoadSize = nTick * sizeof(Tick) * NUMBER_OF_COMPUTORS;
-        auto sz = loadLargeFile(SNAPSHOT_TICKS_FILE_NAME, totalLoadSize, (unsigned char*)ticksPtr, directory);
+        CHAR16 fileName[64];
+        getSnapshotSegmentFileName(SNAPSHOT_TICKS_FILE_NAME, segmentNumber, fileName);
+        long long totalLoadSize = (segment.tickEnd - segment.tickBegin + 1ULL) * sizeof(Tick) * NUMBER_OF_COMPUTORS;
+        auto sz = loadLargeFile(fileName, totalLoadSize, (unsigned char*)(ticksPtr + (segment.tickBegin - tickBegin) * (unsigned long long)NUMBER_OF_COMPUTORS), directory);
         if (sz != totalLoadSize)
         {
             return false;
         }
         return true;
     }
-    bool loadTickTransactionOffsets(unsigned long long nTick, CHAR16* directory = NULL)
+    bool loadTickTransactionOffsets(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
     {
-        long long totalLoadSize = nTick * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
-        auto sz = loadLargeFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalLoadSize, (unsigned char*)tickTransactionOffsetsPtr, directory);
+        CHAR16 fileName[64];
+        getSnapshotSegmentFileName(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, segmentNumber, fileName);
+        long long totalLoadSize = (segment.tickEnd - segment.tickBegin + 1ULL) * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
+        auto sz = loadLargeFile(fileName, totalLoadSize, (unsigned char*)(tickTransactionOffsetsPtr + (segment.tickBegin - tickBegin) * (unsigned long long)NUMBER_OF_TRANSACTIONS_PER_TICK), directory);
         if (sz != totalLoadSize)
         {
             return false;
         }
         return true;
     }
-    bool loadTransactions(unsigned long long nTick, unsigned long long totalLoadSize, CHAR16* directory = NULL)
+    bool loadTransactions(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
     {
-        unsigned char* ptr = tickTransactionsPtr;
-        auto sz = loadLargeFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalLoadSize, (unsigned char*)ptr, directory);
+        CHAR16 fileName[64];
+        getSnapshotSegmentFileName(SNAPSHOT_TRANSACTIONS_FILE_NAME, segmentNumber, fileName);
+        long long totalLoadSize = segment.transactionsEnd - segment.transactionsBegin;
+        auto sz = loadLargeFile(fileName, totalLoadSize, tickTransactionsPtr + segment.transactionsBegin, directory);
         if (sz != totalLoadSize)
         {
             return false;
         }
         return true;
     }
+    // Load the files of a segment, returns 0 on success and the error code of tryLoadFromFile() otherwise
+    int loadSnapshotSegment(unsigned int segmentNumber, const SnapshotSegment& segment, CHAR16* directory = NULL)
+    {
+        if (!loadTickData(segmentNumber, segment, directory))
+        {
+            logToConsole(L"Failed to load loadTickData");
+            return 5;
+        }
+
+        if (!loadTicks(segmentNumber, segment, directory))
+        {
+            logToConsole(L"Failed to load loadTicks");
+            return 4;
+        }
+
+        if (!loadTickTransactionOffsets(segmentNumber, segment, directory))
+        {
+            logToConsole(L"Failed to load loadTickTransactionOffsets");
+            return 3;
+        }
+
+        if (!loadTransactions(segmentNumber, segment, directory))
+        {
+            logToConsole(L"Failed to load loadTransactions");
+            return 2;
+        }
+        return 0;
+    }
 #endif
     
 
@@ -291,9 +445,10 @@ public:
     // And probably cause critical bugs if we forget to do update this feature.
     // 
     // Save procedure:
-    // (1) check current meta data state
-    // (2) write all missing chunks to disk
-    // (3) update metadata state
+    // (1) find the next segment (ticks and transactions since the last save, or everything)
+    // (2) write the segment files
+    // (3) update the segment index
+    // (4) update metadata state
     int trySaveToFile(unsigned int epoch, unsigned int tick, CHAR16* directory = NULL)
     {   
         if (tick <= tickBegin) {
@@ -302,9 +457,19 @@ public:
         unsigned long long nTick = tick - tickBegin + 1; // inclusive [tickBegin, tick]
         prepareFilenames(epoch);
 
+        SnapshotSegment segment;
+        const unsigned int segmentNumber = getNextSnapshotSegment(epoch, tick, segment);
+        setText(message, L"Saving segment ");
+        appendNumber(message, segmentNumber, FALSE);
+        appendText(message, L" with ticks ");
+        appendNumber(message, segment.tickBegin, FALSE);
+        appendText(message, L" to ");
+        appendNumber(message, segment.tickEnd, FALSE);
+        logToConsole(message);
+
         logToConsole(L"Saving tick data...");
         tickData.acquireLock();
-        if (!saveTickData(nTick, directory))
+        if (!saveTickData(segmentNumber, segment, directory))
         {
             tickData.releaseLock();
             logToConsole(L"Failed to save tickData");
@@ -314,7 +479,7 @@ public:
 
         logToConsole(L"Saving quorum ticks");
         for (int i = 0; i < NUMBER_OF_COMPUTORS; i++) ticks.acquireLock(i);
-        if (!saveTicks(nTick, directory))
+        if (!saveTicks(segmentNumber, segment, directory))
         {
             for (int i = 0; i < NUMBER_OF_COMPUTORS; i++) ticks.releaseLock(i);
             logToConsole(L"Failed to save Ticks");
@@ -325,16 +490,14 @@ public:
 
         tickTransactions.acquireLock();
         logToConsole(L"Saving tick transaction offset");
-        if (!saveTickTransactionOffsets(nTick, directory))
+        if (!saveTickTransactionOffsets(segmentNumber, segment, directory))
         {
             tickTransactions.releaseLock();
             logToConsole(L"Failed to save transactionOffset");
             return 3;
         }
         logToConsole(L"Saving transactions");
-        long long outTotalTransactionSize = 0;
-        unsigned long long outNextTickTransactionOffset = 0;
-        if (!saveTransactions(nTick, outTotalTransactionSize, outNextTickTransactionOffset, directory))
+        if (!saveTransactions(nTick, segmentNumber, segment, directory))
         {
             tickTransactions.releaseLock();
             logToConsole(L"Failed to save transactions");
@@ -342,8 +505,16 @@ public:
         }
         tickTransactions.releaseLock();
 
+        logToConsole(L"Saving segment index");
+        setLastSnapshotSegment(epoch, segmentNumber, segment);
+        if (!saveSegmentIndex(directory))
+        {
+            logToConsole(L"Failed to save segment index");
+            return 1;
+        }
+
         logToConsole(L"Saving meta data");
-        if (!saveMetaData(epoch, tick, outTotalTransactionSize, outNextTickTransactionOffset, directory))
+        if (!saveMetaData(epoch, tick, segment.transactionsEnd, segment.transactionsEnd, directory))
         {
             logToConsole(L"Failed to save metaData");
             return 1;
@@ -352,10 +523,89 @@ public:
         return 0;
     }
 
+    // Staged save procedure (same files as trySaveToFile(), but written by the main loop in the background):
+    // (1) stage the data of `tick`, which may still change (such as late votes), the segment index, and the metadata
+    // (2) add the files to the writer, data of the ticks before `tick` doesn't change anymore and is written from the
+    //     tick storage directly, the metadata is written last
+    // The tick storage must not be reset (beginEpoch()) until the writer is done. If writing fails, call
+    // resetSnapshotSegments(). Returns false if the staging buffer of the writer is too small or there are too many
+    // files.
+    bool addToStagedFileWriter(StagedFileWriter& writer, unsigned int epoch, unsigned int tick)
+    {
+        if (tick <= tickBegin) {
+            return false;
+        }
+        const unsigned long long nTick = tick - tickBegin + 1; // inclusive [tickBegin, tick]
+        const unsigned long long lastTickIndex = nTick - 1;
+        prepareFilenames(epoch);
+
+        SnapshotSegment segment;
+        const unsigned int segmentNumber = getNextSnapshotSegment(epoch, tick, segment);
+        const unsigned long long firstTickIndex = segment.tickBegin - tickBegin;
+        const unsigned long long numberOfLiveTicks = tick - segment.tickBegin; // ticks of the segment before `tick`
+
+        tickData.acquireLock();
+        const void* stagedTickData = writer.stage(tickDataPtr + lastTickIndex, sizeof(TickData));
+        tickData.releaseLock();
+
+        for (int i = 0; i < NUMBER_OF_COMPUTORS; i++) ticks.acquireLock(i);
+        const void* stagedTicks = writer.stage(ticksPtr + lastTickIndex * NUMBER_OF_COMPUTORS, sizeof(Tick) * NUMBER_OF_COMPUTORS);
+        for (int i = 0; i < NUMBER_OF_COMPUTORS; i++) ticks.releaseLock(i);
+
+        // Transactions are appended to tickTransactions, so the bytes before the end offset don't change anymore
+        tickTransactions.acquireLock();
+        const void* stagedTickTransactionOffsets = writer.stage(tickTransactionOffsetsPtr + lastTickIndex * NUMBER_OF_TRANSACTIONS_PER_TICK, sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK);
+        const unsigned long long transactionsEnd = findTransactionsEndOffset(nTick);
+        tickTransactions.releaseLock();
+        segment.transactionsEnd = (transactionsEnd > segment.transactionsBegin) ? transactionsEnd : segment.transactionsBegin;
+
+        setLastSnapshotSegment(epoch, segmentNumber, segment);
+        const void* stagedSegmentIndex = writer.stage(&segmentIndex, sizeof(segmentIndex));
+
+        metaData.epoch = epoch;
+        metaData.tickBegin = tickBegin;
+        metaData.tickEnd = tick;
+        metaData.outTotalTransactionSize = segment.transactionsEnd;
+        metaData.outNextTickTransactionOffset = segment.transactionsEnd;
+        const void* stagedMetaData = writer.stage(&metaData, sizeof(metaData));
+
+        if (!stagedTickData || !stagedTicks || !stagedTickTransactionOffsets || !stagedSegmentIndex || !stagedMetaData)
+        {
+            resetSnapshotSegments();
+            return false;
+        }
+
+        CHAR16 tickDataFileName[64], ticksFileName[64], tickTransactionOffsetsFileName[64], transactionsFileName[64];
+        getLargeFileChunkName(SNAPSHOT_TICK_DATA_FILE_NAME, segmentNumber, tickDataFileName);
+        getLargeFileChunkName(SNAPSHOT_TICKS_FILE_NAME, segmentNumber, ticksFileName);
+        getLargeFileChunkName(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, segmentNumber, tickTransactionOffsetsFileName);
+        getLargeFileChunkName(SNAPSHOT_TRANSACTIONS_FILE_NAME, segmentNumber, transactionsFileName);
+        if (!writer.addLargeFile(tickDataFileName, tickDataPtr + firstTickIndex, numberOfLiveTicks * sizeof(TickData), stagedTickData, sizeof(TickData), false)
+            || !writer.addLargeFile(ticksFileName, ticksPtr + firstTickIndex * NUMBER_OF_COMPUTORS, numberOfLiveTicks * sizeof(Tick) * NUMBER_OF_COMPUTORS, stagedTicks, sizeof(Tick) * NUMBER_OF_COMPUTORS, false)
+            || !writer.addLargeFile(tickTransactionOffsetsFileName, tickTransactionOffsetsPtr + firstTickIndex * NUMBER_OF_TRANSACTIONS_PER_TICK, numberOfLiveTicks * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK, stagedTickTransactionOffsets, sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK, false)
+            || !writer.addLargeFile(transactionsFileName, tickTransactionsPtr + segment.transactionsBegin, segment.transactionsEnd - segment.transactionsBegin, nullptr, 0, false)
+            || !writer.addFile(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, stagedSegmentIndex, sizeof(segmentIndex))
+            || !writer.addLargeFile(SNAPSHOT_METADATA_FILE_NAME, stagedMetaData, sizeof(metaData)))
+        {
+            resetSnapshotSegments();
+            return false;
+        }
+        return true;
+    }
+
+    // Make the next save write all ticks (for example, if writing the files added with addToStagedFileWriter() failed)
+    void resetSnapshotSegments()
+    {
+        segmentIndex.numberOfSegments = 0;
+    }
+
     // Load procedure:
     // (1) try to load metadata file
     // (2) sanity check meta data file
-    // (3) load these in order: tickData -> Ticks -> tx offset -> tx 
+    // (3) load and check segment index
+    // (4) load the segments in order, each one in this order: tickData -> Ticks -> tx offset -> tx
+    // A snapshot without segment index (saved by older versions) is loaded as one segment with all ticks of the metadata.
+    // The segment index stays empty, so the next save writes all ticks as segment 0 and the new segment index.
     // only load once at start up
     int tryLoadFromFile(unsigned short epoch, CHAR16* directory)
     {
@@ -373,39 +623,52 @@ public:
             return 2;
         }
         nextTickTransactionOffset = metaData.outNextTickTransactionOffset;
-        unsigned long long nTick = metaData.tickEnd - metaData.tickBegin + 1;
         prepareFilenames(epoch);
 
-        logToConsole(L"Loading tick data...");
-        if (!loadTickData(nTick, directory))
-        {
-            logToConsole(L"Failed to load loadTickData");
-            initMetaData(epoch);
-            return 5;
-        }
-
-        logToConsole(L"Loading ticks...");
-        if (!loadTicks(nTick, directory))
+        if (getFileSize(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, directory) < 0)
         {
-            logToConsole(L"Failed to load loadTicks");
-            initMetaData(epoch);
-            return 4;
+            logToConsole(L"No segment index, loading snapshot without segments...");
+            if ((unsigned long long)metaData.outTotalTransactionSize > tickTransactionsSizeCurrentEpoch)
+            {
+                logToConsole(L"Invalid meta data file for tick storage");
+                initMetaData(epoch);
+                return 2;
+            }
+            const SnapshotSegment legacySegment = { tickBegin, metaData.tickEnd, 0, (unsigned long long)metaData.outTotalTransactionSize };
+            segmentIndex.numberOfSegments = 0;
+            int result = loadSnapshotSegment(legacySnapshotSegment, legacySegment, directory);
+            if (result)
+            {
+                initMetaData(epoch);
+            }
+            return result;
         }
 
-        logToConsole(L"Loading transaction offset...");
-        if (!loadTickTransactionOffsets(nTick, directory))
+        logToConsole(L"Loading segment index...");
+        if (!loadSegmentIndex(directory) || !checkSegmentIndex())
         {
-            logToConsole(L"Failed to load loadTickTransactionOffsets");
+            logToConsole(L"Invalid segment index file for tick storage");
             initMetaData(epoch);
-            return 3;
+            return 2;
         }
 
-        logToConsole(L"Loading transactions...");
-        if (!loadTransactions(nTick, metaData.outTotalTransactionSize, directory))
+        for (unsigned int segmentNumber = 0; segmentNumber < segmentIndex.numberOfSegments; segmentNumber++)
         {
-            logToConsole(L"Failed to load loadTransactions");
-            initMetaData(epoch);
-            return 2;
+            const SnapshotSegment& segment = segmentIndex.segments[segmentNumber];
+            setText(message, L"Loading segment ");
+            appendNumber(message, segmentNumber, FALSE);
+            appendText(message, L" with ticks ");
+            appendNumber(message, segment.tickBegin, FALSE);
+            appendText(message, L" to ");
+            appendNumber(message, segment.tickEnd, FALSE);
+            logToConsole(message);
+
+            int result = loadSnapshotSegment(segmentNumber, segment, directory);
+            if (result)
+            {
+                initMetaData(epoch);
+                return result;
+            }
         }
         return 0;
     }
@@ -435,6 +698,7 @@ public:
         metaData.tickEnd = tickBegin;
         metaData.epoch = epoch;
         lastCheckTransactionOffset = tickBegin;
+        segmentIndex.numberOfSegments = 0;
         return true;
     }
 #endif
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+
+#include "network_messages/tick.h"
+
+#include "kangaroo_twelve.h"
+
+// Matches the votes (ticks) of all computors with the etalon tick of this node, which updateVotesCount() does on every
+// pass while waiting for the quorum. The salted digests expected from a computor only depend on the etalon tick, the
+// resource testing digest, and the computor's public key. So they are computed once for all computors (using the
+// multi-lane K12) instead of on every pass. Further, a vote stored in tick storage isn't replaced during the epoch, so
+// the result of matching it is kept and each pass only checks the votes that have arrived since the previous pass.
+class TickVoteMatcher
+{
+private:
+    // Inputs of salted digests: computor public key followed by etalon digest (or resource testing digest)
+    m256i saltedData[NUMBER_OF_COMPUTORS][2];
+    unsigned long long expectedSaltedResourceTestingDigests[NUMBER_OF_COMPUTORS];
+    m256i expectedSaltedSpectrumDigests[NUMBER_OF_COMPUTORS];
+    m256i expectedSaltedUniverseDigests[NUMBER_OF_COMPUTORS];
+    m256i expectedSaltedComputerDigests[NUMBER_OF_COMPUTORS];
+
+    // State the expected digests and the matching results refer to
+    unsigned int tick;
+    unsigned short epoch;
+    Tick etalon;
+    unsigned long long resourceTestingDigest;
+    bool valid = false;
+
+    // Votes that have been checked / have matched since the last recomputation
+    unsigned long long checkedFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
+    unsigned long long matchedFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
+
+    unsigned long long numberOfRecomputations = 0;
+
+    bool isPrepared(unsigned int currentTick, unsigned short currentEpoch, const Tick& etalonTick, unsigned long long currentResourceTestingDigest, const m256i* computorPublicKeys) const
+    {
+        if (!valid
+            || tick != currentTick
+            || epoch != currentEpoch
+            || resourceTestingDigest != currentResourceTestingDigest
+            || *((unsigned long long*) & etalon.millisecond) != *((unsigned long long*) & etalonTick.millisecond)
+            || etalon.prevSpectrumDigest != etalonTick.prevSpectrumDigest
+            || etalon.prevUniverseDigest != etalonTick.prevUniverseDigest
+            || etalon.prevComputerDigest != etalonTick.prevComputerDigest
+            || etalon.transactionDigest != etalonTick.transactionDigest
+            || etalon.saltedSpectrumDigest != etalonTick.saltedSpectrumDigest
+            || etalon.saltedUniverseDigest != etalonTick.saltedUniverseDigest
+            || etalon.saltedComputerDigest != etalonTick.saltedComputerDigest)
+        {
+            return false;
+        }
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            if (saltedData[i][0] != computorPublicKeys[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    // Force recomputation on next call of prepare(), for example after loading votes from a snapshot
+    void invalidate()
+    {
+        valid = false;
+    }
+
+    // Prepare matching the votes of currentTick with etalonTick. The expected salted digests are only recomputed (and
+    // the matching results discarded) if anything they depend on has changed since the last call.
+    void prepare(unsigned int currentTick, unsigned short currentEpoch, const Tick& etalonTick, unsigned long long currentResourceTestingDigest, const m256i* computorPublicKeys)
+    {
+        if (isPrepared(currentTick, currentEpoch, etalonTick, currentResourceTestingDigest, computorPublicKeys))
+        {
+            return;
+        }
+
+        tick = currentTick;
+        epoch = currentEpoch;
+        copyMem(&etalon, &etalonTick, sizeof(Tick));
+        resourceTestingDigest = currentResourceTestingDigest;
+
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            saltedData[i][0] = computorPublicKeys[i];
+            saltedData[i][1].m256i_u64[0] = resourceTestingDigest;
+            KangarooTwelve(saltedData[i], 32 + sizeof(resourceTestingDigest), &expectedSaltedResourceTestingDigests[i], sizeof(resourceTestingDigest));
+        }
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            saltedData[i][1] = etalon.saltedSpectrumDigest;
+        }
+        KangarooTwelve64To32Multiple(saltedData, expectedSaltedSpectrumDigests, NUMBER_OF_COMPUTORS);
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            saltedData[i][1] = etalon.saltedUniverseDigest;
+        }
+        KangarooTwelve64To32Multiple(saltedData, expectedSaltedUniverseDigests, NUMBER_OF_COMPUTORS);
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            saltedData[i][1] = etalon.saltedComputerDigest;
+        }
+        KangarooTwelve64To32Multiple(saltedData, expectedSaltedComputerDigests, NUMBER_OF_COMPUTORS);
+
+        setMem(checkedFlags, sizeof(checkedFlags), 0);
+        setMem(matchedFlags, sizeof(matchedFlags), 0);
+        valid = true;
+        numberOfRecomputations++;
+    }
+
+    // Check if vote of computorIndex (stored in tick storage for the prepared tick and epoch) matches the etalon tick.
+    // isNewMatch is set if the vote matches and hasn't been reported as matching since the last recomputation.
+    bool matches(unsigned int computorIndex, const Tick& vote, bool& isNewMatch)
+    {
+        ASSERT(valid && computorIndex < NUMBER_OF_COMPUTORS);
+        const unsigned long long flag = 1ULL << (computorIndex & 63);
+        if (checkedFlags[computorIndex >> 6] & flag)
+        {
+            isNewMatch = false;
+            return (matchedFlags[computorIndex >> 6] & flag) != 0;
+        }
+
+        checkedFlags[computorIndex >> 6] |= flag;
+        isNewMatch = *((unsigned long long*) & vote.millisecond) == *((unsigned long long*) & etalon.millisecond)
+            && vote.prevSpectrumDigest == etalon.prevSpectrumDigest
+            && vote.prevUniverseDigest == etalon.prevUniverseDigest
+            && vote.prevComputerDigest == etalon.prevComputerDigest
+            && vote.transactionDigest == etalon.transactionDigest
+            && vote.saltedResourceTestingDigest == expectedSaltedResourceTestingDigests[computorIndex]
+            && vote.saltedSpectrumDigest == expectedSaltedSpectrumDigests[computorIndex]
+            && vote.saltedUniverseDigest == expectedSaltedUniverseDigests[computorIndex]
+            && vote.saltedComputerDigest == expectedSaltedComputerDigests[computorIndex];
+        if (isNewMatch)
+        {
+            matchedFlags[computorIndex >> 6] |= flag;
+        }
+        return isNewMatch;
+    }
+
+    unsigned long long getNumberOfRecomputations() const
+    {
+        return numberOfRecomputations;
+    }
+};
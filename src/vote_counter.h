@@ -1,4 +1,5 @@
 #pragma once
+#include <intrin.h>
 #include "platform/memory.h"
 #include "network_messages/transactions.h"
 #define VOTE_COUNTER_INPUT_TYPE 1
@@ -6,6 +7,7 @@
 #define VOTE_COUNTER_NUM_BIT_PER_COMP 10
 static_assert((1<< VOTE_COUNTER_NUM_BIT_PER_COMP) >= NUMBER_OF_COMPUTORS, "Invalid number of bit per datum");
 static_assert(VOTE_COUNTER_DATA_SIZE_IN_BYTES * 8 >= NUMBER_OF_COMPUTORS * VOTE_COUNTER_NUM_BIT_PER_COMP, "Invalid data size");
+static_assert(NUMBER_OF_COMPUTORS % 4 == 0, "Packing 10-bit numbers in groups of 4 (5 bytes) requires multiple of 4 computors");
 
 class VoteCounter
 {
@@ -47,6 +49,75 @@ protected:
 		accumulatedVoteCount[computorIdx] += value;
 	}
 
+	// pack 676 numbers to 676x10 bit, with the same layout as update10Bit(): each group of 4 numbers is stored as one
+	// big-endian 40-bit word (5 bytes)
+	static void pack10Bit(unsigned char* data, const unsigned int* values)
+	{
+		for (unsigned int i = 0, offset = 0; i < NUMBER_OF_COMPUTORS; i += 4, offset += 5)
+		{
+			const unsigned long long group = ((unsigned long long)(values[i] & 0x3FF) << 30)
+				| ((unsigned long long)(values[i + 1] & 0x3FF) << 20)
+				| ((unsigned long long)(values[i + 2] & 0x3FF) << 10)
+				| (unsigned long long)(values[i + 3] & 0x3FF);
+			data[offset] = (unsigned char)(group >> 32);
+			data[offset + 1] = (unsigned char)(group >> 24);
+			data[offset + 2] = (unsigned char)(group >> 16);
+			data[offset + 3] = (unsigned char)(group >> 8);
+			data[offset + 4] = (unsigned char)group;
+		}
+	}
+
+	// unpack 676x10 bit numbers packed by pack10Bit() / update10Bit()
+	static void unpack10Bit(const unsigned char* data, unsigned int* values)
+	{
+		for (unsigned int i = 0, offset = 0; i < NUMBER_OF_COMPUTORS; i += 4, offset += 5)
+		{
+			const unsigned long long group = ((unsigned long long)data[offset] << 32)
+				| ((unsigned long long)data[offset + 1] << 24)
+				| ((unsigned long long)data[offset + 2] << 16)
+				| ((unsigned long long)data[offset + 3] << 8)
+				| (unsigned long long)data[offset + 4];
+			values[i] = (unsigned int)(group >> 30) & 0x3FF;
+			values[i + 1] = (unsigned int)(group >> 20) & 0x3FF;
+			values[i + 2] = (unsigned int)(group >> 10) & 0x3FF;
+			values[i + 3] = (unsigned int)group & 0x3FF;
+		}
+	}
+
+	// increment buffer[j] for all computors j whose registered vote is for the given tick
+	void countVotesOfTick(unsigned int tick)
+	{
+		const unsigned int* tickVotes = votes[tick % (NUMBER_OF_COMPUTORS * 2)];
+		unsigned int j = 0;
+#if defined(__AVX512F__)
+		const __m512i tickVec512 = _mm512_set1_epi32(tick);
+		const __m512i one512 = _mm512_set1_epi32(1);
+		for (; j + 16 <= NUMBER_OF_COMPUTORS; j += 16)
+		{
+			const __mmask16 match = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(tickVotes + j), tickVec512);
+			const __m512i count = _mm512_loadu_si512(buffer + j);
+			_mm512_storeu_si512(buffer + j, _mm512_mask_add_epi32(count, match, count, one512));
+		}
+#endif
+#if defined(__AVX2__) || defined(__AVX512F__)
+		const __m256i tickVec256 = _mm256_set1_epi32(tick);
+		for (; j + 8 <= NUMBER_OF_COMPUTORS; j += 8)
+		{
+			// matching lanes are all ones (-1), so subtracting the comparison result increments them
+			const __m256i match = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(tickVotes + j)), tickVec256);
+			const __m256i count = _mm256_loadu_si256((const __m256i*)(buffer + j));
+			_mm256_storeu_si256((__m256i*)(buffer + j), _mm256_sub_epi32(count, match));
+		}
+#endif
+		for (; j < NUMBER_OF_COMPUTORS; j++)
+		{
+			if (tickVotes[j] == tick)
+			{
+				buffer[j]++;
+			}
+		}
+	}
+
 public:
 	static constexpr unsigned int VoteCounterDataSize = sizeof(votes) + sizeof(accumulatedVoteCount);
 	void init()
@@ -64,37 +135,29 @@ public:
 	// get and compress number of votes of 676 computors to 676x10 bit numbers between [fromTick, toTick)
 	void compressNewVotesPacket(unsigned int fromTick, unsigned int toTick, unsigned int computorIdx, unsigned char votePacket[VOTE_COUNTER_DATA_SIZE_IN_BYTES])
 	{
-		setMem(votePacket, sizeof(votePacket), 0);
+		setMem(votePacket, VOTE_COUNTER_DATA_SIZE_IN_BYTES, 0);
 		setMem(buffer, sizeof(buffer), 0);
 		for (unsigned int i = fromTick; i < toTick; i++)
 		{
-			unsigned int slotId = i % (NUMBER_OF_COMPUTORS * 2);
-			for (int j = 0; j < NUMBER_OF_COMPUTORS; j++)
-			{
-				if (votes[slotId][j] == i)
-				{
-					buffer[j]++;
-				}
-			}
+			countVotesOfTick(i);
 		}
 		buffer[computorIdx] = 0; // remove self-report
-		for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
-		{
-			update10Bit(votePacket, i, buffer[i]);
-		}
+		pack10Bit(votePacket, buffer);
 	}
 
 	bool validateNewVotesPacket(const unsigned char* votePacket, unsigned int computorIdx)
 	{
+		unpack10Bit(votePacket, buffer);
 		unsigned long long sum = 0;
+		unsigned int maxVotes = 0;
 		for (int i = 0; i < NUMBER_OF_COMPUTORS; i++)
 		{
-			buffer[i] = extract10Bit(votePacket, i);
-			if (buffer[i] > NUMBER_OF_COMPUTORS)
-			{
-				return false;
-			}
 			sum += buffer[i];
+			maxVotes = (buffer[i] > maxVotes) ? buffer[i] : maxVotes;
+		}
+		if (maxVotes > NUMBER_OF_COMPUTORS)
+		{
+			return false;
 		}
 		// check #0: sum of all vote must be >= 675*451 (vote of the tick leader is removed)
 		if (sum < (NUMBER_OF_COMPUTORS - 1) * QUORUM)
@@ -111,12 +174,12 @@ public:
 
 	void addVotes(const unsigned char* newVotePacket, unsigned int computorIdx)
 	{
+		// validateNewVotesPacket() leaves the unpacked numbers in buffer
 		if (validateNewVotesPacket(newVotePacket, computorIdx))
 		{
 			for (int i = 0; i < NUMBER_OF_COMPUTORS; i++)
 			{
-				unsigned int vote_count = extract10Bit(newVotePacket, i);
-				accumulateVoteCount(i, vote_count);
+				accumulateVoteCount(i, buffer[i]);
 			}
 		}
 	}
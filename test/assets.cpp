@@ -10,6 +10,7 @@
 #include "contract_core/qpi_asset_impl.h"
 
 #include "test_util.h"
+#include <set>
 
 
 class AssetsTest : public AssetStorage
@@ -116,6 +117,28 @@ public:
             EXPECT_EQ(it1->second, it2->second);
         }
 
+        // check that entity lists contain each ownership and possession exactly once, in the list of the entity's hash map start index
+        std::set<unsigned int> entityListElements;
+        for (unsigned int listIdx = 0; listIdx < ASSETS_CAPACITY; listIdx++)
+        {
+            unsigned int idx = indexLists.entityOwnershipsPossessionsFirstIdx[listIdx];
+            while (idx != NO_ASSET_INDEX)
+            {
+                EXPECT_LT(idx, ASSETS_CAPACITY);
+                EXPECT_TRUE(assets[idx].varStruct.issuance.type == OWNERSHIP || assets[idx].varStruct.issuance.type == POSSESSION);
+                EXPECT_EQ(assets[idx].varStruct.issuance.publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1), listIdx);
+                EXPECT_TRUE(entityListElements.insert(idx).second);
+                idx = indexLists.entityNextIdx[idx];
+            }
+        }
+        for (unsigned int index = 0; index < ASSETS_CAPACITY; index++)
+        {
+            if (assets[index].varStruct.issuance.type == OWNERSHIP || assets[index].varStruct.issuance.type == POSSESSION)
+            {
+                EXPECT_EQ(entityListElements.count(index), 1);
+            }
+        }
+
         // check that number of owned and possessed shares are equal for each issuance
         issuanceIdx = indexLists.issuancesFirstIdx;
         while (issuanceIdx != NO_ASSET_INDEX)
@@ -135,6 +158,34 @@ public:
             issuanceIdx = indexLists.nextIdx[issuanceIdx];
         }
     }
+
+    // Collect ownerships or possessions of entity by walking the entity list, as processRequestOwnedAssets() / processRequestPossessedAssets() do
+    static std::set<unsigned int> queryEntityRecords(const m256i& publicKey, unsigned char type)
+    {
+        std::set<unsigned int> records;
+        for (unsigned int idx = as.indexLists.getEntityOwnershipsPossessionsFirstIdx(publicKey); idx != NO_ASSET_INDEX; idx = as.indexLists.entityNextIdx[idx])
+        {
+            if (assets[idx].varStruct.issuance.type == type && assets[idx].varStruct.issuance.publicKey == publicKey)
+            {
+                EXPECT_TRUE(records.insert(idx).second);
+            }
+        }
+        return records;
+    }
+
+    // Collect ownerships or possessions of all entities by scanning the whole universe
+    static std::map<m256i, std::set<unsigned int>> scanEntityRecords(unsigned char type)
+    {
+        std::map<m256i, std::set<unsigned int>> records;
+        for (unsigned int idx = 0; idx < ASSETS_CAPACITY; idx++)
+        {
+            if (assets[idx].varStruct.issuance.type == type)
+            {
+                records[assets[idx].varStruct.issuance.publicKey].insert(idx);
+            }
+        }
+        return records;
+    }
 };
 
 
@@ -244,7 +295,7 @@ TEST(TestCoreAssets, AssetIteratorOwnershipAndPossession)
     for (int i = 0; i < issuancesCount; ++i)
     {
         int firstOwnershipIdx = -1, firstPossessionIdx = -1, issuanceIdx = -1;
-        EXPECT_EQ(issueAsset(issuances[i].id.issuer, assetNameFromInt64(issuances[i].id.assetName).c_str(), 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT,
+        EXPECT_EQ(issueAsset(issuances[i].id.issuer, (const char*)&issuances[i].id.assetName, 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT,
             issuances[i].numOfShares, issuances[i].managingContract, &issuanceIdx, &firstOwnershipIdx, &firstPossessionIdx), issuances[i].numOfShares);
         issuances[i].universeIdx = issuanceIdx;
 
@@ -406,9 +457,56 @@ TEST(TestCoreAssets, AssetIteratorOwnershipAndPossession)
         }
     }
 
+    // Test querying ownerships and possessions by entity (RequestOwnedAssets / RequestPossessedAssets)
+    std::map<m256i, std::set<unsigned int>> expectedOwnerships, expectedPossessions;
+    for (int i = 0; i < issuancesCount; ++i)
+    {
+        for (const auto& ownerOwnershipIdxPair : issuances[i].ownershipIdx)
+        {
+            expectedOwnerships[ownerOwnershipIdxPair.first].insert((unsigned int)ownerOwnershipIdxPair.second);
+        }
+        for (const auto& possessorPossessionIdxPair : issuances[i].possessionIdx)
+        {
+            expectedPossessions[possessorPossessionIdxPair.first].insert((unsigned int)possessorPossessionIdxPair.second);
+        }
+    }
+    EXPECT_EQ(test.scanEntityRecords(OWNERSHIP), expectedOwnerships);
+    EXPECT_EQ(test.scanEntityRecords(POSSESSION), expectedPossessions);
+    for (const auto& entityRecordsPair : expectedOwnerships)
+    {
+        EXPECT_EQ(test.queryEntityRecords(entityRecordsPair.first, OWNERSHIP), entityRecordsPair.second);
+    }
+    for (const auto& entityRecordsPair : expectedPossessions)
+    {
+        EXPECT_EQ(test.queryEntityRecords(entityRecordsPair.first, POSSESSION), entityRecordsPair.second);
+    }
+
+    // entity sharing the list of an issuer (same hash map start index) without owning or possessing anything
+    const m256i collidingEntity(1, 0, 0, 0);
+    EXPECT_EQ(as.indexLists.getEntityOwnershipsPossessionsFirstIdx(collidingEntity), as.indexLists.getEntityOwnershipsPossessionsFirstIdx(issuances[0].id.issuer));
+    EXPECT_NE(as.indexLists.getEntityOwnershipsPossessionsFirstIdx(collidingEntity), NO_ASSET_INDEX);
+    EXPECT_TRUE(test.queryEntityRecords(collidingEntity, OWNERSHIP).empty());
+    EXPECT_TRUE(test.queryEntityRecords(collidingEntity, POSSESSION).empty());
+
     // check consistency after rebuild/cleanup of hash map
     assetsEndEpoch();
     test.checkAssetsConsistency();
+
+    // records are moved by the rebuild and records without shares are removed, so compare entity queries with full scan
+    const std::map<m256i, std::set<unsigned int>> ownershipsAfterRebuild = test.scanEntityRecords(OWNERSHIP);
+    const std::map<m256i, std::set<unsigned int>> possessionsAfterRebuild = test.scanEntityRecords(POSSESSION);
+    EXPECT_EQ(ownershipsAfterRebuild.size(), expectedOwnerships.size());
+    EXPECT_EQ(possessionsAfterRebuild.size(), expectedPossessions.size());
+    for (const auto& entityRecordsPair : ownershipsAfterRebuild)
+    {
+        EXPECT_LE(entityRecordsPair.second.size(), expectedOwnerships[entityRecordsPair.first].size());
+        EXPECT_EQ(test.queryEntityRecords(entityRecordsPair.first, OWNERSHIP), entityRecordsPair.second);
+    }
+    for (const auto& entityRecordsPair : possessionsAfterRebuild)
+    {
+        EXPECT_LE(entityRecordsPair.second.size(), expectedPossessions[entityRecordsPair.first].size());
+        EXPECT_EQ(test.queryEntityRecords(entityRecordsPair.first, POSSESSION), entityRecordsPair.second);
+    }
 }
 
 /*
@@ -0,0 +1,112 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/contract_core/contract_state_digest.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+// Straightforward computation of the page Merkle root for comparison
+static m256i computeReferencePageDigest(const unsigned char* state, unsigned long long stateSize)
+{
+    constexpr unsigned int pageSize = ContractStatePageDigest::pageSize;
+    const unsigned long long numberOfPages = (stateSize + pageSize - 1) / pageSize;
+    unsigned long long numberOfLeafs = 1;
+    while (numberOfLeafs < numberOfPages)
+        numberOfLeafs <<= 1;
+
+    std::vector<m256i> level(numberOfLeafs, m256i::zero());
+    for (unsigned long long page = 0; page < numberOfPages; ++page)
+    {
+        const unsigned long long offset = page * pageSize;
+        const unsigned int size = (unsigned int)std::min<unsigned long long>(pageSize, stateSize - offset);
+        KangarooTwelve(state + offset, size, &level[page], 32);
+    }
+    while (level.size() > 1)
+    {
+        std::vector<m256i> nextLevel(level.size() / 2);
+        for (size_t i = 0; i < nextLevel.size(); ++i)
+            KangarooTwelve(&level[2 * i], 64, &nextLevel[i], 32);
+        level.swap(nextLevel);
+    }
+    return level[0];
+}
+
+static void modifyRandomBytes(std::vector<unsigned char>& state, unsigned int count, std::mt19937_64& gen)
+{
+    for (unsigned int i = 0; i < count; ++i)
+        state[gen() % state.size()] ^= (unsigned char)(1 + gen() % 255);
+}
+
+TEST(TestCoreContractStatePageDigest, MatchesReference)
+{
+    std::mt19937_64 gen(42);
+    const unsigned long long stateSizes[] = { 1, 100, ContractStatePageDigest::pageSize, ContractStatePageDigest::pageSize + 1, 3 * ContractStatePageDigest::pageSize + 12345, 200 * ContractStatePageDigest::pageSize - 7 };
+    for (const unsigned long long stateSize : stateSizes)
+    {
+        std::vector<unsigned char> state(stateSize);
+        for (auto& b : state)
+            b = (unsigned char)gen();
+
+        ContractStatePageDigest pageDigest;
+        EXPECT_TRUE(pageDigest.init(stateSize));
+        EXPECT_EQ(pageDigest.update(state.data()), computeReferencePageDigest(state.data(), stateSize));
+
+        for (int round = 0; round < 5; ++round)
+        {
+            // unchanged state: nothing is rehashed
+            const unsigned long long rehashedPagesBefore = pageDigest.getNumberOfRehashedPages();
+            EXPECT_EQ(pageDigest.update(state.data()), computeReferencePageDigest(state.data(), stateSize));
+            EXPECT_EQ(pageDigest.getNumberOfRehashedPages(), rehashedPagesBefore);
+
+            // some bytes changed (including last byte of state)
+            modifyRandomBytes(state, round * 3 + 1, gen);
+            state[stateSize - 1] ^= 0x5a;
+            EXPECT_EQ(pageDigest.update(state.data()), computeReferencePageDigest(state.data(), stateSize));
+            EXPECT_LE(pageDigest.getNumberOfRehashedPages() - rehashedPagesBefore, round * 3 + 2);
+        }
+
+        pageDigest.deinit();
+    }
+}
+
+TEST(TestCoreContractStatePageDigest, PerformanceQxSizedState)
+{
+    // order of magnitude of Qx state (two collections of 2^21 orders)
+    constexpr unsigned long long stateSize = 256ULL * 1024 * 1024;
+    std::vector<unsigned char> state(stateSize, 0);
+    std::mt19937_64 gen(1234);
+    modifyRandomBytes(state, 100000, gen);
+
+    ContractStatePageDigest pageDigest;
+    EXPECT_TRUE(pageDigest.init(stateSize));
+    pageDigest.update(state.data());
+
+    m256i fullDigest;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    KangarooTwelve(state.data(), (unsigned int)stateSize, &fullDigest, 32);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    const auto fullMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+
+    // a few small procedure calls per tick
+    constexpr int ticks = 10;
+    m256i incrementalDigest;
+    t0 = std::chrono::high_resolution_clock::now();
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        modifyRandomBytes(state, 20, gen);
+        incrementalDigest = pageDigest.update(state.data());
+    }
+    t1 = std::chrono::high_resolution_clock::now();
+    const auto incrementalMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / ticks;
+
+    const m256i referenceDigest = computeReferencePageDigest(state.data(), stateSize);
+    EXPECT_EQ(incrementalDigest, referenceDigest);
+    std::cout << "Digest of " << stateSize << " bytes: full K12 " << fullMicroseconds << " us, page-granular update "
+        << incrementalMicroseconds << " us" << std::endl;
+
+    pageDigest.deinit();
+}
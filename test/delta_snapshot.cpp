@@ -0,0 +1,135 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/delta_snapshot.h"
+
+#include <filesystem>
+#include <random>
+#include <vector>
+
+
+struct TestRecord
+{
+    unsigned long long value[6];
+};
+
+static constexpr unsigned long long testCapacity = 4096;
+typedef DeltaSnapshot<TestRecord, testCapacity> TestDeltaSnapshot;
+
+static void changeRecords(std::vector<TestRecord>& records, TestDeltaSnapshot& snapshot, unsigned int count, std::mt19937_64& gen)
+{
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        const unsigned int index = gen() % testCapacity;
+        records[index].value[gen() % 6] = gen();
+        snapshot.markChanged(index);
+    }
+}
+
+static bool loadAndCompare(const std::vector<TestRecord>& expected, CHAR16* baseFileName, CHAR16* directory, unsigned int epoch)
+{
+    TestDeltaSnapshot loaded;
+    EXPECT_TRUE(loaded.init(L"snapshotTestDelta"));
+    std::vector<TestRecord> records(testCapacity);
+    const bool ok = loaded.loadFromFiles(records.data(), baseFileName, directory, epoch);
+    loaded.deinit();
+    return ok && memcmp(records.data(), expected.data(), testCapacity * sizeof(TestRecord)) == 0;
+}
+
+TEST(TestCoreDeltaSnapshot, SaveLoadAndCompact)
+{
+    const std::filesystem::path directoryPath = std::filesystem::temp_directory_path() / "qubicDeltaSnapshot";
+    std::filesystem::remove_all(directoryPath);
+    std::filesystem::create_directories(directoryPath);
+    const std::wstring directoryString = directoryPath.wstring();
+    CHAR16* directory = (CHAR16*)directoryString.c_str();
+    CHAR16 baseFileName[] = L"snapshotTestBase";
+    const unsigned int epoch = 123;
+
+    std::mt19937_64 gen(42);
+    std::vector<TestRecord> records(testCapacity);
+    for (auto& record : records)
+        for (auto& value : record.value)
+            value = gen();
+
+    TestDeltaSnapshot snapshot;
+    EXPECT_TRUE(snapshot.init(L"snapshotTestDelta"));
+
+    // first save writes base
+    EXPECT_TRUE(snapshot.saveToFiles(records.data(), baseFileName, directory, epoch));
+    EXPECT_TRUE(snapshot.lastSavedBase());
+    EXPECT_EQ(getFileSize(baseFileName, directory), (long long)TestDeltaSnapshot::baseSize);
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch));
+
+    // small changes are saved as deltas with changed records and their indices
+    CHAR16 deltaFileName[64];
+    for (unsigned int i = 0; i < TestDeltaSnapshot::maxNumberOfDeltas; ++i)
+    {
+        changeRecords(records, snapshot, 3, gen);
+        EXPECT_TRUE(snapshot.saveToFiles(records.data(), baseFileName, directory, epoch));
+        EXPECT_FALSE(snapshot.lastSavedBase());
+        EXPECT_FALSE(snapshot.lastSavedCompaction());
+        EXPECT_EQ(snapshot.getNumberOfDeltas(), i + 1);
+        getLargeFileChunkName(L"snapshotTestDelta", i, deltaFileName);
+        EXPECT_EQ(getFileSize(deltaFileName, directory), (long long)(snapshot.getLastSavedRecords() * (sizeof(TestRecord) + 4)));
+        EXPECT_LE(snapshot.getLastSavedRecords(), 3);
+    }
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch));
+
+    // no change: no delta added
+    EXPECT_TRUE(snapshot.saveToFiles(records.data(), baseFileName, directory, epoch));
+    EXPECT_EQ(snapshot.getNumberOfDeltas(), TestDeltaSnapshot::maxNumberOfDeltas);
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch));
+
+    // too many deltas: compacted to one delta with all records changed since the base
+    changeRecords(records, snapshot, 3, gen);
+    EXPECT_TRUE(snapshot.saveToFiles(records.data(), baseFileName, directory, epoch));
+    EXPECT_TRUE(snapshot.lastSavedCompaction());
+    EXPECT_EQ(snapshot.getNumberOfDeltas(), 1);
+    EXPECT_GT(snapshot.getLastSavedRecords(), 3);
+    EXPECT_LE(snapshot.getLastSavedRecords(), 3 * (TestDeltaSnapshot::maxNumberOfDeltas + 1));
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch));
+
+    // continue deltas after loading
+    TestDeltaSnapshot loaded;
+    EXPECT_TRUE(loaded.init(L"snapshotTestDelta"));
+    EXPECT_TRUE(loaded.loadFromFiles(records.data(), baseFileName, directory, epoch));
+    changeRecords(records, loaded, 5, gen);
+    EXPECT_TRUE(loaded.saveToFiles(records.data(), baseFileName, directory, epoch));
+    EXPECT_FALSE(loaded.lastSavedBase());
+    EXPECT_EQ(loaded.getNumberOfDeltas(), 2);
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch));
+
+    // large change: new base
+    changeRecords(records, loaded, (unsigned int)TestDeltaSnapshot::maxRecordsPerDelta * 4, gen);
+    EXPECT_TRUE(loaded.saveToFiles(records.data(), baseFileName, directory, epoch));
+    EXPECT_TRUE(loaded.lastSavedBase());
+    EXPECT_EQ(loaded.getNumberOfDeltas(), 0);
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch));
+
+    // base required explicitly (for example after reorganizing) and for new epoch
+    changeRecords(records, loaded, 1, gen);
+    loaded.requireBase();
+    EXPECT_TRUE(loaded.saveToFiles(records.data(), baseFileName, directory, epoch));
+    EXPECT_TRUE(loaded.lastSavedBase());
+    changeRecords(records, loaded, 1, gen);
+    EXPECT_TRUE(loaded.saveToFiles(records.data(), baseFileName, directory, epoch + 1));
+    EXPECT_TRUE(loaded.lastSavedBase());
+    EXPECT_FALSE(loadAndCompare(records, baseFileName, directory, epoch));
+    EXPECT_TRUE(loadAndCompare(records, baseFileName, directory, epoch + 1));
+
+    // corrupted delta is rejected
+    changeRecords(records, loaded, 2, gen);
+    EXPECT_TRUE(loaded.saveToFiles(records.data(), baseFileName, directory, epoch + 1));
+    getLargeFileChunkName(L"snapshotTestDelta", 0, deltaFileName);
+    std::vector<unsigned char> delta(getFileSize(deltaFileName, directory));
+    EXPECT_EQ(load(deltaFileName, delta.size(), delta.data(), directory), (long long)delta.size());
+    delta[0] ^= 1;
+    EXPECT_EQ(save(deltaFileName, delta.size(), delta.data(), directory), (long long)delta.size());
+    EXPECT_FALSE(loadAndCompare(records, baseFileName, directory, epoch + 1));
+
+    loaded.deinit();
+    snapshot.deinit();
+    std::filesystem::remove_all(directoryPath);
+}
@@ -4,7 +4,10 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <chrono>
+#include <random>
+#include <vector>
 
 
 TEST(TestCoreK12, PerformanceDigest32Of1GB)
@@ -35,3 +38,137 @@ TEST(TestCoreK12, PerformanceDigest32Of1GB)
 
     delete [] inputPtr;
 }
+
+TEST(TestCoreK12, MultiLane64To32MatchesScalar)
+{
+    constexpr unsigned int inputN = 1000;
+    std::mt19937_64 gen(42);
+    std::vector<unsigned char> input(inputN * 64);
+    for (auto& byte : input)
+        byte = (unsigned char)gen();
+
+    std::vector<unsigned char> expectedOutput(inputN * 32);
+    for (unsigned int i = 0; i < inputN; ++i)
+        KangarooTwelve64To32(&input[i * 64], &expectedOutput[i * 32]);
+
+    // Consecutive inputs, with all counts that lead to different combinations of 8 lanes, 4 lanes, and scalar
+    for (unsigned int count = 0; count <= 20; ++count)
+    {
+        std::vector<unsigned char> output(inputN * 32, 0);
+        KangarooTwelve64To32Multiple(input.data(), output.data(), count);
+        EXPECT_EQ(memcmp(output.data(), expectedOutput.data(), count * 32), 0);
+        for (unsigned int i = count * 32; i < inputN * 32; ++i)
+            EXPECT_EQ(output[i], 0);
+    }
+    std::vector<unsigned char> output(inputN * 32, 0);
+    KangarooTwelve64To32Multiple(input.data(), output.data(), inputN);
+    EXPECT_EQ(output, expectedOutput);
+
+    // Scattered inputs in random order, with flushes at random points
+    std::vector<unsigned int> order(inputN);
+    for (unsigned int i = 0; i < inputN; ++i)
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), gen);
+    std::fill(output.begin(), output.end(), 0);
+    KangarooTwelve64To32Batch batch;
+    for (unsigned int i = 0; i < inputN; ++i)
+    {
+        batch.add(&input[order[i] * 64], &output[order[i] * 32]);
+        if (gen() % 16 == 0)
+            batch.flush();
+    }
+    batch.flush();
+    EXPECT_EQ(output, expectedOutput);
+}
+
+TEST(TestCoreK12, PerformanceMultiLane64To32)
+{
+    constexpr unsigned int inputN = 1024 * 1024;
+    std::vector<unsigned char> input(inputN * 64, 0x5a);
+    std::vector<unsigned char> output(inputN * 32);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < inputN; ++i)
+        KangarooTwelve64To32(&input[i * 64], &output[i * 32]);
+    auto scalarMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    startTime = std::chrono::high_resolution_clock::now();
+    KangarooTwelve64To32Multiple(input.data(), output.data(), inputN);
+    auto multiLaneMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "K12 64 to 32 bytes of " << inputN << " inputs: scalar " << scalarMilliSec << " ms, "
+        << KangarooTwelve64To32Batch::numberOfLanes << " lanes " << multiLaneMilliSec << " ms" << std::endl;
+}
+
+TEST(TestCoreK12, MultiLaneShortInputMatchesScalar)
+{
+    // All lengths up to some blocks and around the block boundaries up to the chunk size, plus some multi-chunk inputs
+    std::vector<unsigned int> lengths;
+    for (unsigned int len = 0; len <= 3 * K12_rateInBytes + 2; ++len)
+        lengths.push_back(len);
+    for (unsigned int boundary = 4 * K12_rateInBytes; boundary < K12_chunkSize + 2; boundary += K12_rateInBytes)
+        for (unsigned int len = boundary - 2; len <= boundary + 1; ++len)
+            lengths.push_back(len);
+    for (unsigned int len = K12_chunkSize - 3; len <= K12_chunkSize + 1; ++len)
+        lengths.push_back(len);
+    lengths.push_back(3 * K12_chunkSize + 100);
+
+    std::mt19937_64 gen(42);
+    std::vector<unsigned char> data(4 * K12_chunkSize);
+    for (auto& byte : data)
+        byte = (unsigned char)gen();
+
+    for (unsigned int outputByteLen : { 8u, 32u, 41u, (unsigned int)K12_rateInBytes })
+    {
+        // Several inputs of each length in random order, starting at random offsets of data
+        std::vector<unsigned int> inputLengths;
+        for (unsigned int round = 0; round < 6; ++round)
+            inputLengths.insert(inputLengths.end(), lengths.begin(), lengths.end());
+        std::shuffle(inputLengths.begin(), inputLengths.end(), gen);
+        const unsigned int inputN = (unsigned int)inputLengths.size();
+
+        std::vector<const unsigned char*> inputs(inputN);
+        std::vector<unsigned char> output(inputN * outputByteLen, 0);
+        std::vector<unsigned char*> outputs(inputN);
+        std::vector<unsigned char> expectedOutput(inputN * outputByteLen);
+        for (unsigned int i = 0; i < inputN; ++i)
+        {
+            inputs[i] = &data[gen() % (data.size() - inputLengths[i] + 1)];
+            outputs[i] = &output[i * outputByteLen];
+            KangarooTwelve(inputs[i], inputLengths[i], &expectedOutput[i * outputByteLen], outputByteLen);
+        }
+
+        KangarooTwelveMultiple(inputs.data(), inputLengths.data(), outputs.data(), inputN, outputByteLen);
+        EXPECT_EQ(output, expectedOutput);
+    }
+}
+
+TEST(TestCoreK12, PerformanceMultiLaneShortInput)
+{
+    // Inputs of typical log message sizes
+    constexpr unsigned int inputN = 1024 * 1024;
+    std::mt19937_64 gen(42);
+    std::vector<unsigned char> data(inputN * 16 + 256, 0x5a);
+    std::vector<const unsigned char*> inputs(inputN);
+    std::vector<unsigned int> inputLengths(inputN);
+    std::vector<unsigned char> output(inputN * 8);
+    std::vector<unsigned char*> outputs(inputN);
+    for (unsigned int i = 0; i < inputN; ++i)
+    {
+        inputs[i] = &data[i * 16];
+        inputLengths[i] = (gen() % 4) ? 72 : 24 + gen() % 200;
+        outputs[i] = &output[i * 8];
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < inputN; ++i)
+        KangarooTwelve(inputs[i], inputLengths[i], outputs[i], 8);
+    auto scalarMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    startTime = std::chrono::high_resolution_clock::now();
+    KangarooTwelveMultiple(inputs.data(), inputLengths.data(), outputs.data(), inputN, 8);
+    auto multiLaneMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "K12 of " << inputN << " short inputs to 8 bytes: scalar " << scalarMilliSec << " ms, multi-lane "
+        << multiLaneMilliSec << " ms" << std::endl;
+}
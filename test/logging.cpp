@@ -0,0 +1,758 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+// workaround for name clash with stdlib
+#define system qubicSystemStruct
+
+// enable some logging for testing
+#include "../src/private_settings.h"
+#undef LOG_CUSTOM_MESSAGES
+#define LOG_CUSTOM_MESSAGES 1
+#undef LOG_INDEX
+#define LOG_INDEX 1
+
+// reduced size of logging buffer (1 MB instead of 8 GB), so it wraps around quickly
+#define LOG_BUFFER_SIZE 1048576ULL
+
+// small secondary log index: postings of logs still in the log buffer are kept, but older postings are overwritten,
+// and keys are evicted if more than a few thousand entities are involved
+#define LOG_INDEX_POSTINGS 32768ULL
+#define LOG_INDEX_KEYS 4096ULL
+#define LOG_INDEX_MAX_POSTINGS_PER_QUERY 8192
+
+// small on-disk log segments, so segments roll over and the oldest are overwritten
+#define LOG_SEGMENT_SIZE 65536ULL
+#define LOG_MAX_NUMBER_OF_SEGMENTS 24
+
+// also reduce size of logging tx index by reducing maximum number of ticks per epoch
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 3000
+
+#include "../src/logging/logging.h"
+
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+
+struct LoggingTest
+{
+    // copies of all logs (header and message) as written to the log buffer, indexed by log ID
+    std::vector<std::vector<char>> loggedData;
+
+    LoggingTest()
+    {
+        system.epoch = 150;
+        system.tick = 20000000;
+        EXPECT_TRUE(logger.initLogging());
+        logger.reset(system.tick);
+    }
+
+    ~LoggingTest()
+    {
+        logger.deinitLogging();
+    }
+
+    // Compute digests like the tick processor does at the end of a tick and record the logs of the tick
+    void endTick()
+    {
+        if (qLogger::digestedLogId < qLogger::logId)
+            EXPECT_LT(qLogger::logBuf.getBlobInfo(qLogger::logId - 1).startIndex, 0);
+        qLogger::updateDigests();
+        EXPECT_EQ(qLogger::digestedLogId, qLogger::logId);
+        while (loggedData.size() < qLogger::logId)
+        {
+            const qLogger::BlobInfo info = qLogger::logBuf.getBlobInfo(loggedData.size());
+            ASSERT_GE(info.startIndex, 0);
+            const char* logged = qLogger::logBuffer + info.startIndex;
+            EXPECT_EQ(info.length, LOG_HEADER_SIZE + qLogger::getLogSize(logged));
+            loggedData.emplace_back(logged, logged + info.length);
+        }
+    }
+
+    void logRandomMessages(unsigned int count, std::mt19937_64& gen)
+    {
+        std::vector<unsigned char> message(2000);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            // messages of different sizes, some small, some large
+            const unsigned int messageSize = (gen() % 8 == 0) ? 1 + gen() % 2000 : 8 + gen() % 100;
+            for (unsigned int j = 0; j < messageSize; ++j)
+                message[j] = (unsigned char)gen();
+            if (gen() % 16 == 0)
+            {
+                endTick();
+                system.tick++;
+            }
+            qLogger::registerNewTx(system.tick, gen() % LOG_TX_PER_TICK);
+            qLogger::logMessage(messageSize, CUSTOM_MESSAGE, message.data());
+        }
+        endTick();
+    }
+
+    // Stream logs like processRequestLogStream() and compare with expected logged data
+    void checkStream(unsigned long long fromID, unsigned long long toID, unsigned long long maxPacketSize)
+    {
+        std::vector<char> streamed;
+        unsigned long long id = fromID;
+        qLogger::BlobInfo packet;
+        unsigned long long nextID;
+        while (id <= toID && qLogger::getLogStreamPacket(id, toID, maxPacketSize, packet, nextID))
+        {
+            EXPECT_GT(nextID, id);
+            EXPECT_LE(nextID, toID + 1);
+            EXPECT_GE(packet.startIndex, 0);
+            EXPECT_LE(packet.startIndex + packet.length, (long long)LOG_BUFFER_SIZE);
+            EXPECT_TRUE(packet.length <= (long long)maxPacketSize || nextID == id + 1);
+            streamed.insert(streamed.end(), qLogger::logBuffer + packet.startIndex, qLogger::logBuffer + packet.startIndex + packet.length);
+            id = nextID;
+        }
+        EXPECT_EQ(id, toID + 1);
+
+        std::vector<char> expected;
+        for (unsigned long long i = fromID; i <= toID; ++i)
+            expected.insert(expected.end(), loggedData[i].begin(), loggedData[i].end());
+        EXPECT_EQ(streamed.size(), expected.size());
+        EXPECT_TRUE(streamed == expected);
+    }
+
+    // Log random mix of QU transfers, asset ownership changes, burnings, contract messages, and custom messages
+    // involving the given entities
+    void logRandomIndexedMessages(unsigned int count, const std::vector<m256i>& entities, std::mt19937_64& gen)
+    {
+        std::vector<unsigned char> message(2000);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            unsigned char messageType;
+            unsigned int messageSize;
+            const m256i& source = entities[gen() % entities.size()];
+            const m256i& destination = (gen() % 8 == 0) ? source : entities[gen() % entities.size()];
+            switch (gen() % 5)
+            {
+            case 0:
+            {
+                QuTransfer quTransfer{ source, destination, (long long)(gen() % 1000) };
+                messageType = QU_TRANSFER;
+                messageSize = offsetof(QuTransfer, _terminator);
+                memcpy(message.data(), &quTransfer, messageSize);
+                break;
+            }
+            case 1:
+            {
+                AssetOwnershipChange change;
+                memset(&change, 0, sizeof(change));
+                change.sourcePublicKey = source;
+                change.destinationPublicKey = destination;
+                change.issuerPublicKey = entities[gen() % entities.size()];
+                change.numberOfShares = gen() % 1000;
+                messageType = ASSET_OWNERSHIP_CHANGE;
+                messageSize = offsetof(AssetOwnershipChange, _terminator);
+                memcpy(message.data(), &change, messageSize);
+                break;
+            }
+            case 2:
+            {
+                Burning burning{ source, (long long)(gen() % 1000) };
+                messageType = BURNING;
+                messageSize = offsetof(Burning, _terminator);
+                memcpy(message.data(), &burning, messageSize);
+                break;
+            }
+            case 3:
+            {
+                messageType = CONTRACT_ERROR_MESSAGE + gen() % 4;
+                messageSize = 8 + gen() % 100;
+                for (unsigned int j = 0; j < messageSize; ++j)
+                    message[j] = (unsigned char)gen();
+                *((unsigned int*)message.data()) = 1 + gen() % 5;
+                break;
+            }
+            default:
+            {
+                // custom messages of different sizes, some small, some large, containing entities that aren't indexed
+                messageType = CUSTOM_MESSAGE;
+                messageSize = (gen() % 4 == 0) ? 64 + gen() % 1900 : 64 + gen() % 100;
+                for (unsigned int j = 0; j < messageSize; ++j)
+                    message[j] = (unsigned char)gen();
+                memcpy(message.data(), &source, sizeof(m256i));
+                break;
+            }
+            }
+            if (gen() % 16 == 0)
+            {
+                endTick();
+                system.tick++;
+            }
+            qLogger::registerNewTx(system.tick, gen() % LOG_TX_PER_TICK);
+            qLogger::logMessage(messageSize, messageType, message.data());
+        }
+        endTick();
+    }
+
+    // Check if logged data of a log matches the filter of the request, independently of the index implementation
+    static bool referenceMatches(const std::vector<char>& log, const RequestIndexedLogs& request)
+    {
+        const unsigned char messageType = (unsigned char)log[9];
+        const char* message = log.data() + LOG_HEADER_SIZE;
+        switch (request.filterType)
+        {
+        case RequestIndexedLogs::byMessageType:
+            return messageType == request.messageType;
+        case RequestIndexedLogs::byEntity:
+        {
+            unsigned int numberOfPublicKeys = 0;
+            if (messageType == QU_TRANSFER)
+                numberOfPublicKeys = 2;
+            else if (messageType == ASSET_OWNERSHIP_CHANGE)
+                numberOfPublicKeys = 3;
+            else if (messageType == BURNING)
+                numberOfPublicKeys = 1;
+            for (unsigned int i = 0; i < numberOfPublicKeys; ++i)
+                if (memcmp(message + i * 32, &request.publicKey, 32) == 0)
+                    return true;
+            return false;
+        }
+        case RequestIndexedLogs::byContract:
+            return messageType >= CONTRACT_ERROR_MESSAGE && messageType <= CONTRACT_DEBUG_MESSAGE
+                && *((const unsigned int*)message) == request.contractIndex;
+        }
+        return false;
+    }
+
+    // Query index like processRequestIndexedLogs() and compare with the latest matching logs still in the log buffer
+    void checkIndex(const RequestIndexedLogs& request)
+    {
+        std::vector<unsigned long long> found(RequestIndexedLogs::maxNumberOfLogs);
+        const unsigned int numberOfFound = qLogger::logIndex.find(request, found.data(), RequestIndexedLogs::maxNumberOfLogs);
+        found.resize(numberOfFound);
+
+        std::vector<unsigned long long> expected;
+        unsigned long long id = std::min<unsigned long long>(request.toID, loggedData.size() - 1) + 1;
+        while (id > request.fromID && expected.size() < RequestIndexedLogs::maxNumberOfLogs)
+        {
+            --id;
+            if (qLogger::logBuf.getBlobInfo(id).startIndex < 0)
+                break;
+            if (referenceMatches(loggedData[id], request))
+                expected.insert(expected.begin(), id);
+        }
+        EXPECT_EQ(found, expected);
+    }
+
+    // Persist all logs that are complete like the main loop does, in steps of maxStepSize bytes
+    static void flushAll(unsigned long long maxStepSize)
+    {
+        unsigned long long persistedLogId = qLogger::persistedLogId;
+        while (true)
+        {
+            qLogger::flushToDisk(maxStepSize);
+            if (qLogger::persistedLogId == persistedLogId)
+                break;
+            EXPECT_GT(qLogger::persistedLogId, persistedLogId);
+            persistedLogId = qLogger::persistedLogId;
+        }
+    }
+
+    // Read logs from disk like processDiskReads() and compare with expected logged data
+    void checkDiskRead(unsigned int epoch, unsigned long long fromID, unsigned long long toID, unsigned long long maxSize, const std::vector<std::vector<char>>& expectedLogs)
+    {
+        std::vector<char> buffer(maxSize);
+        unsigned long long nextID = 0;
+        const long long size = qLogger::logSegments.read(epoch, fromID, toID, maxSize, buffer.data(), nextID);
+        ASSERT_GT(size, 0);
+        EXPECT_LE(size, (long long)maxSize);
+        EXPECT_GT(nextID, fromID);
+        EXPECT_LE(nextID, toID + 1);
+        EXPECT_TRUE(qLogger::verifyLog(buffer.data(), fromID));
+
+        std::vector<char> expected;
+        for (unsigned long long i = fromID; i < nextID; ++i)
+            expected.insert(expected.end(), expectedLogs[i].begin(), expectedLogs[i].end());
+        buffer.resize(size);
+        EXPECT_TRUE(buffer == expected);
+
+        // read stops at end of range, end of segment, or because the next log doesn't fit
+        if (nextID <= toID && nextID - fromID < LogSegmentStore::maxNumberOfLogsPerRead)
+        {
+            const int segment = qLogger::logSegments.findSegment(epoch, fromID);
+            const LogSegmentStore::Segment& s = qLogger::logSegments.getSegment(segment);
+            EXPECT_TRUE(nextID == s.firstLogId + s.numberOfLogs || size + expectedLogs[nextID].size() > maxSize);
+        }
+    }
+};
+
+TEST(TestCoreLogging, StreamAcrossWrapAround)
+{
+    LoggingTest test;
+    std::mt19937_64 gen(42);
+
+    // fill buffer about 2.5 times, so the log buffer has wrapped around twice
+    test.logRandomMessages(12000, gen);
+    const unsigned long long numberOfLogs = qLogger::logId;
+    ASSERT_EQ(numberOfLogs, test.loggedData.size());
+
+    // find oldest available log and log at wrap-around
+    unsigned long long oldestID = numberOfLogs - 1;
+    while (oldestID > 0 && qLogger::logBuf.getBlobInfo(oldestID - 1).startIndex >= 0)
+        --oldestID;
+    unsigned long long wrapID = oldestID;
+    while (qLogger::logBuf.getBlobInfo(wrapID + 1).startIndex > qLogger::logBuf.getBlobInfo(wrapID).startIndex)
+        ++wrapID;
+    ASSERT_GT(oldestID, 0);
+    ASSERT_LT(wrapID, numberOfLogs - 1);
+
+    // overwritten logs aren't available
+    qLogger::BlobInfo packet;
+    unsigned long long nextID;
+    EXPECT_FALSE(qLogger::getLogStreamPacket(oldestID - 1, numberOfLogs - 1, RequestLogStream::maxPacketSize, packet, nextID));
+    EXPECT_FALSE(qLogger::getLogStreamPacket(0, numberOfLogs - 1, RequestLogStream::maxPacketSize, packet, nextID));
+    EXPECT_FALSE(qLogger::getLogStreamPacket(numberOfLogs, numberOfLogs + 10, RequestLogStream::maxPacketSize, packet, nextID));
+
+    // all available logs, crossing the wrap-around, split at the wrap-around
+    test.checkStream(oldestID, numberOfLogs - 1, RequestLogStream::maxPacketSize);
+    EXPECT_TRUE(qLogger::getLogStreamPacket(oldestID, numberOfLogs - 1, RequestLogStream::maxPacketSize, packet, nextID));
+    EXPECT_EQ(nextID, wrapID + 1);
+
+    // small packets and ranges around the wrap-around
+    test.checkStream(oldestID, numberOfLogs - 1, 4096);
+    test.checkStream(wrapID, wrapID, 4096);
+    test.checkStream(wrapID, wrapID + 1, 4096);
+    test.checkStream(wrapID - 10, wrapID + 10, 1);
+    for (int i = 0; i < 20; ++i)
+    {
+        const unsigned long long fromID = oldestID + gen() % (numberOfLogs - oldestID);
+        const unsigned long long toID = fromID + gen() % (numberOfLogs - fromID);
+        test.checkStream(fromID, toID, 1 + gen() % 50000);
+    }
+
+    // corrupted last log of a packet is detected and the packet is reduced to the first log
+    const qLogger::BlobInfo last = qLogger::logBuf.getBlobInfo(numberOfLogs - 1);
+    qLogger::logBuffer[last.startIndex + LOG_HEADER_SIZE] ^= 1;
+    EXPECT_TRUE(qLogger::getLogStreamPacket(numberOfLogs - 3, numberOfLogs - 1, RequestLogStream::maxPacketSize, packet, nextID));
+    EXPECT_EQ(nextID, numberOfLogs - 2);
+    EXPECT_FALSE(qLogger::getLogStreamPacket(numberOfLogs - 1, numberOfLogs - 1, RequestLogStream::maxPacketSize, packet, nextID));
+}
+
+TEST(TestCoreLogging, IndexAcrossWrapAround)
+{
+    LoggingTest test;
+    std::mt19937_64 gen(42);
+
+    std::vector<m256i> entities(30);
+    for (auto& entity : entities)
+        entity = m256i(gen(), gen(), gen(), gen());
+    const m256i unknownEntity(gen(), gen(), gen(), gen());
+
+    RequestIndexedLogs request;
+    memset(&request, 0, sizeof(request));
+    for (int round = 0; round < 4; ++round)
+    {
+        // log buffer wraps around about once per round, overwriting the logs referenced by the oldest postings
+        test.logRandomIndexedMessages(8000, entities, gen);
+        const unsigned long long numberOfLogs = qLogger::logId;
+        ASSERT_EQ(numberOfLogs, test.loggedData.size());
+        if (round > 0)
+        {
+            EXPECT_LT(qLogger::logBuf.getBlobInfo(numberOfLogs - 16000).startIndex, 0);
+            EXPECT_GT(qLogger::logIndexNumberOfPostings, LOG_INDEX_POSTINGS);
+        }
+
+        // whole range, range of newest logs, and random ranges (including overwritten logs)
+        for (int r = 0; r < 6; ++r)
+        {
+            if (r == 0)
+            {
+                request.fromID = 0;
+                request.toID = numberOfLogs + 100;
+            }
+            else if (r == 1)
+            {
+                request.fromID = numberOfLogs - 300;
+                request.toID = numberOfLogs - 1;
+            }
+            else
+            {
+                request.fromID = gen() % numberOfLogs;
+                request.toID = request.fromID + gen() % (numberOfLogs - request.fromID);
+            }
+
+            request.filterType = RequestIndexedLogs::byMessageType;
+            for (unsigned char messageType : { QU_TRANSFER, ASSET_OWNERSHIP_CHANGE, BURNING, CONTRACT_INFORMATION_MESSAGE, CUSTOM_MESSAGE, SPECTRUM_STATS })
+            {
+                request.messageType = messageType;
+                test.checkIndex(request);
+            }
+
+            request.filterType = RequestIndexedLogs::byEntity;
+            for (int i = 0; i < 5; ++i)
+            {
+                request.publicKey = entities[gen() % entities.size()];
+                test.checkIndex(request);
+            }
+            request.publicKey = unknownEntity;
+            test.checkIndex(request);
+
+            request.filterType = RequestIndexedLogs::byContract;
+            for (unsigned int contractIndex = 0; contractIndex <= 6; ++contractIndex)
+            {
+                request.contractIndex = contractIndex;
+                test.checkIndex(request);
+            }
+        }
+    }
+
+    // invalid filter type
+    unsigned long long logIds[RequestIndexedLogs::maxNumberOfLogs];
+    request.filterType = 3;
+    EXPECT_EQ(qLogger::logIndex.find(request, logIds, RequestIndexedLogs::maxNumberOfLogs), 0);
+
+    // index is cleared on reset
+    qLogger::reset(system.tick);
+    request.fromID = 0;
+    request.toID = 1000000;
+    request.filterType = RequestIndexedLogs::byEntity;
+    request.publicKey = entities[0];
+    EXPECT_EQ(qLogger::logIndex.find(request, logIds, RequestIndexedLogs::maxNumberOfLogs), 0);
+}
+
+TEST(TestCoreLogging, IndexEvictionAndQueryLimit)
+{
+    LoggingTest test;
+    std::mt19937_64 gen(43);
+    const m256i frequentEntity(gen(), gen(), gen(), gen());
+
+    // QU transfers between entities that occur only once, more than the index has key slots, so keys are evicted;
+    // every fourth transfer goes to the frequent entity
+    const unsigned long long firstTransferId = qLogger::logId;
+    std::vector<m256i> sources(4000);
+    for (unsigned int i = 0; i < sources.size(); ++i)
+    {
+        sources[i] = m256i(gen(), gen(), gen(), gen());
+        const m256i destination = (i % 4 == 0) ? frequentEntity : m256i(gen(), gen(), gen(), gen());
+        QuTransfer quTransfer{ sources[i], destination, (long long)(gen() % 1000) };
+        if (i % 16 == 0)
+        {
+            test.endTick();
+            system.tick++;
+        }
+        qLogger::registerNewTx(system.tick, gen() % LOG_TX_PER_TICK);
+        qLogger::logMessage(offsetof(QuTransfer, _terminator), QU_TRANSFER, &quTransfer);
+    }
+    test.endTick();
+
+    // logs of evicted keys aren't found anymore, but the key of the frequent entity is kept
+    RequestIndexedLogs request;
+    memset(&request, 0, sizeof(request));
+    request.fromID = 0;
+    request.toID = qLogger::logId - 1;
+    request.filterType = RequestIndexedLogs::byEntity;
+    unsigned long long logIds[RequestIndexedLogs::maxNumberOfLogs];
+    unsigned int numberOfEvicted = 0;
+    for (unsigned int i = 0; i < sources.size(); ++i)
+    {
+        request.publicKey = sources[i];
+        const unsigned int numberOfFound = qLogger::logIndex.find(request, logIds, RequestIndexedLogs::maxNumberOfLogs);
+        ASSERT_LE(numberOfFound, 1u);
+        if (numberOfFound)
+            EXPECT_EQ(logIds[0], firstTransferId + i);
+        else
+            numberOfEvicted++;
+    }
+    EXPECT_GT(numberOfEvicted, 0u);
+    EXPECT_LT(numberOfEvicted, sources.size());
+    request.publicKey = frequentEntity;
+    test.checkIndex(request);
+
+    // many burnings, so the postings of the first transfers are overwritten and a query for the oldest burnings
+    // visits more postings than allowed
+    const unsigned long long firstBurningId = qLogger::logId;
+    for (unsigned int i = 0; i < 12000; ++i)
+    {
+        Burning burning{ frequentEntity, (long long)(gen() % 1000) };
+        if (i % 16 == 0)
+        {
+            test.endTick();
+            system.tick++;
+        }
+        qLogger::registerNewTx(system.tick, gen() % LOG_TX_PER_TICK);
+        qLogger::logMessage(offsetof(Burning, _terminator), BURNING, &burning);
+    }
+    test.endTick();
+    EXPECT_GT(qLogger::logIndexNumberOfPostings, LOG_INDEX_POSTINGS);
+    EXPECT_GE(qLogger::logBuf.getBlobInfo(firstBurningId).startIndex, 0);
+
+    request.filterType = RequestIndexedLogs::byMessageType;
+    request.messageType = BURNING;
+    request.fromID = firstBurningId;
+    request.toID = firstBurningId + 9;
+    EXPECT_EQ(qLogger::logIndex.find(request, logIds, RequestIndexedLogs::maxNumberOfLogs), 0);
+
+    // queries within the limit are complete
+    request.toID = qLogger::logId - LOG_INDEX_MAX_POSTINGS_PER_QUERY + 100;
+    request.fromID = request.toID - 9;
+    test.checkIndex(request);
+    request.fromID = 0;
+    request.toID = qLogger::logId - 1;
+    test.checkIndex(request);
+    request.filterType = RequestIndexedLogs::byEntity;
+    request.publicKey = frequentEntity;
+    test.checkIndex(request);
+}
+
+TEST(TestCoreLogging, PersistToDiskSegments)
+{
+    const std::filesystem::path directoryPath = std::filesystem::temp_directory_path() / "qubicLogSegments";
+    std::filesystem::remove_all(directoryPath);
+    std::filesystem::create_directories(directoryPath);
+    const std::wstring directoryString = directoryPath.wstring();
+    const CHAR16* directory = (const CHAR16*)directoryString.c_str();
+
+    LoggingTest test;
+    std::mt19937_64 gen(42);
+    EXPECT_TRUE(qLogger::openLogSegments(directory));
+    EXPECT_EQ(qLogger::logSegments.getNumberOfSegments(), 0);
+
+    // persist logs while logging, several segments are filled and rolled over
+    for (int i = 0; i < 20; ++i)
+    {
+        test.logRandomMessages(400, gen);
+        LoggingTest::flushAll(1 + gen() % 20000);
+    }
+    const unsigned long long numberOfLogs = qLogger::logId;
+    EXPECT_EQ(qLogger::persistedLogId, numberOfLogs);
+    EXPECT_EQ(qLogger::logSegments.getNumberOfSegments(), LOG_MAX_NUMBER_OF_SEGMENTS);
+
+    // segments are consecutive and don't exceed the size, the oldest have been overwritten
+    const unsigned long long firstPersistedID = qLogger::logSegments.getSegment(0).firstLogId;
+    EXPECT_GT(firstPersistedID, 0);
+    for (unsigned int i = 0; i < qLogger::logSegments.getNumberOfSegments(); ++i)
+    {
+        const LogSegmentStore::Segment& segment = qLogger::logSegments.getSegment(i);
+        EXPECT_EQ(segment.epoch, system.epoch);
+        EXPECT_GT(segment.numberOfLogs, 0);
+        EXPECT_LE(segment.size, LOG_SEGMENT_SIZE);
+        if (i > 0)
+        {
+            const LogSegmentStore::Segment& previous = qLogger::logSegments.getSegment(i - 1);
+            EXPECT_EQ(segment.firstLogId, previous.firstLogId + previous.numberOfLogs);
+        }
+    }
+    EXPECT_EQ(qLogger::logSegments.findSegment(system.epoch, firstPersistedID - 1), -1);
+    EXPECT_EQ(qLogger::logSegments.findSegment(system.epoch, numberOfLogs), -1);
+    EXPECT_EQ(qLogger::logSegments.findSegment(system.epoch + 1, numberOfLogs - 1), -1);
+
+    // random-access reads, including logs evicted from the log buffer
+    ASSERT_LT(qLogger::logBuf.getBlobInfo(firstPersistedID).startIndex, 0);
+    test.checkDiskRead(system.epoch, firstPersistedID, numberOfLogs - 1, LOG_DISK_READ_SIZE, test.loggedData);
+    test.checkDiskRead(system.epoch, numberOfLogs - 1, numberOfLogs + 10, LOG_DISK_READ_SIZE, test.loggedData);
+    for (int i = 0; i < 50; ++i)
+    {
+        const unsigned long long fromID = firstPersistedID + gen() % (numberOfLogs - firstPersistedID);
+        const unsigned long long toID = fromID + gen() % 500;
+        test.checkDiskRead(system.epoch, fromID, toID, 2100 + gen() % 40000, test.loggedData);
+    }
+    unsigned long long nextID;
+    std::vector<char> buffer(LOG_DISK_READ_SIZE);
+    EXPECT_EQ(qLogger::logSegments.read(system.epoch, firstPersistedID - 1, numberOfLogs, LOG_DISK_READ_SIZE, buffer.data(), nextID), -1);
+    EXPECT_EQ(qLogger::logSegments.read(system.epoch, numberOfLogs - 1, numberOfLogs - 2, LOG_DISK_READ_SIZE, buffer.data(), nextID), -1);
+
+    // log larger than maxSize is reported as too large, so it can be read again with a larger maxSize
+    const unsigned long long largeLogSize = test.loggedData[numberOfLogs - 1].size();
+    EXPECT_EQ(qLogger::logSegments.read(system.epoch, numberOfLogs - 1, numberOfLogs - 1, largeLogSize - 1, buffer.data(), nextID), LogSegmentStore::logTooLarge);
+    test.checkDiskRead(system.epoch, numberOfLogs - 1, numberOfLogs - 1, largeLogSize, test.loggedData);
+
+    // reopen: persisting continues behind the last segment, new logs are appended to a new segment
+    qLogger::logSegments.close();
+    EXPECT_FALSE(qLogger::logSegments.isOpen());
+    EXPECT_TRUE(qLogger::openLogSegments(directory));
+    EXPECT_EQ(qLogger::logSegments.getNumberOfSegments(), LOG_MAX_NUMBER_OF_SEGMENTS);
+    EXPECT_EQ(qLogger::logSegments.getSegment(0).firstLogId, firstPersistedID);
+    for (int i = 0; i < 20; ++i)
+    {
+        const unsigned long long fromID = firstPersistedID + gen() % (numberOfLogs - firstPersistedID);
+        test.checkDiskRead(system.epoch, fromID, fromID + gen() % 500, 2100 + gen() % 40000, test.loggedData);
+    }
+    EXPECT_EQ(qLogger::persistedLogId, numberOfLogs);
+    test.logRandomMessages(10, gen);
+    LoggingTest::flushAll(100000);
+    const LogSegmentStore::Segment& lastSegment = qLogger::logSegments.getSegment(LOG_MAX_NUMBER_OF_SEGMENTS - 1);
+    EXPECT_EQ(lastSegment.firstLogId, numberOfLogs);
+    EXPECT_EQ(lastSegment.numberOfLogs, 10);
+    test.checkDiskRead(system.epoch, numberOfLogs - 10, numberOfLogs + 9, LOG_DISK_READ_SIZE, test.loggedData);
+    EXPECT_EQ(qLogger::logSegments.findSegment(system.epoch, numberOfLogs - 1), LOG_MAX_NUMBER_OF_SEGMENTS - 2);
+
+    // logs overwritten before persisting them are skipped
+    const unsigned long long skippedFromID = qLogger::logId;
+    test.logRandomMessages(6000, gen);
+    LoggingTest::flushAll(100000);
+    EXPECT_EQ(qLogger::persistedLogId, qLogger::logId);
+    int segment = qLogger::logSegments.findSegment(system.epoch, qLogger::logId - 1);
+    while (segment > 0 && qLogger::logSegments.getSegment(segment - 1).firstLogId + qLogger::logSegments.getSegment(segment - 1).numberOfLogs == qLogger::logSegments.getSegment(segment).firstLogId)
+        --segment;
+    const unsigned long long firstID = qLogger::logSegments.getSegment(segment).firstLogId;
+    EXPECT_GT(firstID, skippedFromID);
+    EXPECT_GE(qLogger::logBuf.getBlobInfo(firstID).startIndex, 0);
+    EXPECT_LT(qLogger::logBuf.getBlobInfo(firstID - 1).startIndex, 0);
+    EXPECT_EQ(qLogger::logSegments.findSegment(system.epoch, firstID - 1), -1);
+
+    // new epoch: log IDs start again with 0 in new segment, old epoch can still be read
+    const std::vector<std::vector<char>> loggedDataOfPreviousEpoch = test.loggedData;
+    const unsigned long long numberOfLogsOfPreviousEpoch = qLogger::logId;
+    test.loggedData.clear();
+    system.epoch++;
+    qLogger::reset(system.tick);
+    test.logRandomMessages(100, gen);
+    LoggingTest::flushAll(5000);
+    EXPECT_EQ(qLogger::persistedLogId, 100);
+    test.checkDiskRead(system.epoch, 0, 99, LOG_DISK_READ_SIZE, test.loggedData);
+    test.checkDiskRead(system.epoch - 1, numberOfLogsOfPreviousEpoch - 20, numberOfLogsOfPreviousEpoch - 1, LOG_DISK_READ_SIZE, loggedDataOfPreviousEpoch);
+
+    qLogger::logSegments.close();
+    std::filesystem::remove_all(directoryPath);
+}
+
+TEST(TestCoreLogging, PersistToDiskAfterRestart)
+{
+    const std::filesystem::path directoryPath = std::filesystem::temp_directory_path() / "qubicLogSegmentsRestart";
+    std::filesystem::remove_all(directoryPath);
+    std::filesystem::create_directories(directoryPath);
+    const std::wstring directoryString = directoryPath.wstring();
+    const CHAR16* directory = (const CHAR16*)directoryString.c_str();
+
+    std::mt19937_64 gen(44);
+    std::vector<std::vector<char>> loggedDataBeforeRestart;
+    unsigned long long numberOfLogsBeforeRestart;
+    unsigned int numberOfSegmentsBeforeRestart;
+    {
+        LoggingTest test;
+        EXPECT_TRUE(qLogger::openLogSegments(directory));
+        test.logRandomMessages(500, gen);
+        LoggingTest::flushAll(100000);
+        numberOfLogsBeforeRestart = qLogger::logId;
+        EXPECT_EQ(qLogger::persistedLogId, numberOfLogsBeforeRestart);
+        numberOfSegmentsBeforeRestart = qLogger::logSegments.getNumberOfSegments();
+        loggedDataBeforeRestart = test.loggedData;
+    }
+    EXPECT_FALSE(qLogger::logSegments.isOpen());
+
+    // restart in the order of the node's initialization: the segments are opened before the epoch is set, then the
+    // logger is reset when loading the node states (or at the initial tick)
+    LoggingTest test;
+    const unsigned short epoch = system.epoch;
+    system.epoch = 0;
+    EXPECT_TRUE(qLogger::openLogSegments(directory));
+    EXPECT_EQ(qLogger::logSegments.getNumberOfSegments(), numberOfSegmentsBeforeRestart);
+    system.epoch = epoch;
+    qLogger::reset(system.tick);
+    EXPECT_EQ(qLogger::logId, 0);
+    EXPECT_EQ(qLogger::persistedLogId, numberOfLogsBeforeRestart);
+
+    // logs of the restarted node with IDs persisted before aren't persisted again, the following are appended
+    test.logRandomMessages((unsigned int)numberOfLogsBeforeRestart + 20, gen);
+    LoggingTest::flushAll(100000);
+    EXPECT_EQ(qLogger::persistedLogId, qLogger::logId);
+    EXPECT_EQ(qLogger::logSegments.getNumberOfSegments(), numberOfSegmentsBeforeRestart + 1);
+    const LogSegmentStore::Segment& lastSegment = qLogger::logSegments.getSegment(numberOfSegmentsBeforeRestart);
+    EXPECT_EQ(lastSegment.epoch, epoch);
+    EXPECT_EQ(lastSegment.firstLogId, numberOfLogsBeforeRestart);
+    EXPECT_EQ(lastSegment.numberOfLogs, 20);
+    test.checkDiskRead(epoch, 0, numberOfLogsBeforeRestart - 1, LOG_DISK_READ_SIZE, loggedDataBeforeRestart);
+    test.checkDiskRead(epoch, numberOfLogsBeforeRestart, qLogger::logId - 1, LOG_DISK_READ_SIZE, test.loggedData);
+
+    // in the next epoch, persisting starts with log 0 again
+    system.epoch++;
+    qLogger::reset(system.tick);
+    EXPECT_EQ(qLogger::persistedLogId, 0);
+
+    qLogger::logSegments.close();
+    std::filesystem::remove_all(directoryPath);
+}
+
+TEST(TestCoreLogging, DeferredDigests)
+{
+    LoggingTest test;
+    std::mt19937_64 gen(42);
+    test.logRandomMessages(100, gen);
+    const unsigned long long firstPendingID = qLogger::logId;
+
+    // logs of the current tick can't be read before their digests are computed, including multi-chunk messages
+    std::vector<unsigned char> message(2 * K12_chunkSize);
+    for (int i = 0; i < 300; ++i)
+    {
+        const unsigned int messageSize = (i % 100 == 50) ? K12_chunkSize - 2 + gen() % K12_chunkSize : 1 + gen() % 300;
+        for (unsigned int j = 0; j < messageSize; ++j)
+            message[j] = (unsigned char)gen();
+        qLogger::logMessage(messageSize, CUSTOM_MESSAGE, message.data());
+        EXPECT_LT(qLogger::logBuf.getBlobInfo(qLogger::logId - 1).startIndex, 0);
+    }
+    qLogger::BlobInfo packet;
+    unsigned long long nextID;
+    EXPECT_FALSE(qLogger::getLogStreamPacket(firstPendingID, qLogger::logId - 1, RequestLogStream::maxPacketSize, packet, nextID));
+    EXPECT_TRUE(qLogger::getLogStreamPacket(firstPendingID - 5, qLogger::logId - 1, RequestLogStream::maxPacketSize, packet, nextID));
+    EXPECT_EQ(nextID, firstPendingID);
+
+    // digests computed in batches equal digests of the single messages
+    test.endTick();
+    for (unsigned long long id = firstPendingID; id < qLogger::logId; ++id)
+    {
+        const std::vector<char>& log = test.loggedData[id];
+        unsigned long long digest;
+        KangarooTwelve(log.data() + LOG_HEADER_SIZE, (unsigned int)(log.size() - LOG_HEADER_SIZE), &digest, 8);
+        EXPECT_EQ(qLogger::getLogDigest(log.data()), digest);
+    }
+    test.checkStream(firstPendingID - 5, qLogger::logId - 1, RequestLogStream::maxPacketSize);
+
+    // logs overwritten before computing the digests are skipped
+    for (int i = 0; i < 12000; ++i)
+        qLogger::logMessage(100, CUSTOM_MESSAGE, message.data());
+    qLogger::updateDigests();
+    EXPECT_EQ(qLogger::digestedLogId, qLogger::logId);
+    EXPECT_LT(qLogger::logBuf.getBlobInfo(qLogger::logId - 12000).startIndex, 0);
+    EXPECT_GE(qLogger::logBuf.getBlobInfo(qLogger::logId - 1).startIndex, 0);
+}
+
+TEST(TestCoreLogging, PerformanceLogMessage)
+{
+    LoggingTest test;
+    constexpr unsigned int numberOfTicks = 1000;
+    constexpr unsigned int messagesPerTick = 1000;
+    std::mt19937_64 gen(42);
+    std::vector<unsigned char> messages(messagesPerTick * 72);
+    for (auto& byte : messages)
+        byte = (unsigned char)gen();
+
+    // Before: the digest of each log is computed while logging the message (like logMessage() did before
+    // updateDigests() was introduced)
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int tick = 0; tick < numberOfTicks; ++tick)
+    {
+        for (unsigned int i = 0; i < messagesPerTick; ++i)
+        {
+            qLogger::logMessage(72, QU_TRANSFER, &messages[i * 72]);
+            qLogger::updateDigests();
+        }
+    }
+    const double inlineNanoSec = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    // After: logMessage() only copies the message, digests are computed in batches at the end of the tick
+    double logMessageNanoSec = 0;
+    startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int tick = 0; tick < numberOfTicks; ++tick)
+    {
+        auto tickStartTime = std::chrono::high_resolution_clock::now();
+        for (unsigned int i = 0; i < messagesPerTick; ++i)
+            qLogger::logMessage(72, QU_TRANSFER, &messages[i * 72]);
+        logMessageNanoSec += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - tickStartTime).count();
+        qLogger::updateDigests();
+    }
+    const double batchedNanoSec = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+    EXPECT_EQ(qLogger::digestedLogId, qLogger::logId);
+
+    constexpr double numberOfMessages = double(numberOfTicks) * messagesPerTick;
+    std::cout << "Logging " << numberOfMessages << " messages of 72 bytes: digest per message "
+        << numberOfMessages * 1e9 / inlineNanoSec << " messages/sec, " << inlineNanoSec / numberOfMessages << " ns in logMessage(); "
+        << "digests per tick " << numberOfMessages * 1e9 / batchedNanoSec << " messages/sec, " << logMessageNanoSec / numberOfMessages << " ns in logMessage()" << std::endl;
+}
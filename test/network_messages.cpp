@@ -3,6 +3,10 @@
 #define NETWORK_MESSAGES_WITHOUT_CORE_DEPENDENCIES
 #include "../src/network_messages/all.h"
 
+#include <random>
+#include <set>
+#include <vector>
+
 
 TEST(TestCoreRequestResponseHeader, TestSize) {
     RequestResponseHeader hdr;
@@ -66,3 +70,86 @@ TEST(TestCoreCommonDef, IPv4Address) {
     EXPECT_TRUE(ip_ref == ip2);
     EXPECT_FALSE(ip_ref != ip2);
 }
+
+// Tree of depth testDepth with the digest of a node storing its level and index, so siblings can be identified
+static constexpr unsigned int testDepth = 10;
+static std::vector<m256i> createTestDigests()
+{
+    std::vector<m256i> digests((1ULL << testDepth) * 2 - 1);
+    unsigned int digestOffset = 0;
+    for (unsigned int level = 0; level <= testDepth; level++)
+    {
+        for (unsigned int index = 0; index < (1U << (testDepth - level)); index++)
+        {
+            memset(&digests[digestOffset + index], 0, sizeof(m256i));
+            digests[digestOffset + index].m256i_u32[0] = level;
+            digests[digestOffset + index].m256i_u32[1] = index;
+        }
+        digestOffset += (1U << (testDepth - level));
+    }
+    return digests;
+}
+
+TEST(TestCoreEntity, MultiProofMatchesIndividualProofs) {
+    const std::vector<m256i> digests = createTestDigests();
+    std::mt19937_64 gen(42);
+    for (unsigned int test = 0; test < 100; test++)
+    {
+        // random leaves, some of them duplicated or neighbors
+        const unsigned int numberOfLeaves = (test < 5) ? test : 1 + gen() % 64;
+        std::vector<int> leaves;
+        for (unsigned int i = 0; i < numberOfLeaves; i++)
+        {
+            if (i > 0 && gen() % 4 == 0)
+                leaves.push_back(leaves[gen() % i] ^ (gen() % 2));
+            else
+                leaves.push_back(gen() % (1ULL << testDepth));
+        }
+
+        // nodes that can be computed from the leaves, and siblings of the individual proofs that cannot be computed
+        std::set<std::pair<unsigned int, unsigned int>> computable, expectedSiblings;
+        unsigned int individualProofSiblings = 0;
+        for (int leaf : leaves)
+        {
+            for (unsigned int level = 0; level <= testDepth; level++)
+                computable.insert({ level, (unsigned int)leaf >> level });
+        }
+        for (int leaf : leaves)
+        {
+            m256i siblings[testDepth];
+            getSiblings<testDepth>(leaf, digests.data(), siblings);
+            individualProofSiblings += testDepth;
+            for (unsigned int level = 0; level < testDepth; level++)
+            {
+                const std::pair<unsigned int, unsigned int> node = { siblings[level].m256i_u32[0], siblings[level].m256i_u32[1] };
+                EXPECT_EQ(node.first, level);
+                EXPECT_EQ(node.second, (((unsigned int)leaf) >> level) ^ 1);
+                if (!computable.count(node))
+                    expectedSiblings.insert(node);
+            }
+        }
+
+        std::vector<int> digestIndices = leaves;
+        std::vector<m256i> multiProof(numberOfLeaves * testDepth);
+        const unsigned int numberOfSiblings = getMultiProofSiblings<testDepth>(digestIndices.data(), numberOfLeaves, digests.data(), multiProof.data());
+        EXPECT_LE(numberOfSiblings, individualProofSiblings);
+
+        // multi-proof has each required sibling once, ordered by level and index
+        EXPECT_EQ(numberOfSiblings, expectedSiblings.size());
+        unsigned int i = 0;
+        for (const auto& node : expectedSiblings)
+        {
+            if (i >= numberOfSiblings)
+                break;
+            EXPECT_EQ(multiProof[i].m256i_u32[0], node.first);
+            EXPECT_EQ(multiProof[i].m256i_u32[1], node.second);
+            i++;
+        }
+    }
+}
+
+TEST(TestCoreEntity, RequestEntitiesSizes) {
+    // maximum response fits into one message
+    EXPECT_LE(sizeof(RequestResponseHeader) + RespondEntities::maxSize, RequestResponseHeader::max_size);
+    EXPECT_LE(sizeof(RequestResponseHeader) + RequestEntities::maxNumberOfPublicKeys * sizeof(m256i), RequestResponseHeader::max_size);
+}
@@ -0,0 +1,120 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/pending_transaction_index.h"
+
+#include <random>
+#include <set>
+
+
+static constexpr unsigned int testNumberOfSlots = 1000;
+static constexpr unsigned int testNumberOfBuckets = 64;
+
+typedef PendingTransactionTickIndex<testNumberOfSlots, testNumberOfBuckets> TestPendingTransactionTickIndex;
+
+static std::set<unsigned int> getSlotsOfBucket(const TestPendingTransactionTickIndex& index, unsigned int tick)
+{
+    std::set<unsigned int> slots;
+    for (unsigned int slot = index.firstSlot(tick); slot != index.noSlot; slot = index.nextSlot(slot))
+    {
+        EXPECT_LT(slot, testNumberOfSlots);
+        EXPECT_TRUE(slots.insert(slot).second);
+    }
+    return slots;
+}
+
+TEST(TestPendingTransactionTickIndex, AddRemoveReset)
+{
+    TestPendingTransactionTickIndex index;
+    EXPECT_TRUE(index.init());
+
+    // tick of each slot, 0 means slot is empty
+    unsigned int slotTicks[testNumberOfSlots] = { 0 };
+    std::mt19937 gen(42);
+
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 20000; ++i)
+        {
+            const unsigned int slot = gen() % testNumberOfSlots;
+            if (gen() % 4 == 0)
+            {
+                // remove slot (also tests removing slots that are not in the index)
+                index.remove(slot);
+                slotTicks[slot] = 0;
+            }
+            else
+            {
+                // overwrite slot with transaction of other tick, like in the pending transactions pool
+                const unsigned int tick = 1 + gen() % (testNumberOfBuckets * 3);
+                index.remove(slot);
+                index.add(slot, tick);
+                slotTicks[slot] = tick;
+            }
+
+            if (i % 1000 == 0)
+            {
+                for (unsigned int bucket = 0; bucket < testNumberOfBuckets; ++bucket)
+                {
+                    std::set<unsigned int> expectedSlots;
+                    for (unsigned int slot = 0; slot < testNumberOfSlots; ++slot)
+                    {
+                        if (slotTicks[slot] && slotTicks[slot] % testNumberOfBuckets == bucket)
+                            expectedSlots.insert(slot);
+                    }
+                    EXPECT_EQ(getSlotsOfBucket(index, bucket), expectedSlots);
+
+                    // ticks with same bucket share list
+                    EXPECT_EQ(getSlotsOfBucket(index, bucket + testNumberOfBuckets), expectedSlots);
+                }
+            }
+        }
+
+        index.reset();
+        for (unsigned int slot = 0; slot < testNumberOfSlots; ++slot)
+            slotTicks[slot] = 0;
+        for (unsigned int bucket = 0; bucket < testNumberOfBuckets; ++bucket)
+            EXPECT_EQ(index.firstSlot(bucket), index.noSlot);
+    }
+
+    index.deinit();
+}
+
+TEST(TestTickTransactionDigestMap, AddFindAndRemove)
+{
+    static m256i digests[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    static TickTransactionDigestMap map;
+    std::mt19937_64 gen(123);
+
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; ++i)
+    {
+        digests[i] = m256i(gen(), gen(), gen(), gen());
+    }
+
+    // duplicate digests are found in the order of adding
+    digests[100] = digests[10];
+    digests[900] = digests[10];
+
+    map.reset();
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; ++i)
+    {
+        if (i % 3)
+            map.add(digests[i], i);
+    }
+
+    m256i unknownDigest(gen(), gen(), gen(), gen());
+    EXPECT_EQ(map.findAndRemove(unknownDigest, digests), -1);
+
+    EXPECT_EQ(map.findAndRemove(digests[10], digests), 10);
+    EXPECT_EQ(map.findAndRemove(digests[10], digests), 100);
+    EXPECT_EQ(map.findAndRemove(digests[10], digests), -1);
+
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; ++i)
+    {
+        if (i == 10 || i == 100 || i == 900)
+            continue;
+        EXPECT_EQ(map.findAndRemove(digests[i], digests), (i % 3) ? int(i) : -1);
+        EXPECT_EQ(map.findAndRemove(digests[i], digests), -1);
+    }
+}
@@ -4,6 +4,13 @@
 #include "../src/platform/read_write_lock.h"
 #include "../src/platform/stack_size_tracker.h"
 #include "../src/platform/custom_stack.h"
+#include "../src/platform/parallel_job.h"
+#include "../src/platform/staged_file_writer.h"
+
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include <vector>
 
 TEST(TestCoreReadWriteLock, SimpleSingleThread)
 {
@@ -165,3 +172,110 @@ TEST(TestCoreCustomStack, SimpleTest)
     auto size4 = s.maxStackUsed();
     EXPECT_GT(size4, size3);
 }
+
+static std::atomic<unsigned int> parallelJobTestChunkRuns[1000];
+
+static void parallelJobTestChunk(void* context, unsigned int chunkIndex)
+{
+    EXPECT_EQ(context, (void*)parallelJobTestChunkRuns);
+    parallelJobTestChunkRuns[chunkIndex]++;
+}
+
+TEST(TestCoreParallelJob, AllChunksRunOnce)
+{
+    // without helpers, the caller runs all chunks
+    for (auto& runs : parallelJobTestChunkRuns)
+        runs = 0;
+    runParallelJob(parallelJobTestChunk, parallelJobTestChunkRuns, 1000);
+    for (auto& runs : parallelJobTestChunkRuns)
+        EXPECT_EQ(runs, 1);
+    EXPECT_FALSE(helpWithParallelJob());
+
+    // with helper threads spinning like idle request processors
+    std::atomic<bool> stopHelpers = false;
+    std::vector<std::thread> helpers;
+    for (int i = 0; i < 4; ++i)
+    {
+        helpers.emplace_back([&stopHelpers]()
+            {
+                while (!stopHelpers)
+                    helpWithParallelJob();
+            });
+    }
+    for (unsigned int numberOfChunks = 0; numberOfChunks <= 1000; numberOfChunks += 50)
+    {
+        for (auto& runs : parallelJobTestChunkRuns)
+            runs = 0;
+        runParallelJob(parallelJobTestChunk, parallelJobTestChunkRuns, numberOfChunks);
+        for (unsigned int i = 0; i < 1000; ++i)
+            EXPECT_EQ(parallelJobTestChunkRuns[i], (i < numberOfChunks) ? 1 : 0);
+    }
+    stopHelpers = true;
+    for (auto& helper : helpers)
+        helper.join();
+
+    EXPECT_EQ(parallelJob.numberOfHelpers, 0);
+    EXPECT_EQ(parallelJob.function, nullptr);
+}
+
+TEST(TestCoreStagedFileWriter, WriteInSteps)
+{
+    StagedFileWriter writer;
+    EXPECT_TRUE(writer.init(1024 * 1024));
+
+    std::vector<unsigned char> data0(100000), data1(3000), data2(70000);
+    for (size_t i = 0; i < data0.size(); ++i)
+        data0[i] = (unsigned char)(i * 7);
+    for (size_t i = 0; i < data1.size(); ++i)
+        data1[i] = (unsigned char)(i * 13);
+    for (size_t i = 0; i < data2.size(); ++i)
+        data2[i] = (unsigned char)(i * 3 + 1);
+
+    const std::wstring fileName0 = (std::filesystem::temp_directory_path() / L"staged_file_writer_test0.bin").wstring();
+    const std::wstring fileName1 = (std::filesystem::temp_directory_path() / L"staged_file_writer_test1.bin").wstring();
+
+    writer.begin(NULL);
+
+    // file 0: data0 written from original location followed by staged copy of data1
+    const void* stagedData1 = writer.stage(data1.data(), data1.size());
+    EXPECT_NE(stagedData1, nullptr);
+    EXPECT_TRUE(writer.addFile((const CHAR16*)fileName0.c_str(), data0.data(), data0.size(), stagedData1, data1.size()));
+
+    // file 1: staged copy of data2
+    const void* stagedData2 = writer.stage(data2.data(), data2.size());
+    EXPECT_NE(stagedData2, nullptr);
+    EXPECT_TRUE(writer.addFile((const CHAR16*)fileName1.c_str(), stagedData2, data2.size()));
+    EXPECT_EQ(writer.getTotalSize(), data0.size() + data1.size() + data2.size());
+
+    // staging buffer is full
+    EXPECT_EQ(writer.stage(data0.data(), 1024 * 1024), nullptr);
+
+    // changing the original data after staging doesn't change the files
+    const std::vector<unsigned char> expectedData1 = data1, expectedData2 = data2;
+    data1[0] ^= 1;
+    data2[100] ^= 1;
+
+    writer.startWriting();
+    EXPECT_TRUE(writer.isWriting());
+    unsigned int steps = 0;
+    while (writer.isWriting())
+    {
+        EXPECT_TRUE(writer.writeStep(10000));
+        ++steps;
+        EXPECT_LE(writer.getWrittenSize(), steps * 10000ULL);
+    }
+    EXPECT_FALSE(writer.hasFailed());
+    EXPECT_EQ(writer.getWrittenSize(), writer.getTotalSize());
+    EXPECT_GE(steps, (unsigned int)(writer.getTotalSize() / 10000));
+
+    std::vector<unsigned char> loaded0(data0.size() + data1.size()), loaded1(data2.size());
+    EXPECT_EQ(load((const CHAR16*)fileName0.c_str(), loaded0.size(), loaded0.data()), (long long)loaded0.size());
+    EXPECT_EQ(load((const CHAR16*)fileName1.c_str(), loaded1.size(), loaded1.data()), (long long)loaded1.size());
+    EXPECT_TRUE(std::equal(data0.begin(), data0.end(), loaded0.begin()));
+    EXPECT_TRUE(std::equal(expectedData1.begin(), expectedData1.end(), loaded0.begin() + data0.size()));
+    EXPECT_TRUE(loaded1 == expectedData2);
+
+    std::filesystem::remove(fileName0);
+    std::filesystem::remove(fileName1);
+    writer.deinit();
+}
@@ -0,0 +1,85 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/revenue.h"
+
+#include <random>
+#include <vector>
+
+
+// Revenue scores computed like endEpoch() did before accumulating them per tick: scan tick data of all ticks
+static void computeReferenceRevenueScores(const std::vector<TickData>& tickData, unsigned int initialTick, unsigned short epoch, unsigned long long* revenueScore)
+{
+    setMem(revenueScore, NUMBER_OF_COMPUTORS * sizeof(unsigned long long), 0);
+    for (unsigned int tick = initialTick; tick < initialTick + tickData.size(); tick++)
+    {
+        const TickData& td = tickData[tick - initialTick];
+        if (td.epoch == epoch)
+        {
+            unsigned int numberOfTransactions = 0;
+            for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+            {
+                if (!isZero(td.transactionDigests[transactionIndex]))
+                {
+                    numberOfTransactions++;
+                }
+            }
+            revenueScore[tick % NUMBER_OF_COMPUTORS] += revenuePoints[numberOfTransactions];
+        }
+    }
+}
+
+TEST(TestCoreRevenueScore, AccumulatedEqualsScan)
+{
+    constexpr unsigned short epoch = 150;
+    constexpr unsigned int initialTick = 20000000;
+    constexpr unsigned int numberOfTicks = 3 * NUMBER_OF_COMPUTORS + 17;
+    std::mt19937_64 gen(42);
+
+    std::vector<TickData> tickData(numberOfTicks);
+    for (auto& td : tickData)
+    {
+        setMem(&td, sizeof(td), 0);
+        // empty ticks, ticks of other epoch / invalidated ticks, and ticks with 0 to 1024 transactions
+        const unsigned int type = gen() % 8;
+        td.epoch = (type == 0) ? 0 : ((type == 1) ? epoch - 1 : epoch);
+        const unsigned int numberOfTransactions = (type == 2) ? NUMBER_OF_TRANSACTIONS_PER_TICK : gen() % (NUMBER_OF_TRANSACTIONS_PER_TICK + 1);
+        for (unsigned int i = 0; i < numberOfTransactions; i++)
+        {
+            // digests don't need to be consecutive
+            td.transactionDigests[gen() % NUMBER_OF_TRANSACTIONS_PER_TICK] = m256i(gen(), gen(), gen(), gen() | 1);
+        }
+    }
+
+    RevenueScore revenueScore;
+    revenueScore.init();
+    for (unsigned int tick = initialTick; tick < initialTick + numberOfTicks; tick++)
+    {
+        revenueScore.addTick(tick, tickData[tick - initialTick], epoch);
+    }
+
+    unsigned long long referenceScores[NUMBER_OF_COMPUTORS];
+    computeReferenceRevenueScores(tickData, initialTick, epoch, referenceScores);
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        EXPECT_EQ(revenueScore.getScore(i), referenceScores[i]);
+    }
+
+    // persisting in node state snapshot
+    std::vector<unsigned char> data(RevenueScore::RevenueScoreDataSize);
+    revenueScore.saveAllDataToArray(data.data());
+    RevenueScore loadedRevenueScore;
+    loadedRevenueScore.init();
+    loadedRevenueScore.loadAllDataFromArray(data.data());
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        EXPECT_EQ(loadedRevenueScore.getScore(i), referenceScores[i]);
+    }
+
+    revenueScore.init();
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        EXPECT_EQ(revenueScore.getScore(i), 0);
+    }
+}
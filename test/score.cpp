@@ -297,3 +297,106 @@ TEST(TestQubicScoreFunction, CommonTests)
 {
     runCommonTests();
 }
+
+// Solution tasks are processed by any thread that finds a free compute buffer, also with more threads than buffers
+TEST(TestQubicScoreFunction, TaskQueueWithFreeBuffers)
+{
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+    constexpr unsigned long long numberOfTasks = 16;
+    constexpr unsigned int numberOfThreads = 5;
+    auto sampleString = readCSV(COMMON_TEST_SAMPLES_FILE_NAME);
+    ASSERT_GE(sampleString.size(), numberOfTasks);
+
+    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], kSettings[0][NR_OPTIMIZATION_STEPS], 2>>();
+    pScore->initMemory();
+    const m256i miningSeed = hexToByte(sampleString[0][0], 32);
+    pScore->initMiningData(miningSeed);
+    pScore->resetTaskQueue();
+    for (unsigned long long i = 0; i < numberOfTasks; ++i)
+    {
+        const m256i publicKey = hexToByte(sampleString[i][1], 32);
+        const m256i nonce = hexToByte(sampleString[i][2], 32);
+        pScore->addTask(publicKey, miningSeed, nonce, computeSolutionHash(publicKey, miningSeed, nonce));
+    }
+
+    // nothing is processed before the queue is started
+    EXPECT_FALSE(pScore->tryProcessSolution(0));
+
+    pScore->startProcessTaskQueue();
+    std::vector<unsigned long long> processedByThread(numberOfThreads, 0);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        threads.emplace_back([&, t]()
+            {
+                while (!pScore->isTaskQueueProcessed())
+                {
+                    if (pScore->tryProcessSolution(t))
+                        processedByThread[t]++;
+                }
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    pScore->stopProcessTaskQueue();
+
+    unsigned long long processed = 0;
+    for (auto count : processedByThread)
+        processed += count;
+    EXPECT_EQ(processed, numberOfTasks);
+    EXPECT_FALSE(pScore->tryProcessSolution(0));
+}
+
+// Single-threaded throughput of the score function with the setting used by the node, scores are checked against
+// the ground truth of this setting
+TEST(TestQubicScoreFunction, Throughput)
+{
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+    constexpr unsigned long long numberOfSamples = 4;
+    auto sampleString = readCSV(COMMON_TEST_SAMPLES_FILE_NAME);
+    auto scoresString = readCSV(COMMON_TEST_SCORES_FILE_NAME);
+    ASSERT_GE(sampleString.size(), numberOfSamples);
+    ASSERT_GT(scoresString.size(), numberOfSamples);
+
+    // Find ground truth column of the node setting
+    const unsigned long long nodeSetting[MAX_PARAM_TYPE] = { NUMBER_OF_HIDDEN_NEURONS, NUMBER_OF_NEIGHBOR_NEURONS, MAX_DURATION, NUMBER_OF_OPTIMIZATION_STEPS };
+    long long groundTruthIndex = -1;
+    for (unsigned long long gtIdx = 0; gtIdx < scoresString[0].size() && groundTruthIndex < 0; ++gtIdx)
+    {
+        auto scoresSettingHeader = convertULLFromString(scoresString[0][gtIdx]);
+        if (scoresSettingHeader.size() == MAX_PARAM_TYPE && std::equal(scoresSettingHeader.begin(), scoresSettingHeader.end(), nodeSetting))
+        {
+            groundTruthIndex = gtIdx;
+        }
+    }
+    ASSERT_GE(groundTruthIndex, 0);
+
+    auto pScore = std::make_unique<ScoreFunction<DATA_LENGTH, NUMBER_OF_HIDDEN_NEURONS, NUMBER_OF_NEIGHBOR_NEURONS, MAX_DURATION, NUMBER_OF_OPTIMIZATION_STEPS, 1>>();
+    pScore->initMemory();
+
+    unsigned long long totalMicroseconds = 0;
+    for (unsigned long long i = 0; i < numberOfSamples; ++i)
+    {
+        m256i miningSeed = hexToByte(sampleString[i][0], 32);
+        m256i publicKey = hexToByte(sampleString[i][1], 32);
+        m256i nonce = hexToByte(sampleString[i][2], 32);
+        pScore->initMiningData(miningSeed);
+
+        int x = 0;
+        top_of_stack = (unsigned long long)(&x);
+        auto t0 = std::chrono::high_resolution_clock::now();
+        unsigned int scoreValue = (*pScore)(0, publicKey, miningSeed, nonce);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        totalMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        EXPECT_EQ(scoreValue, (unsigned int)std::stoi(scoresString[i + 1][groundTruthIndex]));
+    }
+
+    const double secondsPerSolution = totalMicroseconds / 1e6 / numberOfSamples;
+    std::cout << "Score function (NEURON " << NUMBER_OF_HIDDEN_NEURONS << ", NEIGHBOR " << NUMBER_OF_NEIGHBOR_NEURONS
+        << ", DURATIONS " << MAX_DURATION << ", OPT_STEPS " << NUMBER_OF_OPTIMIZATION_STEPS << "): "
+        << secondsPerSolution * 1000 << " ms per solution, " << 1.0 / secondsPerSolution << " solutions per second per thread" << std::endl;
+}
@@ -4,7 +4,10 @@
 
 #include "../src/score_cache.h"
 
+#include <filesystem>
 #include <random>
+#include <thread>
+#include <vector>
 
 
 template <unsigned int cacheCapacity>
@@ -14,10 +17,10 @@ void expectEmptyCache(ScoreCache<cacheCapacity>& cache)
     EXPECT_EQ(cache.collisionCount(), 0);
     EXPECT_EQ(cache.missCount(), 0);
 
-    // test that all is empty and access out of bounds is no error
+    // test that all is empty and any hash is no error
     for (unsigned int i = 0; i < cache.capacity() + 100; ++i)
     {
-        // test with arbitrary publicKey and nonce (real and pseudo-random is slow, so use a fast quite random pattern)
+        // test with arbitrary publicKey, nonce, and hash (real and pseudo-random is slow, so use a fast quite random pattern)
         unsigned long long a = i * 123456789ull;
         unsigned long long b = 0xbca326450256c63eull - i * 759037ull;
         unsigned long long c = 2345932453043560ull << (i & 63);
@@ -25,9 +28,7 @@ void expectEmptyCache(ScoreCache<cacheCapacity>& cache)
         m256i miningSeed = m256i(1, 1, 1, 1);
         m256i nonce((a << 2) ^ b, (a << 2) ^ c, (b << 1) ^ c, (b >> 1) ^ c);
 
-        unsigned int ioIdx = i;
-        EXPECT_EQ(cache.tryFetching(publicKey, miningSeed, nonce, ioIdx), cache.SCORE_CACHE_MISS);
-        EXPECT_TRUE(ioIdx == i || (i >= cache.capacity() && ioIdx == i % cache.capacity()));
+        EXPECT_EQ(cache.tryFetching(publicKey, miningSeed, nonce, (i & 1) ? a ^ b ^ c : i), cache.SCORE_CACHE_MISS);
     }
 }
 
@@ -36,25 +37,25 @@ unsigned int pseudoRandomCacheTest(ScoreCache<cacheCapacity> & cache, unsigned l
 {
     cache.reset();
 
-    // add entries with pseudo-random data
+    // add entries with pseudo-random data (mining seed is the same for all solutions of a phase)
     std::mt19937_64 gen64;
     gen64.seed(seed);
+    const m256i miningSeed(gen64(), gen64(), gen64(), gen64());
     for (unsigned int i = 0; i < entryCount; ++i)
     {
         m256i publicKey(gen64(), gen64(), gen64(), gen64());
-        m256i miningSeed(gen64(), gen64(), gen64(), gen64());
         m256i nonce(gen64(), gen64(), gen64(), gen64());
         int score = gen64() % std::numeric_limits<int>::max();
         assert(score >= 0);
-        unsigned int idx = cache.getCacheIndex(publicKey, miningSeed, nonce);
-        int fetchedScore = cache.tryFetching(publicKey, miningSeed, nonce, idx);
+        unsigned long long hash = computeSolutionHash(publicKey, miningSeed, nonce);
+        int fetchedScore = cache.tryFetching(publicKey, miningSeed, nonce, hash);
 
         // assume that we will not get the same publicKey and nonce twice in random entry generation
         EXPECT_TRUE(fetchedScore == cache.SCORE_CACHE_MISS || fetchedScore == cache.SCORE_CACHE_COLLISION);
 
         if (fetchedScore != cache.SCORE_CACHE_COLLISION || overwrite)
         {
-            cache.addEntry(publicKey, miningSeed, nonce, idx, score);
+            cache.addEntry(publicKey, miningSeed, nonce, hash, score);
         }
     }
     EXPECT_EQ(entryCount, cache.missCount() + cache.collisionCount());
@@ -67,15 +68,15 @@ unsigned int pseudoRandomCacheTest(ScoreCache<cacheCapacity> & cache, unsigned l
 
     // test entries with pseudo-random data
     gen64.seed(seed);
+    EXPECT_TRUE(miningSeed == m256i(gen64(), gen64(), gen64(), gen64()));
     for (unsigned int i = 0; i < entryCount; ++i)
     {
         m256i publicKey(gen64(), gen64(), gen64(), gen64());
-        m256i miningSeed(gen64(), gen64(), gen64(), gen64());
         m256i nonce(gen64(), gen64(), gen64(), gen64());
         int expectedScore = gen64() % std::numeric_limits<int>::max();
         
-        unsigned int idx = cache.getCacheIndex(publicKey, miningSeed, nonce);
-        int fetchedScore = cache.tryFetching(publicKey, miningSeed, nonce, idx);
+        unsigned long long hash = computeSolutionHash(publicKey, miningSeed, nonce);
+        int fetchedScore = cache.tryFetching(publicKey, miningSeed, nonce, hash);
 
         EXPECT_TRUE(fetchedScore == cache.SCORE_CACHE_COLLISION || fetchedScore >= cache.MIN_VALID_SCORE);
         if (fetchedScore >= cache.MIN_VALID_SCORE)
@@ -199,3 +200,163 @@ TEST(TestQubicScoreCache, RandomSeeds80pctFilled) {
     testCacheRandomSeeds<200000>(80);     // non-prime number as cache size
     testCacheRandomSeeds<199999>(80);     // prime number as cache size
 }
+
+// The lower 32 bits of the solution hash are the index of minerSolutionFlags computed with 4-byte output before
+TEST(TestQubicScoreCache, SolutionHashExtendsFlagIndex) {
+    std::mt19937_64 gen64(42);
+    for (unsigned int i = 0; i < 100; ++i)
+    {
+        m256i data[3] = { m256i(gen64(), gen64(), gen64(), gen64()), m256i(gen64(), gen64(), gen64(), gen64()), m256i(gen64(), gen64(), gen64(), gen64()) };
+        unsigned int flagIndex;
+        KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
+        EXPECT_EQ((unsigned int)computeSolutionHash(data[0], data[1], data[2]), flagIndex);
+    }
+}
+
+TEST(TestQubicScoreCache, SeedGenerations) {
+    typedef ScoreCache<200000> CacheType;
+    CacheType* cache = new CacheType();
+    std::mt19937_64 gen64(42);
+
+    std::vector<m256i> miningSeeds, publicKeys, nonces;
+    for (unsigned int i = 0; i < CacheType::maxNumberOfSeedGenerations + 1; ++i)
+    {
+        miningSeeds.push_back(m256i(gen64(), gen64(), gen64(), gen64()));
+    }
+    for (unsigned int i = 0; i < 1000; ++i)
+    {
+        publicKeys.push_back(m256i(gen64(), gen64(), gen64(), gen64()));
+        nonces.push_back(m256i(gen64(), gen64(), gen64(), gen64()));
+    }
+
+    // same publicKey and nonce with different seeds are different entries
+    for (unsigned int s = 0; s < CacheType::maxNumberOfSeedGenerations; ++s)
+    {
+        for (unsigned int i = 0; i < publicKeys.size(); ++i)
+        {
+            cache->addEntry(publicKeys[i], miningSeeds[s], nonces[i], computeSolutionHash(publicKeys[i], miningSeeds[s], nonces[i]), s * 1000 + i);
+        }
+    }
+    for (unsigned int s = 0; s < CacheType::maxNumberOfSeedGenerations; ++s)
+    {
+        for (unsigned int i = 0; i < publicKeys.size(); ++i)
+        {
+            EXPECT_EQ(cache->tryFetching(publicKeys[i], miningSeeds[s], nonces[i], computeSolutionHash(publicKeys[i], miningSeeds[s], nonces[i])), (int)(s * 1000 + i));
+        }
+    }
+
+    // new seed replaces oldest seed, entries of oldest seed are outdated and buckets are reused
+    const unsigned int newSeed = CacheType::maxNumberOfSeedGenerations;
+    for (unsigned int i = 0; i < publicKeys.size(); ++i)
+    {
+        cache->addEntry(publicKeys[i], miningSeeds[newSeed], nonces[i], computeSolutionHash(publicKeys[i], miningSeeds[newSeed], nonces[i]), i + 7);
+    }
+    for (unsigned int i = 0; i < publicKeys.size(); ++i)
+    {
+        EXPECT_EQ(cache->tryFetching(publicKeys[i], miningSeeds[0], nonces[i], computeSolutionHash(publicKeys[i], miningSeeds[0], nonces[i])), cache->SCORE_CACHE_MISS);
+        EXPECT_EQ(cache->tryFetching(publicKeys[i], miningSeeds[1], nonces[i], computeSolutionHash(publicKeys[i], miningSeeds[1], nonces[i])), (int)(1000 + i));
+        EXPECT_EQ(cache->tryFetching(publicKeys[i], miningSeeds[newSeed], nonces[i], computeSolutionHash(publicKeys[i], miningSeeds[newSeed], nonces[i])), (int)(i + 7));
+    }
+
+    delete cache;
+}
+
+TEST(TestQubicScoreCache, SaveLoadPopulatedBuckets) {
+    typedef ScoreCache<200000> CacheType;
+    const std::wstring directoryString = std::filesystem::temp_directory_path().wstring();
+    CHAR16* directory = (CHAR16*)directoryString.c_str();
+    CHAR16 fileName[] = L"scoreCacheTest.000";
+    constexpr unsigned int entryCount = 5000;
+    frequency = 1000000000; // used for logging duration of saving, not initialized in test
+
+    CacheType* cache = new CacheType();
+    std::mt19937_64 gen64(42);
+    const m256i miningSeed(gen64(), gen64(), gen64(), gen64());
+    std::vector<m256i> publicKeys, nonces;
+    for (unsigned int i = 0; i < entryCount; ++i)
+    {
+        publicKeys.push_back(m256i(gen64(), gen64(), gen64(), gen64()));
+        nonces.push_back(m256i(gen64(), gen64(), gen64(), gen64()));
+        cache->addEntry(publicKeys[i], miningSeed, nonces[i], computeSolutionHash(publicKeys[i], miningSeed, nonces[i]), i);
+    }
+    cache->save(fileName, directory);
+
+    // only populated buckets are saved
+    const long long fileSize = getFileSize(fileName, directory);
+    EXPECT_GT(fileSize, (long long)(entryCount * 80));
+    EXPECT_LT(fileSize, (long long)(entryCount * 100));
+
+    CacheType* loadedCache = new CacheType();
+    EXPECT_TRUE(loadedCache->load(fileName, directory));
+    for (unsigned int i = 0; i < entryCount; ++i)
+    {
+        EXPECT_EQ(loadedCache->tryFetching(publicKeys[i], miningSeed, nonces[i], computeSolutionHash(publicKeys[i], miningSeed, nonces[i])), (int)i);
+    }
+    EXPECT_EQ(loadedCache->hitCount(), entryCount);
+
+    // file of cache with other layout is rejected
+    ScoreCache<200000, 20, 32>* otherCache = new ScoreCache<200000, 20, 32>();
+    EXPECT_FALSE(otherCache->load(fileName, directory));
+
+    // cache is empty after loading missing or truncated file
+    save(fileName, fileSize - 1, std::vector<unsigned char>(fileSize).data(), directory);
+    EXPECT_FALSE(loadedCache->load(fileName, directory));
+    expectEmptyCache(*loadedCache);
+    std::filesystem::remove(std::filesystem::temp_directory_path() / "scoreCacheTest.000");
+    EXPECT_FALSE(loadedCache->load(fileName, directory));
+
+    delete otherCache;
+    delete loadedCache;
+    delete cache;
+}
+
+// Solution processors look up and add solutions in parallel
+TEST(TestQubicScoreCache, ConcurrentAccess) {
+    typedef ScoreCache<200000> CacheType;
+    constexpr unsigned int numberOfThreads = 4;
+    constexpr unsigned int entriesPerThread = 10000;
+    CacheType* cache = new CacheType();
+    const m256i miningSeed(1, 2, 3, 4);
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        threads.emplace_back([=]()
+            {
+                for (unsigned int i = 0; i < entriesPerThread; ++i)
+                {
+                    const m256i publicKey(t, i, 0, 1);
+                    const m256i nonce(i, t, 1, 0);
+                    const unsigned long long hash = computeSolutionHash(publicKey, miningSeed, nonce);
+                    if (cache->tryFetching(publicKey, miningSeed, nonce, hash) < cache->MIN_VALID_SCORE)
+                    {
+                        cache->addEntry(publicKey, miningSeed, nonce, hash, t * entriesPerThread + i);
+                    }
+                }
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(cache->hitCount(), 0);
+    EXPECT_EQ(cache->missCount() + cache->collisionCount(), numberOfThreads * entriesPerThread);
+
+    unsigned int found = 0;
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        for (unsigned int i = 0; i < entriesPerThread; ++i)
+        {
+            const m256i publicKey(t, i, 0, 1);
+            const m256i nonce(i, t, 1, 0);
+            const int score = cache->tryFetching(publicKey, miningSeed, nonce, computeSolutionHash(publicKey, miningSeed, nonce));
+            if (score >= cache->MIN_VALID_SCORE)
+            {
+                EXPECT_EQ(score, (int)(t * entriesPerThread + i));
+                found++;
+            }
+        }
+    }
+    // at 20% fill, very few entries are lost due to collisions
+    EXPECT_GT(found, numberOfThreads * entriesPerThread * 99 / 100);
+
+    delete cache;
+}
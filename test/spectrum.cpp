@@ -24,8 +24,11 @@
 
 #include "../src/spectrum.h"
 
+#include <atomic>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <vector>
 
 static bool transfer(const m256i& src, const m256i& dst, long long amount)
 {
@@ -416,3 +419,173 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseHugeBinZeroBalance)
     test.afterAntiDust();
 }
 
+
+// Compute all spectrum digests from scratch (for checking the incremental update)
+static void computeSpectrumDigestsFromScratch(m256i* digests)
+{
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        KangarooTwelve64To32(&spectrum[digestIndex], &digests[digestIndex]);
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+}
+
+TEST(TestCoreSpectrum, DigestUpdateWithTickJournal)
+{
+    SpectrumTest test;
+    memset(spectrumChangeFlags, 0, sizeof(spectrumChangeFlags));
+    m256i* expectedDigests = (m256i*)malloc(spectrumDigestsSizeInByte);
+    ASSERT_NE(expectedDigests, nullptr);
+
+    // Create some entities and compute full digest tree (invalidates journal)
+    std::vector<m256i> richIds;
+    for (int i = 0; i < 100000; i++)
+    {
+        richIds.push_back(m256i::randomValue());
+        increaseEnergy(richIds.back(), (i + 1) * 1000llu);
+    }
+    reorganizeSpectrum();
+    EXPECT_FALSE(spectrumTickJournal.valid);
+
+    // First update falls back to full scan
+    const unsigned long long fullScanCount = spectrumDigestUpdateFullScanCount;
+    updateSpectrumDigestsOfCurrentTick();
+    EXPECT_EQ(spectrumDigestUpdateFullScanCount, fullScanCount + 1);
+    EXPECT_TRUE(spectrumTickJournal.valid);
+
+    for (int tick = 0; tick < 4; ++tick)
+    {
+        ++system.tick;
+
+        // Transfers to new and existing entities, with repeated changes of the same entities.
+        // In tick 2, more entities are changed than fit into the journal.
+        const unsigned int numberOfTransfers = (tick == 2) ? spectrumTickJournalCapacity + 10 : 500 * tick + 1;
+        for (unsigned int i = 0; i < numberOfTransfers; i++)
+        {
+            const m256i& src = richIds[test.rnd64() % 1000];
+            const m256i dst = (i % 7 == 0) ? richIds[test.rnd64() % richIds.size()] : m256i::randomValue();
+            EXPECT_TRUE(transfer(src, dst, 1 + i % 5));
+        }
+
+        const bool journalExpected = spectrumTickJournal.valid;
+        EXPECT_EQ(journalExpected, tick != 2);
+        const unsigned long long journalCount = spectrumDigestUpdateJournalCount;
+        updateSpectrumDigestsOfCurrentTick();
+        EXPECT_EQ(spectrumDigestUpdateJournalCount, journalCount + (journalExpected ? 1 : 0));
+
+        // Result must be the same as computing all digests from scratch
+        computeSpectrumDigestsFromScratch(expectedDigests);
+        EXPECT_EQ(memcmp(expectedDigests, spectrumDigests, spectrumDigestsSizeInByte), 0);
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 64; i++)
+            EXPECT_EQ(spectrumChangeFlags[i], 0);
+    }
+
+    free(expectedDigests);
+}
+
+// Compute Merkle root from entity and siblings, as done by clients verifying a RespondedEntity
+static m256i computeSpectrumRootFromSiblings(const ::Entity& entity, int spectrumIndex, const m256i* siblings)
+{
+    m256i digest, pair[2];
+    KangarooTwelve64To32(&entity, &digest);
+    for (unsigned int j = 0; j < SPECTRUM_DEPTH; j++)
+    {
+        pair[spectrumIndex & 1] = digest;
+        pair[(spectrumIndex & 1) ^ 1] = siblings[j];
+        KangarooTwelve64To32(pair, &digest);
+        spectrumIndex >>= 1;
+    }
+    return digest;
+}
+
+TEST(TestCoreSpectrum, LockFreeEntityReadsWithConcurrentWriter)
+{
+    SpectrumTest test;
+    memset(spectrumChangeFlags, 0, sizeof(spectrumChangeFlags));
+
+    std::vector<m256i> ids;
+    for (int i = 0; i < 100000; i++)
+    {
+        ids.push_back(m256i::randomValue());
+        increaseEnergy(ids.back(), 1000000llu);
+    }
+    reorganizeSpectrum();
+    updateSpectrumDigestsOfCurrentTick();
+
+    // Readers do what processRequestEntity() does and check that entity, siblings, and root are consistent
+    constexpr unsigned int numberOfReaders = 4;
+    std::atomic<bool> stop = false;
+    std::atomic<unsigned long long> numberOfReads = 0;
+    std::atomic<unsigned long long> numberOfInconsistentReads = 0;
+    const long long retriesBefore = spectrumReadRetries;
+    std::vector<std::thread> readers;
+    for (unsigned int r = 0; r < numberOfReaders; ++r)
+    {
+        readers.emplace_back([&, r]()
+            {
+                std::mt19937_64 gen(r);
+                unsigned long long reads = 0;
+                while (!stop)
+                {
+                    const m256i& id = ids[gen() % ids.size()];
+                    ::Entity entity;
+                    m256i siblings[SPECTRUM_DEPTH];
+                    m256i root;
+                    int index;
+                    long long sequenceNumber;
+                    do
+                    {
+                        sequenceNumber = beginSpectrumRead();
+                        index = spectrumIndexNoLock(id);
+                        if (index >= 0)
+                        {
+                            entity = spectrum[index];
+                            getSiblings<SPECTRUM_DEPTH>(index, spectrumDigests, siblings);
+                        }
+                        root = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+                    } while (!endSpectrumRead(sequenceNumber));
+
+                    if (index < 0 || entity.publicKey != id || computeSpectrumRootFromSiblings(entity, index, siblings) != root)
+                        ++numberOfInconsistentReads;
+                    ++reads;
+                }
+                numberOfReads += reads;
+            });
+    }
+
+    // Single writer simulating ticks with transfers and digest updates
+    const auto startTime = std::chrono::steady_clock::now();
+    unsigned int numberOfTicks = 0;
+    while (std::chrono::steady_clock::now() - startTime < std::chrono::seconds(3))
+    {
+        ++system.tick;
+        for (unsigned int i = 0; i < 1000; i++)
+        {
+            EXPECT_TRUE(transfer(ids[test.rnd64() % ids.size()], ids[test.rnd64() % ids.size()], 1));
+        }
+        ACQUIRE(spectrumLock);
+        updateSpectrumDigestsOfCurrentTick();
+        RELEASE(spectrumLock);
+        ++numberOfTicks;
+    }
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+    const auto durationMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    EXPECT_EQ(numberOfInconsistentReads, 0);
+    EXPECT_EQ(spectrumSequenceNumber & 1, 0);
+    std::cout << numberOfReaders << " lock-free readers with 1 writer: " << numberOfReads * 1000 / durationMilliSec << " entity reads/s, "
+        << spectrumReadRetries - retriesBefore << " retries, writer processed " << numberOfTicks << " ticks with 1000 transfers each" << std::endl;
+}
@@ -1,4 +1,5 @@
 #define NO_UEFI
+#define TICK_STORAGE_AUTOSAVE_MODE 1
 
 #include "gtest/gtest.h"
 
@@ -9,7 +10,9 @@
 #define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 5
 #include "../src/tick_storage.h"
 
+#include <filesystem>
 #include <random>
+#include <vector>
 
 
 class TestTickStorage : public TickStorage
@@ -208,3 +211,166 @@ TEST(TestCoreTickStorage, EpochTransition) {
         ts.deinit();
     }
 }
+
+// All data of ticks [tickBegin, tickEnd] in current epoch storage, including the transactions
+static std::vector<unsigned char> getTickStorageData(unsigned int tickBegin, unsigned int tickEnd)
+{
+    std::vector<unsigned char> data;
+    for (unsigned int tick = tickBegin; tick <= tickEnd; ++tick)
+    {
+        const unsigned char* td = (const unsigned char*)&ts.tickData.getByTickInCurrentEpoch(tick);
+        data.insert(data.end(), td, td + sizeof(TickData));
+        const unsigned char* computorTicks = (const unsigned char*)ts.ticks.getByTickInCurrentEpoch(tick);
+        data.insert(data.end(), computorTicks, computorTicks + NUMBER_OF_COMPUTORS * sizeof(Tick));
+        const auto* offsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+        data.insert(data.end(), (const unsigned char*)offsets, (const unsigned char*)(offsets + NUMBER_OF_TRANSACTIONS_PER_TICK));
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; ++i)
+        {
+            if (offsets[i])
+            {
+                const unsigned char* transaction = (const unsigned char*)ts.tickTransactions(offsets[i]);
+                data.insert(data.end(), transaction, transaction + ts.tickTransactions(offsets[i])->totalSize());
+            }
+        }
+    }
+    return data;
+}
+
+static long long getSegmentFileSize(unsigned short* fileName, int segment, CHAR16* directory)
+{
+    CHAR16 segmentFileName[64];
+    getLargeFileChunkName(fileName, segment, segmentFileName);
+    return getFileSize(segmentFileName, directory);
+}
+
+TEST(TestCoreTickStorage, SaveAndLoadSnapshotSegments)
+{
+    const std::filesystem::path directoryPath = std::filesystem::temp_directory_path() / "qubicTickStorageSnapshot";
+    std::filesystem::remove_all(directoryPath);
+    std::filesystem::create_directories(directoryPath);
+    const std::wstring directoryString = directoryPath.wstring();
+    CHAR16* directory = (CHAR16*)directoryString.c_str();
+    constexpr unsigned short epoch = 123;
+    constexpr unsigned int tick0 = 1000;
+    std::mt19937_64 gen64(1234);
+
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+
+    // Save several times, each save adds a segment
+    const unsigned int saveTicks[] = { tick0 + 10, tick0 + 25, tick0 + 26, tick0 + 26, tick0 + 40 };
+    unsigned int nextTick = tick0;
+    for (int i = 0; i < 5; ++i)
+    {
+        // votes for last saved tick arrived after saving
+        if (i > 0)
+            ts.ticks.getByTickInCurrentEpoch(saveTicks[i - 1])[0].prevResourceTestingDigest ^= 1;
+
+        // transactions of following tick may be stored before saving
+        while (nextTick <= saveTicks[i] + 1)
+            addTick(nextTick++, gen64(), NUMBER_OF_TRANSACTIONS_PER_TICK);
+        EXPECT_EQ(ts.trySaveToFile(epoch, saveTicks[i], directory), 0);
+    }
+    EXPECT_EQ(getSegmentFileSize(SNAPSHOT_TICK_DATA_FILE_NAME, 0, directory), 11 * sizeof(TickData));
+    EXPECT_EQ(getSegmentFileSize(SNAPSHOT_TICK_DATA_FILE_NAME, 1, directory), 16 * sizeof(TickData));
+    EXPECT_EQ(getSegmentFileSize(SNAPSHOT_TICKS_FILE_NAME, 3, directory), 1 * NUMBER_OF_COMPUTORS * sizeof(Tick));
+    EXPECT_EQ(getSegmentFileSize(SNAPSHOT_TICKS_FILE_NAME, 4, directory), 15 * NUMBER_OF_COMPUTORS * sizeof(Tick));
+    const std::vector<unsigned char> savedData = getTickStorageData(tick0, saveTicks[4]);
+
+    // Load into empty tick storage (node restart) and continue appending
+    ts.deinit();
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+    EXPECT_EQ(ts.tryLoadFromFile(epoch, directory), 0);
+    EXPECT_EQ(ts.getPreloadTick(), saveTicks[4]);
+    EXPECT_TRUE(getTickStorageData(tick0, saveTicks[4]) == savedData);
+
+    nextTick = saveTicks[4] + 1;
+    while (nextTick <= tick0 + 46)
+        addTick(nextTick++, gen64(), NUMBER_OF_TRANSACTIONS_PER_TICK);
+    EXPECT_EQ(ts.trySaveToFile(epoch, tick0 + 45, directory), 0);
+    EXPECT_EQ(getSegmentFileSize(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, 5, directory), 6 * NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(unsigned long long));
+    const std::vector<unsigned char> savedData2 = getTickStorageData(tick0, tick0 + 45);
+
+    ts.deinit();
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+    EXPECT_EQ(ts.tryLoadFromFile(epoch, directory), 0);
+    EXPECT_TRUE(getTickStorageData(tick0, tick0 + 45) == savedData2);
+
+    // Corrupted segment index isn't loaded
+    std::vector<unsigned char> segmentIndex(getFileSize(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, directory));
+    EXPECT_EQ(load(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, segmentIndex.size(), segmentIndex.data(), directory), (long long)segmentIndex.size());
+    segmentIndex[40] ^= 1;
+    EXPECT_EQ(save(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, segmentIndex.size(), segmentIndex.data(), directory), (long long)segmentIndex.size());
+    ts.deinit();
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+    EXPECT_NE(ts.tryLoadFromFile(epoch, directory), 0);
+
+    ts.deinit();
+    std::filesystem::remove_all(directoryPath);
+}
+
+TEST(TestCoreTickStorage, LoadSnapshotWithoutSegmentIndex)
+{
+    const std::filesystem::path directoryPath = std::filesystem::temp_directory_path() / "qubicTickStorageLegacySnapshot";
+    std::filesystem::remove_all(directoryPath);
+    std::filesystem::create_directories(directoryPath);
+    const std::wstring directoryString = directoryPath.wstring();
+    CHAR16* directory = (CHAR16*)directoryString.c_str();
+    constexpr unsigned short epoch = 123;
+    constexpr unsigned int tick0 = 1000;
+    constexpr unsigned int savedTick = tick0 + 20;
+    std::mt19937_64 gen64(4321);
+
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+    for (unsigned int tick = tick0; tick <= savedTick; ++tick)
+        addTick(tick, gen64(), NUMBER_OF_TRANSACTIONS_PER_TICK);
+    const std::vector<unsigned char> savedData = getTickStorageData(tick0, savedTick);
+
+    // Create snapshot in the format without segments: the metadata is the same, the data files don't have a
+    // segment number, and there is no segment index
+    EXPECT_EQ(ts.trySaveToFile(epoch, savedTick, directory), 0);
+    for (unsigned short* fileName : { SNAPSHOT_TICK_DATA_FILE_NAME, SNAPSHOT_TICKS_FILE_NAME, SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, SNAPSHOT_TRANSACTIONS_FILE_NAME })
+    {
+        CHAR16 segmentFileName[64];
+        getLargeFileChunkName(fileName, 0, segmentFileName);
+        std::filesystem::rename(directoryPath / std::u16string((const char16_t*)segmentFileName), directoryPath / std::u16string((const char16_t*)fileName));
+    }
+    std::filesystem::remove(directoryPath / std::u16string((const char16_t*)SNAPSHOT_SEGMENT_INDEX_FILE_NAME));
+    EXPECT_LT(getFileSize(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, directory), 0);
+
+    // Snapshot is loaded as a single segment
+    ts.deinit();
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+    EXPECT_EQ(ts.tryLoadFromFile(epoch, directory), 0);
+    EXPECT_EQ(ts.getPreloadTick(), savedTick);
+    EXPECT_TRUE(getTickStorageData(tick0, savedTick) == savedData);
+
+    // Next save writes all ticks as segment 0 and the segment index
+    for (unsigned int tick = savedTick + 1; tick <= tick0 + 30; ++tick)
+        addTick(tick, gen64(), NUMBER_OF_TRANSACTIONS_PER_TICK);
+    EXPECT_EQ(ts.trySaveToFile(epoch, tick0 + 30, directory), 0);
+    EXPECT_EQ(getSegmentFileSize(SNAPSHOT_TICK_DATA_FILE_NAME, 0, directory), 31 * sizeof(TickData));
+    EXPECT_GT(getFileSize(SNAPSHOT_SEGMENT_INDEX_FILE_NAME, directory), 0);
+    const std::vector<unsigned char> savedData2 = getTickStorageData(tick0, tick0 + 30);
+
+    ts.deinit();
+    ts.init();
+    ts.beginEpoch(tick0);
+    ts.initMetaData(epoch);
+    EXPECT_EQ(ts.tryLoadFromFile(epoch, directory), 0);
+    EXPECT_TRUE(getTickStorageData(tick0, tick0 + 30) == savedData2);
+
+    ts.deinit();
+    std::filesystem::remove_all(directoryPath);
+}
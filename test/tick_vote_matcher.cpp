@@ -0,0 +1,160 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/tick_vote_matcher.h"
+
+#include <random>
+#include <vector>
+
+
+// Matching of a vote like updateVotesCount() did before caching the expected salted digests
+static bool referenceMatches(const Tick& vote, const Tick& etalon, unsigned long long resourceTestingDigest, const m256i* computorPublicKeys)
+{
+    if (*((unsigned long long*) & vote.millisecond) == *((unsigned long long*) & etalon.millisecond)
+        && vote.prevSpectrumDigest == etalon.prevSpectrumDigest
+        && vote.prevUniverseDigest == etalon.prevUniverseDigest
+        && vote.prevComputerDigest == etalon.prevComputerDigest
+        && vote.transactionDigest == etalon.transactionDigest)
+    {
+        m256i saltedData[2];
+        m256i saltedDigest;
+        saltedData[0] = computorPublicKeys[vote.computorIndex];
+        saltedData[1].m256i_u64[0] = resourceTestingDigest;
+        KangarooTwelve(saltedData, 32 + sizeof(resourceTestingDigest), &saltedDigest, sizeof(resourceTestingDigest));
+        if (vote.saltedResourceTestingDigest != saltedDigest.m256i_u64[0])
+            return false;
+        saltedData[1] = etalon.saltedSpectrumDigest;
+        KangarooTwelve64To32(saltedData, &saltedDigest);
+        if (vote.saltedSpectrumDigest != saltedDigest)
+            return false;
+        saltedData[1] = etalon.saltedUniverseDigest;
+        KangarooTwelve64To32(saltedData, &saltedDigest);
+        if (vote.saltedUniverseDigest != saltedDigest)
+            return false;
+        saltedData[1] = etalon.saltedComputerDigest;
+        KangarooTwelve64To32(saltedData, &saltedDigest);
+        return vote.saltedComputerDigest == saltedDigest;
+    }
+    return false;
+}
+
+// Create vote of computor like broadcastTickVotes() does, breaking one of the fields depending on corruption
+static void createVote(Tick& vote, unsigned int computorIndex, const Tick& etalon, unsigned long long resourceTestingDigest, const m256i* computorPublicKeys, unsigned int corruption)
+{
+    copyMem(&vote, &etalon, sizeof(Tick));
+    vote.computorIndex = computorIndex;
+    m256i saltedData[2];
+    saltedData[0] = computorPublicKeys[computorIndex];
+    saltedData[1].m256i_u64[0] = resourceTestingDigest;
+    KangarooTwelve(saltedData, 32 + sizeof(resourceTestingDigest), &vote.saltedResourceTestingDigest, sizeof(vote.saltedResourceTestingDigest));
+    saltedData[1] = etalon.saltedSpectrumDigest;
+    KangarooTwelve64To32(saltedData, &vote.saltedSpectrumDigest);
+    saltedData[1] = etalon.saltedUniverseDigest;
+    KangarooTwelve64To32(saltedData, &vote.saltedUniverseDigest);
+    saltedData[1] = etalon.saltedComputerDigest;
+    KangarooTwelve64To32(saltedData, &vote.saltedComputerDigest);
+
+    switch (corruption)
+    {
+    case 1: vote.millisecond++; break;
+    case 2: vote.prevUniverseDigest.m256i_u8[7] ^= 1; break;
+    case 3: vote.transactionDigest.m256i_u8[31] ^= 1; break;
+    case 4: vote.saltedResourceTestingDigest ^= 1; break;
+    case 5: vote.saltedSpectrumDigest.m256i_u8[0] ^= 1; break;
+    case 6: vote.saltedUniverseDigest.m256i_u8[13] ^= 1; break;
+    case 7: vote.saltedComputerDigest.m256i_u8[30] ^= 1; break;
+    }
+}
+
+TEST(TestCoreTickVoteMatcher, MatchesReference)
+{
+    constexpr unsigned int tick = 20000000;
+    constexpr unsigned short epoch = 150;
+    std::mt19937_64 gen(42);
+
+    std::vector<m256i> computorPublicKeys(NUMBER_OF_COMPUTORS);
+    for (auto& publicKey : computorPublicKeys)
+        publicKey = m256i(gen(), gen(), gen(), gen());
+
+    Tick etalon;
+    setMem(&etalon, sizeof(etalon), 0);
+    etalon.tick = tick;
+    etalon.epoch = epoch;
+    etalon.millisecond = 123;
+    etalon.prevSpectrumDigest = m256i(gen(), gen(), gen(), gen());
+    etalon.prevUniverseDigest = m256i(gen(), gen(), gen(), gen());
+    etalon.prevComputerDigest = m256i(gen(), gen(), gen(), gen());
+    etalon.saltedSpectrumDigest = m256i(gen(), gen(), gen(), gen());
+    etalon.saltedUniverseDigest = m256i(gen(), gen(), gen(), gen());
+    etalon.saltedComputerDigest = m256i(gen(), gen(), gen(), gen());
+    etalon.transactionDigest = m256i(gen(), gen(), gen(), gen());
+    unsigned long long resourceTestingDigest = gen();
+
+    // votes arrive in several passes, about every second vote is corrupted in one of the fields
+    std::vector<Tick> votes(NUMBER_OF_COMPUTORS);
+    std::vector<bool> arrived(NUMBER_OF_COMPUTORS, false);
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        createVote(votes[i], i, etalon, resourceTestingDigest, computorPublicKeys.data(), (gen() & 1) ? 0 : gen() % 8);
+
+    TickVoteMatcher* matcher = new TickVoteMatcher;
+    unsigned int registeredVotes = 0;
+    for (unsigned int pass = 0; pass < 6; pass++)
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS / 5; i++)
+            arrived[gen() % NUMBER_OF_COMPUTORS] = true;
+
+        matcher->prepare(tick, epoch, etalon, resourceTestingDigest, computorPublicKeys.data());
+        EXPECT_EQ(matcher->getNumberOfRecomputations(), 1);
+
+        unsigned int matchingVotes = 0, referenceMatchingVotes = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            if (arrived[i])
+            {
+                bool isNewMatch;
+                if (matcher->matches(i, votes[i], isNewMatch))
+                {
+                    matchingVotes++;
+                    if (isNewMatch)
+                        registeredVotes++;
+                }
+                if (referenceMatches(votes[i], etalon, resourceTestingDigest, computorPublicKeys.data()))
+                    referenceMatchingVotes++;
+            }
+        }
+        EXPECT_EQ(matchingVotes, referenceMatchingVotes);
+        EXPECT_EQ(registeredVotes, referenceMatchingVotes);
+    }
+
+    // changing any input of the salted digests leads to recomputation
+    etalon.saltedUniverseDigest.m256i_u8[3] ^= 1;
+    matcher->prepare(tick, epoch, etalon, resourceTestingDigest, computorPublicKeys.data());
+    EXPECT_EQ(matcher->getNumberOfRecomputations(), 2);
+    resourceTestingDigest++;
+    matcher->prepare(tick, epoch, etalon, resourceTestingDigest, computorPublicKeys.data());
+    EXPECT_EQ(matcher->getNumberOfRecomputations(), 3);
+    computorPublicKeys[NUMBER_OF_COMPUTORS - 1].m256i_u8[0] ^= 1;
+    matcher->prepare(tick, epoch, etalon, resourceTestingDigest, computorPublicKeys.data());
+    EXPECT_EQ(matcher->getNumberOfRecomputations(), 4);
+    matcher->prepare(tick + 1, epoch, etalon, resourceTestingDigest, computorPublicKeys.data());
+    EXPECT_EQ(matcher->getNumberOfRecomputations(), 5);
+    matcher->invalidate();
+    matcher->prepare(tick + 1, epoch, etalon, resourceTestingDigest, computorPublicKeys.data());
+    EXPECT_EQ(matcher->getNumberOfRecomputations(), 6);
+
+    // votes matching the new etalon are reported as new matches again
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        Tick vote;
+        createVote(vote, i, etalon, resourceTestingDigest, computorPublicKeys.data(), (i & 1) ? 5 : 0);
+        bool isNewMatch;
+        EXPECT_EQ(matcher->matches(i, vote, isNewMatch), (i & 1) == 0);
+        EXPECT_EQ(isNewMatch, (i & 1) == 0);
+        EXPECT_EQ(matcher->matches(i, vote, isNewMatch), (i & 1) == 0);
+        EXPECT_FALSE(isNewMatch);
+        EXPECT_EQ(referenceMatches(vote, etalon, resourceTestingDigest, computorPublicKeys.data()), (i & 1) == 0);
+    }
+
+    delete matcher;
+}
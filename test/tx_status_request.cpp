@@ -15,7 +15,9 @@ void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char type, unsi
 #define ADDON_TX_STATUS_REQUEST 1
 #include "../src/addons/tx_status_request.h"
 
+#include <algorithm>
 #include <random>
+#include <vector>
 
 unsigned int numberOfTransactions = 0;
 
@@ -52,9 +54,27 @@ struct {
 
 RespondTxStatus responseMessage;
 
+struct {
+    RequestResponseHeader header;
+    RequestTxStatusByDigests payload;
+} requestByDigestsMessage;
+
+RespondTxStatusByDigests responseByDigestsMessage;
+
 
 static void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char type, unsigned int dejavu, const void* data)
 {
+    if (type == RESPOND_TX_STATUS_BY_DIGESTS)
+    {
+        const RespondTxStatusByDigests* txStatusByDigests = (const RespondTxStatusByDigests*)data;
+
+        EXPECT_EQ(dejavu, requestByDigestsMessage.header.dejavu());
+        EXPECT_EQ(dataSize, txStatusByDigests->size());
+
+        copyMem(&responseByDigestsMessage, txStatusByDigests, txStatusByDigests->size());
+        return;
+    }
+
     const RespondTxStatus* txStatus = (const RespondTxStatus*)data;
 
     EXPECT_EQ(type, RESPOND_TX_STATUS);
@@ -64,6 +84,76 @@ static void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char typ
     copyMem(&responseMessage, txStatus, txStatus->size());
 }
 
+// Request status of digests with RequestTxStatusByDigests, return number of transactions in response (0 if there is none)
+static unsigned int requestByDigests(const m256i* digests, unsigned int digestCount, unsigned int dejavu)
+{
+    requestByDigestsMessage.header.checkAndSetSize(sizeof(RequestResponseHeader) + digestCount * sizeof(m256i));
+    requestByDigestsMessage.header.setType(REQUEST_TX_STATUS_BY_DIGESTS);
+    requestByDigestsMessage.header.setDejavu(dejavu);
+    copyMem(requestByDigestsMessage.payload.digests, digests, digestCount * sizeof(m256i));
+
+    responseByDigestsMessage.currentTickOfNode = responseByDigestsMessage.txCount = 0;
+    processRequestTxStatusByDigests(0, nullptr, &requestByDigestsMessage.header);
+    if (responseByDigestsMessage.txCount)
+        EXPECT_EQ(responseByDigestsMessage.currentTickOfNode, system.tick);
+    return responseByDigestsMessage.txCount;
+}
+
+// Check status of tick's transactions by digest, requesting all digests of the tick and an unknown digest in batches,
+// followed by single digest requests
+static void checkTickByDigests(unsigned int tick, unsigned long long seed, unsigned short maxTransactions, bool fullyStoredTick, bool available)
+{
+    // use pseudo-random sequence for generating test data
+    std::mt19937_64 gen64(seed);
+    unsigned int transactionNum = gen64() % (maxTransactions + 1);
+    std::vector<m256i> digests(transactionNum);
+    std::vector<unsigned char> moneyFlew(transactionNum);
+    for (unsigned int transaction = 0; transaction < transactionNum; ++transaction)
+    {
+        digests[transaction] = m256i(gen64(), gen64(), gen64(), gen64());
+        moneyFlew[transaction] = gen64() % 2;
+    }
+    digests.push_back(m256i(gen64(), gen64(), gen64(), gen64()));
+
+    std::vector<ConfirmedTx> txStatus(digests.size());
+    for (unsigned int first = 0; first < digests.size(); first += RequestTxStatusByDigests::maxNumberOfDigests)
+    {
+        const unsigned int digestCount = std::min<unsigned int>((unsigned int)digests.size() - first, RequestTxStatusByDigests::maxNumberOfDigests);
+        EXPECT_EQ(requestByDigests(&digests[first], digestCount, seed % UINT_MAX), digestCount);
+        copyMem(&txStatus[first], responseByDigestsMessage.txStatus, digestCount * sizeof(ConfirmedTx));
+    }
+
+    unsigned int foundTransactions = 0;
+    for (unsigned int transaction = 0; transaction < digests.size(); ++transaction)
+    {
+        EXPECT_EQ(txStatus[transaction].digest, digests[transaction]);
+        if (txStatus[transaction].tick)
+        {
+            // found transactions are stored without gap
+            EXPECT_EQ(transaction, foundTransactions);
+            EXPECT_EQ(txStatus[transaction].tick, tick);
+            EXPECT_EQ(txStatus[transaction].moneyFlew, moneyFlew[transaction]);
+            ++foundTransactions;
+        }
+        else
+        {
+            EXPECT_EQ(txStatus[transaction].moneyFlew, 0);
+        }
+    }
+    if (!available)
+        EXPECT_EQ(foundTransactions, 0);
+    else if (fullyStoredTick)
+        EXPECT_EQ(foundTransactions, transactionNum);
+    else
+        EXPECT_LE(foundTransactions, transactionNum);
+
+    for (unsigned int transaction = 0; transaction < digests.size(); transaction += 97)
+    {
+        EXPECT_EQ(requestByDigests(&digests[transaction], 1, transaction), 1);
+        EXPECT_EQ(responseByDigestsMessage.txStatus[0].tick, (transaction < foundTransactions) ? tick : 0);
+    }
+}
+
 static void checkTick(unsigned int tick, unsigned long long seed, unsigned short maxTransactions, bool fullyStoredTick, bool previousEpoch)
 {
     // Ensure that we do not skip processRequestConfirmedTx()
@@ -178,7 +268,10 @@ TEST(TestCoreTxStatusRequestAddOn, EpochTransition)
         // check ticks
         bool previousEpoch = true;
         for (int i = 0; i < firstEpochTicks; ++i)
+        {
             checkTick(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions, i < firstEpochLastFullyStoredTick, !previousEpoch);
+            checkTickByDigests(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions, i < firstEpochLastFullyStoredTick, true);
+        }
 
         // Epoch transistion
         numberOfTransactions = 0;
@@ -195,9 +288,16 @@ TEST(TestCoreTxStatusRequestAddOn, EpochTransition)
 
         // check ticks
         for (int i = 0; i < secondEpochTicks; ++i)
+        {
             checkTick(secondEpochTick0 + i, secondEpochSeeds[i], maxTransactions, i < secondEpochLastFullyStoredTick, !previousEpoch);
+            checkTickByDigests(secondEpochTick0 + i, secondEpochSeeds[i], maxTransactions, i < secondEpochLastFullyStoredTick, true);
+        }
         for (int i = 0; i < firstEpochTicks; ++i)
+        {
             checkTick(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions, i < firstEpochLastFullyStoredTick, previousEpoch);
+            checkTickByDigests(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions, i < firstEpochLastFullyStoredTick,
+                txStatusData.confirmedTxPreviousEpochBeginTick && firstEpochTick0 + i >= txStatusData.confirmedTxPreviousEpochBeginTick);
+        }
 
         // Epoch transistion
         numberOfTransactions = 0;
@@ -214,11 +314,90 @@ TEST(TestCoreTxStatusRequestAddOn, EpochTransition)
 
         // check ticks
         for (int i = 0; i < thirdEpochTicks; ++i)
+        {
             checkTick(thirdEpochTick0 + i, thirdEpochSeeds[i], maxTransactions, i < thirdEpochLastFullyStoredTick, !previousEpoch);
+            checkTickByDigests(thirdEpochTick0 + i, thirdEpochSeeds[i], maxTransactions, i < thirdEpochLastFullyStoredTick, true);
+        }
         for (int i = 0; i < secondEpochTicks; ++i)
+        {
             checkTick(secondEpochTick0 + i, secondEpochSeeds[i], maxTransactions, i < secondEpochLastFullyStoredTick, previousEpoch);
+            checkTickByDigests(secondEpochTick0 + i, secondEpochSeeds[i], maxTransactions, i < secondEpochLastFullyStoredTick,
+                txStatusData.confirmedTxPreviousEpochBeginTick && secondEpochTick0 + i >= txStatusData.confirmedTxPreviousEpochBeginTick);
+        }
+        for (int i = 0; i < firstEpochTicks; ++i)
+            checkTickByDigests(firstEpochTick0 + i, firstEpochSeeds[i], maxTransactions, false, false);
+
+        // index rebuilt from confirmedTx (as after loading snapshot) finds the same transactions
+        ACQUIRE(confirmedTxLock);
+        rebuildConfirmedTxIndex();
+        RELEASE(confirmedTxLock);
+        for (int i = 0; i < thirdEpochTicks; ++i)
+            checkTickByDigests(thirdEpochTick0 + i, thirdEpochSeeds[i], maxTransactions, i < thirdEpochLastFullyStoredTick, true);
 
         deinitTxStatusRequestAddOn();
     }
 }
 
+TEST(TestCoreTxStatusRequestAddOn, InvalidRequestByDigests)
+{
+    initTxStatusRequestAddOn();
+    system.initialTick = 1000;
+    beginEpochTxStatusRequestAddOn(system.initialTick);
+    numberOfTransactions = 0;
+    addTick(system.initialTick, 42, NUMBER_OF_TRANSACTIONS_PER_TICK);
+    system.tick = system.initialTick + 1;
+
+    static m256i digests[RequestTxStatusByDigests::maxNumberOfDigests];
+    for (unsigned int i = 0; i < RequestTxStatusByDigests::maxNumberOfDigests; ++i)
+        digests[i] = confirmedTx[i % numberOfTransactions].digest;
+
+    // no response without digest, with incomplete digest, or with too many digests
+    EXPECT_EQ(requestByDigests(digests, 0, 1), 0);
+    for (unsigned int size : { (unsigned int)sizeof(m256i) + 5, (unsigned int)sizeof(RequestTxStatusByDigests) + (unsigned int)sizeof(m256i) })
+    {
+        requestByDigestsMessage.header.checkAndSetSize(sizeof(RequestResponseHeader) + size);
+        processRequestTxStatusByDigests(0, nullptr, &requestByDigestsMessage.header);
+        EXPECT_EQ(responseByDigestsMessage.txCount, 0);
+    }
+
+    // maximum number of digests
+    EXPECT_EQ(requestByDigests(digests, RequestTxStatusByDigests::maxNumberOfDigests, 3), RequestTxStatusByDigests::maxNumberOfDigests);
+    for (unsigned int i = 0; i < RequestTxStatusByDigests::maxNumberOfDigests; ++i)
+        EXPECT_EQ(responseByDigestsMessage.txStatus[i].tick, system.initialTick);
+
+    deinitTxStatusRequestAddOn();
+}
+
+TEST(TestCoreTxStatusRequestAddOn, DigestsWithEqualLowBits)
+{
+    initTxStatusRequestAddOn();
+    system.initialTick = 1000;
+    beginEpochTxStatusRequestAddOn(system.initialTick);
+    numberOfTransactions = 0;
+    system.tick = system.initialTick;
+    txStatusData.tickTxIndexStart[0] = 0;
+
+    // digests with equal bits used for the slot without salt are spread over the index
+    std::mt19937_64 gen64(43);
+    std::vector<m256i> digests(RequestTxStatusByDigests::maxNumberOfDigests);
+    std::vector<unsigned long long> slots(digests.size());
+    for (unsigned int i = 0; i < digests.size(); ++i)
+    {
+        digests[i] = m256i((gen64() & ~(confirmedTxIndexSize - 1)) | 12345, gen64(), gen64(), gen64());
+        slots[i] = getConfirmedTxIndexSlot(digests[i]);
+        ++numberOfTransactions;
+        EXPECT_TRUE(saveConfirmedTx(numberOfTransactions - 1, i % 2, system.tick, digests[i]));
+    }
+    std::sort(slots.begin(), slots.end());
+    EXPECT_GT(std::unique(slots.begin(), slots.end()) - slots.begin(), (long long)digests.size() * 9 / 10);
+
+    system.tick = system.initialTick + 1;
+    EXPECT_EQ(requestByDigests(digests.data(), (unsigned int)digests.size(), 5), digests.size());
+    for (unsigned int i = 0; i < digests.size(); ++i)
+    {
+        EXPECT_EQ(responseByDigestsMessage.txStatus[i].tick, system.initialTick);
+        EXPECT_EQ(responseByDigestsMessage.txStatus[i].moneyFlew, i % 2);
+    }
+
+    deinitTxStatusRequestAddOn();
+}
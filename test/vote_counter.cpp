@@ -5,7 +5,10 @@
 #include "../src/public_settings.h"
 #include "../src/vote_counter.h"
 
+#include <chrono>
+#include <iostream>
 #include <random>
+#include <vector>
 
 
 class TestVoteCounter : public VoteCounter
@@ -19,6 +22,14 @@ public:
     {
         update10Bit(data, idx, value);
     }
+    void testPack10Bit(unsigned char* data, const unsigned int* values)
+    {
+        pack10Bit(data, values);
+    }
+    void testUnpack10Bit(const unsigned char* data, unsigned int* values)
+    {
+        unpack10Bit(data, values);
+    }
 };
 
 TestVoteCounter tvc;
@@ -169,4 +180,115 @@ TEST(TestCoreVoteCounter, RegisterNewCompressVotes) {
         EXPECT_TRUE(isMatched);
         //printf("[PASSED] tick %u\n", tick);
     }
-}
\ No newline at end of file
+}
+
+TEST(TestCoreVoteCounter, BulkTenBitsMatchSingle) {
+    unsigned char packed[848], expected[848];
+    unsigned int values[676], unpacked[676];
+    std::mt19937 gen(1);
+    for (int round = 0; round < 32; round++)
+    {
+        setMem(packed, sizeof(packed), 0);
+        setMem(expected, sizeof(expected), 0);
+        for (int i = 0; i < 676; i++)
+        {
+            values[i] = (round == 0) ? 1023 : gen() % 1024;
+            tvc.testUpdate10Bit(expected, i, values[i]);
+        }
+        tvc.testPack10Bit(packed, values);
+        EXPECT_EQ(memcmp(packed, expected, sizeof(packed)), 0);
+        tvc.testUnpack10Bit(expected, unpacked);
+        for (int i = 0; i < 676; i++)
+        {
+            EXPECT_EQ(unpacked[i], tvc.testExtract10Bit(expected, i));
+        }
+    }
+}
+
+// compression like before vectorizing: scalar compare of each vote and packing one number at a time
+static void referenceCompressNewVotesPacket(const unsigned int* votes, unsigned int fromTick, unsigned int toTick, unsigned int computorIdx, unsigned char* votePacket)
+{
+    unsigned int buffer[676] = { 0 };
+    for (unsigned int i = fromTick; i < toTick; i++)
+    {
+        const unsigned int slotId = i % (676 * 2);
+        for (int j = 0; j < 676; j++)
+        {
+            if (votes[slotId * 676 + j] == i)
+            {
+                buffer[j]++;
+            }
+        }
+    }
+    buffer[computorIdx] = 0;
+    setMem(votePacket, 848, 0);
+    for (unsigned int i = 0; i < 676; i++)
+    {
+        tvc.testUpdate10Bit(votePacket, i, buffer[i]);
+    }
+}
+
+TEST(TestCoreVoteCounter, PerformanceCompressValidate) {
+    std::mt19937 gen(2);
+    tvc.init();
+    const unsigned int lastTick = 676 * 10 + 123;
+    for (unsigned int tick = lastTick - 2 * 676 + 1; tick <= lastTick; tick++)
+    {
+        for (int i = 0; i < 676; i++)
+        {
+            if (gen() % 10)
+            {
+                tvc.registerNewVote(tick, i);
+            }
+        }
+    }
+    std::vector<unsigned char> state(VoteCounter::VoteCounterDataSize);
+    tvc.saveAllDataToArray(state.data());
+    const unsigned int* votes = (const unsigned int*)state.data();
+
+    constexpr int packets = 200;
+    unsigned char packet[848], referencePacket[848];
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < packets; k++)
+    {
+        referenceCompressNewVotesPacket(votes, lastTick - 675, lastTick + 1, k % 676, referencePacket);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    const auto referenceCompressNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / packets;
+
+    t0 = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < packets; k++)
+    {
+        tvc.compressNewVotesPacket(lastTick - 675, lastTick + 1, k % 676, packet);
+    }
+    t1 = std::chrono::high_resolution_clock::now();
+    const auto compressNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / packets;
+    EXPECT_EQ(memcmp(packet, referencePacket, sizeof(packet)), 0);
+
+    // validation with unpacking one number at a time for comparison
+    unsigned long long referenceSum = 0;
+    t0 = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < packets; k++)
+    {
+        for (int i = 0; i < 676; i++)
+        {
+            referenceSum += tvc.testExtract10Bit(packet, i);
+        }
+    }
+    t1 = std::chrono::high_resolution_clock::now();
+    const auto referenceValidateNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / packets;
+
+    bool isValid = false;
+    t0 = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < packets; k++)
+    {
+        isValid = tvc.validateNewVotesPacket(packet, (packets - 1) % 676);
+    }
+    t1 = std::chrono::high_resolution_clock::now();
+    const auto validateNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / packets;
+    EXPECT_TRUE(isValid);
+    EXPECT_GT(referenceSum, 0);
+
+    std::cout << "Vote packet compression: scalar " << referenceCompressNanoseconds << " ns, vectorized " << compressNanoseconds
+        << " ns; validation: scalar unpacking " << referenceValidateNanoseconds << " ns, bulk unpacking " << validateNanoseconds << " ns" << std::endl;
+}